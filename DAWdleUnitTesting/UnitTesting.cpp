@@ -1,6 +1,11 @@
 #include "pch.h"
 #include "../src/SerializeTools.h"
 #include "../src/DrillLib.h"
+#include "../src/ExpressionParser.h"
+#include "../src/AudioFormat.h"
+#include "../src/PeakPyramid.h"
+#include "../src/NullAudioInterface.h"
+#include "../src/Nodes.h"
 
 // needed to initialize memory arenas for testing
 struct initializer {
@@ -914,4 +919,524 @@ namespace MemoryTests {
 		char buffer2[10] = "hello";
 		EXPECT_EQ(memcmp(buffer1, buffer2, 3), 0);
 	}
+}
+
+namespace Expressions {
+	// $$ is held at self and every other variable at zero, so every sample comes out the same
+	F64 evaluate(const char* expression, F64 self = 0.0) {
+		tbrs::ByteProgram program;
+		program.init();
+		tbrs::parse_program(&program, StrA{ expression, strlen(expression) });
+		EXPECT_TRUE(program.valid);
+		alignas(32) F64 zeros[4]{};
+		alignas(32) F64 selfData[4]{ self, self, self, self };
+		tbrs::OperandData variables[tbrs::MAX_VARIABLES];
+		for (U32 i = 0; i < tbrs::MAX_VARIABLES; i++) {
+			variables[i] = tbrs::OperandData{ zeros, 0 };
+		}
+		variables[tbrs::VARIABLE_SELF] = tbrs::OperandData{ selfData, 0 };
+		alignas(32) F64 result[4]{};
+		if (program.valid) {
+			tbrs::interpret(program, result, variables, 4);
+		}
+		program.destroy();
+		return result[0];
+	}
+
+	tbrs::ParseError parse_error(const char* expression) {
+		tbrs::ByteProgram program;
+		program.init();
+		tbrs::parse_program(&program, StrA{ expression, strlen(expression) });
+		EXPECT_FALSE(program.valid);
+		tbrs::ParseError error = program.error;
+		program.destroy();
+		return error;
+	}
+
+	TEST(Parse, Precedence) {
+		EXPECT_DOUBLE_EQ(evaluate("2 + 3 * 4"), 14.0);
+	}
+
+	TEST(Parse, Parentheses) {
+		EXPECT_DOUBLE_EQ(evaluate("(2 + 3) * 4"), 20.0);
+	}
+
+	TEST(Parse, SubtractionIsLeftAssociative) {
+		EXPECT_DOUBLE_EQ(evaluate("10 - 2 - 3"), 5.0);
+	}
+
+	TEST(Parse, DivisionIsLeftAssociative) {
+		EXPECT_DOUBLE_EQ(evaluate("16 / 4 / 2"), 2.0);
+	}
+
+	TEST(Parse, UnaryMinusBindsTighterThanAddition) {
+		EXPECT_DOUBLE_EQ(evaluate("-1 + 3"), 2.0);
+	}
+
+	TEST(Parse, DoubleNegation) {
+		EXPECT_DOUBLE_EQ(evaluate("--2"), 2.0);
+	}
+
+	TEST(Parse, FunctionCall) {
+		EXPECT_DOUBLE_EQ(evaluate("clamp(5, 0, 1) + min(2, 3)"), 3.0);
+	}
+
+	TEST(Optimize, ConstantPowMatchesVariablePow) {
+		EXPECT_DOUBLE_EQ(evaluate("pow(-2, 2)"), 4.0);
+		EXPECT_DOUBLE_EQ(evaluate("pow($$, 2)", -2.0), 4.0);
+		EXPECT_DOUBLE_EQ(evaluate("pow(-3, 1)"), evaluate("pow($$, 1)", -3.0));
+	}
+
+	TEST(Functions, PowOfNegativeBase) {
+		EXPECT_NEAR(evaluate("pow($$, 3)", -2.0), -8.0, 1e-4);
+		EXPECT_NEAR(evaluate("pow($$, -2)", -2.0), 0.25, 1e-5);
+		EXPECT_TRUE(isnan(evaluate("pow($$, 0.5)", -2.0)));
+	}
+
+	TEST(Errors, UnexpectedCharacter) {
+		EXPECT_EQ(parse_error("2 # 3").position, 2);
+	}
+
+	TEST(Errors, MissingOperand) {
+		EXPECT_EQ(parse_error("2 +").position, 3);
+	}
+
+	TEST(Errors, UnclosedCall) {
+		EXPECT_EQ(parse_error("sin(1").position, 5);
+	}
+
+	TEST(Errors, WrongArgumentCount) {
+		EXPECT_EQ(parse_error("clamp(1, 2)").position, 10);
+	}
+
+	TEST(Errors, UnknownName) {
+		EXPECT_EQ(parse_error("foo(1)").position, 0);
+	}
+
+	TEST(Errors, TrailingTokens) {
+		EXPECT_EQ(parse_error("2 3").position, 2);
+	}
+}
+
+namespace OutputEncoding {
+	using namespace AudioDevice;
+
+	TEST(Encode, SixteenBitFullScaleAndClipping) {
+		F32 input[3]{ 1.0F, -1.0F, 2.0F };
+		I16 output[3];
+		encode_audio_to_final_buffer(output, input, 3, 1, AUDIO_FORMAT_16BIT_INTEGER_48_KHZ, DEFAULT_OUTPUT_SETTINGS);
+		EXPECT_EQ(output[0], 32767);
+		EXPECT_EQ(output[1], -32767);
+		EXPECT_EQ(output[2], 32767);
+	}
+
+	TEST(Encode, EightBitIsUnsigned) {
+		F32 input[2]{ 0.0F, -1.0F };
+		U8 output[2];
+		encode_audio_to_final_buffer(output, input, 2, 1, AUDIO_FORMAT_8BIT_INTEGER_48_KHZ, DEFAULT_OUTPUT_SETTINGS);
+		EXPECT_EQ(output[0], 128);
+		EXPECT_EQ(output[1], 1);
+	}
+
+	TEST(Encode, Packed24BitDoesNotOverrun) {
+		F32 input[9]{ 0.0F, 0.0F, 0.0F, 0.0F, 0.0F, 0.0F, 0.0F, 0.0F, -1.0F };
+		U8 output[9 * 3 + 4];
+		memset(output, 0xAB, sizeof(output));
+		OutputSettings settings = DEFAULT_OUTPUT_SETTINGS;
+		settings.packed24Bit = true;
+		encode_audio_to_final_buffer(output, input, 9, 1, AUDIO_FORMAT_24BIT_INTEGER_48_KHZ, settings);
+		// -8388607 is 0x800001, little endian
+		EXPECT_EQ(output[24], 0x01);
+		EXPECT_EQ(output[25], 0x00);
+		EXPECT_EQ(output[26], 0x80);
+		EXPECT_EQ(output[27], 0xAB);
+	}
+
+	TEST(Interleave, MonoToStereo) {
+		F32 input[9]{ 0.0F, 1.0F, 2.0F, 3.0F, 4.0F, 5.0F, 6.0F, 7.0F, 8.0F };
+		const F32* lanes[2]{ input, input };
+		F32 output[18];
+		interleave_channels(output, lanes, 9, 2);
+		for (U32 i = 0; i < 18; i++) {
+			EXPECT_EQ(output[i], F32(i / 2));
+		}
+	}
+
+	TEST(Interleave, PlanarChannels) {
+		// 9 frames so both the AVX stereo path and its scalar tail get hit
+		F32 planar[3][9];
+		for (U32 channel = 0; channel < 3; channel++) {
+			for (U32 i = 0; i < 9; i++) {
+				planar[channel][i] = F32(i * 10 + channel);
+			}
+		}
+		const F32* lanes[3]{ planar[0], planar[1], planar[2] };
+		F32 output[27];
+		for (U32 channelCount = 2; channelCount <= 3; channelCount++) {
+			interleave_channels(output, lanes, 9, channelCount);
+			for (U32 i = 0; i < 9; i++) {
+				for (U32 channel = 0; channel < channelCount; channel++) {
+					EXPECT_EQ(output[i * channelCount + channel], F32(i * 10 + channel));
+				}
+			}
+		}
+	}
+}
+
+namespace Ring {
+	TEST(SPSCRing, WrapsAround) {
+		U32 storage[8];
+		SPSCRing<U32> ring;
+		ring.init(storage, 8);
+		U32 next = 0;
+		U32 expected = 0;
+		// Uneven sizes so writes and reads land all over the wrap point
+		for (U32 round = 0; round < 20; round++) {
+			U32 input[5];
+			for (U32 i = 0; i < 5; i++) {
+				input[i] = next + i;
+			}
+			next += U32(ring.write(input, 5));
+			U32 output[3];
+			U64 count = ring.read(output, 3);
+			for (U32 i = 0; i < count; i++) {
+				EXPECT_EQ(output[i], expected++);
+			}
+		}
+		EXPECT_EQ(ring.available(), U64(next - expected));
+	}
+
+	TEST(SPSCRing, DropsWhatDoesntFit) {
+		U32 storage[8];
+		SPSCRing<U32> ring;
+		ring.init(storage, 8);
+		U32 input[12]{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+		EXPECT_EQ(ring.write(input, 12), 8);
+		EXPECT_EQ(ring.droppedCount, 4);
+		U32 output[8];
+		EXPECT_EQ(ring.read(output, 8), 8);
+		EXPECT_EQ(output[7], 7);
+	}
+
+	TEST(SPSCRing, SkipKeepsNewest) {
+		U32 storage[8];
+		SPSCRing<U32> ring;
+		ring.init(storage, 8);
+		U32 input[6]{ 0, 1, 2, 3, 4, 5 };
+		ring.write(input, 6);
+		ring.skip(4);
+		U32 output[8];
+		EXPECT_EQ(ring.read(output, 8), 2);
+		EXPECT_EQ(output[0], 4);
+		EXPECT_EQ(output[1], 5);
+	}
+}
+
+namespace Slab {
+	struct SmallObject {
+		U64 value;
+	};
+	struct LargeObject {
+		U64 values[40];
+	};
+
+	TEST(SlabAllocator, SizeClassesAndReuse) {
+		SlabAllocator allocator{};
+		EXPECT_EQ(SlabAllocator::size_class<SmallObject>(), 0);
+		EXPECT_EQ(SlabAllocator::size_class<LargeObject>(), 5);
+		SmallObject* first = allocator.alloc<SmallObject>();
+		SmallObject* second = allocator.alloc<SmallObject>();
+		// Fresh slots come out in address order, one cache line apart
+		EXPECT_EQ(reinterpret_cast<U8*>(second) - reinterpret_cast<U8*>(first), SLAB_SIZE_CLASS_BYTES);
+		U64 firstGeneration = slab_generation(first);
+		EXPECT_TRUE(slab_is_live(first));
+		allocator.free(first);
+		EXPECT_FALSE(slab_is_live(first));
+		SmallObject* reused = allocator.alloc<SmallObject>();
+		EXPECT_EQ(reused, first);
+		EXPECT_NE(slab_generation(reused), firstGeneration);
+	}
+
+	TEST(SlabAllocator, IteratesLiveObjects) {
+		SlabAllocator allocator{};
+		SmallObject* objects[3000];
+		for (U32 i = 0; i < 3000; i++) {
+			objects[i] = allocator.alloc<SmallObject>();
+			objects[i]->value = i;
+		}
+		allocator.alloc<LargeObject>()->values[0] = 3000;
+		for (U32 i = 0; i < 3000; i += 2) {
+			allocator.free(objects[i]);
+		}
+		U64 count = 0;
+		U64 sum = 0;
+		allocator.for_each_live([&](void* object) {
+			count++;
+			sum += *reinterpret_cast<U64*>(object);
+		});
+		// Odd values 1 to 2999 plus the large object, across more than one slab
+		EXPECT_EQ(count, 1501);
+		EXPECT_EQ(sum, 1500ull * 1500ull + 3000ull);
+	}
+}
+
+namespace Peaks {
+	// Samples from a small LCG so the tests don't depend on anything outside the library
+	F32 test_sample(U32 i) {
+		U32 state = i * 1664525u + 1013904223u;
+		return F32(I32(state >> 8) - (1 << 23)) / F32(1 << 23);
+	}
+
+	TEST(PeakPyramid, RangeMatchesSamplesAfterWrapping) {
+		PeakPyramid::Pyramid pyramid;
+		pyramid.init(256);
+		F32 samples[256];
+		U32 written = 0;
+		// Odd sized appends so buckets fill across several calls and the storage wraps a few times
+		while (written < 1000) {
+			F32 chunk[37];
+			for (U32 i = 0; i < 37; i++) {
+				chunk[i] = test_sample(written + i);
+				samples[(written + i) & 255] = chunk[i];
+			}
+			pyramid.append(chunk, 37);
+			written += 37;
+		}
+		U64 first = pyramid.first_position();
+		for (U64 start = first; start < written; start += 13) {
+			for (U64 end = start + 1; end <= written; end += 29) {
+				F32 expectedMin = F32_INF;
+				F32 expectedMax = -F32_INF;
+				for (U64 i = start; i < end; i++) {
+					expectedMin = min(expectedMin, test_sample(U32(i)));
+					expectedMax = max(expectedMax, test_sample(U32(i)));
+				}
+				PeakPyramid::Peak peak = pyramid.range_peak(start, end, samples);
+				EXPECT_EQ(peak.min, expectedMin);
+				EXPECT_EQ(peak.max, expectedMax);
+			}
+		}
+		pyramid.destroy();
+	}
+
+	TEST(PeakPyramid, ColumnsCoverEverySample) {
+		const U32 sampleCount = 100000;
+		F32* samples = reinterpret_cast<F32*>(heap_alloc(sampleCount * sizeof(F32)));
+		for (U32 i = 0; i < sampleCount; i++) {
+			samples[i] = test_sample(i);
+		}
+		samples[54321] = 2.0F;
+		PeakPyramid::Pyramid pyramid;
+		pyramid.init(sampleCount);
+		pyramid.append(samples, sampleCount);
+		PeakPyramid::Peak columns[200];
+		pyramid.column_peaks(0, sampleCount, 200, samples, columns);
+		// The spike is in exactly one column, and no column sees past the samples
+		U32 spikeColumns = 0;
+		for (U32 i = 0; i < 200; i++) {
+			spikeColumns += columns[i].max == 2.0F;
+			EXPECT_GE(columns[i].min, -1.0F);
+		}
+		EXPECT_EQ(spikeColumns, 1);
+		pyramid.destroy();
+		heap_free(samples);
+	}
+}
+
+namespace NullDevice {
+	using namespace AudioDevice;
+
+	U64 framesRequested;
+
+	B32 fill_silence(F32* buffer, U32 numSamples, U32 numChannels) {
+		memset(buffer, 0, numSamples * numChannels * sizeof(F32));
+		framesRequested += numSamples;
+		return true;
+	}
+
+	TEST(NullAudio, PacesPeriodsWithoutXruns) {
+		stats = Stats{};
+		framesRequested = 0;
+		ASSERT_TRUE(NullAudioInterface::init_null(fill_silence, NullAudioInterface::DEFAULT_FORMAT, 2, nullptr));
+		U64 startTime = monotonic_nanoseconds();
+		for (U32 i = 0; i < 6; i++) {
+			NullAudioInterface::do_audio();
+		}
+		U64 elapsed = monotonic_nanoseconds() - startTime;
+		NullAudioInterface::shutdown_null();
+		// The first call fills the whole buffer, every one after waits for a period to play and then tops it back up
+		EXPECT_EQ(stats.callbackCount, 6);
+		EXPECT_EQ(stats.framesRendered, framesRequested);
+		EXPECT_GE(stats.framesRendered, NullAudioInterface::bufferFrames + 5 * NullAudioInterface::periodFrames);
+		EXPECT_EQ(stats.xrunCount, 0);
+		EXPECT_GE(elapsed, NullAudioInterface::frames_to_nanoseconds(5 * NullAudioInterface::periodFrames));
+	}
+
+	TEST(NullAudio, StallCountsXrunAndFillsGapWithSilence) {
+		const char* wavPath = "null_audio_test.wav";
+		stats = Stats{};
+		framesRequested = 0;
+		ASSERT_TRUE(NullAudioInterface::init_null(fill_silence, NullAudioInterface::DEFAULT_FORMAT, 2, wavPath));
+		NullAudioInterface::do_audio();
+		NullAudioInterface::do_audio();
+		// Long enough for the whole buffer to play out and then some, like a callback that ran far too long
+		sleep_until_nanoseconds(monotonic_nanoseconds() + NullAudioInterface::frames_to_nanoseconds(3 * NullAudioInterface::bufferFrames));
+		NullAudioInterface::do_audio();
+		NullAudioInterface::shutdown_null();
+		EXPECT_EQ(stats.callbackCount, 3);
+		EXPECT_EQ(stats.xrunCount, 1);
+		EXPECT_EQ(stats.framesRendered, framesRequested);
+		// The device kept playing through the gap, so the stream has more frames in it than were ever rendered
+		U64 framesWritten = NullAudioInterface::framesWritten;
+		EXPECT_GT(framesWritten, stats.framesRendered);
+		std::ifstream wav(wavPath, std::ios::binary | std::ios::ate);
+		EXPECT_EQ(U64(wav.tellg()), WavWriter::WAV_HEADER_SIZE + framesWritten * 2 * sizeof(F32));
+		wav.close();
+		std::remove(wavPath);
+	}
+}
+
+namespace StftNodes {
+	using namespace Nodes;
+
+	// Feeds blockCount blocks of noise through analysis straight into synthesis, the way the graph would pass the values along,
+	// and checks every sample comes back out exactly fftSize samples later. Synthesis gets its settings applied again at resetBlock,
+	// the way they would be if someone picked them on each node separately, and only has to be right once it's had fftSize samples since
+	void check_round_trip(StftSettings settings, U32 blockCount, U32 resetBlock) {
+		NodeSTFTAnalysis analysis;
+		NodeSTFTSynthesis synthesis;
+		analysis.init();
+		synthesis.init();
+		analysis.apply_settings(settings);
+		synthesis.apply_settings(settings);
+		const U32 fftSize = analysis.settings.fft_size();
+		alignas(32) F64 block[PROCESS_BUFFER_SIZE];
+		F64 maxError = 0.0;
+		F64 maxOutput = 0.0;
+		for (U32 blockIdx = 0; blockIdx < blockCount; blockIdx++) {
+			audioArena.reset();
+			U32 blockStart = blockIdx * PROCESS_BUFFER_SIZE;
+			for (U32 i = 0; i < PROCESS_BUFFER_SIZE; i++) {
+				block[i] = Peaks::test_sample(blockStart + i);
+			}
+			if (blockIdx == resetBlock) {
+				synthesis.apply_settings(settings);
+			}
+			NodeIOValue& input = analysis.header.get_input(0)->value;
+			input = NodeIOValue{};
+			input.buffer = block;
+			input.bufferLength = PROCESS_BUFFER_SIZE;
+			input.bufferMask = U32_MAX;
+			analysis.process();
+			synthesis.header.get_input(0)->value = analysis.header.get_output(0)->value;
+			synthesis.header.get_input(1)->value = analysis.header.get_output(1)->value;
+			synthesis.process();
+			F64* output = synthesis.header.get_output(0)->value.buffer;
+			for (U32 i = 0; i < PROCESS_BUFFER_SIZE; i++) {
+				U32 sample = blockStart + i;
+				if (sample < resetBlock * PROCESS_BUFFER_SIZE + fftSize) {
+					continue;
+				}
+				F64 expected = sample < fftSize ? 0.0 : F64(Peaks::test_sample(sample - fftSize));
+				maxError = max(maxError, fabs(output[i] - expected));
+				maxOutput = max(maxOutput, fabs(output[i]));
+			}
+		}
+		EXPECT_LT(maxError, 1e-3);
+		EXPECT_GT(maxOutput, 0.5);
+		analysis.header.destroy();
+		synthesis.header.destroy();
+	}
+
+	TEST(Stft, RoundTripWithHopLongerThanBlock) {
+		check_round_trip(StftSettings{ 13, 1, STFT_WINDOW_HANN }, 24, 0);
+		check_round_trip(StftSettings{ 13, 1, STFT_WINDOW_HANN }, 24, 3);
+		check_round_trip(StftSettings{ 13, 2, STFT_WINDOW_BLACKMAN_HARRIS }, 24, 1);
+		check_round_trip(StftSettings{ 12, 1, STFT_WINDOW_HANN }, 16, 1);
+	}
+
+	TEST(Stft, RoundTripWithSeveralFramesPerBlock) {
+		check_round_trip(StftSettings{ 10, 2, STFT_WINDOW_HANN }, 8, 0);
+		check_round_trip(StftSettings{ 8, 3, STFT_WINDOW_BLACKMAN_HARRIS }, 8, 2);
+	}
+}
+
+namespace VoiceFft {
+	using namespace Nodes;
+
+	NodeIOValue plain_value(F64* buffer) {
+		NodeIOValue value{};
+		value.buffer = buffer;
+		value.bufferLength = PROCESS_BUFFER_SIZE;
+		value.bufferMask = U32_MAX;
+		return value;
+	}
+
+	// One input is a list with 1 to 3 voices depending on the sample and the other is a plain buffer, which every voice should see.
+	// Each voice of the batched output has to match transforming that voice on its own
+	void check_list_with_plain(B32 listIsX) {
+		const U32 size = PROCESS_BUFFER_SIZE;
+		const U32 maxVoices = 3;
+		NodeFFT node;
+		node.init();
+		MEMORY_ARENA_FRAME(globalArena) {
+			U32* listEnds = globalArena.alloc_aligned_with_slack<U32>(size, alignof(__m256), 0);
+			F64* listData = globalArena.alloc_aligned_with_slack<F64>(size * maxVoices, alignof(__m256), 2 * sizeof(__m256));
+			F64* plainData = globalArena.alloc_aligned_with_slack<F64>(size, alignof(__m256), 2 * sizeof(__m256));
+			U32 end = 0;
+			for (U32 i = 0; i < size; i++) {
+				for (U32 voice = 0; voice < 1 + i % maxVoices; voice++) {
+					listData[end++] = Peaks::test_sample(i * maxVoices + voice);
+				}
+				listEnds[i] = end;
+				plainData[i] = Peaks::test_sample(i + 100000);
+			}
+			NodeIOValue list = plain_value(listData);
+			list.bufferLength = end;
+			list.listEnds = listEnds;
+			list.listEndsLength = size;
+			NodeIOValue plain = plain_value(plainData);
+
+			audioArena.reset();
+			node.header.get_input(0)->value = listIsX ? list : plain;
+			node.header.get_input(1)->value = listIsX ? plain : list;
+			node.process();
+			NodeIOValue batchX = node.header.get_output(0)->value;
+			NodeIOValue batchY = node.header.get_output(1)->value;
+			ASSERT_EQ(batchX.bufferLength, size * maxVoices);
+
+			F64* voiceList = globalArena.alloc_aligned_with_slack<F64>(size, alignof(__m256), 2 * sizeof(__m256));
+			F64* voicePlain = globalArena.alloc_aligned_with_slack<F64>(size, alignof(__m256), 2 * sizeof(__m256));
+			for (U32 voice = 0; voice < maxVoices; voice++) {
+				for (U32 i = 0; i < size; i++) {
+					B32 hasVoice = voice < 1 + i % maxVoices;
+					voiceList[i] = hasVoice ? listData[(i == 0 ? 0 : listEnds[i - 1]) + voice] : 0.0;
+					voicePlain[i] = hasVoice ? plainData[i] : 0.0;
+				}
+				node.header.get_input(0)->value = plain_value(listIsX ? voiceList : voicePlain);
+				node.header.get_input(1)->value = plain_value(listIsX ? voicePlain : voiceList);
+				for (U32 output = 0; output < 3; output++) {
+					node.header.get_output(output)->value = plain_value(audioArena.alloc_aligned_with_slack<F64>(size, alignof(__m256), 2 * sizeof(__m256)));
+				}
+				node.process();
+				F64* singleX = node.header.get_output(0)->value.buffer;
+				F64* singleY = node.header.get_output(1)->value.buffer;
+				F64 maxError = 0.0;
+				for (U32 k = 0; k < size; k++) {
+					maxError = max(maxError, fabs(batchX.buffer[k * maxVoices + voice] - singleX[k]));
+					maxError = max(maxError, fabs(batchY.buffer[k * maxVoices + voice] - singleY[k]));
+				}
+				EXPECT_LT(maxError, 1e-3);
+			}
+		}
+		node.header.destroy();
+	}
+
+	TEST(VoiceFft, ListXWithPlainY) {
+		check_list_with_plain(true);
+	}
+
+	TEST(VoiceFft, PlainXWithListY) {
+		check_list_with_plain(false);
+	}
 }
\ No newline at end of file
@@ -0,0 +1,125 @@
+#pragma once
+#include <alsa/asoundlib.h>
+#include <unistd.h>
+#include "AudioFormat.h"
+
+// Plain blocking ALSA playback through the default device. Same shape as the WASAPI backend: wait until there's room, fill what's free
+namespace ALSAInterface {
+
+using namespace AudioDevice;
+
+snd_pcm_t* pcm;
+// Period and buffer as ALSA actually set them up, which might not be exactly what was asked for
+snd_pcm_uframes_t periodFrames;
+snd_pcm_uframes_t bufferFrames;
+F32* audioBuffer;
+U8* encodedBuffer;
+const U32 REQUESTED_LATENCY_MICROSECONDS = 20000;
+
+FillCallback audioBufferFillCallback;
+
+snd_pcm_format_t audio_format_to_alsa(AudioFormat format) {
+	if (AUDIO_FORMAT_IS_FLOAT[format]) {
+		return SND_PCM_FORMAT_FLOAT_LE;
+	}
+	switch (AUDIO_FORMAT_BIT_DEPTH[format]) {
+	case 8: return SND_PCM_FORMAT_U8;
+	case 16: return SND_PCM_FORMAT_S16_LE;
+	// The encoder puts 24 bit samples at the top of a 32 bit container
+	default: return SND_PCM_FORMAT_S32_LE;
+	}
+}
+
+// Returns false if there's no usable device, so the caller can fall back to something else
+B32 init_alsa(FillCallback bufferFillCallback) {
+	audioBufferFillCallback = bufferFillCallback;
+	I32 err = snd_pcm_open(&pcm, "default", SND_PCM_STREAM_PLAYBACK, 0);
+	if (err < 0) {
+		print("Failed to open ALSA device: ");
+		println(snd_strerror(err));
+		return false;
+	}
+
+	outputChannelCount = 2;
+	// Try without resampling first, so a format the hardware takes natively wins over one ALSA would have to convert
+	for (I32 softResample = 0; softResample <= 1; softResample++) {
+		for (U32 i = 0; i < ARRAY_COUNT(audioFormatAttemptOrder); i++) {
+			outputAudioFormat = audioFormatAttemptOrder[i];
+			if (snd_pcm_set_params(pcm, audio_format_to_alsa(outputAudioFormat), SND_PCM_ACCESS_RW_INTERLEAVED, outputChannelCount, AUDIO_FORMAT_SAMPLE_RATE_HZ[outputAudioFormat], softResample, REQUESTED_LATENCY_MICROSECONDS) == 0) {
+				goto foundSuitableFormat;
+			}
+		}
+	}
+	println("Failed to find suitable format for ALSA device");
+	snd_pcm_close(pcm);
+	pcm = nullptr;
+	return false;
+foundSuitableFormat:;
+	print("Using audio format ");
+	println(AUDIO_FORMAT_NAMES[outputAudioFormat]);
+
+	if (snd_pcm_get_params(pcm, &bufferFrames, &periodFrames) < 0) {
+		bufferFrames = AUDIO_FORMAT_SAMPLE_RATE_HZ[outputAudioFormat] * REQUESTED_LATENCY_MICROSECONDS / 1000000;
+		periodFrames = bufferFrames / 2;
+	}
+	// Allocated once for the life of the program, same as the device
+	audioBuffer = globalArena.alloc<F32>(bufferFrames * outputChannelCount);
+	encodedBuffer = globalArena.alloc<U8>(bufferFrames * outputChannelCount * audio_format_container_bytes(outputAudioFormat));
+	return true;
+}
+
+void shutdown_alsa() {
+	if (pcm) {
+		snd_pcm_drain(pcm);
+		snd_pcm_close(pcm);
+		pcm = nullptr;
+	}
+}
+
+void do_audio() {
+	// Blocks until at least a period of the buffer is free, or 100ms pass, which only happens if something is badly wrong
+	I32 waitResult = snd_pcm_wait(pcm, 100);
+	snd_pcm_sframes_t framesAvailable = waitResult < 0 ? waitResult : snd_pcm_avail_update(pcm);
+	if (framesAvailable < 0) {
+		// -EPIPE is an underrun, anything else recoverable gets handled the same way. The stream restarts on the next write
+		if (framesAvailable == -EPIPE) {
+			stats.xrunCount++;
+		}
+		if (snd_pcm_recover(pcm, I32(framesAvailable), 1) < 0) {
+			// Don't spin if the device is gone for good
+			usleep(1000);
+		}
+		return;
+	}
+	U32 framesToFill = U32(min<snd_pcm_sframes_t>(framesAvailable, snd_pcm_sframes_t(bufferFrames)));
+	if (framesToFill == 0) {
+		return;
+	}
+
+	B32 hasAudio = audioBufferFillCallback(audioBuffer, framesToFill, outputChannelCount);
+	if (!hasAudio) {
+		zero_memory(audioBuffer, framesToFill * outputChannelCount * sizeof(F32));
+	}
+	encode_audio_to_final_buffer(encodedBuffer, audioBuffer, framesToFill, outputChannelCount, outputAudioFormat, outputSettings);
+
+	U8* encodedPtr = encodedBuffer;
+	U32 framesLeft = framesToFill;
+	while (framesLeft > 0) {
+		snd_pcm_sframes_t written = snd_pcm_writei(pcm, encodedPtr, framesLeft);
+		if (written < 0) {
+			if (written == -EPIPE) {
+				stats.xrunCount++;
+			}
+			if (snd_pcm_recover(pcm, I32(written), 1) < 0) {
+				break;
+			}
+			continue;
+		}
+		encodedPtr += written * outputChannelCount * audio_format_container_bytes(outputAudioFormat);
+		framesLeft -= U32(written);
+	}
+	stats.callbackCount++;
+	stats.framesRendered += framesToFill;
+}
+
+}
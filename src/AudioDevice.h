@@ -0,0 +1,142 @@
+#pragma once
+#include "AudioFormat.h"
+#ifdef _WIN32
+#include "WASAPIInterface.h"
+#endif
+// A Linux build without libasound around can leave ALSA out (make ALSA=0), which leaves just the null backend
+#if defined(__linux__) && !defined(AUDIO_DEVICE_NO_ALSA)
+#define AUDIO_DEVICE_ALSA 1
+#include "ALSAInterface.h"
+#else
+#define AUDIO_DEVICE_ALSA 0
+#endif
+#include "NullAudioInterface.h"
+#include "DeadlineMonitor.h"
+
+// Picks a backend and forwards to it. The audio thread only calls init once and then do_audio in a loop, every backend blocks in do_audio until it needs more samples
+namespace AudioDevice {
+
+enum Backend {
+	BACKEND_NULL,
+	BACKEND_WASAPI,
+	BACKEND_ALSA
+};
+
+#ifdef _WIN32
+const Backend DEFAULT_BACKEND = BACKEND_WASAPI;
+#elif AUDIO_DEVICE_ALSA != 0
+const Backend DEFAULT_BACKEND = BACKEND_ALSA;
+#else
+const Backend DEFAULT_BACKEND = BACKEND_NULL;
+#endif
+
+// What the command line asked for, which whoever opens the device passes to init
+Backend requestedBackend = DEFAULT_BACKEND;
+const char* requestedWavOutputPath;
+
+Backend activeBackend;
+FillCallback engineFillCallback;
+
+void print_args_usage() {
+	println("Audio device options, usable with any mode: [--audio-backend null|wasapi|alsa] [--audio-wav <path>] (the WAV file is only written by the null backend)");
+}
+
+// Takes the audio device options out of argv wherever they are, so the mode's own argument parsing never sees them. Returns false on a bad or missing value
+B32 parse_args(int* argc, char** argv) {
+	int kept = 0;
+	for (int i = 0; i < *argc; i++) {
+		StrA option{ argv[i], strlen(argv[i]) };
+		B32 isBackend = option == "--audio-backend"sa;
+		if (!isBackend && !(option == "--audio-wav"sa)) {
+			argv[kept++] = argv[i];
+			continue;
+		}
+		if (i + 1 >= *argc) {
+			return false;
+		}
+		const char* value = argv[++i];
+		if (!isBackend) {
+			requestedWavOutputPath = value;
+			continue;
+		}
+		StrA backendName{ value, strlen(value) };
+		if (backendName == "null"sa) {
+			requestedBackend = BACKEND_NULL;
+		} else if (backendName == "wasapi"sa) {
+			requestedBackend = BACKEND_WASAPI;
+		} else if (backendName == "alsa"sa) {
+			requestedBackend = BACKEND_ALSA;
+		} else {
+			return false;
+		}
+	}
+	*argc = kept;
+	if (requestedWavOutputPath && requestedBackend != BACKEND_NULL) {
+		println("--audio-wav is only written by the null backend, ignoring it");
+	}
+	return true;
+}
+
+// Backends call this instead of the engine directly so every block gets timed the same way no matter which backend is running.
+// Blocks with nothing to play (paused) aren't counted, they'd just drag the load statistics down
+B32 monitored_fill(F32* buffer, U32 numSamples, U32 numChannels) {
+	U64 startTsc = DeadlineMonitor::block_begin();
+	B32 hasAudio = engineFillCallback(buffer, numSamples, numChannels);
+	if (hasAudio) {
+		DeadlineMonitor::block_end(startTsc, numSamples);
+	}
+	return hasAudio;
+}
+
+// If the requested device can't be opened this falls back to the null backend, so the engine still runs (silently) on a machine without audio.
+// nullWavOutputPath is only used by the null backend, and can be null to not write a file
+void init(Backend backend, FillCallback fillCallback, const char* nullWavOutputPath = nullptr) {
+	stats = Stats{};
+	activeBackend = backend;
+	engineFillCallback = fillCallback;
+	fillCallback = monitored_fill;
+	DeadlineMonitor::init();
+	switch (backend) {
+#ifdef _WIN32
+	case BACKEND_WASAPI: WASAPIInterface::init_wasapi(fillCallback); return;
+#endif
+#if AUDIO_DEVICE_ALSA != 0
+	case BACKEND_ALSA: if (ALSAInterface::init_alsa(fillCallback)) return; break;
+#endif
+	default: break;
+	}
+	if (backend != BACKEND_NULL) {
+		println("Requested audio backend unavailable, falling back to null device");
+	}
+	activeBackend = BACKEND_NULL;
+	if (!NullAudioInterface::init_null(fillCallback, NullAudioInterface::DEFAULT_FORMAT, NullAudioInterface::DEFAULT_CHANNEL_COUNT, nullWavOutputPath)) {
+		// Only fails if the WAV file can't be opened, in which case running without it is better than not running
+		NullAudioInterface::init_null(fillCallback, NullAudioInterface::DEFAULT_FORMAT, NullAudioInterface::DEFAULT_CHANNEL_COUNT, nullptr);
+	}
+}
+
+void do_audio() {
+	switch (activeBackend) {
+#ifdef _WIN32
+	case BACKEND_WASAPI: WASAPIInterface::do_audio(); break;
+#endif
+#if AUDIO_DEVICE_ALSA != 0
+	case BACKEND_ALSA: ALSAInterface::do_audio(); break;
+#endif
+	default: NullAudioInterface::do_audio(); break;
+	}
+}
+
+void shutdown() {
+	switch (activeBackend) {
+#ifdef _WIN32
+	case BACKEND_WASAPI: WASAPIInterface::shutdown_wasapi(); break;
+#endif
+#if AUDIO_DEVICE_ALSA != 0
+	case BACKEND_ALSA: ALSAInterface::shutdown_alsa(); break;
+#endif
+	default: NullAudioInterface::shutdown_null(); break;
+	}
+}
+
+}
@@ -0,0 +1,345 @@
+#pragma once
+#include <fstream>
+#include "DrillLib.h"
+
+// Everything about output audio that doesn't depend on which backend is playing it
+namespace AudioDevice {
+
+#define AUDIO_FORMATS \
+	X(AUDIO_FORMAT_8BIT_INTEGER_44_1_KHZ, 8, false, 44100)\
+	X(AUDIO_FORMAT_8BIT_INTEGER_48_KHZ, 8, false, 48000)\
+	X(AUDIO_FORMAT_8BIT_INTEGER_96_KHZ, 8, false, 96000)\
+	X(AUDIO_FORMAT_16BIT_INTEGER_44_1_KHZ, 16, false, 44100)\
+	X(AUDIO_FORMAT_16BIT_INTEGER_48_KHZ, 16, false, 48000)\
+	X(AUDIO_FORMAT_16BIT_INTEGER_96_KHZ, 16, false, 96000)\
+	X(AUDIO_FORMAT_24BIT_INTEGER_44_1_KHZ, 24, false, 44100)\
+	X(AUDIO_FORMAT_24BIT_INTEGER_48_KHZ, 24, false, 48000)\
+	X(AUDIO_FORMAT_24BIT_INTEGER_96_KHZ, 24, false, 96000)\
+	X(AUDIO_FORMAT_32BIT_INTEGER_44_1_KHZ, 32, false, 44100)\
+	X(AUDIO_FORMAT_32BIT_INTEGER_48_KHZ, 32, false, 48000)\
+	X(AUDIO_FORMAT_32BIT_INTEGER_96_KHZ, 32, false, 96000)\
+	X(AUDIO_FORMAT_32BIT_IEEE_FLOAT_44_1_KHZ, 32, true, 44100)\
+	X(AUDIO_FORMAT_32BIT_IEEE_FLOAT_48_KHZ, 32, true, 48000)\
+	X(AUDIO_FORMAT_32BIT_IEEE_FLOAT_96_KHZ, 32, true, 96000)\
+
+
+enum AudioFormat {
+#define X(name, bitDepth, isFloat, frequencyHz) name,
+	AUDIO_FORMATS
+#undef X
+	AUDIO_FORMAT_Count
+};
+
+#define X(name, bitDepth, isFloat, frequencyHz) bitDepth,
+const U32 AUDIO_FORMAT_BIT_DEPTH[]{
+	AUDIO_FORMATS
+	0
+};
+#undef X
+#define X(name, bitDepth, isFloat, frequencyHz) isFloat,
+const B32 AUDIO_FORMAT_IS_FLOAT[]{
+	AUDIO_FORMATS
+	false
+};
+#undef X
+#define X(name, bitDepth, isFloat, frequencyHz) frequencyHz,
+const U32 AUDIO_FORMAT_SAMPLE_RATE_HZ[]{
+	AUDIO_FORMATS
+	0
+};
+#undef X
+#define X(name, bitDepth, isFloat, frequencyHz) #name,
+const char* AUDIO_FORMAT_NAMES[]{
+	AUDIO_FORMATS
+	"AUDIO_FORMAT_COUNT"
+};
+#undef X
+
+#undef AUDIO_FORMATS
+
+AudioFormat audioFormatAttemptOrder[]{
+	AUDIO_FORMAT_32BIT_IEEE_FLOAT_44_1_KHZ,
+	AUDIO_FORMAT_32BIT_IEEE_FLOAT_48_KHZ,
+	AUDIO_FORMAT_32BIT_IEEE_FLOAT_96_KHZ,
+	AUDIO_FORMAT_32BIT_INTEGER_44_1_KHZ,
+	AUDIO_FORMAT_32BIT_INTEGER_48_KHZ,
+	AUDIO_FORMAT_32BIT_INTEGER_96_KHZ,
+	AUDIO_FORMAT_24BIT_INTEGER_44_1_KHZ,
+	AUDIO_FORMAT_24BIT_INTEGER_48_KHZ,
+	AUDIO_FORMAT_24BIT_INTEGER_96_KHZ,
+	AUDIO_FORMAT_16BIT_INTEGER_44_1_KHZ,
+	AUDIO_FORMAT_16BIT_INTEGER_48_KHZ,
+	AUDIO_FORMAT_16BIT_INTEGER_96_KHZ,
+	AUDIO_FORMAT_8BIT_INTEGER_44_1_KHZ,
+	AUDIO_FORMAT_8BIT_INTEGER_48_KHZ,
+	AUDIO_FORMAT_8BIT_INTEGER_96_KHZ
+};
+
+// 24 bit samples are stored in the high bits of a 32 bit container, which is what WASAPI wants and what ALSA calls S32, unless packed24Bit asks for 3 bytes per sample
+FINLINE U32 audio_format_container_bytes(AudioFormat format, B32 packed24Bit = false) {
+	U32 bitDepth = AUDIO_FORMAT_BIT_DEPTH[format];
+	return bitDepth == 24 ? (packed24Bit ? 3 : 4) : bitDepth / 8;
+}
+
+// What happens to samples between the graph and the encoded output
+struct OutputSettings {
+	// Linear, applied before clipping
+	F32 gain;
+	// TPDF dither on integer formats, so quantization error becomes a constant noise floor instead of distortion that follows the signal.
+	// Ignored for 32 bit, where F32 doesn't have the precision for it to matter
+	B32 dither;
+	// 24 bit as 3 packed bytes per sample, what WAV files want. Devices get the 32 bit container
+	B32 packed24Bit;
+};
+const OutputSettings DEFAULT_OUTPUT_SETTINGS{ 1.0F, false, false };
+
+// Fills the next numSamples frames of numChannels interleaved samples. Returns false if there's nothing to play.
+// There's no time passed in, the engine counts samples itself so its clock can't drift against the device
+// Every backend pulls audio through this, on whatever thread called do_audio
+typedef B32 (*FillCallback)(F32* buffer, U32 numSamples, U32 numChannels);
+
+// Set by whichever backend is active when it opens its device
+AudioFormat outputAudioFormat;
+U32 outputChannelCount;
+
+FINLINE U32 sample_rate() {
+	return AUDIO_FORMAT_SAMPLE_RATE_HZ[outputAudioFormat];
+}
+
+// Only the audio thread writes these. Anything reading them from another thread might see a slightly stale value, which is fine for watching latency
+struct Stats {
+	U64 callbackCount;
+	U64 framesRendered;
+	// Times the device ran out of samples before the next callback got to it
+	U32 xrunCount;
+	// Worst case of how long after the intended wakeup time the audio thread actually got to run, for backends that pace themselves
+	F64 maxWakeLatenessSeconds;
+};
+Stats stats;
+
+// Settings device backends encode with. packed24Bit only makes sense for the null backend writing a file, devices are set up for the 32 bit container
+OutputSettings outputSettings = DEFAULT_OUTPUT_SETTINGS;
+
+// Interleaves planar channel lanes (what the graph renders) into the frame order devices and files want. A mono graph just passes the same lane for every channel
+void interleave_channels(F32* output, const F32* const* lanes, U32 numFrames, U32 numChannels) {
+	U32 i = 0;
+	if (numChannels == 1) {
+		memcpy(output, lanes[0], numFrames * sizeof(F32));
+		return;
+	} else if (numChannels == 2) {
+		const F32* left = lanes[0];
+		const F32* right = lanes[1];
+		for (; i + 8 <= numFrames; i += 8) {
+			__m256 leftSamples = _mm256_loadu_ps(left + i);
+			__m256 rightSamples = _mm256_loadu_ps(right + i);
+			// Unpack works within 128 bit lanes, so the halves come out as L0 R0 L1 R1 | L4 R4 L5 R5 and L2 R2 L3 R3 | L6 R6 L7 R7 and need one more shuffle to put them in order
+			__m256 low = _mm256_unpacklo_ps(leftSamples, rightSamples);
+			__m256 high = _mm256_unpackhi_ps(leftSamples, rightSamples);
+			_mm256_storeu_ps(output + i * 2, _mm256_permute2f128_ps(low, high, 0x20));
+			_mm256_storeu_ps(output + i * 2 + 8, _mm256_permute2f128_ps(low, high, 0x31));
+		}
+	}
+	for (; i < numFrames; i++) {
+		for (U32 j = 0; j < numChannels; j++) {
+			output[i * numChannels + j] = lanes[j][i];
+		}
+	}
+}
+
+enum SampleEncoding {
+	SAMPLE_ENCODING_F32,
+	SAMPLE_ENCODING_U8,
+	SAMPLE_ENCODING_S16,
+	SAMPLE_ENCODING_S24_PACKED,
+	SAMPLE_ENCODING_S24_IN_S32,
+	SAMPLE_ENCODING_S32
+};
+
+// One xorshift32 per lane. Only ever touched by whichever thread is encoding output, which is one at a time
+alignas(32) U32 ditherRngState[8]{ 0x9E3779B9, 0x7F4A7C15, 0x85EBCA6B, 0xC2B2AE35, 0x27D4EB2F, 0x165667B1, 0xD3A2646C, 0xFD7046C5 };
+
+FINLINE __m256 uniform_f32x8(__m256i* state) {
+	__m256i x = *state;
+	x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 13));
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+	x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 5));
+	*state = x;
+	// Top 24 bits to a float in [0, 1)
+	return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(x, 8)), _mm256_set1_ps(1.0F / 16777216.0F));
+}
+
+template<SampleEncoding encoding>
+FINLINE void encode_f32x8(U8* output, __m256 samples, __m256 scale, __m256 lowerBound, __m256 upperBound, B32 dither, __m256i* rngState) {
+	if constexpr (encoding == SAMPLE_ENCODING_F32) {
+		_mm256_storeu_ps(reinterpret_cast<F32*>(output), _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(samples, scale), lowerBound), upperBound));
+		return;
+	} else {
+		samples = _mm256_mul_ps(samples, scale);
+		if (dither) {
+			// Difference of two uniforms is triangular over +-1 LSB
+			samples = _mm256_add_ps(samples, _mm256_sub_ps(uniform_f32x8(rngState), uniform_f32x8(rngState)));
+		}
+		// Bounds are exactly representable and in range, so the conversion (round to nearest) can't overflow
+		__m256i quantized = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(samples, lowerBound), upperBound));
+		if constexpr (encoding == SAMPLE_ENCODING_U8) {
+			quantized = _mm256_add_epi32(quantized, _mm256_set1_epi32(128));
+			// Low byte of each sample to the bottom of its lane, then the two lanes' 4 bytes next to each other
+			quantized = _mm256_shuffle_epi8(quantized, _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(output), _mm_unpacklo_epi32(_mm256_castsi256_si128(quantized), _mm256_extracti128_si256(quantized, 1)));
+		} else if constexpr (encoding == SAMPLE_ENCODING_S16) {
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(output), _mm_packs_epi32(_mm256_castsi256_si128(quantized), _mm256_extracti128_si256(quantized, 1)));
+		} else if constexpr (encoding == SAMPLE_ENCODING_S24_PACKED) {
+			// Drop the top byte of each sample, leaving 12 bytes at the bottom of each lane. The second store overwrites the 4 garbage bytes the first leaves, but writes 4 past the end itself
+			quantized = _mm256_shuffle_epi8(quantized, _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1, 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(output), _mm256_castsi256_si128(quantized));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(output + 12), _mm256_extracti128_si256(quantized, 1));
+		} else if constexpr (encoding == SAMPLE_ENCODING_S24_IN_S32) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(output), _mm256_slli_epi32(quantized, 8));
+		} else {
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(output), quantized);
+		}
+	}
+}
+
+template<SampleEncoding encoding>
+void encode_samples(U8* output, const F32* input, U32 sampleCount, U32 bitDepth, const OutputSettings& settings) {
+	constexpr U32 BYTES_PER_SAMPLE = encoding == SAMPLE_ENCODING_U8 ? 1 : encoding == SAMPLE_ENCODING_S16 ? 2 : encoding == SAMPLE_ENCODING_S24_PACKED ? 3 : 4;
+	// Packed 24 bit stores write 4 bytes past the 8 samples they're given, so the main loop stops while there's at least that much left to be overwritten later
+	constexpr U32 OVERHANG_SAMPLES = encoding == SAMPLE_ENCODING_S24_PACKED ? 2 : 0;
+	__m256 scale;
+	__m256 lowerBound;
+	__m256 upperBound;
+	if constexpr (encoding == SAMPLE_ENCODING_F32) {
+		scale = _mm256_set1_ps(settings.gain);
+		lowerBound = _mm256_set1_ps(-1.0F);
+		upperBound = _mm256_set1_ps(1.0F);
+	} else {
+		// Full scale maps to the largest positive value and the negative side gets its one extra code.
+		// 2^31 - 1 isn't a float, so 32 bit stops at the largest float below it
+		F32 amplitude = F32((1ull << (bitDepth - 1)) - 1);
+		scale = _mm256_set1_ps(settings.gain * amplitude);
+		lowerBound = _mm256_set1_ps(-F32(1ull << (bitDepth - 1)));
+		upperBound = _mm256_set1_ps(bitDepth == 32 ? 2147483520.0F : amplitude);
+	}
+	B32 dither = encoding != SAMPLE_ENCODING_F32 && settings.dither && bitDepth <= 24;
+	__m256i rngState = _mm256_load_si256(reinterpret_cast<__m256i*>(ditherRngState));
+	U32 i = 0;
+	for (; i + 8 + OVERHANG_SAMPLES <= sampleCount; i += 8) {
+		encode_f32x8<encoding>(output + i * BYTES_PER_SAMPLE, _mm256_loadu_ps(input + i), scale, lowerBound, upperBound, dither, &rngState);
+	}
+	if (i < sampleCount) {
+		// Whatever's left goes through a padded copy so the tail gets the exact same math as everything else
+		alignas(32) F32 tailInput[16]{};
+		U8 tailOutput[16 * 4 + 4];
+		U32 tailCount = sampleCount - i;
+		memcpy(tailInput, input + i, tailCount * sizeof(F32));
+		for (U32 j = 0; j < tailCount; j += 8) {
+			encode_f32x8<encoding>(tailOutput + j * BYTES_PER_SAMPLE, _mm256_load_ps(tailInput + j), scale, lowerBound, upperBound, dither, &rngState);
+		}
+		memcpy(output + i * BYTES_PER_SAMPLE, tailOutput, tailCount * BYTES_PER_SAMPLE);
+	}
+	_mm256_store_si256(reinterpret_cast<__m256i*>(ditherRngState), rngState);
+}
+
+// Gain, clipping, and conversion of interleaved samples to whatever the output wants. Channels don't matter here, every sample is handled the same way
+void encode_audio_to_final_buffer(void* outputBuffer, const F32* inputBuffer, U32 numFrames, U32 numChannels, AudioFormat format, const OutputSettings& settings) {
+	U8* output = reinterpret_cast<U8*>(outputBuffer);
+	U32 sampleCount = numFrames * numChannels;
+	U32 bitDepth = AUDIO_FORMAT_BIT_DEPTH[format];
+	if (AUDIO_FORMAT_IS_FLOAT[format]) {
+		encode_samples<SAMPLE_ENCODING_F32>(output, inputBuffer, sampleCount, bitDepth, settings);
+	} else if (bitDepth == 8) {
+		encode_samples<SAMPLE_ENCODING_U8>(output, inputBuffer, sampleCount, bitDepth, settings);
+	} else if (bitDepth == 16) {
+		encode_samples<SAMPLE_ENCODING_S16>(output, inputBuffer, sampleCount, bitDepth, settings);
+	} else if (bitDepth == 24) {
+		if (settings.packed24Bit) {
+			encode_samples<SAMPLE_ENCODING_S24_PACKED>(output, inputBuffer, sampleCount, bitDepth, settings);
+		} else {
+			encode_samples<SAMPLE_ENCODING_S24_IN_S32>(output, inputBuffer, sampleCount, bitDepth, settings);
+		}
+	} else {
+		encode_samples<SAMPLE_ENCODING_S32>(output, inputBuffer, sampleCount, bitDepth, settings);
+	}
+}
+
+// Streams already encoded audio to a WAV file, so arbitrarily long output never has to be held in memory.
+// The chunk sizes aren't known until the end, so close goes back and patches them into the header
+struct WavWriter {
+	std::ofstream file;
+	AudioFormat format;
+	U32 channelCount;
+	B32 packed24Bit;
+	U64 dataBytes;
+
+	static constexpr U32 WAV_HEADER_SIZE = 44;
+	static constexpr U16 WAVE_FORMAT_TAG_PCM = 1;
+	static constexpr U16 WAVE_FORMAT_TAG_IEEE_FLOAT = 3;
+
+	template<typename T>
+	void write_le(T val) {
+		file.write(reinterpret_cast<const char*>(&val), sizeof(T));
+	}
+
+	void write_header() {
+		U32 containerBytes = audio_format_container_bytes(format, packed24Bit);
+		U32 sampleRate = AUDIO_FORMAT_SAMPLE_RATE_HZ[format];
+		U32 dataSize = U32(min<U64>(dataBytes, U32_MAX - WAV_HEADER_SIZE));
+		file.write("RIFF", 4);
+		write_le<U32>(WAV_HEADER_SIZE - 8 + dataSize);
+		file.write("WAVE", 4);
+		file.write("fmt ", 4);
+		write_le<U32>(16);
+		write_le<U16>(AUDIO_FORMAT_IS_FLOAT[format] ? WAVE_FORMAT_TAG_IEEE_FLOAT : WAVE_FORMAT_TAG_PCM);
+		write_le<U16>(U16(channelCount));
+		write_le<U32>(sampleRate);
+		write_le<U32>(sampleRate * channelCount * containerBytes);
+		write_le<U16>(U16(channelCount * containerBytes));
+		// Unpacked 24 bit audio is written as left justified 32 bit, which any reader can take as plain 32 bit PCM
+		write_le<U16>(U16(containerBytes * 8));
+		file.write("data", 4);
+		write_le<U32>(dataSize);
+	}
+
+	// packed24Bit has to match what the samples were encoded with
+	B32 open(const char* path, AudioFormat outputFormat, U32 numChannels, B32 packed24BitSamples) {
+		file.open(path, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			return false;
+		}
+		format = outputFormat;
+		channelCount = numChannels;
+		packed24Bit = packed24BitSamples;
+		dataBytes = 0;
+		write_header();
+		return file.good();
+	}
+
+	void write(const void* encodedSamples, U32 numFrames) {
+		U64 numBytes = U64(numFrames) * channelCount * audio_format_container_bytes(format, packed24Bit);
+		file.write(reinterpret_cast<const char*>(encodedSamples), std::streamsize(numBytes));
+		dataBytes += numBytes;
+	}
+
+	void write_silence(U64 numFrames) {
+		// Silence is 128 in unsigned 8 bit and 0 in everything else
+		char silence[256];
+		memset(silence, AUDIO_FORMAT_BIT_DEPTH[format] == 8 ? 128 : 0, sizeof(silence));
+		U64 numBytes = numFrames * channelCount * audio_format_container_bytes(format, packed24Bit);
+		dataBytes += numBytes;
+		while (numBytes > 0) {
+			U64 bytesToWrite = min<U64>(numBytes, sizeof(silence));
+			file.write(silence, std::streamsize(bytesToWrite));
+			numBytes -= bytesToWrite;
+		}
+	}
+
+	B32 close() {
+		file.seekp(0);
+		write_header();
+		file.close();
+		return !file.fail();
+	}
+};
+
+}
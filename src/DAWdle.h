@@ -2,7 +2,8 @@
 #include "VK.h"
 #include "DynamicVertexBuffer.h"
 #include "TextRenderer.h"
-#include "WASAPIInterface.h"
+#include "AudioDevice.h"
+#include "RealTime.h"
 #include "Nodes.h"
 #include "NodeUI.h"
 
@@ -13,53 +14,80 @@ U64 prevFrameTime;
 U64 frameTime;
 F64 deltaTime;
 F64 totalTime;
+// Frame index of the next block the graph will generate. The engine's clock is this count, everything time related is derived from it
+U64 audioFrameClock;
+// Seconds of audio handed to the device so far. Only for the UI to read, the audio itself never accumulates time.
 // F32 cannot be used for total audio time. The precision is insufficient and results in audible artifacts after only a handful of seconds
 F64 audioPlaybackTime;
+// Set by the UI to send playback back to the start. The audio thread owns the clock, so it does the reset next time it runs
+volatile B32 audioClockResetRequested;
 B32 isPaused;
 U32 audioBufferCount;
-F32 audioBuffer[Nodes::PROCESS_BUFFER_SIZE];
+// One lane per output channel, the graph renders planar and it gets interleaved on the way out
+alignas(32) F32 audioBuffer[Nodes::MAX_OUTPUT_CHANNELS][Nodes::PROCESS_BUFFER_SIZE];
+// Stands in for any device channels past what the graph can output
+alignas(32) F32 silentLane[Nodes::PROCESS_BUFFER_SIZE];
 
 Nodes::NodeGraph primaryGraph;
 
 HANDLE audioThread;
 B32 audioThreadShouldShutdown;
 
-B32 fill_audio_buffer(F32* buffer, U32 numSamples, U32 numChannels, F32 timeAmount) {
+B32 fill_audio_buffer(F32* buffer, U32 numSamples, U32 numChannels) {
+	if (audioClockResetRequested) {
+		audioFrameClock = 0;
+		audioBufferCount = 0;
+		audioPlaybackTime = 0.0;
+		audioClockResetRequested = false;
+	}
 	if (isPaused) {
 		return false;
 	}
+	U32 faultCountBeforeBlock = arenaFaultCount;
 	UI::modificationLock.lock_read();
 	U32 currentSample = 0;
-	while (currentSample < numSamples) {
-		if (audioBufferCount == 0) {
-			F64 timeBuffer[ARRAY_COUNT(audioBuffer)];
-			for (U32 i = 0; i < ARRAY_COUNT(audioBuffer); i++) {
-				timeBuffer[i] = audioPlaybackTime + F64(currentSample + i) / F64(numSamples) * F64(timeAmount);
+	U32 graphChannels = min(numChannels, Nodes::MAX_OUTPUT_CHANNELS);
+	MemoryArena& stackArena = get_scratch_arena();
+	MEMORY_ARENA_FRAME(stackArena) {
+		const F32** lanes = stackArena.alloc<const F32*>(numChannels);
+		while (currentSample < numSamples) {
+			if (audioBufferCount == 0) {
+				primaryGraph.generate_output(audioBuffer, graphChannels, audioFrameClock);
+				audioFrameClock += Nodes::PROCESS_BUFFER_SIZE;
+				audioBufferCount = Nodes::PROCESS_BUFFER_SIZE;
 			}
-			primaryGraph.generate_output(audioBuffer, timeBuffer);
-			audioBufferCount = ARRAY_COUNT(audioBuffer);
-		}
-		U32 samplesToGenerate = min(audioBufferCount, numSamples - currentSample);
-		F32* audioPtr = &audioBuffer[ARRAY_COUNT(audioBuffer) - audioBufferCount];
-		for (U32 i = 0; i < samplesToGenerate; i++) {
-			for (U32 j = 0; j < numChannels; j++) {
-				*buffer++ = audioPtr[i];
+			U32 samplesToGenerate = min(audioBufferCount, numSamples - currentSample);
+			U32 laneOffset = Nodes::PROCESS_BUFFER_SIZE - audioBufferCount;
+			for (U32 i = 0; i < numChannels; i++) {
+				lanes[i] = (i < graphChannels ? audioBuffer[i] : silentLane) + laneOffset;
 			}
+			AudioDevice::interleave_channels(buffer, lanes, samplesToGenerate, numChannels);
+			buffer += samplesToGenerate * numChannels;
+			audioBufferCount -= samplesToGenerate;
+			currentSample += samplesToGenerate;
 		}
-		audioBufferCount -= samplesToGenerate;
-		currentSample += samplesToGenerate;
 	}
-	audioPlaybackTime += timeAmount;
+	// Leftover samples in audioBuffer haven't been played yet
+	audioPlaybackTime = F64(audioFrameClock - audioBufferCount) / F64(AudioDevice::sample_rate());
 	UI::modificationLock.unlock_read();
+	RealTime::end_block(faultCountBeforeBlock);
 	return true;
 }
 
 DWORD WINAPI audio_thread_func(LPVOID) {
+	if (!drill_lib_init_thread()) {
+		println("Failed to init audio thread arenas");
+		return EXIT_FAILURE;
+	}
+	RealTime::prepare_audio_thread();
+	audioFrameClock = 0;
 	audioPlaybackTime = 0.0;
-	WASAPIInterface::init_wasapi(fill_audio_buffer);
+	AudioDevice::init(AudioDevice::requestedBackend, fill_audio_buffer, AudioDevice::requestedWavOutputPath);
 	while (!audioThreadShouldShutdown) {
-		WASAPIInterface::do_audio();
+		AudioDevice::do_audio();
 	}
+	AudioDevice::shutdown();
+	drill_lib_destroy_thread();
 	return 0;
 }
 
@@ -89,6 +117,7 @@ void do_frame() {
 	V2F32 mousePos = Win32::get_mouse();
 	V2F32 mouseDelta = Win32::get_delta_mouse();
 	UI::handle_mouse_update(mousePos, mouseDelta);
+	DeadlineMonitor::update_overlay_text();
 
 	VK::FrameBeginResult beginAction = VK::begin_frame();
 	if (beginAction == VK::FRAME_BEGIN_RESULT_TRY_AGAIN) {
@@ -200,6 +229,7 @@ U32 run_dawdle() {
 		} else {
 			CloseHandle(audioThread);
 		}
+		RealTime::report();
 		CHK_VK(VK::vkDeviceWaitIdle(VK::logicalDevice));
 		LOG_TIME("UI Shutdown Time: ") {
 			UI::destroy_ui();
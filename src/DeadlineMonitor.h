@@ -0,0 +1,207 @@
+#pragma once
+#include "DrillLib.h"
+#include "AudioFormat.h"
+
+// Times every block the audio thread renders against how long the audio it produced lasts, which is the most time it could have taken before the device runs dry.
+// That ratio is the DSP load: 100% means the render took as long as the audio plays for, and anything near that is a click waiting to happen.
+// The audio thread is the only writer. Readers (UI, dumps) read without locking and might see a block half counted, which is fine for monitoring
+namespace DeadlineMonitor {
+
+// Load histogram bins are half a percent wide, the last one catches everything past 127.5%
+const U32 BIN_COUNT = 256;
+const F64 BINS_PER_UNIT_LOAD = 200.0;
+// Rolling window made of WINDOW_COUNT one second windows. The oldest one gets cleared and reused as time moves on
+const U32 WINDOW_COUNT = 8;
+const F64 WINDOW_SECONDS = 1.0;
+
+struct Window {
+	U32 counts[BIN_COUNT];
+	U32 blockCount;
+	F32 maxLoad;
+};
+
+struct Summary {
+	U32 blockCount;
+	F32 p50Load;
+	F32 p99Load;
+	F32 maxLoad;
+	F32 allTimeMaxLoad;
+	U64 totalBlocks;
+	U64 deadlineMisses;
+	U32 underruns;
+	F64 lastBlockSeconds;
+};
+
+Window windows[WINDOW_COUNT];
+volatile U32 currentWindow;
+U64 windowStartTsc;
+F64 tscFrequency;
+U64 cyclesPerWindow;
+F32 allTimeMaxLoad;
+U64 totalBlocks;
+// Blocks that took longer than the audio they produced. Not an underrun by itself if the device had enough queued, but the queue shrank
+U64 deadlineMisses;
+U64 lastBlockCycles;
+
+// TSC ticks at a constant rate on anything with an invariant TSC (everything this runs on), so it's calibrated once against the performance counter
+void init() {
+	U64 counterStart = performance_counter();
+	U64 tscStart = __rdtsc();
+	sleep_milliseconds(20);
+	U64 counterEnd = performance_counter();
+	U64 tscEnd = __rdtsc();
+	tscFrequency = F64(tscEnd - tscStart) * F64(performanceCounterTimerFrequency) / F64(counterEnd - counterStart);
+	cyclesPerWindow = U64(tscFrequency * WINDOW_SECONDS);
+	memset(windows, 0, sizeof(windows));
+	currentWindow = 0;
+	windowStartTsc = tscEnd;
+	allTimeMaxLoad = 0.0F;
+	totalBlocks = 0;
+	deadlineMisses = 0;
+	lastBlockCycles = 0;
+}
+
+FINLINE U64 block_begin() {
+	return __rdtsc();
+}
+
+// Audio thread only
+void block_end(U64 startTsc, U32 numFrames) {
+	U64 endTsc = __rdtsc();
+	U64 cycles = endTsc - startTsc;
+	F64 availableCycles = F64(numFrames) * tscFrequency / F64(AudioDevice::sample_rate());
+	F32 load = F32(F64(cycles) / availableCycles);
+	U64 elapsedWindows = (endTsc - windowStartTsc) / cyclesPerWindow;
+	if (elapsedWindows) {
+		// After a pause, everything from before it ages out rather than sitting in the windows that got skipped
+		for (U64 i = 0; i < min<U64>(elapsedWindows, WINDOW_COUNT); i++) {
+			U32 nextWindow = (currentWindow + 1) % WINDOW_COUNT;
+			memset(&windows[nextWindow], 0, sizeof(Window));
+			currentWindow = nextWindow;
+		}
+		windowStartTsc += elapsedWindows * cyclesPerWindow;
+	}
+	Window& window = windows[currentWindow];
+	window.counts[min(U32(F64(load) * BINS_PER_UNIT_LOAD), BIN_COUNT - 1)]++;
+	window.blockCount++;
+	window.maxLoad = max(window.maxLoad, load);
+	allTimeMaxLoad = max(allTimeMaxLoad, load);
+	deadlineMisses += load > 1.0F;
+	totalBlocks++;
+	lastBlockCycles = cycles;
+}
+
+// Upper edge of the bin the percentile lands in, so it errs on the pessimistic side
+F32 percentile_load(const U32* counts, U32 total, F64 percentile) {
+	U32 target = U32(F64(total) * percentile + 0.5);
+	U32 cumulative = 0;
+	for (U32 i = 0; i < BIN_COUNT; i++) {
+		cumulative += counts[i];
+		if (cumulative >= max(target, 1u)) {
+			return F32(F64(i + 1) / BINS_PER_UNIT_LOAD);
+		}
+	}
+	return 0.0F;
+}
+
+Summary summarize() {
+	Summary summary{};
+	U32 counts[BIN_COUNT]{};
+	for (U32 i = 0; i < WINDOW_COUNT; i++) {
+		for (U32 j = 0; j < BIN_COUNT; j++) {
+			counts[j] += windows[i].counts[j];
+		}
+		summary.blockCount += windows[i].blockCount;
+		summary.maxLoad = max(summary.maxLoad, windows[i].maxLoad);
+	}
+	if (summary.blockCount) {
+		summary.p50Load = percentile_load(counts, summary.blockCount, 0.5);
+		summary.p99Load = percentile_load(counts, summary.blockCount, 0.99);
+	}
+	summary.allTimeMaxLoad = allTimeMaxLoad;
+	summary.totalBlocks = totalBlocks;
+	summary.deadlineMisses = deadlineMisses;
+	summary.underruns = AudioDevice::stats.xrunCount;
+	summary.lastBlockSeconds = tscFrequency > 0.0 ? F64(lastBlockCycles) / tscFrequency : 0.0;
+	return summary;
+}
+
+// Tiny formatting helpers, there's nothing in the base library that formats into a buffer
+struct TextWriter {
+	char* buffer;
+	U32 capacity;
+	U32 length;
+
+	void str(StrA text) {
+		U32 count = min<U32>(U32(text.length), capacity - length);
+		memcpy(buffer + length, text.str, count);
+		length += count;
+	}
+	void u64(U64 num) {
+		char digits[20];
+		U32 digitCount = 0;
+		do {
+			digits[digitCount++] = char(num % 10) + '0';
+			num /= 10;
+		} while (num);
+		while (digitCount && length < capacity) {
+			buffer[length++] = digits[--digitCount];
+		}
+	}
+	// Load as a percentage with one decimal
+	void percent(F32 load) {
+		U64 tenths = U64(F64(load) * 1000.0 + 0.5);
+		u64(tenths / 10);
+		str("."sa);
+		u64(tenths % 10);
+	}
+};
+
+// Short one line version for the UI overlay. UI thread only, refreshed once a frame so every panel shows the same thing
+char overlayTextBuffer[128];
+StrA overlayText;
+void update_overlay_text() {
+	Summary summary = summarize();
+	TextWriter writer{ overlayTextBuffer, sizeof(overlayTextBuffer), 0 };
+	writer.str("DSP p50 "sa);
+	writer.percent(summary.p50Load);
+	writer.str("% p99 "sa);
+	writer.percent(summary.p99Load);
+	writer.str("% max "sa);
+	writer.percent(summary.maxLoad);
+	writer.str("% xruns "sa);
+	writer.u64(summary.underruns);
+	overlayText = StrA{ overlayTextBuffer, writer.length };
+}
+
+// JSON, so it can be diffed between machines or checked by a script before a show
+StrA dump_json(char* buffer, U32 capacity) {
+	Summary summary = summarize();
+	TextWriter writer{ buffer, capacity, 0 };
+	writer.str("{\n  \"sampleRate\": "sa);
+	writer.u64(AudioDevice::sample_rate());
+	writer.str(",\n  \"totalBlocks\": "sa);
+	writer.u64(summary.totalBlocks);
+	writer.str(",\n  \"underruns\": "sa);
+	writer.u64(summary.underruns);
+	writer.str(",\n  \"deadlineMisses\": "sa);
+	writer.u64(summary.deadlineMisses);
+	writer.str(",\n  \"allTimeMaxLoadPercent\": "sa);
+	writer.percent(summary.allTimeMaxLoad);
+	writer.str(",\n  \"lastBlockMicroseconds\": "sa);
+	writer.u64(U64(summary.lastBlockSeconds * 1000000.0));
+	writer.str(",\n  \"window\": {\n    \"seconds\": "sa);
+	writer.u64(U64(WINDOW_COUNT * WINDOW_SECONDS));
+	writer.str(",\n    \"blocks\": "sa);
+	writer.u64(summary.blockCount);
+	writer.str(",\n    \"p50LoadPercent\": "sa);
+	writer.percent(summary.p50Load);
+	writer.str(",\n    \"p99LoadPercent\": "sa);
+	writer.percent(summary.p99Load);
+	writer.str(",\n    \"maxLoadPercent\": "sa);
+	writer.percent(summary.maxLoad);
+	writer.str("\n  }\n}\n"sa);
+	return StrA{ buffer, writer.length };
+}
+
+}
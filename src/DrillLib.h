@@ -1,25 +1,38 @@
 #pragma once
+#ifdef _WIN32
 #define _CRT_SECURE_NO_WARNINGS
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
 #pragma warning(push, 0)
 #include <Windows.h>
+#include <malloc.h>
 #pragma warning(pop)
+#else
+#include <string.h>
+// glibc declares its own sinf32, floorf64 and the like (for _Float32/_Float64). They have to be seen before DrillMath's, which overload them,
+// otherwise the first standard header to pull in math.h afterwards won't compile
+#include <math.h>
+#endif
 #include "DrillLibDefs.h"
 #include "DrillMath.h"
-
-extern "C" int _fltused = 0;
-
-U64 performanceCounterTimerFrequency;
+#include "DrillLibPlatform.h"
 
 DEBUG_OPTIMIZE_ON
 
 FINLINE void zero_memory(void* mem, U64 bytes) {
+#ifdef _MSC_VER
 	__stosb(reinterpret_cast<Byte*>(mem), 0, bytes);
+#else
+	memset(mem, 0, bytes);
+#endif
 }
 
 DEBUG_OPTIMIZE_OFF
 
+// MSVC builds without the C runtime, so the few CRT functions the compiler emits calls to are provided here. Everywhere else libc has them
+#ifdef _MSC_VER
+extern "C" int _fltused = 0;
+
 #pragma warning(disable:28251) // Inconsistent annotation for ''
 #pragma warning(disable:6001) // Using uninitialized memory. There appears to be a false positive for some functions here
 
@@ -87,6 +100,7 @@ int __cdecl memcmp(const void* m1, const void* m2, size_t n) {
 
 #pragma warning(default:6001)
 #pragma warning(default:28251)
+#endif
 
 DEBUG_OPTIMIZE_ON
 
@@ -128,20 +142,38 @@ struct MemoryArena {
 	U8* stackBase;
 	U64 stackMaxSize;
 	U64 stackPtr;
+	// Furthest the fault handler has committed. Committed memory is never given back, so this is the most the arena has ever touched, rounded up to a commit chunk
+	U64 committedBytes;
+	// What was actually reserved, stackBase is this rounded up to a commit chunk
+	void* reservation;
+	U64 reservationSize;
 
 	bool init(U64 capacity) {
-		stackBase = reinterpret_cast<U8*>(VirtualAlloc(nullptr, ((capacity + 4095) & ~0xFFF) + MEMORY_ARENA_BYTES_TO_COMMIT_AT_A_TIME, MEM_RESERVE, PAGE_READWRITE));
-		stackBase = reinterpret_cast<U8*>(ALIGN_HIGH(reinterpret_cast<UPtr>(stackBase), MEMORY_ARENA_BYTES_TO_COMMIT_AT_A_TIME));
-		if (!stackBase) {
+		reservationSize = ((capacity + 4095) & ~0xFFF) + MEMORY_ARENA_BYTES_TO_COMMIT_AT_A_TIME;
+		reservation = reserve_memory(reservationSize);
+		if (!reservation) {
 			return false;
 		}
+		stackBase = reinterpret_cast<U8*>(ALIGN_HIGH(reinterpret_cast<UPtr>(reservation), MEMORY_ARENA_BYTES_TO_COMMIT_AT_A_TIME));
 		stackMaxSize = capacity;
 		stackPtr = 0;
+		committedBytes = 0;
 		return true;
 	}
 
+	// Commits the first numBytes and locks them into physical memory, so touching them can never fault, not even to page back in.
+	// Fails if the process isn't allowed to lock that much, see grow_lockable_memory
+	bool commit_and_lock(U64 numBytes) {
+		numBytes = min<U64>(ALIGN_HIGH(numBytes, MEMORY_ARENA_BYTES_TO_COMMIT_AT_A_TIME), ALIGN_HIGH(stackMaxSize, MEMORY_ARENA_BYTES_TO_COMMIT_AT_A_TIME));
+		if (!commit_memory(stackBase, numBytes)) {
+			return false;
+		}
+		committedBytes = max(committedBytes, numBytes);
+		return lock_memory(stackBase, numBytes);
+	}
+
 	void destroy() {
-		VirtualFree(stackBase, 0, MEM_RELEASE);
+		release_memory(reservation, reservationSize);
 	}
 
 	void reset() {
@@ -226,16 +258,16 @@ DEBUG_OPTIMIZE_ON
 // Things allocated here get pushed and popped with the call stack, 
 // importantly, not necessarily at the same time as scopes, allowing objects to be passed out of their C++ scope
 // There are two of them so that results can get returned on one while the other is used as temporary scratch space
-// In multithreaded code, there should be two of these per thread
+// In multithreaded code, there should be two of these per thread, so they're thread local. Threads other than main have to call drill_lib_init_thread
 // Idea from Ryan Fleury
-MemoryArena scratchArena0{};
-MemoryArena scratchArena1{};
+thread_local MemoryArena scratchArena0{};
+thread_local MemoryArena scratchArena1{};
 // Things allocated here exist for two frames. At the end of a frame, it is swapped to lastFrameArena
 MemoryArena frameArena{};
 // At the end of a frame, lastFrameArena is cleared and made the new frameArena
 MemoryArena lastFrameArena{};
-// Used to store temporary buffer values for audio nodes
-MemoryArena audioArena{};
+// Used to store temporary buffer values for audio nodes. Thread local so more than one thread can process a node graph at once
+thread_local MemoryArena audioArena{};
 // Things allocated here exist for the duration of the program, it is never reset
 MemoryArena globalArena{};
 
@@ -483,10 +515,17 @@ struct StrA {
 
 // Here's one of the C++ features I'll be using, should make string literals much nicer
 // Technically user defined literal suffixes that don't start with an underscore are reserved, but I don't really care.
-// If it becomes an issue, I'll change it then
-FINLINE constexpr StrA operator""sa(const char* lit, U64 len) {
+// If it becomes an issue, I'll change it then. GCC warns about the reserved suffix, so that one warning is turned off just for this
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wliteral-suffix"
+#endif
+FINLINE constexpr StrA operator""sa(const char* lit, size_t len) {
 	return StrA{ lit, len };
 }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
 
 FINLINE U64 total_stralen(StrA str) {
 	return str.length;
@@ -516,31 +555,216 @@ struct RWSpinLock {
 
 	void lock_read() {
 		while (true) {
-			I32 lockVal = __iso_volatile_load32(&lock);
-			if (lockVal != -1 && _InterlockedCompareExchange(reinterpret_cast<long*>(&lock), lockVal + 1, lockVal) == lockVal) {
+			I32 lockVal = atomic_load32(&lock);
+			if (lockVal != -1 && atomic_compare_exchange32(&lock, lockVal + 1, lockVal) == lockVal) {
 				break;
 			}
-			while (__iso_volatile_load32(&lock) == -1);
+			while (atomic_load32(&lock) == -1);
 		}
 	}
 	void lock_write() {
 		while (true) {
 			I32 val = 0;
-			long result = _InterlockedCompareExchange(reinterpret_cast<long*>(&lock), -1, val);
+			I32 result = atomic_compare_exchange32(&lock, -1, val);
 			if (result == 0) {
 				break;
 			}
-			while (__iso_volatile_load32(&lock) != 0);
+			while (atomic_load32(&lock) != 0);
 		}
 	}
 	void unlock_read() {
 		// Assumes you have already established a read lock
-		_InterlockedDecrement(reinterpret_cast<unsigned int*>(&lock));
+		atomic_decrement32(&lock);
 	}
 	void unlock_write() {
 		// Assumes you have already established a write lock
-		_ReadWriteBarrier();
-		__iso_volatile_store32(&lock, 0);
+		compiler_barrier();
+		atomic_store32(&lock, 0);
+	}
+};
+
+// Single producer, single consumer, lock free. Made for getting data from the audio thread to the UI, so the producer never waits on anything.
+// If the consumer falls behind, whatever doesn't fit is dropped rather than overwriting something the consumer might be in the middle of reading.
+// Positions only ever count up and get masked on access, so a full ring and an empty one can't be confused.
+// x86 doesn't reorder loads with other loads or stores with other stores, so keeping the compiler from moving things past the position updates is all the ordering this needs
+template<typename T>
+struct SPSCRing {
+	T* data;
+	U64 capacity;
+	// Producer only, how much didn't fit
+	U64 droppedCount;
+	// Each position gets its own cache line, otherwise the two threads would keep stealing it from each other.
+	// Padded apart rather than aligned, so a ring can sit inside a slab object (those only get 16 byte alignment)
+	I64 writePos;
+	U8 writePosPadding[64 - sizeof(I64)];
+	I64 readPos;
+	U8 readPosPadding[64 - sizeof(I64)];
+
+	// capacity has to be a power of two
+	void init(T* storage, U64 capacityPowerOfTwo) {
+		ASSERT(capacityPowerOfTwo && (capacityPowerOfTwo & (capacityPowerOfTwo - 1)) == 0, "Ring capacity must be a power of two");
+		data = storage;
+		capacity = capacityPowerOfTwo;
+		droppedCount = 0;
+		writePos = 0;
+		readPos = 0;
+	}
+
+	// Producer only. Returns how much was written
+	U64 write(const T* src, U64 count) {
+		U64 write = U64(writePos);
+		U64 read = U64(atomic_load64(&readPos));
+		// The consumer has to be done with the space before it gets written over
+		compiler_barrier();
+		U64 toWrite = min(count, capacity - (write - read));
+		droppedCount += count - toWrite;
+		U64 start = write & (capacity - 1);
+		U64 firstPart = min(toWrite, capacity - start);
+		memcpy(data + start, src, firstPart * sizeof(T));
+		memcpy(data, src + firstPart, (toWrite - firstPart) * sizeof(T));
+		// And the data has to be there before the position that hands it over
+		compiler_barrier();
+		atomic_store64(&writePos, I64(write + toWrite));
+		return toWrite;
+	}
+
+	// Consumer only
+	U64 available() {
+		return U64(atomic_load64(&writePos)) - U64(readPos);
+	}
+	// Consumer only. Returns how much was read
+	U64 read(T* dst, U64 count) {
+		U64 read = U64(readPos);
+		U64 write = U64(atomic_load64(&writePos));
+		compiler_barrier();
+		U64 toRead = min(count, write - read);
+		U64 start = read & (capacity - 1);
+		U64 firstPart = min(toRead, capacity - start);
+		memcpy(dst, data + start, firstPart * sizeof(T));
+		memcpy(dst + firstPart, data, (toRead - firstPart) * sizeof(T));
+		compiler_barrier();
+		atomic_store64(&readPos, I64(read + toRead));
+		return toRead;
+	}
+	// Consumer only. Throws away the oldest count without reading them, for consumers that only care about the latest data
+	void skip(U64 count) {
+		U64 read = U64(readPos);
+		U64 write = U64(atomic_load64(&writePos));
+		atomic_store64(&readPos, I64(read + min(count, write - read)));
+	}
+};
+
+// Fixed size slots for things that are created and destroyed one at a time and live a while, like graph nodes.
+// Each object goes in the pool for its size class, a whole number of cache lines, so a small object doesn't take up as much room as the biggest one.
+// Every slot keeps a generation just in front of its object. It's odd while the slot is live and goes up on both alloc and free,
+// so a pointer together with the generation it had when it was handed out is a weak handle. Slabs come from globalArena and are never given back.
+// All zeros is a valid empty allocator
+const U32 SLAB_OBJECT_OFFSET = 16;
+const U32 SLAB_SIZE_CLASS_BYTES = 64;
+const U32 SLAB_SIZE_CLASS_COUNT = 32;
+const U64 SLAB_BYTES = 64 * KILOBYTE;
+
+FINLINE U64& slab_generation(const void* object) {
+	return reinterpret_cast<U64*>(const_cast<void*>(object))[-1];
+}
+FINLINE B32 slab_is_live(const void* object) {
+	return slab_generation(object) & 1;
+}
+
+struct SlabPool {
+	// Padded out to a cache line, slots start right after it
+	struct Slab {
+		Slab* next;
+		U32 slotSize;
+		U32 slotCount;
+	};
+	Slab* slabFirst;
+	Slab* slabLast;
+	// Points at a free slot's object, which holds the next one
+	void* freeList;
+	U32 liveCount;
+
+	FINLINE static U8* first_slot(Slab* slab) {
+		return reinterpret_cast<U8*>(slab) + SLAB_SIZE_CLASS_BYTES;
+	}
+
+	void* alloc(U32 slotSize) {
+		if (!freeList) {
+			U32 slotCount = U32((SLAB_BYTES - SLAB_SIZE_CLASS_BYTES) / slotSize);
+			Slab* slab = reinterpret_cast<Slab*>(globalArena.alloc_aligned_with_slack<U8>(SLAB_SIZE_CLASS_BYTES + U64(slotCount) * slotSize, SLAB_SIZE_CLASS_BYTES, 0));
+			slab->next = nullptr;
+			slab->slotSize = slotSize;
+			slab->slotCount = slotCount;
+			if (slabLast) {
+				slabLast->next = slab;
+			} else {
+				slabFirst = slab;
+			}
+			slabLast = slab;
+			// Pushed back to front so they come off the free list in address order
+			for (U32 i = slotCount; i-- > 0;) {
+				void* object = first_slot(slab) + U64(i) * slotSize + SLAB_OBJECT_OFFSET;
+				slab_generation(object) = 0;
+				*reinterpret_cast<void**>(object) = freeList;
+				freeList = object;
+			}
+		}
+		void* object = freeList;
+		freeList = *reinterpret_cast<void**>(object);
+		slab_generation(object)++;
+		liveCount++;
+		return object;
+	}
+	void free(void* object) {
+		ASSERT(slab_is_live(object), "Slab object freed twice");
+		slab_generation(object)++;
+		*reinterpret_cast<void**>(object) = freeList;
+		freeList = object;
+		liveCount--;
+	}
+
+	// Every live object, slab by slab. That's the order they were allocated in until freed slots start getting reused,
+	// and either way it's a straight walk through memory instead of chasing pointers
+	template<typename Fn>
+	void for_each_live(Fn&& fn) {
+		for (Slab* slab = slabFirst; slab; slab = slab->next) {
+			U8* slot = first_slot(slab);
+			for (U32 i = 0; i < slab->slotCount; i++, slot += slab->slotSize) {
+				if (slab_is_live(slot + SLAB_OBJECT_OFFSET)) {
+					fn(reinterpret_cast<void*>(slot + SLAB_OBJECT_OFFSET));
+				}
+			}
+		}
+	}
+};
+
+struct SlabAllocator {
+	SlabPool pools[SLAB_SIZE_CLASS_COUNT];
+
+	template<typename T>
+	static constexpr U32 size_class() {
+		static_assert(alignof(T) <= SLAB_OBJECT_OFFSET, "Slab objects can't be aligned past the generation in front of them");
+		static_assert(SLAB_OBJECT_OFFSET + sizeof(T) <= SLAB_SIZE_CLASS_BYTES * SLAB_SIZE_CLASS_COUNT, "Too big for any slab size class");
+		return U32((SLAB_OBJECT_OFFSET + sizeof(T) + SLAB_SIZE_CLASS_BYTES - 1) / SLAB_SIZE_CLASS_BYTES) - 1;
+	}
+
+	// Not initialized, same as an arena alloc
+	template<typename T>
+	T* alloc() {
+		constexpr U32 sizeClass = size_class<T>();
+		return reinterpret_cast<T*>(pools[sizeClass].alloc((sizeClass + 1) * SLAB_SIZE_CLASS_BYTES));
+	}
+	template<typename T>
+	void free(T* object) {
+		pools[size_class<T>()].free(object);
+	}
+
+	// Smallest size class first. Objects of different types can share a class, so fn gets them untyped
+	template<typename Fn>
+	void for_each_live(Fn&& fn) {
+		for (U32 i = 0; i < SLAB_SIZE_CLASS_COUNT; i++) {
+			pools[i].for_each_live(fn);
+		}
 	}
 };
 
@@ -723,12 +947,12 @@ struct ByteBuf {
 
 DEBUG_OPTIMIZE_OFF
 
-HANDLE consoleOutput;
+FileHandle consoleOutput;
 
 // One day I'll get around to implementing a printf, then I can get rid of this horrid API
 void print(const char* str) {
-	// Doing a lot of WriteFile calls like this is going to be really slow, but I probably won't be printing a lot of stuff like this anyway
-	WriteFile(consoleOutput, str, DWORD(strlen(str)), NULL, NULL);
+	// Doing a lot of write calls like this is going to be really slow, but I probably won't be printing a lot of stuff like this anyway
+	write_file(consoleOutput, str, strlen(str));
 }
 void println() {
 	print("\n");
@@ -738,7 +962,7 @@ void println(const char* str) {
 	print("\n");
 }
 void print(StrA str) {
-	WriteFile(consoleOutput, str.str, DWORD(str.length), NULL, NULL);
+	write_file(consoleOutput, str.str, str.length);
 }
 void println(StrA str) {
 	print(str);
@@ -793,32 +1017,32 @@ void println_float(F64 f) {
 
 [[noreturn]] void abort(const char* message) {
 	print(message);
-	__debugbreak();
-	ExitProcess(EXIT_FAILURE);
+	DEBUG_BREAK();
+	exit_process(EXIT_FAILURE);
 }
 
 template<typename T>
 T* read_full_file_to_arena(U32* count, MemoryArena& arena, StrA fileName) {
 	T* result = nullptr;
 	U64 oldStackPtr = arena.stackPtr;
-	HANDLE file = CreateFileA(fileName.c_str(arena), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	FileHandle file = open_file_read(fileName.c_str(arena));
 	arena.stackPtr = oldStackPtr;
-	if (file != INVALID_HANDLE_VALUE) {
-		U32 size = GetFileSize(file, NULL);
+	if (file != FILE_HANDLE_INVALID) {
+		U32 size = U32(file_size(file));
 		result = arena.alloc_and_commit<T>(size);
-		DWORD numBytesRead{};
-		if (!ReadFile(file, result, size, &numBytesRead, NULL)) {
+		U32 numBytesRead = 0;
+		if (!read_file(file, result, size, &numBytesRead)) {
 			result = nullptr;
-			DWORD fileReadError = GetLastError();
+			U32 fileReadError = last_platform_error();
 			print("Failed to read file, code: ");
 			println_integer(fileReadError);
 		}
-		CloseHandle(file);
+		close_file(file);
 		*count = numBytesRead / sizeof(T);
 	}
 	else {
 		print("Failed to create file, code: ");
-		println_integer(GetLastError());
+		println_integer(last_platform_error());
 	}
 	return result;
 }
@@ -826,15 +1050,15 @@ T* read_full_file_to_arena(U32* count, MemoryArena& arena, StrA fileName) {
 B32 write_data_to_file(StrA fileName, void* data, U32 numBytes) {
 	MemoryArena& stackArena = get_scratch_arena();
 	U64 oldArenaPtr = stackArena.stackPtr;
-	HANDLE file = CreateFileA(fileName.c_str(stackArena), GENERIC_WRITE, FILE_SHARE_WRITE, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	FileHandle file = open_file_write(fileName.c_str(stackArena));
 	B32 success = false;
-	if (file != INVALID_HANDLE_VALUE) {
-		success = !!WriteFile(file, data, numBytes, 0, NULL);
-		CloseHandle(file);
+	if (file != FILE_HANDLE_INVALID) {
+		success = write_file(file, data, numBytes);
+		close_file(file);
 	}
 	else {
 		print("Failed to create file, code: ");
-		println_integer(GetLastError());
+		println_integer(last_platform_error());
 	}
 	stackArena.stackPtr = oldArenaPtr;
 	return success;
@@ -842,7 +1066,7 @@ B32 write_data_to_file(StrA fileName, void* data, U32 numBytes) {
 
 B32 run_program_and_wait(U32* exitCodeOut, StrA programName, StrA commandLine) {
 	MemoryArena& stackArena = get_scratch_arena();
-	BOOL success = FALSE;
+	B32 success = false;
 	MEMORY_ARENA_FRAME(stackArena) {
 		char* commandLineCStr = stackArena.alloc<char>(programName.length + 1 + commandLine.length + 1);
 		memcpy(commandLineCStr, programName.str, programName.length);
@@ -850,71 +1074,55 @@ B32 run_program_and_wait(U32* exitCodeOut, StrA programName, StrA commandLine) {
 		memcpy(commandLineCStr + programName.length + 1, commandLine.str, commandLine.length);
 		commandLineCStr[programName.length + 1 + commandLine.length] = '\0';
 
-		STARTUPINFOA startupInfo{};
-		startupInfo.cb = sizeof(STARTUPINFOA);
-		PROCESS_INFORMATION procInfo{};
-		success = CreateProcessA(programName.c_str(stackArena), commandLineCStr, NULL, NULL, FALSE, 0, NULL, NULL, &startupInfo, &procInfo);
-
-		if (success) {
-			WaitForSingleObject(procInfo.hProcess, INFINITE);
-			DWORD exitCode;
-			if (GetExitCodeProcess(procInfo.hProcess, &exitCode)) {
-				*exitCodeOut = exitCode;
-			}
-			else {
-				*exitCodeOut = U32(-1);
-			}
-			CloseHandle(procInfo.hProcess);
-			CloseHandle(procInfo.hThread);
-		}
+		success = run_process_and_wait(exitCodeOut, programName.c_str(stackArena), commandLineCStr);
 	}
-	return B32(success != 0);
+	return success;
 }
 
 F64 current_time_seconds() {
-	LARGE_INTEGER perfCounter;
-	if (!QueryPerformanceCounter(&perfCounter)) {
-		abort("Could not get performanceCounter");
-	}
-	return F64(perfCounter.QuadPart) / F64(performanceCounterTimerFrequency);
+	return F64(performance_counter()) / F64(performanceCounterTimerFrequency);
 }
 
-void (*previousPageFaultHandler)(int);
+// How many times the handler below has had to commit memory for this thread. Real-time code checks this hasn't moved across a block
+thread_local U32 arenaFaultCount;
 
 // This handler is used so we can reserve large amounts of memory up front and only commit it when we need to
-LONG WINAPI page_fault_handler(PEXCEPTION_POINTERS exceptionPointers) {
-	LONG result = EXCEPTION_CONTINUE_SEARCH;
-	if (exceptionPointers->ExceptionRecord->ExceptionCode == EXCEPTION_ACCESS_VIOLATION) {
-		// https://learn.microsoft.com/en-us/windows/win32/api/winnt/ns-winnt-exception_record
-		// For EXCEPTION_ACCESS_VIOLATION
-		// ExceptionInformation[0] contains 0 if read, 1 if write
-		// ExceptionInformation[1] contains the virtual address accessed
-		UPtr address = ALIGN_LOW(exceptionPointers->ExceptionRecord->ExceptionInformation[1], MEMORY_ARENA_BYTES_TO_COMMIT_AT_A_TIME);
-		LPVOID allocatedAddress = nullptr;
-		if ((address >= reinterpret_cast<UPtr>(scratchArena0.stackBase) && (address - reinterpret_cast<UPtr>(scratchArena0.stackBase)) < scratchArena0.stackMaxSize) ||
-			(address >= reinterpret_cast<UPtr>(scratchArena1.stackBase) && (address - reinterpret_cast<UPtr>(scratchArena1.stackBase)) < scratchArena1.stackMaxSize) ||
-			(address >= reinterpret_cast<UPtr>(frameArena.stackBase) && (address - reinterpret_cast<UPtr>(frameArena.stackBase)) < frameArena.stackMaxSize) ||
-			(address >= reinterpret_cast<UPtr>(lastFrameArena.stackBase) && (address - reinterpret_cast<UPtr>(lastFrameArena.stackBase)) < lastFrameArena.stackMaxSize) ||
-			(address >= reinterpret_cast<UPtr>(audioArena.stackBase) && (address - reinterpret_cast<UPtr>(audioArena.stackBase)) < audioArena.stackMaxSize) ||
-			(address >= reinterpret_cast<UPtr>(globalArena.stackBase) && (address - reinterpret_cast<UPtr>(globalArena.stackBase)) < globalArena.stackMaxSize)) {
-			allocatedAddress = VirtualAlloc(reinterpret_cast<void*>(address), MEMORY_ARENA_BYTES_TO_COMMIT_AT_A_TIME, MEM_COMMIT, PAGE_READWRITE);
-		}
-		if (allocatedAddress) {
-			result = EXCEPTION_CONTINUE_EXECUTION;
+B32 arena_page_fault_handler(UPtr faultAddress) {
+	UPtr address = ALIGN_LOW(faultAddress, MEMORY_ARENA_BYTES_TO_COMMIT_AT_A_TIME);
+	// The handler runs on the faulting thread, so the thread local arenas here are the ones that thread was using
+	MemoryArena* arenas[]{ &scratchArena0, &scratchArena1, &frameArena, &lastFrameArena, &audioArena, &globalArena };
+	for (MemoryArena* arena : arenas) {
+		UPtr arenaBase = reinterpret_cast<UPtr>(arena->stackBase);
+		if (address >= arenaBase && address - arenaBase < arena->stackMaxSize) {
+			if (commit_memory(reinterpret_cast<void*>(address), MEMORY_ARENA_BYTES_TO_COMMIT_AT_A_TIME)) {
+				arena->committedBytes = max<U64>(arena->committedBytes, address - arenaBase + MEMORY_ARENA_BYTES_TO_COMMIT_AT_A_TIME);
+				arenaFaultCount++;
+				return true;
+			}
+			break;
 		}
 	}
-	return result;
+	return false;
+}
+
+// Touches numBytes of stack below the caller and locks it, so the thread never takes a fault growing or paging in its stack later.
+// numBytes has to leave room within the thread's reserved stack size for everything the caller goes on to do
+NOINLINE B32 prefault_and_lock_stack(U32 numBytes) {
+	// _alloca probes every page on the way down, which walks the guard page and commits the lot. Linux grows the main stack on touch and maps thread stacks up front, so the loop is enough there
+	volatile U8* stack = reinterpret_cast<volatile U8*>(STACK_ALLOC(numBytes));
+	for (U32 i = 0; i < numBytes; i += PAGE_SIZE) {
+		stack[i] = 0;
+	}
+	return lock_memory(const_cast<U8*>(stack), numBytes);
 }
 
 B32 drill_lib_init() {
-	LARGE_INTEGER perfFreq;
-	if (!QueryPerformanceFrequency(&perfFreq)) {
+	if (!init_performance_counter()) {
 		abort("Could not get performance counter frequency");
 	}
-	performanceCounterTimerFrequency = U64(perfFreq.QuadPart);
 
-	consoleOutput = CreateFileA("CON", GENERIC_WRITE, FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
-	AddVectoredExceptionHandler(1, page_fault_handler);
+	consoleOutput = open_console_output();
+	install_page_fault_handler(arena_page_fault_handler);
 	if (!scratchArena0.init(1 * GIGABYTE)) {
 		return false;
 	}
@@ -934,4 +1142,24 @@ B32 drill_lib_init() {
 		return false;
 	}
 	return true;
+}
+
+// Sets up the thread local arenas for a thread other than the main one. Fault handling already works per thread, since the handler runs on the faulting thread
+B32 drill_lib_init_thread() {
+	if (!scratchArena0.init(1 * GIGABYTE)) {
+		return false;
+	}
+	if (!scratchArena1.init(1 * GIGABYTE)) {
+		return false;
+	}
+	if (!audioArena.init(1 * GIGABYTE)) {
+		return false;
+	}
+	return true;
+}
+
+void drill_lib_destroy_thread() {
+	scratchArena0.destroy();
+	scratchArena1.destroy();
+	audioArena.destroy();
 }
\ No newline at end of file
@@ -6,7 +6,9 @@
 // Use FINLINE for small functions that are called often and probably don't need to be stepped into for debugging
 // Usually used in conjunction with DEBUG_OPTIMIZE macros to make sure they're optimized even in debug mode
 // For things I've tested with, this can result in an order of magnitude of speed improvement (though still not as good as release mode)
+#ifdef _MSC_VER
 #define FINLINE __inline __forceinline
+#define NOINLINE __declspec(noinline)
 #ifndef NDEBUG
 // t means optimize for speed
 #define DEBUG_OPTIMIZE_ON __pragma(optimize("t", on))
@@ -16,6 +18,18 @@
 #define DEBUG_OPTIMIZE_ON
 #define DEBUG_OPTIMIZE_OFF
 #endif
+// Suppress "hides previous local declaration", intended behavior for the loop macros below
+#define SUPPRESS_SHADOW_WARNING __pragma(warning(suppress : 4456))
+#define DEBUG_BREAK() __debugbreak()
+#else
+// GCC and clang have no per function optimize toggle that works like MSVC's, debug builds on them are just slower
+#define FINLINE inline __attribute__((always_inline))
+#define NOINLINE __attribute__((noinline))
+#define DEBUG_OPTIMIZE_ON
+#define DEBUG_OPTIMIZE_OFF
+#define SUPPRESS_SHADOW_WARNING
+#define DEBUG_BREAK() __builtin_trap()
+#endif
 #define NODISCARD [[nodiscard]]
 
 #define KILOBYTE 1024
@@ -31,11 +45,10 @@
 #define ALIGN_HIGH(num, alignment) (((num) + (static_cast<decltype(num)>(alignment) - 1)) & ~(static_cast<decltype(num)>(alignment) - 1))
 #define OFFSET_OF(type, member) __builtin_offsetof(type, member) //(reinterpret_cast<uptr>(&reinterpret_cast<type*>(uptr(0))->member))
 
-// Suppress "hides previous local declaration", intended behavior for this construct
-#define DEFER_LOOP(before, after) __pragma(warning(suppress : 4456))\
+#define DEFER_LOOP(before, after) SUPPRESS_SHADOW_WARNING\
 	for (U32 DEFER_LOOP_I = ((before), 0u); DEFER_LOOP_I == 0u; DEFER_LOOP_I++, (after))
 
-#define LOG_TIME(str) __pragma(warning(suppress : 4456))\
+#define LOG_TIME(str) SUPPRESS_SHADOW_WARNING\
 	for (F64 LOG_TIME_TIME = current_time_seconds(), LOG_TIME_I = 0.0; LOG_TIME_I == 0.0; print(str), println_float(F32(current_time_seconds() - LOG_TIME_TIME)), LOG_TIME_I = 1.0)
 
 // DLL because I don't want to type DOUBLY_LINKED_LIST every time
@@ -46,7 +59,7 @@
 
 #define ASSERT(cond, msg) if(!(cond)) { abort(msg); }
 #ifndef NDEBUG
-#define DEBUG_ASSERT(cond, msg) if(!(cond)) { __debugbreak(); abort(msg); }
+#define DEBUG_ASSERT(cond, msg) if(!(cond)) { DEBUG_BREAK(); abort(msg); }
 #else
 #define DEBUG_ASSERT
 #endif
@@ -72,6 +85,7 @@
 
 #define DRILL_LIB_VERSION DRILL_LIB_MAKE_VERSION(1, 2, 0)
 
+#ifdef _MSC_VER
 typedef signed __int8 I8;
 typedef unsigned __int8 U8;
 typedef signed __int16 I16;
@@ -80,6 +94,16 @@ typedef signed __int32 I32;
 typedef unsigned __int32 U32;
 typedef signed __int64 I64;
 typedef unsigned __int64 U64;
+#else
+typedef signed char I8;
+typedef unsigned char U8;
+typedef signed short I16;
+typedef unsigned short U16;
+typedef signed int I32;
+typedef unsigned int U32;
+typedef signed long long I64;
+typedef unsigned long long U64;
+#endif
 typedef U64 UPtr;
 typedef U8 Byte;
 typedef float F32;
@@ -111,7 +135,13 @@ typedef U32 Flags32;
 #define F64_QNAN (__builtin_bit_cast(F64, 0x7FFFFFFFFFFFFFFFull))
 #define F64_SNAN (__builtin_bit_cast(F64, 0x7FF7FFFFFFFFFFFFull))
 
+// glibc's stdint.h declares the 64 bit ones as long, which would clash with these, so everywhere else just gets the real header
+#ifdef _MSC_VER
 #define DRILL_LIB_REDECLARE_STDINT
+#else
+#include <stdint.h>
+#include <stddef.h>
+#endif
 #ifdef DRILL_LIB_REDECLARE_STDINT
 typedef I8 int8_t;
 typedef U8 uint8_t;
@@ -150,6 +180,46 @@ FINLINE void store_le32(void* ptr, U32 val) {
 FINLINE void store_le64(void* ptr, U64 val) {
 	memcpy(ptr, &val, sizeof(U64));
 }
+// MSVC has big endian loads and stores as intrinsics (movbe), everything else gets a byte swap
+#ifdef _MSC_VER
+FINLINE U16 load_be16(void* ptr) {
+	return _load_be_u16(ptr);
+}
+FINLINE U32 load_be32(void* ptr) {
+	return _load_be_u32(ptr);
+}
+FINLINE U64 load_be64(void* ptr) {
+	return _load_be_u64(ptr);
+}
+FINLINE void store_be16(void* ptr, U16 val) {
+	_store_be_u16(ptr, val);
+}
+FINLINE void store_be32(void* ptr, U32 val) {
+	_store_be_u32(ptr, val);
+}
+FINLINE void store_be64(void* ptr, U64 val) {
+	_store_be_u64(ptr, val);
+}
+#else
+FINLINE U16 load_be16(void* ptr) {
+	return __builtin_bswap16(load_le16(ptr));
+}
+FINLINE U32 load_be32(void* ptr) {
+	return __builtin_bswap32(load_le32(ptr));
+}
+FINLINE U64 load_be64(void* ptr) {
+	return __builtin_bswap64(load_le64(ptr));
+}
+FINLINE void store_be16(void* ptr, U16 val) {
+	store_le16(ptr, __builtin_bswap16(val));
+}
+FINLINE void store_be32(void* ptr, U32 val) {
+	store_le32(ptr, __builtin_bswap32(val));
+}
+FINLINE void store_be64(void* ptr, U64 val) {
+	store_le64(ptr, __builtin_bswap64(val));
+}
+#endif
 
 DEBUG_OPTIMIZE_OFF
 
@@ -162,13 +232,13 @@ DEBUG_OPTIMIZE_OFF
 #define STORE_LE32(ptr, val) (store_le32((ptr), (val)))
 #define STORE_LE64(ptr, val) (store_le64((ptr), (val)))
 #define LOAD_BE8(ptr) (*reinterpret_cast<U8*>(ptr))
-#define LOAD_BE16(ptr) (_load_be_u16((ptr)))
-#define LOAD_BE32(ptr) (_load_be_u32((ptr)))
-#define LOAD_BE64(ptr) (_load_be_u64((ptr)))
+#define LOAD_BE16(ptr) (load_be16((ptr)))
+#define LOAD_BE32(ptr) (load_be32((ptr)))
+#define LOAD_BE64(ptr) (load_be64((ptr)))
 #define STORE_BE8(ptr, val) (*reinterpret_cast<U8*>(ptr) = (val))
-#define STORE_BE16(ptr, val) (_store_be_u16((ptr), (val)))
-#define STORE_BE32(ptr, val) (_store_be_u32((ptr), (val)))
-#define STORE_BE64(ptr, val) (_store_be_u64((ptr), (val)))
+#define STORE_BE16(ptr, val) (store_be16((ptr), (val)))
+#define STORE_BE32(ptr, val) (store_be32((ptr), (val)))
+#define STORE_BE64(ptr, val) (store_be64((ptr), (val)))
 
 
 void print(const char* str);
@@ -0,0 +1,598 @@
+#pragma once
+#include "DrillLibDefs.h"
+#include "DrillMath.h"
+#ifdef _WIN32
+// WIN32_LEAN_AND_MEAN leaves the common dialogs out of Windows.h
+#include <commdlg.h>
+#else
+#include <alloca.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// Everything DrillLib and the engine need from the OS, once for Win32 and once for POSIX. Nothing outside this file should have to care which one it's on,
+// apart from the windowing and audio device code that's platform specific anyway.
+// These are thin on purpose: they report failure and leave printing and giving up to the caller, same as the Win32 calls they replaced
+
+#ifdef _WIN32
+#define STACK_ALLOC(numBytes) _alloca(numBytes)
+#else
+#define STACK_ALLOC(numBytes) alloca(numBytes)
+#endif
+
+// Error code from the last platform call that failed, GetLastError or errno
+FINLINE U32 last_platform_error() {
+#ifdef _WIN32
+	return U32(GetLastError());
+#else
+	return U32(errno);
+#endif
+}
+
+[[noreturn]] FINLINE void exit_process(U32 exitCode) {
+#ifdef _WIN32
+	ExitProcess(exitCode);
+#else
+	_exit(int(exitCode));
+#endif
+}
+
+// Virtual memory
+
+// Address space only. Touching it faults until it's been committed
+void* reserve_memory(U64 numBytes) {
+#ifdef _WIN32
+	return VirtualAlloc(nullptr, numBytes, MEM_RESERVE, PAGE_READWRITE);
+#else
+	void* memory = mmap(nullptr, numBytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	return memory == MAP_FAILED ? nullptr : memory;
+#endif
+}
+
+// Backs reserved pages with memory, readable and writable
+B32 commit_memory(void* address, U64 numBytes) {
+#ifdef _WIN32
+	return VirtualAlloc(address, numBytes, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+	return mprotect(address, numBytes, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+// Reserves and commits in one go, for memory that's going to be used right away
+void* alloc_pages(U64 numBytes) {
+#ifdef _WIN32
+	return VirtualAlloc(nullptr, numBytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+	void* memory = mmap(nullptr, numBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return memory == MAP_FAILED ? nullptr : memory;
+#endif
+}
+
+// address and numBytes have to be exactly what reserve_memory or alloc_pages gave back
+void release_memory(void* address, U64 numBytes) {
+#ifdef _WIN32
+	VirtualFree(address, 0, MEM_RELEASE);
+#else
+	munmap(address, numBytes);
+#endif
+}
+
+// Committed pages become read only and executable. For generated code, which has to be written before it can be run
+B32 make_executable(void* address, U64 numBytes) {
+#ifdef _WIN32
+	DWORD oldProtect;
+	if (!VirtualProtect(address, numBytes, PAGE_EXECUTE_READ, &oldProtect)) {
+		return false;
+	}
+	FlushInstructionCache(GetCurrentProcess(), address, numBytes);
+	return true;
+#else
+	// x86 keeps the instruction cache coherent by itself, there's nothing to flush
+	return mprotect(address, numBytes, PROT_READ | PROT_EXEC) == 0;
+#endif
+}
+
+// Keeps committed pages in physical memory, so touching them never faults, not even to page back in
+B32 lock_memory(void* address, U64 numBytes) {
+#ifdef _WIN32
+	return VirtualLock(address, numBytes);
+#else
+	return mlock(address, numBytes) == 0;
+#endif
+}
+
+// Locking is capped per process, by the working set minimum on Windows and RLIMIT_MEMLOCK everywhere else. This raises the cap by however much more is going to be locked.
+// A POSIX process can only raise its soft limit as far as the hard limit, past that it needs privileges
+B32 grow_lockable_memory(U64 additionalBytes) {
+#ifdef _WIN32
+	SIZE_T minimumSize, maximumSize;
+	if (!GetProcessWorkingSetSize(GetCurrentProcess(), &minimumSize, &maximumSize)) {
+		return false;
+	}
+	return SetProcessWorkingSetSize(GetCurrentProcess(), minimumSize + additionalBytes, maximumSize + additionalBytes);
+#else
+	rlimit limit;
+	if (getrlimit(RLIMIT_MEMLOCK, &limit) != 0) {
+		return false;
+	}
+	if (limit.rlim_cur == RLIM_INFINITY) {
+		return true;
+	}
+	limit.rlim_cur = limit.rlim_max == RLIM_INFINITY ? limit.rlim_cur + additionalBytes : min<U64>(limit.rlim_cur + additionalBytes, limit.rlim_max);
+	return setrlimit(RLIMIT_MEMLOCK, &limit) == 0;
+#endif
+}
+
+// Called with the address of any access violation. Returns whether it committed memory there, in which case the access is retried
+typedef B32 (*PageFaultCallback)(UPtr address);
+PageFaultCallback pageFaultCallback;
+
+#ifdef _WIN32
+LONG WINAPI win32_page_fault_handler(PEXCEPTION_POINTERS exceptionPointers) {
+	LONG result = EXCEPTION_CONTINUE_SEARCH;
+	if (exceptionPointers->ExceptionRecord->ExceptionCode == EXCEPTION_ACCESS_VIOLATION) {
+		// https://learn.microsoft.com/en-us/windows/win32/api/winnt/ns-winnt-exception_record
+		// For EXCEPTION_ACCESS_VIOLATION
+		// ExceptionInformation[0] contains 0 if read, 1 if write
+		// ExceptionInformation[1] contains the virtual address accessed
+		if (pageFaultCallback(UPtr(exceptionPointers->ExceptionRecord->ExceptionInformation[1]))) {
+			result = EXCEPTION_CONTINUE_EXECUTION;
+		}
+	}
+	return result;
+}
+#else
+struct sigaction previousPageFaultAction;
+
+void posix_page_fault_handler(int signal, siginfo_t* info, void*) {
+	if (pageFaultCallback(UPtr(info->si_addr))) {
+		return;
+	}
+	// Not ours. Putting the old handler back and returning runs the access again, which faults into whatever would have handled it without us
+	sigaction(signal, &previousPageFaultAction, nullptr);
+}
+#endif
+
+// Runs on the faulting thread, so the callback can look at that thread's thread locals
+B32 install_page_fault_handler(PageFaultCallback callback) {
+	pageFaultCallback = callback;
+#ifdef _WIN32
+	return AddVectoredExceptionHandler(1, win32_page_fault_handler) != nullptr;
+#else
+	struct sigaction action{};
+	action.sa_sigaction = posix_page_fault_handler;
+	action.sa_flags = SA_SIGINFO;
+	sigemptyset(&action.sa_mask);
+	return sigaction(SIGSEGV, &action, &previousPageFaultAction) == 0;
+#endif
+}
+
+// Heap, for things that get resized or freed on their own schedule rather than an arena's
+
+FINLINE void* heap_alloc(U64 numBytes) {
+#ifdef _WIN32
+	return HeapAlloc(GetProcessHeap(), 0, numBytes);
+#else
+	return malloc(numBytes);
+#endif
+}
+
+FINLINE void* heap_zalloc(U64 numBytes) {
+#ifdef _WIN32
+	return HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, numBytes);
+#else
+	return calloc(1, numBytes);
+#endif
+}
+
+// Null on failure, and the original is left alone then, same as HeapReAlloc
+FINLINE void* heap_realloc(void* memory, U64 numBytes) {
+#ifdef _WIN32
+	return HeapReAlloc(GetProcessHeap(), 0, memory, numBytes);
+#else
+	return realloc(memory, numBytes);
+#endif
+}
+
+FINLINE void heap_free(void* memory) {
+#ifdef _WIN32
+	HeapFree(GetProcessHeap(), 0, memory);
+#else
+	free(memory);
+#endif
+}
+
+// Atomics. Loads and stores are plain volatile accesses with no fences, which is all x86 needs as long as the compiler doesn't reorder around them.
+// compiler_barrier is how to stop it doing that
+
+FINLINE void compiler_barrier() {
+#ifdef _MSC_VER
+	_ReadWriteBarrier();
+#else
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+FINLINE I32 atomic_load32(const volatile I32* src) {
+#ifdef _MSC_VER
+	return __iso_volatile_load32(reinterpret_cast<const volatile int*>(src));
+#else
+	return __atomic_load_n(src, __ATOMIC_RELAXED);
+#endif
+}
+
+FINLINE void atomic_store32(volatile I32* dst, I32 value) {
+#ifdef _MSC_VER
+	__iso_volatile_store32(reinterpret_cast<volatile int*>(dst), value);
+#else
+	__atomic_store_n(dst, value, __ATOMIC_RELAXED);
+#endif
+}
+
+FINLINE I64 atomic_load64(const volatile I64* src) {
+#ifdef _MSC_VER
+	return __iso_volatile_load64(reinterpret_cast<const volatile __int64*>(src));
+#else
+	return __atomic_load_n(src, __ATOMIC_RELAXED);
+#endif
+}
+
+FINLINE void atomic_store64(volatile I64* dst, I64 value) {
+#ifdef _MSC_VER
+	__iso_volatile_store64(reinterpret_cast<volatile __int64*>(dst), value);
+#else
+	__atomic_store_n(dst, value, __ATOMIC_RELAXED);
+#endif
+}
+
+// Same argument order as _InterlockedCompareExchange. Returns what was there before, so it worked if that's comparand
+FINLINE I32 atomic_compare_exchange32(volatile I32* dst, I32 exchange, I32 comparand) {
+#ifdef _MSC_VER
+	return _InterlockedCompareExchange(reinterpret_cast<volatile long*>(dst), exchange, comparand);
+#else
+	return __sync_val_compare_and_swap(dst, comparand, exchange);
+#endif
+}
+
+// Returns the new value
+FINLINE I32 atomic_increment32(volatile I32* dst) {
+#ifdef _MSC_VER
+	return _InterlockedIncrement(reinterpret_cast<volatile long*>(dst));
+#else
+	return __sync_add_and_fetch(dst, 1);
+#endif
+}
+
+// Returns the new value
+FINLINE I32 atomic_decrement32(volatile I32* dst) {
+#ifdef _MSC_VER
+	return _InterlockedDecrement(reinterpret_cast<volatile long*>(dst));
+#else
+	return __sync_sub_and_fetch(dst, 1);
+#endif
+}
+
+// Returns the value from before the add
+FINLINE I64 atomic_fetch_add64(volatile I64* dst, I64 value) {
+#ifdef _MSC_VER
+	return _InterlockedExchangeAdd64(reinterpret_cast<volatile __int64*>(dst), value);
+#else
+	return __sync_fetch_and_add(dst, value);
+#endif
+}
+
+// Files
+
+#ifdef _WIN32
+typedef HANDLE FileHandle;
+#define FILE_HANDLE_INVALID INVALID_HANDLE_VALUE
+#else
+typedef int FileHandle;
+#define FILE_HANDLE_INVALID (-1)
+#endif
+
+FileHandle open_file_read(const char* path) {
+#ifdef _WIN32
+	return CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+#else
+	return open(path, O_RDONLY | O_CLOEXEC);
+#endif
+}
+
+// Creates the file, or empties it if it's already there
+FileHandle open_file_write(const char* path) {
+#ifdef _WIN32
+	return CreateFileA(path, GENERIC_WRITE, FILE_SHARE_WRITE, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+#else
+	return open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+}
+
+// Where print goes
+FileHandle open_console_output() {
+#ifdef _WIN32
+	return CreateFileA("CON", GENERIC_WRITE, FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+#else
+	return STDOUT_FILENO;
+#endif
+}
+
+U64 file_size(FileHandle file) {
+#ifdef _WIN32
+	LARGE_INTEGER size;
+	return GetFileSizeEx(file, &size) ? U64(size.QuadPart) : 0;
+#else
+	struct stat status;
+	return fstat(file, &status) == 0 ? U64(status.st_size) : 0;
+#endif
+}
+
+// Reads until numBytes are in or the file ends. numBytesRead is how far it got either way
+B32 read_file(FileHandle file, void* dst, U32 numBytes, U32* numBytesRead) {
+#ifdef _WIN32
+	DWORD bytesRead = 0;
+	BOOL success = ReadFile(file, dst, numBytes, &bytesRead, NULL);
+	*numBytesRead = bytesRead;
+	return success;
+#else
+	U32 total = 0;
+	while (total < numBytes) {
+		ssize_t result = read(file, reinterpret_cast<U8*>(dst) + total, numBytes - total);
+		if (result < 0 && errno == EINTR) {
+			continue;
+		}
+		if (result <= 0) {
+			*numBytesRead = total;
+			return result == 0;
+		}
+		total += U32(result);
+	}
+	*numBytesRead = total;
+	return true;
+#endif
+}
+
+B32 write_file(FileHandle file, const void* src, U64 numBytes) {
+#ifdef _WIN32
+	DWORD bytesWritten = 0;
+	return WriteFile(file, src, DWORD(numBytes), &bytesWritten, NULL) && bytesWritten == numBytes;
+#else
+	U64 total = 0;
+	while (total < numBytes) {
+		ssize_t result = write(file, reinterpret_cast<const U8*>(src) + total, numBytes - total);
+		if (result < 0 && errno == EINTR) {
+			continue;
+		}
+		if (result <= 0) {
+			return false;
+		}
+		total += U64(result);
+	}
+	return true;
+#endif
+}
+
+void close_file(FileHandle file) {
+#ifdef _WIN32
+	CloseHandle(file);
+#else
+	close(file);
+#endif
+}
+
+// The native open dialog. pathBuffer gets the chosen path, filter is in the OPENFILENAME format, pairs of description and pattern ending in an extra \0.
+// Returns false if nothing was picked. There's no window system to ask without Win32, so it always says no there and files have to come from elsewhere (project files, the command line)
+B32 open_file_dialog(char* pathBuffer, U32 pathCapacity, const char* filter) {
+#ifdef _WIN32
+	OPENFILENAMEA fileDialogOptions{};
+	fileDialogOptions.lStructSize = sizeof(fileDialogOptions);
+	// Only ever opened in response to a click, so the active window is ours
+	fileDialogOptions.hwndOwner = GetActiveWindow();
+	fileDialogOptions.hInstance = GetModuleHandleA(NULL);
+	fileDialogOptions.lpstrFilter = filter;
+	fileDialogOptions.lpstrFile = pathBuffer;
+	fileDialogOptions.nMaxFile = pathCapacity;
+	return GetOpenFileNameA(&fileDialogOptions);
+#else
+	return false;
+#endif
+}
+
+// Runs commandLine and waits for it to finish. On Windows programPath is the executable and commandLine its whole command line,
+// everywhere else commandLine goes to the shell
+B32 run_process_and_wait(U32* exitCodeOut, const char* programPath, char* commandLine) {
+#ifdef _WIN32
+	STARTUPINFOA startupInfo{};
+	startupInfo.cb = sizeof(STARTUPINFOA);
+	PROCESS_INFORMATION procInfo{};
+	if (!CreateProcessA(programPath, commandLine, NULL, NULL, FALSE, 0, NULL, NULL, &startupInfo, &procInfo)) {
+		return false;
+	}
+	WaitForSingleObject(procInfo.hProcess, INFINITE);
+	DWORD exitCode;
+	*exitCodeOut = GetExitCodeProcess(procInfo.hProcess, &exitCode) ? U32(exitCode) : U32(-1);
+	CloseHandle(procInfo.hProcess);
+	CloseHandle(procInfo.hThread);
+	return true;
+#else
+	pid_t child = fork();
+	if (child < 0) {
+		return false;
+	}
+	if (child == 0) {
+		execl("/bin/sh", "sh", "-c", commandLine, static_cast<char*>(nullptr));
+		_exit(127);
+	}
+	int status;
+	while (waitpid(child, &status, 0) < 0) {
+		if (errno != EINTR) {
+			return false;
+		}
+	}
+	*exitCodeOut = WIFEXITED(status) ? U32(WEXITSTATUS(status)) : U32(-1);
+	return true;
+#endif
+}
+
+// Threads
+
+typedef U32 (*ThreadProc)(void* param);
+#ifdef _WIN32
+typedef HANDLE ThreadHandle;
+#else
+typedef pthread_t ThreadHandle;
+#endif
+
+struct ThreadStart {
+	ThreadProc proc;
+	void* param;
+};
+
+#ifdef _WIN32
+DWORD WINAPI win32_thread_start(LPVOID param) {
+	ThreadStart start = *reinterpret_cast<ThreadStart*>(param);
+	heap_free(param);
+	return start.proc(start.param);
+}
+#else
+void* posix_thread_start(void* param) {
+	ThreadStart start = *reinterpret_cast<ThreadStart*>(param);
+	heap_free(param);
+	return reinterpret_cast<void*>(UPtr(start.proc(start.param)));
+}
+#endif
+
+// stackSize 0 means the platform default. Windows only commits that much up front and grows from there,
+// POSIX reserves the whole thing at once, so there it only ever raises the default, never shrinks it
+B32 create_thread(ThreadHandle* threadOut, ThreadProc proc, void* param, U64 stackSize) {
+	ThreadStart* start = reinterpret_cast<ThreadStart*>(heap_alloc(sizeof(ThreadStart)));
+	if (!start) {
+		return false;
+	}
+	start->proc = proc;
+	start->param = param;
+#ifdef _WIN32
+	*threadOut = CreateThread(NULL, stackSize, win32_thread_start, start, 0, NULL);
+	B32 success = *threadOut != NULL;
+#else
+	pthread_attr_t attributes;
+	pthread_attr_init(&attributes);
+	size_t defaultStackSize;
+	if (pthread_attr_getstacksize(&attributes, &defaultStackSize) == 0 && stackSize > defaultStackSize) {
+		pthread_attr_setstacksize(&attributes, stackSize);
+	}
+	int error = pthread_create(threadOut, &attributes, posix_thread_start, start);
+	pthread_attr_destroy(&attributes);
+	if (error) {
+		errno = error;
+	}
+	B32 success = error == 0;
+#endif
+	if (!success) {
+		heap_free(start);
+	}
+	return success;
+}
+
+// Waits for the thread to finish and cleans it up. Returns what its ThreadProc returned
+U32 join_thread(ThreadHandle thread) {
+#ifdef _WIN32
+	WaitForSingleObject(thread, INFINITE);
+	DWORD exitCode = 0;
+	GetExitCodeThread(thread, &exitCode);
+	CloseHandle(thread);
+	return U32(exitCode);
+#else
+	void* exitCode = nullptr;
+	pthread_join(thread, &exitCode);
+	return U32(reinterpret_cast<UPtr>(exitCode));
+#endif
+}
+
+FINLINE void yield_thread() {
+#ifdef _WIN32
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
+
+// Logical processors the OS will run threads on, never less than 1
+U32 processor_count() {
+#ifdef _WIN32
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	return max<U32>(systemInfo.dwNumberOfProcessors, 1);
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? U32(count) : 1;
+#endif
+}
+
+// Clocks and sleeping
+
+// Ticks of the highest resolution monotonic clock there is. performanceCounterTimerFrequency of them make a second
+U64 performanceCounterTimerFrequency;
+
+FINLINE U64 performance_counter() {
+#ifdef _WIN32
+	LARGE_INTEGER perfCounter;
+	QueryPerformanceCounter(&perfCounter);
+	return U64(perfCounter.QuadPart);
+#else
+	timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return U64(time.tv_sec) * 1000000000ull + U64(time.tv_nsec);
+#endif
+}
+
+B32 init_performance_counter() {
+#ifdef _WIN32
+	LARGE_INTEGER perfFreq;
+	if (!QueryPerformanceFrequency(&perfFreq)) {
+		return false;
+	}
+	performanceCounterTimerFrequency = U64(perfFreq.QuadPart);
+#else
+	// The counter is CLOCK_MONOTONIC in nanoseconds
+	performanceCounterTimerFrequency = 1000000000ull;
+#endif
+	return true;
+}
+
+U64 monotonic_nanoseconds() {
+	U64 counter = performance_counter();
+	return counter / performanceCounterTimerFrequency * 1000000000ull + counter % performanceCounterTimerFrequency * 1000000000ull / performanceCounterTimerFrequency;
+}
+
+void sleep_milliseconds(U32 milliseconds) {
+#ifdef _WIN32
+	Sleep(milliseconds);
+#else
+	timespec duration{ time_t(milliseconds / 1000), long(milliseconds % 1000) * 1000000l };
+	while (nanosleep(&duration, &duration) == -1 && errno == EINTR);
+#endif
+}
+
+// Windows can only sleep in whole milliseconds, so it wakes up to a millisecond early there
+void sleep_until_nanoseconds(U64 wakeTimeNanoseconds) {
+#ifdef _WIN32
+	U64 now = monotonic_nanoseconds();
+	if (wakeTimeNanoseconds > now) {
+		Sleep(DWORD((wakeTimeNanoseconds - now) / 1000000));
+	}
+#else
+	timespec wakeTime{ time_t(wakeTimeNanoseconds / 1000000000ull), long(wakeTimeNanoseconds % 1000000000ull) };
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeTime, nullptr) == EINTR);
+#endif
+}
@@ -1,8 +1,25 @@
 #pragma once
+#ifdef _MSC_VER
 #include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
 #include <immintrin.h>
 #include "DrillLibDefs.h"
 
+#ifndef _MSC_VER
+// MSVC's names for the rounding immediates, 32 bit lzcnt and the 64x64 multiply
+#define _MM_ROUND_MODE_DOWN _MM_FROUND_TO_NEG_INF
+#define _MM_ROUND_MODE_UP _MM_FROUND_TO_POS_INF
+#define _MM_ROUND_MODE_TOWARD_ZERO _MM_FROUND_TO_ZERO
+#define __lzcnt __lzcnt32
+inline unsigned long long _umul128(unsigned long long a, unsigned long long b, unsigned long long* high) {
+	unsigned __int128 product = (unsigned __int128)a * b;
+	*high = (unsigned long long)(product >> 64);
+	return (unsigned long long)product;
+}
+#endif
+
 DEBUG_OPTIMIZE_ON
 
 // The cos approximation is more accurate than the sin one I generated (gentler curve over [0, 0.5) I guess), so we can just use it for sin as well
@@ -11,6 +28,8 @@ DEBUG_OPTIMIZE_ON
 // This isn't a particularly good polynomial approximation in general, but it's good enough for me.
 // It's a good bit faster than the microsoft standard library implementation while trading off some accuracy, which is a win for me.
 // This paper should provide some info on how to make it better if I need it (https://arxiv.org/pdf/1508.03211.pdf)
+// The coefficients are in tables so the expression JIT can emit the exact same kernels
+const F32 COS_POLY[6]{ 1.00010812282562255859375F, -1.79444365203380584716796875e-2F, -19.2416629791259765625F, -5.366222381591796875F, 93.06533050537109375F, -74.45227813720703125F };
 
 FINLINE __m128 cosf32x4(__m128 xmmX) {
 	__m128 xRoundedDown = _mm_round_ps(xmmX, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
@@ -19,11 +38,11 @@ FINLINE __m128 cosf32x4(__m128 xmmX) {
 	__m128 xIn0to1MinusPoint5 = _mm_sub_ps(xIn0to1, point5);
 	__m128 isGreaterThanPoint5 = _mm_cmpge_ps(xIn0to1, point5);
 	__m128 xInRange0ToPoint5 = _mm_blendv_ps(xIn0to1, xIn0to1MinusPoint5, isGreaterThanPoint5);
-	__m128 sinApprox = _mm_fmadd_ps(xInRange0ToPoint5, _mm_set_ps1(-74.45227813720703125F), _mm_set_ps1(93.06533050537109375F));
-	sinApprox = _mm_fmadd_ps(xInRange0ToPoint5, sinApprox, _mm_set_ps1(-5.366222381591796875F));
-	sinApprox = _mm_fmadd_ps(xInRange0ToPoint5, sinApprox, _mm_set_ps1(-19.2416629791259765625F));
-	sinApprox = _mm_fmadd_ps(xInRange0ToPoint5, sinApprox, _mm_set_ps1(-1.79444365203380584716796875e-2F));
-	sinApprox = _mm_fmadd_ps(xInRange0ToPoint5, sinApprox, _mm_set_ps1(1.00010812282562255859375F));
+	__m128 sinApprox = _mm_fmadd_ps(xInRange0ToPoint5, _mm_set_ps1(COS_POLY[5]), _mm_set_ps1(COS_POLY[4]));
+	sinApprox = _mm_fmadd_ps(xInRange0ToPoint5, sinApprox, _mm_set_ps1(COS_POLY[3]));
+	sinApprox = _mm_fmadd_ps(xInRange0ToPoint5, sinApprox, _mm_set_ps1(COS_POLY[2]));
+	sinApprox = _mm_fmadd_ps(xInRange0ToPoint5, sinApprox, _mm_set_ps1(COS_POLY[1]));
+	sinApprox = _mm_fmadd_ps(xInRange0ToPoint5, sinApprox, _mm_set_ps1(COS_POLY[0]));
 	__m128 sinApproxFlipped = _mm_sub_ps(_mm_setzero_ps(), sinApprox);
 	sinApprox = _mm_blendv_ps(sinApprox, sinApproxFlipped, isGreaterThanPoint5);
 	return sinApprox;
@@ -81,6 +100,68 @@ FINLINE __m128 atan2f32x4(__m128 xmmY, __m128 xmmX) {
 	return _mm_add_ps(_mm_blendv_ps(_mm_set_ps1(0.25F), _mm_set_ps1(0.75F), isInLowerHalf), atanResult);
 }
 
+// Split into integer and fractional part, Taylor series for 2^f on [-0.5, 0.5], then put the integer part straight into the exponent bits
+// Worst case relative error is around 2e-7. Inputs are clamped to the normal range, so this never makes denormals or infinities
+const F32 EXP2_POLY[7]{ 1.0F, 0.69314718055994531F, 0.24022650695910071F, 5.5504108664821580e-2F, 9.6181291076284772e-3F, 1.3333558146428443e-3F, 1.5403530393381609e-4F };
+const F32 EXP2_MIN_INPUT = -125.0F;
+const F32 EXP2_MAX_INPUT = 127.0F;
+const F32 LOG2_E_F32 = 1.4426950408889634F;
+const F32 LN_2_F32 = 0.69314718055994531F;
+FINLINE __m128 exp2f32x4(__m128 xmmX) {
+	xmmX = _mm_min_ps(_mm_max_ps(xmmX, _mm_set_ps1(EXP2_MIN_INPUT)), _mm_set_ps1(EXP2_MAX_INPUT));
+	__m128 xRounded = _mm_round_ps(xmmX, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+	__m128 f = _mm_sub_ps(xmmX, xRounded);
+	__m128 expApprox = _mm_fmadd_ps(f, _mm_set_ps1(EXP2_POLY[6]), _mm_set_ps1(EXP2_POLY[5]));
+	expApprox = _mm_fmadd_ps(f, expApprox, _mm_set_ps1(EXP2_POLY[4]));
+	expApprox = _mm_fmadd_ps(f, expApprox, _mm_set_ps1(EXP2_POLY[3]));
+	expApprox = _mm_fmadd_ps(f, expApprox, _mm_set_ps1(EXP2_POLY[2]));
+	expApprox = _mm_fmadd_ps(f, expApprox, _mm_set_ps1(EXP2_POLY[1]));
+	expApprox = _mm_fmadd_ps(f, expApprox, _mm_set_ps1(EXP2_POLY[0]));
+	__m128i exponent = _mm_slli_epi32(_mm_cvtps_epi32(xRounded), 23);
+	return _mm_castsi128_ps(_mm_add_epi32(_mm_castps_si128(expApprox), exponent));
+}
+// Mantissa gets shifted into [sqrt(0.5), sqrt(2)) so the series argument s = (m - 1) / (m + 1) stays under 0.172, then log2(m) = 2/ln(2) * atanh(s)
+// Only meaningful for positive inputs. Zero, denormals and negatives are clamped to the smallest normal, so they come out as -126 instead of -inf or NaN
+// Coefficients of s, s^3, s^5, s^7
+const F32 LOG2_SERIES[4]{ 2.8853900817779268F, 0.96179669392597560F, 0.57707801635558536F, 0.41219858311113240F };
+const U32 SQRT_HALF_F32_BITS = 0x3F3504F3;
+FINLINE __m128 log2f32x4(__m128 xmmX) {
+	__m128i bits = _mm_castps_si128(_mm_max_ps(xmmX, _mm_set_ps1(F32_SMALL)));
+	// Subtracting the bits of sqrt(0.5) makes the exponent roll over right where the mantissa passes sqrt(2)
+	__m128i offsetBits = _mm_sub_epi32(bits, _mm_set1_epi32(SQRT_HALF_F32_BITS));
+	__m128i exponent = _mm_srai_epi32(offsetBits, 23);
+	__m128 mantissa = _mm_castsi128_ps(_mm_sub_epi32(bits, _mm_slli_epi32(exponent, 23)));
+	__m128 s = _mm_div_ps(_mm_sub_ps(mantissa, _mm_set_ps1(1.0F)), _mm_add_ps(mantissa, _mm_set_ps1(1.0F)));
+	__m128 sSq = _mm_mul_ps(s, s);
+	__m128 logApprox = _mm_fmadd_ps(sSq, _mm_set_ps1(LOG2_SERIES[3]), _mm_set_ps1(LOG2_SERIES[2]));
+	logApprox = _mm_fmadd_ps(sSq, logApprox, _mm_set_ps1(LOG2_SERIES[1]));
+	logApprox = _mm_fmadd_ps(sSq, logApprox, _mm_set_ps1(LOG2_SERIES[0]));
+	return _mm_fmadd_ps(s, logApprox, _mm_cvtepi32_ps(exponent));
+}
+FINLINE __m128 expf32x4(__m128 xmmX) {
+	return exp2f32x4(_mm_mul_ps(xmmX, _mm_set_ps1(LOG2_E_F32)));
+}
+FINLINE __m128 logf32x4(__m128 xmmX) {
+	return _mm_mul_ps(log2f32x4(xmmX), _mm_set_ps1(LN_2_F32));
+}
+// log2 only takes positive inputs, so the magnitude goes through |base| and the sign is put back afterwards.
+// A negative base comes out negative for odd integer exponents and NaN for fractional ones, like the C pow
+FINLINE __m128 powf32x4(__m128 xmmBase, __m128 xmmExponent) {
+	__m128 magnitude = exp2f32x4(_mm_mul_ps(xmmExponent, log2f32x4(_mm_andnot_ps(_mm_set_ps1(-0.0F), xmmBase))));
+	__m128 oddSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_cvtps_epi32(xmmExponent), 31));
+	__m128 fractional = _mm_cmpneq_ps(_mm_round_ps(xmmExponent, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC), xmmExponent);
+	// The magnitude is never negative, so OR sets the sign bit for odd exponents and makes all ones (NaN) for fractional ones
+	__m128 fixup = _mm_and_ps(_mm_cmplt_ps(xmmBase, _mm_setzero_ps()), _mm_or_ps(oddSign, fractional));
+	return _mm_or_ps(magnitude, fixup);
+}
+// tanh(x) = 1 - 2 / (e^2x + 1). Past |x| = 9 it's 1 in float precision anyway, and clamping there keeps the exp from saturating
+const F32 TANH_INPUT_LIMIT = 9.0F;
+FINLINE __m128 tanhf32x4(__m128 xmmX) {
+	xmmX = _mm_min_ps(_mm_max_ps(xmmX, _mm_set_ps1(-TANH_INPUT_LIMIT)), _mm_set_ps1(TANH_INPUT_LIMIT));
+	__m128 exp2x = exp2f32x4(_mm_mul_ps(xmmX, _mm_set_ps1(2.0F * LOG2_E_F32)));
+	return _mm_sub_ps(_mm_set_ps1(1.0F), _mm_div_ps(_mm_set_ps1(2.0F), _mm_add_ps(exp2x, _mm_set_ps1(1.0F))));
+}
+
 FINLINE __m256 cosf32x8(__m256 ymmX) {
 	__m256 xRoundedDown = _mm256_round_ps(ymmX, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
 	__m256 xIn0to1 = _mm256_sub_ps(ymmX, xRoundedDown);
@@ -88,11 +169,11 @@ FINLINE __m256 cosf32x8(__m256 ymmX) {
 	__m256 xIn0to1MinusPoint5 = _mm256_sub_ps(xIn0to1, point5);
 	__m256 isGreaterThanPoint5 = _mm256_cmp_ps(xIn0to1, point5, _CMP_GE_OQ);
 	__m256 xInRange0ToPoint5 = _mm256_blendv_ps(xIn0to1, xIn0to1MinusPoint5, isGreaterThanPoint5);
-	__m256 sinApprox = _mm256_fmadd_ps(xInRange0ToPoint5, _mm256_set1_ps(-74.45227813720703125F), _mm256_set1_ps(93.06533050537109375F));
-	sinApprox = _mm256_fmadd_ps(xInRange0ToPoint5, sinApprox, _mm256_set1_ps(-5.366222381591796875F));
-	sinApprox = _mm256_fmadd_ps(xInRange0ToPoint5, sinApprox, _mm256_set1_ps(-19.2416629791259765625F));
-	sinApprox = _mm256_fmadd_ps(xInRange0ToPoint5, sinApprox, _mm256_set1_ps(-1.79444365203380584716796875e-2F));
-	sinApprox = _mm256_fmadd_ps(xInRange0ToPoint5, sinApprox, _mm256_set1_ps(1.00010812282562255859375F));
+	__m256 sinApprox = _mm256_fmadd_ps(xInRange0ToPoint5, _mm256_set1_ps(COS_POLY[5]), _mm256_set1_ps(COS_POLY[4]));
+	sinApprox = _mm256_fmadd_ps(xInRange0ToPoint5, sinApprox, _mm256_set1_ps(COS_POLY[3]));
+	sinApprox = _mm256_fmadd_ps(xInRange0ToPoint5, sinApprox, _mm256_set1_ps(COS_POLY[2]));
+	sinApprox = _mm256_fmadd_ps(xInRange0ToPoint5, sinApprox, _mm256_set1_ps(COS_POLY[1]));
+	sinApprox = _mm256_fmadd_ps(xInRange0ToPoint5, sinApprox, _mm256_set1_ps(COS_POLY[0]));
 	__m256 sinApproxFlipped = _mm256_sub_ps(_mm256_setzero_ps(), sinApprox);
 	sinApprox = _mm256_blendv_ps(sinApprox, sinApproxFlipped, isGreaterThanPoint5);
 	return sinApprox;
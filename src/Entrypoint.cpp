@@ -1,12 +1,37 @@
 #include "DrillLib.h"
+#ifdef _WIN32
 #include "Win32.h"
 #include "DAWdle.h"
+#endif
+#include "OfflineRender.h"
+#include "HeadlessPlayback.h"
 
 
-int main() {
+int main(int argc, char** argv) {
 	if (!drill_lib_init()) {
 		return EXIT_FAILURE;
 	}
+	if (!AudioDevice::parse_args(&argc, argv)) {
+		AudioDevice::print_args_usage();
+		return EXIT_FAILURE;
+	}
+	if (argc > 1 && strcmp(argv[1], "--render") == 0) {
+		return OfflineRender::run_offline_render(argc - 2, argv + 2);
+	}
+	if (argc > 1 && strcmp(argv[1], "--play") == 0) {
+		return HeadlessPlayback::run_headless_playback(argc - 2, argv + 2);
+	}
+#ifdef _WIN32
+	if (argc > 1 && strcmp(argv[1], "--realtime") == 0) {
+		RealTime::enabled = true;
+	}
 	U32 result = DAWdle::run_dawdle();
 	return result;
-}
\ No newline at end of file
+#else
+	// There's no window outside of Windows, only the headless modes
+	OfflineRender::print_usage();
+	HeadlessPlayback::print_usage();
+	AudioDevice::print_args_usage();
+	return EXIT_FAILURE;
+#endif
+}
@@ -0,0 +1,535 @@
+#pragma once
+#include "DrillLib.h"
+#include "ExpressionParser.h"
+
+// Compiles a ByteProgram to a native AVX2 loop. Where the VM runs each instruction over the whole buffer and round trips every
+// intermediate through memory, this runs the whole program on 4 samples at a time with the VM registers living in ymm registers,
+// so it's about as fast as the same expression written by hand as a kernel.
+// The transcendental functions are the DrillMath kernels emitted inline, with the same ops in the same order, so the JIT and VM agree bit for bit.
+// A loop iteration that's mostly one long kernel is latency bound, so those programs only run about as fast as the VM. The arithmetic ones are where this pays off.
+// The generated code uses the Windows x64 calling convention. On other compilers the function pointer is marked ms_abi so the same code still works.
+namespace tbrs {
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TBRS_JIT_ABI __attribute__((ms_abi))
+#else
+#define TBRS_JIT_ABI
+#endif
+
+typedef void (TBRS_JIT_ABI *JitFunction)(F64* output, const OperandData* variables, U32 length);
+
+// Turning this off makes everything go through the VM, which is handy to check whether a problem is in the JIT
+B32 jitEnabled = true;
+
+struct JitProgram {
+	void* code;
+	U64 codeSize;
+	JitFunction function;
+
+	void init() {
+		code = nullptr;
+		codeSize = 0;
+		function = nullptr;
+	}
+	void destroy() {
+		if (code) {
+			release_memory(code, codeSize);
+		}
+		init();
+	}
+};
+
+// The variable loads hardcode this layout
+static_assert(sizeof(OperandData) == 16 && OFFSET_OF(OperandData, data) == 0 && OFFSET_OF(OperandData, mask) == 8, "JIT variable loads expect a 16 byte OperandData");
+
+enum JitGPR : U32 {
+	RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+	R8, R9, R10, R11, R12, R13, R14, R15
+};
+// The generated function is a leaf that only touches volatile GPRs.
+// rcx = output, r8 = length (both straight from the arguments), r10 = variables, r9 = sample index, rax and r11 are temporaries
+const U32 JIT_OUTPUT = RCX;
+const U32 JIT_LENGTH = R8;
+const U32 JIT_VARIABLES = R10;
+const U32 JIT_INDEX = R9;
+
+// VM registers map straight to ymm0-12. The last three are scratch for materializing constant and variable operands and for the inline kernels
+const U32 JIT_MAX_REGISTERS = 13;
+const U32 JIT_SCRATCH_A = 13;
+const U32 JIT_SCRATCH_B = 14;
+const U32 JIT_SCRATCH_C = 15;
+
+// Stack frame, from rsp after the prologue. Two xmm sized temporaries for the kernels that run out of scratch registers, then the saved xmm6-15
+const I32 JIT_FRAME_KERNEL_TEMP = 0;
+const I32 JIT_FRAME_XMM_SAVE = 32;
+// The return address leaves rsp 8 bytes off 16 byte alignment, so the frame size fixes that up
+const I32 JIT_FRAME_SIZE = JIT_FRAME_XMM_SAVE + 10 * 16 + 8;
+
+const U32 JIT_NO_INDEX = U32_MAX;
+const U32 JIT_NO_POOL_ENTRY = U32_MAX;
+
+// VEX prefix fields
+const U32 JIT_MAP_0F = 1;
+const U32 JIT_MAP_0F38 = 2;
+const U32 JIT_MAP_0F3A = 3;
+const U32 JIT_PP_NONE = 0;
+const U32 JIT_PP_66 = 1;
+
+const U8 JIT_ROUND_FLOOR = _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC;
+const U8 JIT_ROUND_NEAREST = _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC;
+const U8 JIT_CMP_LT_OS = 0x01;
+const U8 JIT_CMP_NEQ_UQ = 0x04;
+const U8 JIT_CMP_GE_OS = 0x0D;
+
+// A memory operand, either [base + index * scale + disp] or a rip relative reference to an entry in the constant pool
+struct JitMem {
+	U32 base;
+	U32 index;
+	U32 scale;
+	I32 disp;
+	U32 poolEntry;
+};
+FINLINE JitMem jit_mem(U32 base, I32 disp, U32 index = JIT_NO_INDEX, U32 scale = 1) {
+	return JitMem{ base, index, scale, disp, JIT_NO_POOL_ENTRY };
+}
+
+// The r/m operand of an instruction, a register or memory
+struct JitRM {
+	B32 isMem;
+	U32 reg;
+	JitMem mem;
+};
+FINLINE JitRM jit_rm(U32 reg) {
+	return JitRM{ false, reg, JitMem{} };
+}
+FINLINE JitRM jit_rm(JitMem mem) {
+	return JitRM{ true, 0, mem };
+}
+
+struct JitPoolEntry {
+	alignas(32) U8 data[32];
+};
+
+struct JitPoolFixup {
+	U32 dispPosition;
+	// rip relative displacements are from the end of the instruction, which is after any immediate
+	U32 instructionEnd;
+	U32 poolEntry;
+};
+
+struct JitEmitter {
+	ArenaArrayList<U8> code;
+	ArenaArrayList<JitPoolEntry> pool;
+	ArenaArrayList<JitPoolFixup> fixups;
+
+	void byte(U8 b) {
+		code.push_back(b);
+	}
+	void imm8(U8 b) {
+		if (!fixups.empty() && fixups.back().instructionEnd == code.size) {
+			fixups.back().instructionEnd++;
+		}
+		byte(b);
+	}
+	void u32(U32 val) {
+		for (U32 i = 0; i < 4; i++) {
+			code.push_back(U8(val >> (i * 8)));
+		}
+	}
+
+	U32 pool_entry(const JitPoolEntry& entry) {
+		for (U32 i = 0; i < pool.size; i++) {
+			if (memcmp(pool.data[i].data, entry.data, sizeof(entry.data)) == 0) {
+				return i;
+			}
+		}
+		pool.push_back(entry);
+		return pool.size - 1;
+	}
+	JitMem f64_constant(F64 val) {
+		JitPoolEntry entry;
+		for (U32 i = 0; i < 4; i++) {
+			memcpy(entry.data + i * sizeof(F64), &val, sizeof(F64));
+		}
+		return JitMem{ 0, JIT_NO_INDEX, 1, 0, pool_entry(entry) };
+	}
+	JitMem f32_constant(F32 val) {
+		JitPoolEntry entry;
+		for (U32 i = 0; i < 8; i++) {
+			memcpy(entry.data + i * sizeof(F32), &val, sizeof(F32));
+		}
+		return JitMem{ 0, JIT_NO_INDEX, 1, 0, pool_entry(entry) };
+	}
+	JitMem u32_constant(U32 val) {
+		return f32_constant(bitcast<F32>(val));
+	}
+
+	void modrm(U32 reg, JitRM rm) {
+		if (!rm.isMem) {
+			byte(U8(0xC0 | (reg & 7) << 3 | (rm.reg & 7)));
+			return;
+		}
+		JitMem mem = rm.mem;
+		if (mem.poolEntry != JIT_NO_POOL_ENTRY) {
+			byte(U8((reg & 7) << 3 | 5));
+			fixups.push_back(JitPoolFixup{ code.size, code.size + 4, mem.poolEntry });
+			u32(0);
+			return;
+		}
+		// rsp and r12 as a base can only be encoded with a SIB byte, rbp and r13 can't have mod 00
+		B32 needsSIB = mem.index != JIT_NO_INDEX || (mem.base & 7) == RSP;
+		U32 mod = mem.disp == 0 && (mem.base & 7) != RBP ? 0 : mem.disp >= -128 && mem.disp <= 127 ? 1 : 2;
+		byte(U8(mod << 6 | (reg & 7) << 3 | (needsSIB ? 4 : mem.base & 7)));
+		if (needsSIB) {
+			U32 scaleBits = mem.scale == 8 ? 3 : mem.scale == 4 ? 2 : mem.scale == 2 ? 1 : 0;
+			byte(U8(scaleBits << 6 | (mem.index == JIT_NO_INDEX ? 4 : mem.index & 7) << 3 | (mem.base & 7)));
+		}
+		if (mod == 1) {
+			byte(U8(I8(mem.disp)));
+		} else if (mod == 2) {
+			u32(U32(mem.disp));
+		}
+	}
+	U32 rm_index(JitRM rm) {
+		return rm.isMem && rm.mem.poolEntry == JIT_NO_POOL_ENTRY ? rm.mem.index : JIT_NO_INDEX;
+	}
+	U32 rm_base(JitRM rm) {
+		return !rm.isMem ? rm.reg : rm.mem.poolEntry == JIT_NO_POOL_ENTRY ? rm.mem.base : 0;
+	}
+
+	void legacy(B32 w, U8 opcode, U32 reg, JitRM rm) {
+		U32 index = rm_index(rm);
+		U8 rex = U8(0x40 | w << 3 | (reg >> 3 & 1) << 2 | (index != JIT_NO_INDEX ? index >> 3 & 1 : 0) << 1 | (rm_base(rm) >> 3 & 1));
+		if (rex != 0x40) {
+			byte(rex);
+		}
+		byte(opcode);
+		modrm(reg, rm);
+	}
+
+	// Always the 3 byte VEX form, the 2 byte form would save a byte here and there but isn't worth the extra cases
+	void vex(U32 map, U32 pp, B32 w, B32 l, U8 opcode, U32 reg, U32 vvvv, JitRM rm) {
+		U32 index = rm_index(rm);
+		U32 notR = ~reg >> 3 & 1;
+		U32 notX = index != JIT_NO_INDEX ? ~index >> 3 & 1 : 1;
+		U32 notB = ~rm_base(rm) >> 3 & 1;
+		byte(0xC4);
+		byte(U8(notR << 7 | notX << 6 | notB << 5 | map));
+		byte(U8(w << 7 | (~vvvv & 15) << 3 | l << 2 | pp));
+		byte(opcode);
+		modrm(reg, rm);
+	}
+
+	// Packed double, ymm
+	void pd(U8 opcode, U32 dst, U32 a, JitRM b) {
+		vex(JIT_MAP_0F, JIT_PP_66, false, true, opcode, dst, a, b);
+	}
+	void vmovupd_load(U32 dst, JitMem mem) {
+		pd(0x10, dst, 0, jit_rm(mem));
+	}
+	void vmovupd_store(JitMem mem, U32 src) {
+		pd(0x11, src, 0, jit_rm(mem));
+	}
+	void vmovapd(U32 dst, JitRM src) {
+		if (src.isMem || dst != src.reg) {
+			pd(0x28, dst, 0, src);
+		}
+	}
+	void vroundpd(U32 dst, U32 src, U8 mode) {
+		vex(JIT_MAP_0F3A, JIT_PP_66, false, true, 0x09, dst, 0, jit_rm(src));
+		imm8(mode);
+	}
+	// Packed single, xmm
+	void ps(U8 opcode, U32 dst, U32 a, JitRM b) {
+		vex(JIT_MAP_0F, JIT_PP_NONE, false, false, opcode, dst, a, b);
+	}
+	// dst = a * dst + b
+	void vfmadd213ps(U32 dst, U32 a, JitRM b) {
+		vex(JIT_MAP_0F38, JIT_PP_66, false, false, 0xA8, dst, a, b);
+	}
+	void vroundps(U32 dst, U32 src, U8 mode) {
+		vex(JIT_MAP_0F3A, JIT_PP_66, false, false, 0x08, dst, 0, jit_rm(src));
+		imm8(mode);
+	}
+	void vcmpps(U32 dst, U32 a, JitRM b, U8 predicate) {
+		ps(0xC2, dst, a, b);
+		imm8(predicate);
+	}
+	// dst = mask ? b : a
+	void vblendvps(U32 dst, U32 a, U32 b, U32 mask) {
+		vex(JIT_MAP_0F3A, JIT_PP_66, false, false, 0x4A, dst, a, jit_rm(b));
+		imm8(U8(mask << 4));
+	}
+	// Packed 32 bit integer, xmm
+	void pi(U8 opcode, U32 dst, U32 a, JitRM b) {
+		vex(JIT_MAP_0F, JIT_PP_66, false, false, opcode, dst, a, b);
+	}
+	// The shift by immediate forms put the destination in vvvv and an opcode extension in reg
+	void pi_shift(U32 extension, U32 dst, U32 src, U8 amount) {
+		vex(JIT_MAP_0F, JIT_PP_66, false, false, 0x72, extension, dst, jit_rm(src));
+		imm8(amount);
+	}
+	void vcvtpd2ps(U32 dstXmm, U32 srcYmm) {
+		vex(JIT_MAP_0F, JIT_PP_66, false, true, 0x5A, dstXmm, 0, jit_rm(srcYmm));
+	}
+	void vcvtps2pd(U32 dstYmm, U32 srcXmm) {
+		vex(JIT_MAP_0F, JIT_PP_NONE, false, true, 0x5A, dstYmm, 0, jit_rm(srcXmm));
+	}
+
+	void rel32_jump(U8 condition, U32 target) {
+		byte(0x0F);
+		byte(condition);
+		u32(U32(I32(target) - I32(code.size + 4)));
+	}
+
+	// Same data[i & mask] addressing the VM does
+	void load_variable(U32 ymm, U32 variable) {
+		legacy(false, 0x89, JIT_INDEX, jit_rm(RAX));
+		legacy(false, 0x23, RAX, jit_rm(jit_mem(JIT_VARIABLES, I32(variable * sizeof(OperandData) + OFFSET_OF(OperandData, mask)))));
+		legacy(true, 0x8B, R11, jit_rm(jit_mem(JIT_VARIABLES, I32(variable * sizeof(OperandData) + OFFSET_OF(OperandData, data)))));
+		vmovupd_load(ymm, jit_mem(R11, 0, RAX, 8));
+	}
+	U32 operand(const ByteProgram& program, Operand op, U32 scratch) {
+		switch (op.type) {
+		case OPERAND_REGISTER: return op.index;
+		case OPERAND_CONSTANT: vmovapd(scratch, jit_rm(f64_constant(program.constants[op.index]))); return scratch;
+		default: load_variable(scratch, op.index); return scratch;
+		}
+	}
+
+	// The kernels below are the DrillMath ones on xmm scratch registers. Input in A, the return value says where the output ended up
+	U32 cosf32x4(U32 a, U32 b, U32 c) {
+		vroundps(b, a, JIT_ROUND_FLOOR);
+		ps(0x5C, a, a, jit_rm(b));
+		vcmpps(b, a, jit_rm(f32_constant(0.5F)), JIT_CMP_GE_OS);
+		ps(0x5C, c, a, jit_rm(f32_constant(0.5F)));
+		vblendvps(a, a, c, b);
+		ps(0x28, c, 0, jit_rm(f32_constant(COS_POLY[5])));
+		for (U32 i = 5; i-- > 0;) {
+			vfmadd213ps(c, a, jit_rm(f32_constant(COS_POLY[i])));
+		}
+		ps(0x57, a, a, jit_rm(a));
+		ps(0x5C, a, a, jit_rm(c));
+		vblendvps(c, c, a, b);
+		return c;
+	}
+	U32 exp2f32x4(U32 a, U32 b, U32 c) {
+		ps(0x5F, a, a, jit_rm(f32_constant(EXP2_MIN_INPUT)));
+		ps(0x5D, a, a, jit_rm(f32_constant(EXP2_MAX_INPUT)));
+		vroundps(b, a, JIT_ROUND_NEAREST);
+		ps(0x5C, a, a, jit_rm(b));
+		ps(0x28, c, 0, jit_rm(f32_constant(EXP2_POLY[6])));
+		for (U32 i = 6; i-- > 0;) {
+			vfmadd213ps(c, a, jit_rm(f32_constant(EXP2_POLY[i])));
+		}
+		pi(0x5B, b, 0, jit_rm(b));
+		pi_shift(6, b, b, 23);
+		pi(0xFE, c, c, jit_rm(b));
+		return c;
+	}
+	U32 log2f32x4(U32 a, U32 b, U32 c) {
+		ps(0x5F, a, a, jit_rm(f32_constant(F32_SMALL)));
+		pi(0xFA, b, a, jit_rm(u32_constant(SQRT_HALF_F32_BITS)));
+		pi_shift(4, b, b, 23);
+		pi_shift(6, c, b, 23);
+		pi(0xFA, c, a, jit_rm(c));
+		// The exponent is needed at the very end, and there aren't enough scratch registers to hold it until then
+		ps(0x5B, b, 0, jit_rm(b));
+		ps(0x11, b, 0, jit_rm(jit_mem(RSP, JIT_FRAME_KERNEL_TEMP)));
+		ps(0x5C, a, c, jit_rm(f32_constant(1.0F)));
+		ps(0x58, c, c, jit_rm(f32_constant(1.0F)));
+		ps(0x5E, a, a, jit_rm(c));
+		ps(0x59, c, a, jit_rm(a));
+		ps(0x28, b, 0, jit_rm(f32_constant(LOG2_SERIES[3])));
+		for (U32 i = 3; i-- > 0;) {
+			vfmadd213ps(b, c, jit_rm(f32_constant(LOG2_SERIES[i])));
+		}
+		vfmadd213ps(b, a, jit_rm(jit_mem(RSP, JIT_FRAME_KERNEL_TEMP)));
+		return b;
+	}
+
+	void instruction(const ByteProgram& program, const Instruction& instruction) {
+		U32 argCount = op_arg_count(instruction.op);
+		U32 dst = instruction.dst;
+		U32 a = operand(program, instruction.a, JIT_SCRATCH_A);
+		U32 b = argCount >= 2 ? operand(program, instruction.b, JIT_SCRATCH_B) : 0;
+		U32 c = argCount >= 3 ? operand(program, instruction.c, JIT_SCRATCH_C) : 0;
+		const U32 sa = JIT_SCRATCH_A, sb = JIT_SCRATCH_B, sc = JIT_SCRATCH_C;
+		switch (instruction.op) {
+		case ADD: pd(0x58, dst, a, jit_rm(b)); break;
+		case MUL: pd(0x59, dst, a, jit_rm(b)); break;
+		case SUB: pd(0x5C, dst, a, jit_rm(b)); break;
+		case MIN: pd(0x5D, dst, a, jit_rm(b)); break;
+		case DIV: pd(0x5E, dst, a, jit_rm(b)); break;
+		case MAX: pd(0x5F, dst, a, jit_rm(b)); break;
+		case FMADD: case FMSUB: case FNMADD: {
+			// The 231 forms accumulate into their destination, so c goes into scratch C first. a and b are never in scratch C
+			vmovapd(sc, jit_rm(c));
+			U8 opcode = instruction.op == FMADD ? 0xB8 : instruction.op == FMSUB ? 0xBA : 0xBC;
+			vex(JIT_MAP_0F38, JIT_PP_66, true, true, opcode, sc, a, jit_rm(b));
+			vmovapd(dst, jit_rm(sc));
+		} break;
+		case CLAMP:
+			// c is never in scratch A, so it's free for the intermediate
+			pd(0x5F, sa, a, jit_rm(b));
+			pd(0x5D, dst, sa, jit_rm(c));
+			break;
+		case FLOOR: vroundpd(dst, a, JIT_ROUND_FLOOR); break;
+		case FRACT:
+			vroundpd(sb, a, JIT_ROUND_FLOOR);
+			pd(0x5C, dst, a, jit_rm(sb));
+			break;
+		case SIN: case COS:
+			// Wrapped to one turn in double first, like apply_op
+			vroundpd(sb, a, JIT_ROUND_FLOOR);
+			pd(0x5C, sa, a, jit_rm(sb));
+			vcvtpd2ps(sa, sa);
+			if (instruction.op == SIN) {
+				ps(0x5C, sa, sa, jit_rm(f32_constant(0.25F)));
+			}
+			vcvtps2pd(dst, cosf32x4(sa, sb, sc));
+			break;
+		case EXP:
+			vcvtpd2ps(sa, a);
+			ps(0x59, sa, sa, jit_rm(f32_constant(LOG2_E_F32)));
+			vcvtps2pd(dst, exp2f32x4(sa, sb, sc));
+			break;
+		case LOG: {
+			vcvtpd2ps(sa, a);
+			U32 log = log2f32x4(sa, sb, sc);
+			ps(0x59, log, log, jit_rm(f32_constant(LN_2_F32)));
+			vcvtps2pd(dst, log);
+		} break;
+		case POW: {
+			// b is in scratch B or a VM register, either way it has to be converted and put aside before the log kernel needs scratch B
+			vcvtpd2ps(sb, b);
+			ps(0x11, sb, 0, jit_rm(jit_mem(RSP, JIT_FRAME_KERNEL_TEMP + 16)));
+			vcvtpd2ps(sa, a);
+			// Sign fixup for negative bases, same as powf32x4. a and b are converted already, so dst is free to hold it through the kernels
+			pi(0x5B, sc, 0, jit_rm(sb));
+			pi_shift(6, sc, sc, 31);
+			vroundps(dst, sb, JIT_ROUND_NEAREST);
+			vcmpps(dst, dst, jit_rm(sb), JIT_CMP_NEQ_UQ);
+			ps(0x56, sc, sc, jit_rm(dst));
+			vcmpps(sb, sa, jit_rm(f32_constant(0.0F)), JIT_CMP_LT_OS);
+			ps(0x54, dst, sc, jit_rm(sb));
+			ps(0x54, sa, sa, jit_rm(u32_constant(0x7FFFFFFF)));
+			U32 log = log2f32x4(sa, sb, sc);
+			ps(0x59, sa, log, jit_rm(jit_mem(RSP, JIT_FRAME_KERNEL_TEMP + 16)));
+			U32 exp = exp2f32x4(sa, sb, sc);
+			ps(0x56, exp, exp, jit_rm(dst));
+			vcvtps2pd(dst, exp);
+		} break;
+		case TANH: {
+			vcvtpd2ps(sa, a);
+			ps(0x5F, sa, sa, jit_rm(f32_constant(-TANH_INPUT_LIMIT)));
+			ps(0x5D, sa, sa, jit_rm(f32_constant(TANH_INPUT_LIMIT)));
+			ps(0x59, sa, sa, jit_rm(f32_constant(2.0F * LOG2_E_F32)));
+			U32 exp = exp2f32x4(sa, sb, sc);
+			ps(0x58, exp, exp, jit_rm(f32_constant(1.0F)));
+			ps(0x28, sa, 0, jit_rm(f32_constant(2.0F)));
+			ps(0x5E, sa, sa, jit_rm(exp));
+			ps(0x28, sb, 0, jit_rm(f32_constant(1.0F)));
+			ps(0x5C, sb, sb, jit_rm(sa));
+			vcvtps2pd(dst, sb);
+		} break;
+		}
+	}
+};
+
+// Copies the finished code and constant pool into their own pages, which are never writable and executable at the same time
+void* alloc_executable(U64* sizeOut, const ArenaArrayList<U8>& code, const ArenaArrayList<JitPoolEntry>& pool) {
+	U32 poolOffset = ALIGN_HIGH(code.size, U32(sizeof(JitPoolEntry)));
+	U64 totalSize = poolOffset + U64(pool.size) * sizeof(JitPoolEntry);
+	U8* memory = reinterpret_cast<U8*>(alloc_pages(totalSize));
+	if (!memory) {
+		return nullptr;
+	}
+	memcpy(memory, code.data, code.size);
+	memcpy(memory + poolOffset, pool.data, pool.size * sizeof(JitPoolEntry));
+	if (!make_executable(memory, totalSize)) {
+		release_memory(memory, totalSize);
+		return nullptr;
+	}
+	*sizeOut = totalSize;
+	return memory;
+}
+
+// Replaces whatever was compiled before. Leaves jit->function null if the program can't be compiled
+// (more live registers than fit in ymm registers), in which case execute falls back to the VM.
+// Must not run while the audio thread could be executing the old code
+void compile_jit(JitProgram* jit, const ByteProgram& program) {
+	jit->destroy();
+	if (!program.valid || program.registerCount > JIT_MAX_REGISTERS) {
+		return;
+	}
+	MemoryArena& arena = get_scratch_arena();
+	MEMORY_ARENA_FRAME(arena) {
+		JitEmitter emitter{ ArenaArrayList<U8>{ &arena }, ArenaArrayList<JitPoolEntry>{ &arena }, ArenaArrayList<JitPoolFixup>{ &arena } };
+
+		// sub rsp, frame size
+		emitter.legacy(true, 0x81, 5, jit_rm(RSP));
+		emitter.u32(U32(JIT_FRAME_SIZE));
+		// xmm6-15 are callee saved
+		for (U32 i = 0; i < 10; i++) {
+			emitter.vex(JIT_MAP_0F, JIT_PP_66, false, false, 0x11, 6 + i, 0, jit_rm(jit_mem(RSP, JIT_FRAME_XMM_SAVE + I32(i) * 16)));
+		}
+		// mov r10, rdx
+		emitter.legacy(true, 0x89, RDX, jit_rm(JIT_VARIABLES));
+		// mov r8d, r8d. length is a U32, and neither calling convention says anything about the upper half of r8, so it gets zero extended before the 64 bit compare
+		emitter.legacy(false, 0x89, JIT_LENGTH, jit_rm(JIT_LENGTH));
+		// xor r9d, r9d
+		emitter.legacy(false, 0x31, JIT_INDEX, jit_rm(JIT_INDEX));
+		// test r8d, r8d, then jz to the epilogue, patched once we know where that is
+		emitter.legacy(false, 0x85, JIT_LENGTH, jit_rm(JIT_LENGTH));
+		emitter.rel32_jump(0x84, 0);
+		U32 skipLoopFixup = emitter.code.size - 4;
+
+		U32 loopStart = emitter.code.size;
+		for (U32 i = 0; i < program.codeLength; i++) {
+			emitter.instruction(program, program.code[i]);
+		}
+		U32 result = emitter.operand(program, program.result, JIT_SCRATCH_A);
+		emitter.vmovupd_store(jit_mem(JIT_OUTPUT, 0, JIT_INDEX, 8), result);
+		// add r9, 4
+		emitter.legacy(true, 0x83, 0, jit_rm(JIT_INDEX));
+		emitter.byte(4);
+		// cmp r9, r8, then jb to the top
+		emitter.legacy(true, 0x39, JIT_LENGTH, jit_rm(JIT_INDEX));
+		emitter.rel32_jump(0x82, loopStart);
+
+		U32 skipLoopDisp = emitter.code.size - (skipLoopFixup + 4);
+		memcpy(emitter.code.data + skipLoopFixup, &skipLoopDisp, sizeof(U32));
+		for (U32 i = 0; i < 10; i++) {
+			emitter.vex(JIT_MAP_0F, JIT_PP_66, false, false, 0x10, 6 + i, 0, jit_rm(jit_mem(RSP, JIT_FRAME_XMM_SAVE + I32(i) * 16)));
+		}
+		// add rsp, frame size
+		emitter.legacy(true, 0x81, 0, jit_rm(RSP));
+		emitter.u32(U32(JIT_FRAME_SIZE));
+		// vzeroupper, ret
+		emitter.byte(0xC5);
+		emitter.byte(0xF8);
+		emitter.byte(0x77);
+		emitter.byte(0xC3);
+
+		// The pool goes right after the code, aligned for the vmovapd loads
+		U32 poolOffset = ALIGN_HIGH(emitter.code.size, U32(sizeof(JitPoolEntry)));
+		for (JitPoolFixup& fixup : emitter.fixups) {
+			U32 disp = poolOffset + fixup.poolEntry * U32(sizeof(JitPoolEntry)) - fixup.instructionEnd;
+			memcpy(emitter.code.data + fixup.dispPosition, &disp, sizeof(U32));
+		}
+		jit->code = alloc_executable(&jit->codeSize, emitter.code, emitter.pool);
+		jit->function = reinterpret_cast<JitFunction>(jit->code);
+	}
+}
+
+// Same contract as interpret, runs the compiled version when there is one
+FINLINE void execute(const ByteProgram& program, const JitProgram& jit, F64* output, const OperandData* variables, U32 length) {
+	if (jitEnabled && jit.function) {
+		jit.function(output, variables, length);
+	} else {
+		interpret(program, output, variables, length);
+	}
+}
+
+}
@@ -1,21 +1,32 @@
-#include <stack>
-#include <queue>
-#include <optional>
-#include <memory>
-#include <variant>
+#pragma once
 #include "DrillLib.h"
+#include "SerializeTools.h"
 
 namespace tbrs {
-	enum Token {
+	enum TokenType : U8 {
 		OP,
 		NUM,
-		INPUT,
+		VARIABLE,
+		IDENTIFIER,
 		LPAREN,
-		RPAREN
+		RPAREN,
+		COMMA
 	};
 
 	using Operator = char;
 
+	// $$ is the input the expression belongs to, $0, $1, ... are the inputs of the node it's on, read before their own expressions are applied
+	enum Variable : U32 {
+		VARIABLE_SELF,
+		VARIABLE_TIME,
+		VARIABLE_SAMPLE_RATE,
+		// Integer sample clock, the same instant as time but exact, for things that need to line up to the sample
+		VARIABLE_SAMPLE_INDEX,
+		VARIABLE_NODE_INPUT0
+	};
+	// ByteProgram tracks used variables in a U64
+	const U32 MAX_VARIABLES = 64;
+
 	bool parse_op(Operator* op, StrA* parseStr) {
 		if (*parseStr->str == '+' || *parseStr->str == '-' || *parseStr->str == '*' || *parseStr->str == '/') {
 			*op = *parseStr->str;
@@ -26,15 +37,44 @@ namespace tbrs {
 		return false;
 	}
 
-	bool parse_dollardollar(StrA* parseStr) {
+	bool parse_variable_ref(U32* variable, StrA* parseStr) {
 		if (parseStr->length >= 2 && parseStr->str[0] == '$' && parseStr->str[1] == '$') {
+			*variable = VARIABLE_SELF;
 			parseStr->str += 2;
 			parseStr->length -= 2;
 			return true;
 		}
+		if (parseStr->length >= 2 && parseStr->str[0] == '$' && parseStr->str[1] >= '0' && parseStr->str[1] <= '9') {
+			U32 inputIdx = 0;
+			U64 i = 1;
+			for (; i < parseStr->length && parseStr->str[i] >= '0' && parseStr->str[i] <= '9'; i++) {
+				inputIdx = inputIdx * 10 + U32(parseStr->str[i] - '0');
+				if (inputIdx >= MAX_VARIABLES - VARIABLE_NODE_INPUT0) {
+					return false;
+				}
+			}
+			*variable = VARIABLE_NODE_INPUT0 + inputIdx;
+			parseStr->str += i;
+			parseStr->length -= i;
+			return true;
+		}
 		return false;
 	}
 
+	bool parse_identifier(StrA* identifier, StrA* parseStr) {
+		U64 length = 0;
+		while (length < parseStr->length && ((parseStr->str[length] >= 'a' && parseStr->str[length] <= 'z') || (parseStr->str[length] >= 'A' && parseStr->str[length] <= 'Z') || parseStr->str[length] == '_')) {
+			length++;
+		}
+		if (length == 0) {
+			return false;
+		}
+		*identifier = StrA{ parseStr->str, length };
+		parseStr->str += length;
+		parseStr->length -= length;
+		return true;
+	}
+
 	bool parse_lparen(StrA* parseStr) {
 		if (*parseStr->str == '(') {
 			parseStr->str++;
@@ -53,53 +93,141 @@ namespace tbrs {
 		return false;
 	}
 
-	struct Tokens {
-		std::queue<Token> tokens;
-		std::queue<F64> numbers;
-		std::queue<Operator> operators;
+	bool parse_comma(StrA* parseStr) {
+		if (*parseStr->str == ',') {
+			parseStr->str++;
+			parseStr->length--;
+			return true;
+		}
+		return false;
+	}
+
+	struct Token {
+		TokenType type;
+		// Offset into the expression text, for error reporting
+		U32 position;
+		Operator op;
+		F64 number;
+		U32 variable;
+		StrA identifier;
+	};
+
+	// message is always a literal, position is an offset into the expression text
+	struct ParseError {
+		StrA message;
+		U32 position;
 	};
 
-	std::optional<Tokens> lex(StrA parseStr) {
-		Tokens result;
+	B32 lex(ArenaArrayList<Token>* tokens, ParseError* error, StrA parseStr) {
+		const char* start = parseStr.str;
+		SerializeTools::skip_whitespace(&parseStr);
 		while (parseStr.length > 0) {
-			F64 num;
-			Operator op;
-			
-			if (parse_op(&op, &parseStr)) {
-				result.tokens.push(OP);
-				result.operators.push(op);
-			}
-			else if (SerializeTools::parse_f64(&num, &parseStr)) {
-				result.tokens.push(NUM);
-				result.numbers.push(num);
+			Token token{};
+			token.position = U32(parseStr.str - start);
+			if (parse_op(&token.op, &parseStr)) {
+				token.type = OP;
+			} else if (SerializeTools::parse_f64(&token.number, &parseStr)) {
+				token.type = NUM;
+			} else if (parse_variable_ref(&token.variable, &parseStr)) {
+				token.type = VARIABLE;
+			} else if (parse_identifier(&token.identifier, &parseStr)) {
+				token.type = IDENTIFIER;
+			} else if (parse_lparen(&parseStr)) {
+				token.type = LPAREN;
+			} else if (parse_rparen(&parseStr)) {
+				token.type = RPAREN;
+			} else if (parse_comma(&parseStr)) {
+				token.type = COMMA;
+			} else {
+				*error = ParseError{ "Unexpected character"sa, token.position };
+				return false;
 			}
-			else if (parse_dollardollar(&parseStr)) {
-				result.tokens.push(INPUT);
-			}
-			else if (parse_lparen(&parseStr)) {
-				result.tokens.push(LPAREN);
-			}
-			else if (parse_rparen(&parseStr)) {
-				result.tokens.push(RPAREN);
-			}
-			else return std::nullopt;
+			tokens->push_back(token);
 			SerializeTools::skip_whitespace(&parseStr);
 		}
-		return result;
+		return true;
 	}
 
-	struct Input {};
-	using NodeVal = std::variant<Operator, F64, Input>;
+	enum ByteCode : U8 {
+		ADD,
+		SUB,
+		MUL,
+		DIV,
+		// a * b + c
+		FMADD,
+		// a * b - c
+		FMSUB,
+		// c - a * b
+		FNMADD,
+		// Angles are in turns, same as DrillMath
+		SIN,
+		COS,
+		EXP,
+		LOG,
+		POW,
+		TANH,
+		MIN,
+		MAX,
+		CLAMP,
+		FLOOR,
+		FRACT
+	};
 
-	struct Node {
-		NodeVal value;
-		std::unique_ptr<Node> lhs;
-		std::unique_ptr<Node> rhs;
+	constexpr U32 op_arg_count(ByteCode op) {
+		switch (op) {
+		case SIN: case COS: case EXP: case LOG: case TANH: case FLOOR: case FRACT: return 1;
+		case FMADD: case FMSUB: case FNMADD: case CLAMP: return 3;
+		default: return 2;
+		}
+	}
+
+	struct FunctionInfo {
+		StrA name;
+		ByteCode op;
+	};
+	const FunctionInfo FUNCTIONS[]{
+		{ "sin"sa, SIN },
+		{ "cos"sa, COS },
+		{ "exp"sa, EXP },
+		{ "log"sa, LOG },
+		{ "pow"sa, POW },
+		{ "tanh"sa, TANH },
+		{ "min"sa, MIN },
+		{ "max"sa, MAX },
+		{ "clamp"sa, CLAMP },
+		{ "floor"sa, FLOOR },
+		{ "fract"sa, FRACT }
+	};
+
+	struct VariableName {
+		StrA name;
+		Variable variable;
+	};
+	const VariableName VARIABLE_NAMES[]{
+		{ "t"sa, VARIABLE_TIME },
+		{ "time"sa, VARIABLE_TIME },
+		{ "sr"sa, VARIABLE_SAMPLE_RATE },
+		{ "samplerate"sa, VARIABLE_SAMPLE_RATE },
+		{ "n"sa, VARIABLE_SAMPLE_INDEX },
+		{ "sample"sa, VARIABLE_SAMPLE_INDEX }
+	};
 
-		Node(NodeVal value, std::unique_ptr<Node> lhs = nullptr, std::unique_ptr<Node> rhs = nullptr) : value{ value }, lhs{ std::move(lhs) }, rhs{ std::move(rhs) } {}
+	enum NodeType : U8 {
+		NODE_OPERATOR,
+		NODE_NUMBER,
+		NODE_VARIABLE,
+		NODE_CALL
 	};
 
-	using AST = std::unique_ptr<Node>;
+	struct Node {
+		NodeType type;
+		Operator op;
+		ByteCode call;
+		F64 number;
+		U32 variable;
+		// lhs and rhs for operators, the arguments in order for calls
+		Node* args[3];
+	};
 
 	U64 precedence(Operator op) {
 		switch (op) {
@@ -114,222 +242,632 @@ namespace tbrs {
 		}
 	}
 
-	std::optional<AST> parse_helper(Tokens&, AST, U64);
-
-	std::optional<AST> parse(Tokens& tokens, U64 prevPrecedence = 0) {
-		std::optional<AST> result;
-
-		if (tokens.tokens.empty()) return std::nullopt;
-		Token front = tokens.tokens.front();
-		tokens.tokens.pop();
-
-		switch (front) {
-		case OP:
-			if (tokens.operators.front() != '-') return std::nullopt;
-			tokens.operators.pop();
-			result = parse(tokens);
-			if (!result.has_value()) return std::nullopt;
-			result = std::make_unique<Node>('*', std::make_unique<Node>(-1.0), std::move(result.value()));
-			break;
-		case NUM:
-			result = std::make_unique<Node>(tokens.numbers.front());
-			tokens.numbers.pop();
-			break;
-		case INPUT:
-			result = std::make_unique<Node>(Input{});
-			break;
-		case LPAREN:
-			result = parse(tokens);
-			if (tokens.tokens.empty() || tokens.tokens.front() != RPAREN) return std::nullopt;
-			tokens.tokens.pop();
-			break;
-		default:
-			return std::nullopt;
+	// Recursive descent over the token list. Nodes come from the arena, so the whole tree goes away with the arena frame.
+	// Every parse function returns null on failure with error filled in, and the nulls just propagate up
+	struct Parser {
+		MemoryArena* arena;
+		const Token* tokens;
+		U32 tokenCount;
+		U32 pos;
+		// Reported when the expression ends early, like "sin(" or "2 +"
+		U32 endPosition;
+		ParseError error;
+
+		B32 at(TokenType type) {
+			return pos < tokenCount && tokens[pos].type == type;
+		}
+		U32 position() {
+			return pos < tokenCount ? tokens[pos].position : endPosition;
+		}
+		Node* fail(StrA message) {
+			error = ParseError{ message, position() };
+			return nullptr;
+		}
+		Node* node(NodeType type) {
+			Node* result = arena->zalloc<Node>(1);
+			result->type = type;
+			return result;
+		}
+		Node* binary(Operator op, Node* lhs, Node* rhs) {
+			Node* result = node(NODE_OPERATOR);
+			result->op = op;
+			result->args[0] = lhs;
+			result->args[1] = rhs;
+			return result;
+		}
+		Node* number(F64 num) {
+			Node* result = node(NODE_NUMBER);
+			result->number = num;
+			return result;
+		}
+		Node* variable(U32 variable) {
+			Node* result = node(NODE_VARIABLE);
+			result->variable = variable;
+			return result;
 		}
 
-		while (!tokens.tokens.empty()) {
-			if (tokens.tokens.front() != OP) break;
-
-			U64 curPrecedence = precedence(tokens.operators.front());
-			if (curPrecedence < prevPrecedence) break;
+		Node* expression(U64 minPrecedence = 1) {
+			Node* result = unary();
+			while (result && at(OP) && precedence(tokens[pos].op) >= minPrecedence) {
+				Operator op = tokens[pos++].op;
+				// Only operators that bind tighter go into the right hand side, so equal precedence groups left to right and 10 - 2 - 3 is (10 - 2) - 3
+				Node* rhs = expression(precedence(op) + 1);
+				result = rhs ? binary(op, result, rhs) : nullptr;
+			}
+			return result;
+		}
 
-			result = parse_helper(tokens, std::move(result.value()), curPrecedence);
+		// Binds tighter than any binary operator, so -a + b is (-a) + b
+		Node* unary() {
+			if (at(OP) && tokens[pos].op == '-') {
+				pos++;
+				Node* operand = unary();
+				// -x is parsed as -1 * x, the optimizer folds that into whatever uses it
+				return operand ? binary('*', number(-1.0), operand) : nullptr;
+			}
+			return primary();
 		}
 
-		return result;
-	}
+		Node* primary() {
+			if (pos == tokenCount) {
+				return fail("Expected a value"sa);
+			}
+			const Token& token = tokens[pos];
+			switch (token.type) {
+			case NUM:
+				pos++;
+				return number(token.number);
+			case VARIABLE:
+				pos++;
+				return variable(token.variable);
+			case IDENTIFIER:
+				for (const FunctionInfo& function : FUNCTIONS) {
+					if (function.name == token.identifier) {
+						pos++;
+						return call(function.op);
+					}
+				}
+				for (const VariableName& name : VARIABLE_NAMES) {
+					if (name.name == token.identifier) {
+						pos++;
+						return variable(name.variable);
+					}
+				}
+				return fail("Unknown name"sa);
+			case LPAREN: {
+				pos++;
+				Node* result = expression();
+				if (result && !at(RPAREN)) {
+					return fail("Expected )"sa);
+				}
+				pos++;
+				return result;
+			}
+			default:
+				return fail("Expected a value"sa);
+			}
+		}
 
-	std::optional<AST> parse_helper(Tokens& tokens, AST left, U64 prevPrecedence) {
-		if (tokens.tokens.empty()) return std::nullopt;
-		Operator op = tokens.operators.front();
-		tokens.operators.pop();
-		tokens.tokens.pop();
+		Node* call(ByteCode op) {
+			if (!at(LPAREN)) {
+				return fail("Expected ("sa);
+			}
+			pos++;
+			Node* result = node(NODE_CALL);
+			result->call = op;
+			U32 argCount = op_arg_count(op);
+			for (U32 i = 0; i < argCount; i++) {
+				result->args[i] = expression();
+				if (!result->args[i]) {
+					return nullptr;
+				}
+				B32 lastArg = i == argCount - 1;
+				if (!at(lastArg ? RPAREN : COMMA)) {
+					return fail(lastArg ? "Expected )"sa : "Expected ,"sa);
+				}
+				pos++;
+			}
+			return result;
+		}
+	};
 
-		std::optional<AST> right = parse(tokens, prevPrecedence);
-		if (!right.has_value()) return std::nullopt;
+	// Instructions read constants and variables directly, so only intermediate results need registers
+	enum OperandType : U8 {
+		OPERAND_REGISTER,
+		OPERAND_CONSTANT,
+		OPERAND_VARIABLE
+	};
 
-		return std::make_unique<Node>(op, std::move(left), std::move(right.value()));
-	}
+	struct Operand {
+		OperandType type;
+		U32 index;
+	};
 
-	enum ByteCode {
-		LDIN,
-		LDCNST,
-		ADD,
-		SUB,
-		MUL,
-		DIV
+	// dst = op(a, b, c), with however many of the operands op takes. dst is always a register
+	struct Instruction {
+		ByteCode op;
+		U32 dst;
+		Operand a;
+		Operand b;
+		Operand c;
 	};
 
 	struct ByteProgram {
+		Instruction* code;
 		F64* constants;
-		ByteCode* code;
-		U64 len;
+		// code and constants share one heap block that only gets replaced when a program doesn't fit, so retyping an expression doesn't hit the allocator
+		void* storage;
+		U32 storageCapacity;
+		U32 codeLength;
+		U32 constantCount;
+		U32 registerCount;
+		// Usually the last instruction's dst, but a program like "2" or "$$" has no instructions at all
+		Operand result;
+		U64 variablesUsed;
+		// Why the last parse failed. The program keeps whatever it had compiled before
+		ParseError error;
 		B8 valid;
-		B8 operatesOnBuffer;
 
 		void init() {
-			constants = nullptr;
 			code = nullptr;
-			len = 0;
+			constants = nullptr;
+			storage = nullptr;
+			storageCapacity = 0;
+			codeLength = 0;
+			constantCount = 0;
+			registerCount = 0;
+			result = Operand{};
+			variablesUsed = 0;
+			error = ParseError{};
 			valid = false;
-			operatesOnBuffer = false;
+		}
+
+		void set_code(const Instruction* newCode, U32 newCodeLength, const F64* newConstants, U32 newConstantCount) {
+			U32 constantsOffset = ALIGN_HIGH(newCodeLength * U32(sizeof(Instruction)), U32(alignof(F64)));
+			U32 size = constantsOffset + newConstantCount * U32(sizeof(F64));
+			if (size > storageCapacity) {
+				if (storage) {
+					heap_free(storage);
+				}
+				storage = heap_alloc(size);
+				storageCapacity = size;
+			}
+			code = reinterpret_cast<Instruction*>(storage);
+			constants = reinterpret_cast<F64*>(reinterpret_cast<U8*>(storage) + constantsOffset);
+			codeLength = newCodeLength;
+			constantCount = newConstantCount;
+			if (size) {
+				memcpy(code, newCode, newCodeLength * sizeof(Instruction));
+				memcpy(constants, newConstants, newConstantCount * sizeof(F64));
+			}
+		}
+
+		B32 uses_variable(U32 variable) const {
+			return variablesUsed >> variable & 1;
 		}
 
 		void destroy() {
-			delete constants;
-			delete code;
+			if (storage) {
+				heap_free(storage);
+			}
+			init();
 		}
 	};
 
-	template<typename... Fs>
-	struct overload : Fs... {
-		using Fs::operator()...;
+	// The DrillMath kernels are single precision, same as how the nodes use them. sin and cos wrap to one turn in double first, so large time values don't lose their phase
+	FINLINE __m256d apply_op(ByteCode op, __m256d a, __m256d b, __m256d c) {
+		switch (op) {
+		case ADD: return _mm256_add_pd(a, b);
+		case SUB: return _mm256_sub_pd(a, b);
+		case MUL: return _mm256_mul_pd(a, b);
+		case DIV: return _mm256_div_pd(a, b);
+		case FMADD: return _mm256_fmadd_pd(a, b, c);
+		case FMSUB: return _mm256_fmsub_pd(a, b, c);
+		case FNMADD: return _mm256_fnmadd_pd(a, b, c);
+		case SIN: return _mm256_cvtps_pd(sinf32x4(_mm256_cvtpd_ps(_mm256_sub_pd(a, _mm256_round_pd(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC)))));
+		case COS: return _mm256_cvtps_pd(cosf32x4(_mm256_cvtpd_ps(_mm256_sub_pd(a, _mm256_round_pd(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC)))));
+		case EXP: return _mm256_cvtps_pd(expf32x4(_mm256_cvtpd_ps(a)));
+		case LOG: return _mm256_cvtps_pd(logf32x4(_mm256_cvtpd_ps(a)));
+		case POW: return _mm256_cvtps_pd(powf32x4(_mm256_cvtpd_ps(a), _mm256_cvtpd_ps(b)));
+		case TANH: return _mm256_cvtps_pd(tanhf32x4(_mm256_cvtpd_ps(a)));
+		case MIN: return _mm256_min_pd(a, b);
+		case MAX: return _mm256_max_pd(a, b);
+		case CLAMP: return _mm256_min_pd(_mm256_max_pd(a, b), c);
+		case FLOOR: return _mm256_round_pd(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+		case FRACT: return _mm256_sub_pd(a, _mm256_round_pd(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC));
+		}
+		return a;
+	}
+
+	// The optimizer works on a DAG instead of the tree. Every distinct subexpression becomes one value,
+	// and values only refer to earlier values, so the list is always in a valid evaluation order
+	enum ValueKind : U8 {
+		VALUE_CONSTANT,
+		VALUE_VARIABLE,
+		VALUE_OP
 	};
 
-	template<class...Fs>
-	overload(Fs...) -> overload<Fs...>;
-
-	void traverse(AST root, std::vector<ByteCode>& code, std::vector<F64>& constants) {
-		if (!root) return;
-		traverse(std::move(root->lhs), code, constants);
-		traverse(std::move(root->rhs), code, constants);
-		std::visit(
-			overload{
-				[&](Input) {
-					code.push_back(LDIN);
-				},
-				[&](F64 num) {
-					constants.push_back(num);
-					code.push_back(LDCNST);
-				},
-				[&](Operator op) {
-					switch (op) {
-						case '+':
-							code.push_back(ADD);
-							break;
-						case '-':
-							code.push_back(SUB);
-							break;
-						case '*':
-							code.push_back(MUL);
-							break;
-						case '/':
-							code.push_back(DIV);
-							break;
-					}
+	struct Value {
+		ValueKind kind;
+		ByteCode op;
+		F64 constant;
+		// Operand values for ops, the variable index for variables
+		U32 args[3];
+		// Filled in by count_uses, 0 means the value is dead and never gets emitted
+		U32 useCount;
+	};
+
+	struct ExprGraph {
+		ArenaArrayList<Value> values;
+		U32 root;
+
+		U32 add(Value value) {
+			// Linear search is fine, even big formulas are only a few hundred values
+			for (U32 i = 0; i < values.size; i++) {
+				Value& other = values.data[i];
+				if (other.kind != value.kind) {
+					continue;
 				}
-			},
-			root->value);
-	}
+				if ((value.kind == VALUE_VARIABLE && other.args[0] == value.args[0]) ||
+					(value.kind == VALUE_CONSTANT && bitcast<U64>(other.constant) == bitcast<U64>(value.constant)) ||
+					(value.kind == VALUE_OP && other.op == value.op && memcmp(other.args, value.args, op_arg_count(value.op) * sizeof(U32)) == 0)) {
+					return i;
+				}
+			}
+			values.push_back(value);
+			return U32(values.size - 1);
+		}
+		U32 constant(F64 num) {
+			Value value{};
+			value.kind = VALUE_CONSTANT;
+			value.constant = num;
+			return add(value);
+		}
+		U32 variable(U32 variable) {
+			Value value{};
+			value.kind = VALUE_VARIABLE;
+			value.args[0] = variable;
+			return add(value);
+		}
+		B32 is_constant(U32 idx, F64 num) {
+			return values.data[idx].kind == VALUE_CONSTANT && values.data[idx].constant == num;
+		}
+		B32 is_op(U32 idx, ByteCode op) {
+			return values.data[idx].kind == VALUE_OP && values.data[idx].op == op;
+		}
+
+		U32 binary(ByteCode op, U32 a, U32 b) {
+			Value& va = values.data[a];
+			Value& vb = values.data[b];
+			if (va.kind == VALUE_CONSTANT && vb.kind == VALUE_CONSTANT) {
+				switch (op) {
+				case ADD: return constant(va.constant + vb.constant);
+				case SUB: return constant(va.constant - vb.constant);
+				case MUL: return constant(va.constant * vb.constant);
+				case DIV: return constant(va.constant / vb.constant);
+				default: break;
+				}
+			}
+			// Constants go on the left of commutative ops, otherwise the lower index does, so 2*$$ and $$*2 end up as the same value
+			if ((op == ADD || op == MUL) && ((vb.kind == VALUE_CONSTANT && va.kind != VALUE_CONSTANT) || (va.kind != VALUE_CONSTANT && b < a))) {
+				return binary(op, b, a);
+			}
+			// A multiply is a lot cheaper than a divide. The reciprocal can be off by an ulp, which nobody will hear
+			if (op == DIV && vb.kind == VALUE_CONSTANT && vb.constant != 0.0) {
+				return binary(MUL, constant(1.0 / vb.constant), a);
+			}
+			if ((op == ADD && is_constant(a, 0.0)) || (op == SUB && is_constant(b, 0.0)) || (op == DIV && is_constant(b, 1.0))) {
+				return op == ADD ? b : a;
+			}
+			if (op == MUL && is_constant(a, 1.0)) {
+				return b;
+			}
+			// c1 * (c2 * x) -> (c1 * c2) * x, which mostly cleans up unary minus
+			if (op == MUL && va.kind == VALUE_CONSTANT && is_op(b, MUL) && values.data[values.data[b].args[0]].kind == VALUE_CONSTANT) {
+				return binary(MUL, constant(va.constant * values.data[values.data[b].args[0]].constant), values.data[b].args[1]);
+			}
+			// Unary minus is parsed as -1 * x, so x + -1 * y and x - -1 * y become a single op
+			if ((op == ADD || op == SUB) && is_op(b, MUL) && is_constant(values.data[b].args[0], -1.0)) {
+				return binary(op == ADD ? SUB : ADD, a, values.data[b].args[1]);
+			}
+			if (op == ADD && is_op(a, MUL) && is_constant(values.data[a].args[0], -1.0)) {
+				return binary(SUB, b, values.data[a].args[1]);
+			}
+			Value value{};
+			value.kind = VALUE_OP;
+			value.op = op;
+			value.args[0] = a;
+			value.args[1] = b;
+			return add(value);
+		}
+
+		U32 call(ByteCode op, const U32 args[3]) {
+			// These run before folding so a constant base gets the same exact result a variable one does
+			if (op == POW && is_constant(args[1], 1.0)) {
+				return args[0];
+			}
+			// Squaring is common enough to be worth it, and unlike the exp/log route it's exact and works for negative bases
+			if (op == POW && is_constant(args[1], 2.0)) {
+				return binary(MUL, args[0], args[0]);
+			}
+			U32 argCount = op_arg_count(op);
+			B32 allConstant = true;
+			for (U32 i = 0; i < argCount; i++) {
+				allConstant &= values.data[args[i]].kind == VALUE_CONSTANT;
+			}
+			// Folded with the same kernel the VM uses, so folding doesn't change the result
+			if (allConstant) {
+				__m256d constantArgs[3]{};
+				for (U32 i = 0; i < argCount; i++) {
+					constantArgs[i] = _mm256_set1_pd(values.data[args[i]].constant);
+				}
+				return constant(_mm256_cvtsd_f64(apply_op(op, constantArgs[0], constantArgs[1], constantArgs[2])));
+			}
+			Value value{};
+			value.kind = VALUE_OP;
+			value.op = op;
+			memcpy(value.args, args, argCount * sizeof(U32));
+			return add(value);
+		}
+
+		void count_uses() {
+			for (Value& value : values) {
+				value.useCount = 0;
+			}
+			values.data[root].useCount = 1;
+			// Walking backwards visits every user before the values it uses
+			for (U32 i = U32(values.size); i-- > 0;) {
+				Value& value = values.data[i];
+				if (value.useCount == 0 || value.kind != VALUE_OP) {
+					continue;
+				}
+				for (U32 j = 0; j < op_arg_count(value.op); j++) {
+					values.data[value.args[j]].useCount++;
+				}
+			}
+		}
 
-	ByteProgram compile(AST ast) {
-		ByteProgram result;
-		result.init();
-		std::vector<ByteCode> code;
-		std::vector<F64> constants;
+		// a * b + c and friends, as long as nothing else needs the product on its own
+		void fuse_multiply_add() {
+			for (Value& value : values) {
+				if (value.useCount == 0 || value.kind != VALUE_OP || (value.op != ADD && value.op != SUB)) {
+					continue;
+				}
+				U32 mulArg = U32_MAX;
+				if (is_op(value.args[0], MUL) && values.data[value.args[0]].useCount == 1) {
+					mulArg = 0;
+				} else if (is_op(value.args[1], MUL) && values.data[value.args[1]].useCount == 1) {
+					mulArg = 1;
+				}
+				if (mulArg == U32_MAX) {
+					continue;
+				}
+				Value& mul = values.data[value.args[mulArg]];
+				U32 addend = value.args[mulArg ^ 1];
+				// a * b + c, a * b - c, c - a * b
+				value.op = value.op == ADD ? FMADD : mulArg == 0 ? FMSUB : FNMADD;
+				value.args[0] = mul.args[0];
+				value.args[1] = mul.args[1];
+				value.args[2] = addend;
+				// The product's operands are now used here instead, so their counts stay the same
+				mul.useCount = 0;
+			}
+		}
+	};
 
-		traverse(std::move(ast), code, constants);
+	U32 build_graph(ExprGraph& graph, const Node* root) {
+		switch (root->type) {
+		case NODE_VARIABLE:
+			return graph.variable(root->variable);
+		case NODE_NUMBER:
+			return graph.constant(root->number);
+		case NODE_CALL: {
+			U32 args[3]{};
+			for (U32 i = 0; i < op_arg_count(root->call); i++) {
+				args[i] = build_graph(graph, root->args[i]);
+			}
+			return graph.call(root->call, args);
+		}
+		default: {
+			U32 a = build_graph(graph, root->args[0]);
+			U32 b = build_graph(graph, root->args[1]);
+			switch (root->op) {
+			case '+': return graph.binary(ADD, a, b);
+			case '-': return graph.binary(SUB, a, b);
+			case '*': return graph.binary(MUL, a, b);
+			default: return graph.binary(DIV, a, b);
+			}
+		}
+		}
+	}
+
+	// Constant folding, common subexpression elimination, division by constants to multiplication and multiply-add fusion.
+	// Most of the work happens as the graph is built, since binary() and call() simplify every op as it's added
+	ExprGraph optimize(const Node* ast, MemoryArena& arena) {
+		ExprGraph graph{};
+		graph.values = ArenaArrayList<Value>{ &arena };
+		graph.root = build_graph(graph, ast);
+		graph.count_uses();
+		graph.fuse_multiply_add();
+		return graph;
+	}
 
-		result.code = new ByteCode[code.size()];
-		result.constants = new F64[constants.size()];
-		result.len = code.size();
-		result.valid = true;
+	// Lowest free register first, so short lived temporaries keep getting reused and the register count stays small
+	struct RegisterAllocator {
+		ArenaArrayList<B8> inUse;
 
-		for (ByteCode op : code) {
-			if (op == LDIN) {
-				result.operatesOnBuffer = true;
-				break;
+		U32 alloc() {
+			for (U32 i = 0; i < inUse.size; i++) {
+				if (!inUse.data[i]) {
+					inUse.data[i] = true;
+					return i;
+				}
+			}
+			inUse.push_back(true);
+			return inUse.size - 1;
+		}
+		void free(Operand operand) {
+			if (operand.type == OPERAND_REGISTER) {
+				inUse.data[operand.index] = false;
 			}
 		}
+	};
 
-		memcpy(result.code, code.data(), code.size() * sizeof(ByteCode));
-		memcpy(result.constants, constants.data(), constants.size() * sizeof(F64));
+	void compile(ByteProgram* program, ExprGraph& graph, MemoryArena& arena) {
+		ArenaArrayList<Instruction> code{ &arena };
+		ArenaArrayList<F64> constants{ &arena };
+		RegisterAllocator registers{ ArenaArrayList<B8>{ &arena } };
+		U64 variablesUsed = 0;
+		// Where each value lives once it's been computed, and how many of its uses haven't been emitted yet
+		Operand* locations = arena.zalloc<Operand>(graph.values.size);
+		U32* remainingUses = arena.alloc<U32>(graph.values.size);
+
+		for (U32 i = 0; i < graph.values.size; i++) {
+			Value& value = graph.values.data[i];
+			remainingUses[i] = value.useCount;
+			if (value.useCount == 0) {
+				continue;
+			}
+			if (value.kind == VALUE_VARIABLE) {
+				locations[i] = Operand{ OPERAND_VARIABLE, value.args[0] };
+				variablesUsed |= 1ull << value.args[0];
+			} else if (value.kind == VALUE_CONSTANT) {
+				constants.push_back(value.constant);
+				locations[i] = Operand{ OPERAND_CONSTANT, constants.size - 1 };
+			} else {
+				Instruction instruction{};
+				instruction.op = value.op;
+				Operand* operands[3]{ &instruction.a, &instruction.b, &instruction.c };
+				for (U32 j = 0; j < op_arg_count(value.op); j++) {
+					*operands[j] = locations[value.args[j]];
+				}
+				// Operands are freed after their last use before the destination is allocated, so the result can overwrite one of them. Every op is elementwise, so that's safe
+				for (U32 j = 0; j < op_arg_count(value.op); j++) {
+					if (--remainingUses[value.args[j]] == 0) {
+						registers.free(locations[value.args[j]]);
+					}
+				}
+				instruction.dst = registers.alloc();
+				locations[i] = Operand{ OPERAND_REGISTER, instruction.dst };
+				code.push_back(instruction);
+			}
+		}
 
-		return result;
+		program->set_code(code.data, code.size, constants.data, constants.size);
+		program->registerCount = registers.inUse.size;
+		program->result = locations[graph.root];
+		program->variablesUsed = variablesUsed;
+		program->error = ParseError{};
+		program->valid = true;
 	}
 
+	// Runs on every keystroke in a slider, so everything but the finished program lives on a scratch arena and the heap only gets touched when the program outgrows its storage.
+	// On failure the program is marked invalid and error says what went wrong and where
 	void parse_program(ByteProgram* program, StrA parseStr) {
-		SerializeTools::skip_whitespace(&parseStr);
-		std::optional<Tokens> tokens = lex(parseStr);
-		if (!tokens.has_value()) {
-			program->valid = false;
-			return;
+		MemoryArena& arena = get_scratch_arena();
+		MEMORY_ARENA_FRAME(arena) {
+			ArenaArrayList<Token> tokens{ &arena };
+			if (lex(&tokens, &program->error, parseStr)) {
+				Parser parser{};
+				parser.arena = &arena;
+				parser.tokens = tokens.data;
+				parser.tokenCount = tokens.size;
+				parser.endPosition = U32(parseStr.length);
+				Node* ast = parser.expression();
+				// Anything left over means the expression didn't parse as a whole, like "2)" or "sin(1) 3"
+				if (ast && parser.pos != parser.tokenCount) {
+					ast = parser.fail("Expected an operator"sa);
+				}
+				if (ast) {
+					ExprGraph graph = optimize(ast, arena);
+					compile(program, graph, arena);
+				} else {
+					program->error = parser.error;
+					program->valid = false;
+				}
+			} else {
+				program->valid = false;
+			}
 		}
+	}
 
-		std::optional<AST> ast = parse(tokens.value());
-		if (!ast.has_value()) {
-			program->valid = false;
-			return;
-		}
+	// Same data + mask addressing as NodeIOValue. Buffers use U32_MAX, a broadcast constant uses 0 so every load hits the same 4 copies
+	struct OperandData {
+		const F64* data;
+		U32 mask;
+	};
 
-		program->destroy();
-		*program = compile(std::move(ast.value()));
+	template<ByteCode op>
+	FINLINE void interpret_op(F64* dst, OperandData a, OperandData b, OperandData c, U32 length) {
+		for (U32 i = 0; i < length; i += 4) {
+			__m256d valA = _mm256_loadu_pd(a.data + (i & a.mask));
+			__m256d valB = op_arg_count(op) >= 2 ? _mm256_loadu_pd(b.data + (i & b.mask)) : valA;
+			__m256d valC = op_arg_count(op) >= 3 ? _mm256_loadu_pd(c.data + (i & c.mask)) : valA;
+			_mm256_storeu_pd(dst + i, apply_op(op, valA, valB, valC));
+		}
 	}
 
-	using AVX2D = __m256d;
-
-	AVX2D interpret(ByteProgram program, AVX2D input) {
-		std::stack<AVX2D> stack;
-		AVX2D op1, op2;
-		U64 constIdx = 0;
-		for (U64 i = 0; i < program.len; i++) {
-			switch (program.code[i]) {
-			case LDIN:
-				stack.push(input);
-				break;
-			case LDCNST:
-				stack.push(_mm256_set1_pd(program.constants[constIdx++]));
-				break;
-			case ADD:
-				op2 = stack.top();
-				stack.pop();
-				op1 = stack.top();
-				stack.pop();
-				stack.push(_mm256_add_pd(op1, op2));
-				break;
-			case SUB:
-				op2 = stack.top();
-				stack.pop();
-				op1 = stack.top();
-				stack.pop();
-				stack.push(_mm256_sub_pd(op1, op2));
-				break;
-			case MUL:
-				op2 = stack.top();
-				stack.pop();
-				op1 = stack.top();
-				stack.pop();
-				stack.push(_mm256_mul_pd(op1, op2));
-				break;
-			case DIV:
-				op2 = stack.top();
-				stack.pop();
-				op1 = stack.top();
-				stack.pop();
-				stack.push(_mm256_div_pd(op1, op2));
-				break;
-			}
-		}
-		return stack.top();
+	// Runs the program over length samples at once, one instruction at a time across the whole buffer,
+	// so the opcode dispatch happens once per instruction per block instead of once per instruction per 4 samples.
+	// variables has MAX_VARIABLES entries, and every variable the program uses must point at something readable for length samples (engine buffers have slack).
+	// Register storage is scratch from the calling thread's audioArena, so this may only be called from a thread that processes audio.
+	// length must be a multiple of 4 and output must not alias any variable
+	void interpret(const ByteProgram& program, F64* output, const OperandData* variables, U32 length) {
+		MEMORY_ARENA_FRAME(audioArena) {
+			F64* broadcastConstants = audioArena.alloc_aligned_with_slack<F64>(program.constantCount * 4, alignof(__m256d), 0);
+			for (U32 i = 0; i < program.constantCount; i++) {
+				_mm256_store_pd(broadcastConstants + i * 4, _mm256_set1_pd(program.constants[i]));
+			}
+			F64** registers = audioArena.alloc<F64*>(program.registerCount);
+			for (U32 i = 0; i < program.registerCount; i++) {
+				registers[i] = audioArena.alloc_aligned_with_slack<F64>(length, alignof(__m256d), 0);
+			}
+			// The result register can just be the output, which saves a copy at the end
+			if (program.result.type == OPERAND_REGISTER) {
+				registers[program.result.index] = output;
+			}
+			auto operand_data = [&](Operand operand) {
+				switch (operand.type) {
+				case OPERAND_REGISTER: return OperandData{ registers[operand.index], U32_MAX };
+				case OPERAND_CONSTANT: return OperandData{ broadcastConstants + operand.index * 4, 0 };
+				default: return variables[operand.index];
+				}
+			};
+
+			for (U32 i = 0; i < program.codeLength; i++) {
+				const Instruction& instruction = program.code[i];
+				F64* dst = registers[instruction.dst];
+				U32 argCount = op_arg_count(instruction.op);
+				OperandData a = operand_data(instruction.a);
+				OperandData b = argCount >= 2 ? operand_data(instruction.b) : OperandData{};
+				OperandData c = argCount >= 3 ? operand_data(instruction.c) : OperandData{};
+				switch (instruction.op) {
+				case ADD: interpret_op<ADD>(dst, a, b, c, length); break;
+				case SUB: interpret_op<SUB>(dst, a, b, c, length); break;
+				case MUL: interpret_op<MUL>(dst, a, b, c, length); break;
+				case DIV: interpret_op<DIV>(dst, a, b, c, length); break;
+				case FMADD: interpret_op<FMADD>(dst, a, b, c, length); break;
+				case FMSUB: interpret_op<FMSUB>(dst, a, b, c, length); break;
+				case FNMADD: interpret_op<FNMADD>(dst, a, b, c, length); break;
+				case SIN: interpret_op<SIN>(dst, a, b, c, length); break;
+				case COS: interpret_op<COS>(dst, a, b, c, length); break;
+				case EXP: interpret_op<EXP>(dst, a, b, c, length); break;
+				case LOG: interpret_op<LOG>(dst, a, b, c, length); break;
+				case POW: interpret_op<POW>(dst, a, b, c, length); break;
+				case TANH: interpret_op<TANH>(dst, a, b, c, length); break;
+				case MIN: interpret_op<MIN>(dst, a, b, c, length); break;
+				case MAX: interpret_op<MAX>(dst, a, b, c, length); break;
+				case CLAMP: interpret_op<CLAMP>(dst, a, b, c, length); break;
+				case FLOOR: interpret_op<FLOOR>(dst, a, b, c, length); break;
+				case FRACT: interpret_op<FRACT>(dst, a, b, c, length); break;
+				}
+			}
+			if (program.result.type != OPERAND_REGISTER) {
+				OperandData result = operand_data(program.result);
+				for (U32 i = 0; i < length; i += 4) {
+					_mm256_storeu_pd(output + i, _mm256_loadu_pd(result.data + (i & result.mask)));
+				}
+			}
+		}
 	}
-}
\ No newline at end of file
+}
@@ -3,19 +3,136 @@
 
 namespace FFT {
 
-F32 FFT_COS_TABLE[]{
-#include "FFTCosineTable.txt"
+// The complex transform does its first three stages in register, so 8 is the smallest complex size.
+// The real transforms run on a half size complex transform and process 8 mirrored bins at a time, so 32 is the smallest real size.
+static constexpr U32 MIN_COMPLEX_LOG2_SIZE = 3;
+static constexpr U32 MIN_REAL_LOG2_SIZE = 5;
+static constexpr U32 MAX_LOG2_SIZE = 16;
+
+// Sign convention (kept from the original 1024 point transform): the forward transform uses e^(+i*2pi*k*n/N), the inverse uses e^(-i*2pi*k*n/N).
+// Neither direction is normalized, so an inverse of a forward comes back scaled by N.
+struct Plan {
+	U32 size;
+	U32 log2Size;
+	// Bit reversed index of every element, fed straight into the gathers of the first pass
+	U32* bitReverseIndices;
+	// For every radix 2 stage with half size h (8, 16, ..., size/2), h cosines followed by h sines of j/(2h) turns.
+	// The table for half size h starts at 2 * (h - 8)
+	F32* stageTwiddles;
+	// Cosines and sines of k/size turns for k in [0, size/2], used to split and merge the half size transform in the real transforms
+	F32* realTwiddlesCos;
+	F32* realTwiddlesSin;
+	// The real transforms of this size run on this plan
+	Plan* halfPlan;
 };
 
-template<B32 inverse, B32 hasInputY>
-void fft_1024(F32* outX, F32* outY, F32* inX, F32* inY) {
-	__m256 zero = _mm256_setzero_ps();
-	__m256i bitReverseLookup = _mm256_setr_epi8(0b000000, 0b100000, 0b010000, 0b110000, 0b001000, 0b101000, 0b011000, 0b111000, 0b000100, 0b100100, 0b010100, 0b110100, 0b001100, 0b101100, 0b011100, 0b111100, 0b000000, 0b100000, 0b010000, 0b110000, 0b001000, 0b101000, 0b011000, 0b111000, 0b000100, 0b100100, 0b010100, 0b110100, 0b001100, 0b101100, 0b011100, 0b111100);
-	__m256i lowBitMask = _mm256_set1_epi32(0x0F0F0F0F);
-	__m256i tenBitMask = _mm256_set1_epi32((1 << 10) - 1);
-	__m256i normalIndices = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
-	__m256i eight = _mm256_set1_epi32(8);
+Plan plans[MAX_LOG2_SIZE + 1];
+
+// The fast approximations in DrillMath aren't nearly accurate enough for twiddles on a 65536 point transform (the old cosine table was generated offline for the same reason),
+// so plans get generated with this double precision version. Only used at plan time, so speed doesn't matter.
+void sincos_turns_f64(F64* sinOut, F64* cosOut, F64 turns) {
+	// Reduce to [-1/8, 1/8] turns around the nearest quarter turn. Twiddle angles are dyadic fractions, so this is exact
+	F64 quarters = floorf64(turns * 4.0 + 0.5);
+	// MATH_PI is only F32 precision
+	F64 reduced = (turns - quarters * 0.25) * 6.283185307179586476925286766559;
+	U32 quadrant = U32(I64(quarters) & 3);
+	F64 reducedSq = reduced * reduced;
+	F64 sinVal = 0.0;
+	F64 cosVal = 0.0;
+	F64 sinTerm = reduced;
+	F64 cosTerm = 1.0;
+	for (U32 i = 1; i < 20; i += 2) {
+		sinVal += sinTerm;
+		cosVal += cosTerm;
+		sinTerm *= -reducedSq / F64((i + 1) * (i + 2));
+		cosTerm *= -reducedSq / F64(i * (i + 1));
+	}
+	switch (quadrant) {
+	case 0: *sinOut = sinVal; *cosOut = cosVal; break;
+	case 1: *sinOut = cosVal; *cosOut = -sinVal; break;
+	case 2: *sinOut = -sinVal; *cosOut = -cosVal; break;
+	case 3: *sinOut = -cosVal; *cosOut = sinVal; break;
+	}
+}
+
+// Plans are generated on first use and live forever in globalArena.
+// This allocates, so it must be called from the UI thread (node init or a setting change, where the modification lock is held), never from the audio thread for a size that doesn't exist yet
+Plan* get_plan(U32 log2Size) {
+	ASSERT(log2Size >= MIN_COMPLEX_LOG2_SIZE && log2Size <= MAX_LOG2_SIZE, "FFT size out of range");
+	Plan& plan = plans[log2Size];
+	if (plan.size != 0) {
+		return &plan;
+	}
+	U32 size = 1u << log2Size;
+	plan.log2Size = log2Size;
+
+	plan.bitReverseIndices = globalArena.alloc_aligned_with_slack<U32>(size, alignof(__m256i), 0);
+	for (U32 i = 0; i < size; i++) {
+		U32 reversed = 0;
+		for (U32 bit = 0; bit < log2Size; bit++) {
+			reversed |= ((i >> bit) & 1) << (log2Size - 1 - bit);
+		}
+		plan.bitReverseIndices[i] = reversed;
+	}
+
+	// 8 + 16 + ... + size/2 entries of both cos and sin
+	U32 stageTwiddleCount = size >= 16 ? 2 * (size - 8) : 0;
+	plan.stageTwiddles = globalArena.alloc_aligned_with_slack<F32>(stageTwiddleCount, alignof(__m256), 0);
+	for (U32 halfStride = 8; halfStride < size; halfStride <<= 1) {
+		F32* table = plan.stageTwiddles + 2 * (halfStride - 8);
+		for (U32 j = 0; j < halfStride; j++) {
+			F64 sinVal, cosVal;
+			sincos_turns_f64(&sinVal, &cosVal, F64(j) / F64(2 * halfStride));
+			table[j] = F32(cosVal);
+			table[halfStride + j] = F32(sinVal);
+		}
+	}
+
+	// Padded out to a multiple of 8 past size/2 so the vector loops never read off the end
+	U32 realTwiddleCount = size / 2 + 8;
+	plan.realTwiddlesCos = globalArena.alloc_aligned_with_slack<F32>(realTwiddleCount, alignof(__m256), 0);
+	plan.realTwiddlesSin = globalArena.alloc_aligned_with_slack<F32>(realTwiddleCount, alignof(__m256), 0);
+	for (U32 k = 0; k < realTwiddleCount; k++) {
+		F64 sinVal, cosVal;
+		sincos_turns_f64(&sinVal, &cosVal, F64(k) / F64(size));
+		plan.realTwiddlesCos[k] = F32(cosVal);
+		plan.realTwiddlesSin[k] = F32(sinVal);
+	}
+
+	plan.halfPlan = log2Size > MIN_COMPLEX_LOG2_SIZE ? get_plan(log2Size - 1) : nullptr;
+	// Set last, size != 0 is what marks the plan as generated
+	plan.size = size;
+	return &plan;
+}
+Plan* get_plan_for_size(U32 size) {
+	ASSERT(size != 0 && (size & (size - 1)) == 0, "FFT size must be a power of two");
+	return get_plan(31 - lzcnt32(size));
+}
+
+enum InputLayout {
+	// Separate real and imaginary arrays
+	INPUT_LAYOUT_COMPLEX,
+	// Real array only, imaginary part is 0
+	INPUT_LAYOUT_REAL,
+	// One real array of 2*size samples, treated as size complex samples with even samples in x and odd samples in y
+	INPUT_LAYOUT_PACKED_REAL
+};
+
+// Twiddle multiply. Forward rotates by cos + i*sin, inverse by cos - i*sin
+template<B32 inverse>
+FINLINE void complex_rotate(__m256* outX, __m256* outY, __m256 x, __m256 y, __m256 cosine, __m256 sine) {
+	if constexpr (inverse) {
+		*outX = _mm256_fmadd_ps(x, cosine, _mm256_mul_ps(y, sine));
+		*outY = _mm256_fmsub_ps(y, cosine, _mm256_mul_ps(x, sine));
+	} else {
+		*outX = _mm256_fmsub_ps(x, cosine, _mm256_mul_ps(y, sine));
+		*outY = _mm256_fmadd_ps(x, sine, _mm256_mul_ps(y, cosine));
+	}
+}
 
+// Bit reversal gather plus the first three radix 2 stages, all in register
+template<B32 inverse, InputLayout layout>
+void fft_first_stages(const Plan& plan, F32* outX, F32* outY, const F32* inX, const F32* inY) {
 	__m256 rotation1, rotation2, rotation3, rotation4;
 	if constexpr (inverse) {
 		rotation1 = _mm256_setr_ps(1.0F, 0.0F, 1.0F, 0.0F, 1.0F, 0.0F, 1.0F, 0.0F);
@@ -29,36 +146,34 @@ void fft_1024(F32* outX, F32* outY, F32* inX, F32* inY) {
 		rotation4 = _mm256_setr_ps(0.0F, -0.707107F, -1.0F, -0.707107F, 0.0F, -0.707107F, -1.0F, -0.707107F);
 	}
 
-	for (U32 i = 0; i < 1024; i += 8) {
-		// x represents a hard 0 bit, number represents source bit index
-		// nybbles xxxx|xx01|2345|6789 -> xx10|xxxx|xx98|76xx
-		__m256i permutedIndexBits1 = _mm256_shuffle_epi8(bitReverseLookup, _mm256_and_si256(normalIndices, lowBitMask));
-		// nybbles xxxx|xx01|2345|6789 -> xxxx|xxxx|xx54|32xx
-		__m256i permutedIndexBits2 = _mm256_shuffle_epi8(bitReverseLookup, _mm256_srli_epi16(normalIndices, 4));
-		// (xx10xxxxxx9876xx << 4 & tenBitMask) | xxxxxxxxxx5432xx | xx10xxxxxx9876xx >> 12 -> xxxxxx9876543210
-		__m256i permutedIndices = _mm256_or_si256(_mm256_or_si256(
-			_mm256_and_si256(_mm256_slli_epi32(permutedIndexBits1, 4), tenBitMask),
-			permutedIndexBits2),
-			_mm256_srli_epi32(permutedIndexBits1, 12));
-
-		__m256 resultX = _mm256_i32gather_ps(inX, permutedIndices, 4);
-		__m256 resultY = zero;
-		if constexpr (hasInputY) {
-			// If this isn't in an if constexpr, the compiler can't optimize out a lot of the operations below, resulting in significantly worse performance
+	for (U32 i = 0; i < plan.size; i += 8) {
+		__m256i permutedIndices = _mm256_load_si256(reinterpret_cast<__m256i*>(plan.bitReverseIndices + i));
+
+		__m256 resultX, resultY;
+		if constexpr (layout == INPUT_LAYOUT_PACKED_REAL) {
+			__m256i packedIndices = _mm256_slli_epi32(permutedIndices, 1);
+			resultX = _mm256_i32gather_ps(inX, packedIndices, 4);
+			resultY = _mm256_i32gather_ps(inX + 1, packedIndices, 4);
+		} else if constexpr (layout == INPUT_LAYOUT_COMPLEX) {
+			resultX = _mm256_i32gather_ps(inX, permutedIndices, 4);
 			resultY = _mm256_i32gather_ps(inY, permutedIndices, 4);
+		} else {
+			// If this isn't in an if constexpr, the compiler can't optimize out a lot of the operations below, resulting in significantly worse performance
+			resultX = _mm256_i32gather_ps(inX, permutedIndices, 4);
+			resultY = _mm256_setzero_ps();
 		}
 
 		// Constants:
 		// 1,0
-		// 
+		//
 		// 1,0
 		// 0,-1
-		// 
+		//
 		// 1,0
 		// 0.707107,-0.707107
 		// 0,-1
 		// -0.707107,-0.707107
-		// 
+		//
 		// outx1 = evenX + (oddX *  c1 + oddY * c2)
 		// outy1 = evenY + (oddX * -c2 + oddY * c1)
 		// outx2 = evenX - (oddX *  c1 + oddY * c2)
@@ -99,43 +214,320 @@ void fft_1024(F32* outX, F32* outY, F32* inX, F32* inY) {
 
 		_mm256_storeu_ps(outX + i, resultX);
 		_mm256_storeu_ps(outY + i, resultY);
-		normalIndices = _mm256_add_epi32(normalIndices, eight);
-	}
-
-	F32* table = FFT_COS_TABLE + 10; // Skip first three iteration entries
-	__m256 two = _mm256_set1_ps(2.0F);
-	for (U32 iteration = 3; iteration < 10; iteration++) {
-		U32 stride = 1 << iteration;
-		U32 halfStride = stride >> 1;
-		U32 iterationMask = stride - 1;
-		for (U32 i = 0; i < 512; i += 8) {
-			U32 index = ((i & ~iterationMask) << 1) + (i & iterationMask);
-			// This algorithm is mostly loads and stores. Switching to a radix 4 (or 2^2) FFT would help with that, but I don't have time right now
-			__m256 rotX = _mm256_loadu_ps(table + (i & iterationMask));
-			__m256 rotY = _mm256_loadu_ps(table + (i & iterationMask) + halfStride);
-			__m256 evenX = _mm256_loadu_ps(outX + index);
-			__m256 evenY = _mm256_loadu_ps(outY + index);
-			__m256 oddX = _mm256_loadu_ps(outX + index + stride);
-			__m256 oddY = _mm256_loadu_ps(outY + index + stride);
-			__m256 resultX1, resultY1, resultX2, resultY2;
-			if constexpr (inverse) {
-				resultX1 = _mm256_fmadd_ps(oddX, rotX, _mm256_fnmadd_ps(oddY, rotY, evenX));
-				resultY1 = _mm256_fmadd_ps(oddX, rotY, _mm256_fmadd_ps(oddY, rotX, evenY));
-				resultX2 = _mm256_fmsub_ps(evenX, two, resultX1);
-				resultY2 = _mm256_fmsub_ps(evenY, two, resultY1);
-			} else {
-				resultX1 = _mm256_fmadd_ps(oddX, rotX, _mm256_fmadd_ps(oddY, rotY, evenX));
-				resultY1 = _mm256_fnmadd_ps(oddX, rotY, _mm256_fmadd_ps(oddY, rotX, evenY));
-				resultX2 = _mm256_fmsub_ps(evenX, two, resultX1);
-				resultY2 = _mm256_fmsub_ps(evenY, two, resultY1);
+	}
+}
+
+// All the stages after the first three, in place.
+// Stages are fused in pairs (radix 2^2), which halves the loads and stores compared to doing one radix 2 stage per pass. If the stage count is odd, the first one is done on its own
+template<B32 inverse>
+void fft_remaining_stages(const Plan& plan, F32* x, F32* y) {
+	U32 size = plan.size;
+	U32 halfStride = 8;
+	if ((plan.log2Size - 3) & 1) {
+		const F32* table = plan.stageTwiddles;
+		for (U32 group = 0; group < size; group += 16) {
+			__m256 cosine = _mm256_load_ps(table);
+			__m256 sine = _mm256_load_ps(table + 8);
+			__m256 evenX = _mm256_loadu_ps(x + group);
+			__m256 evenY = _mm256_loadu_ps(y + group);
+			__m256 oddX, oddY;
+			complex_rotate<inverse>(&oddX, &oddY, _mm256_loadu_ps(x + group + 8), _mm256_loadu_ps(y + group + 8), cosine, sine);
+			_mm256_storeu_ps(x + group, _mm256_add_ps(evenX, oddX));
+			_mm256_storeu_ps(y + group, _mm256_add_ps(evenY, oddY));
+			_mm256_storeu_ps(x + group + 8, _mm256_sub_ps(evenX, oddX));
+			_mm256_storeu_ps(y + group + 8, _mm256_sub_ps(evenY, oddY));
+		}
+		halfStride = 16;
+	}
+	for (; halfStride < size; halfStride <<= 2) {
+		// First stage of the pair has half size h, the second has half size 2h.
+		// Element j+h in the second stage needs twiddle j + h of 4h, which is just twiddle j times a quarter turn
+		const F32* table1 = plan.stageTwiddles + 2 * (halfStride - 8);
+		const F32* table2 = plan.stageTwiddles + 2 * (2 * halfStride - 8);
+		U32 h = halfStride;
+		for (U32 group = 0; group < size; group += 4 * h) {
+			F32* gx = x + group;
+			F32* gy = y + group;
+			for (U32 j = 0; j < h; j += 8) {
+				__m256 cosine1 = _mm256_load_ps(table1 + j);
+				__m256 sine1 = _mm256_load_ps(table1 + h + j);
+				__m256 cosine2 = _mm256_load_ps(table2 + j);
+				__m256 sine2 = _mm256_load_ps(table2 + 2 * h + j);
+
+				__m256 x0 = _mm256_loadu_ps(gx + j);
+				__m256 y0 = _mm256_loadu_ps(gy + j);
+				__m256 x2 = _mm256_loadu_ps(gx + j + 2 * h);
+				__m256 y2 = _mm256_loadu_ps(gy + j + 2 * h);
+				__m256 rotX, rotY;
+				complex_rotate<inverse>(&rotX, &rotY, _mm256_loadu_ps(gx + j + h), _mm256_loadu_ps(gy + j + h), cosine1, sine1);
+				__m256 a0X = _mm256_add_ps(x0, rotX);
+				__m256 a0Y = _mm256_add_ps(y0, rotY);
+				__m256 a1X = _mm256_sub_ps(x0, rotX);
+				__m256 a1Y = _mm256_sub_ps(y0, rotY);
+				complex_rotate<inverse>(&rotX, &rotY, _mm256_loadu_ps(gx + j + 3 * h), _mm256_loadu_ps(gy + j + 3 * h), cosine1, sine1);
+				__m256 a2X = _mm256_add_ps(x2, rotX);
+				__m256 a2Y = _mm256_add_ps(y2, rotY);
+				__m256 a3X = _mm256_sub_ps(x2, rotX);
+				__m256 a3Y = _mm256_sub_ps(y2, rotY);
+
+				complex_rotate<inverse>(&rotX, &rotY, a2X, a2Y, cosine2, sine2);
+				_mm256_storeu_ps(gx + j, _mm256_add_ps(a0X, rotX));
+				_mm256_storeu_ps(gy + j, _mm256_add_ps(a0Y, rotY));
+				_mm256_storeu_ps(gx + j + 2 * h, _mm256_sub_ps(a0X, rotX));
+				_mm256_storeu_ps(gy + j + 2 * h, _mm256_sub_ps(a0Y, rotY));
+				complex_rotate<inverse>(&rotX, &rotY, a3X, a3Y, cosine2, sine2);
+				// Quarter turn, +i for forward, -i for inverse
+				__m256 quarterX, quarterY;
+				if constexpr (inverse) {
+					quarterX = rotY;
+					quarterY = _mm256_sub_ps(_mm256_setzero_ps(), rotX);
+				} else {
+					quarterX = _mm256_sub_ps(_mm256_setzero_ps(), rotY);
+					quarterY = rotX;
+				}
+				_mm256_storeu_ps(gx + j + h, _mm256_add_ps(a1X, quarterX));
+				_mm256_storeu_ps(gy + j + h, _mm256_add_ps(a1Y, quarterY));
+				_mm256_storeu_ps(gx + j + 3 * h, _mm256_sub_ps(a1X, quarterX));
+				_mm256_storeu_ps(gy + j + 3 * h, _mm256_sub_ps(a1Y, quarterY));
 			}
-			_mm256_storeu_ps(outX + index, resultX1);
-			_mm256_storeu_ps(outY + index, resultY1);
-			_mm256_storeu_ps(outX + index + stride, resultX2);
-			_mm256_storeu_ps(outY + index + stride, resultY2);
 		}
-		table += stride + halfStride;
 	}
 }
 
-}
\ No newline at end of file
+// Complex transform of plan.size points. Out of place, the outputs must not alias the inputs
+template<B32 inverse, B32 hasInputY>
+void fft(const Plan& plan, F32* outX, F32* outY, const F32* inX, const F32* inY) {
+	if constexpr (hasInputY) {
+		fft_first_stages<inverse, INPUT_LAYOUT_COMPLEX>(plan, outX, outY, inX, inY);
+	} else {
+		fft_first_stages<inverse, INPUT_LAYOUT_REAL>(plan, outX, outY, inX, inY);
+	}
+	fft_remaining_stages<inverse>(plan, outX, outY);
+}
+
+FINLINE __m256 reverse_f32x8(__m256 v) {
+	return _mm256_permutevar8x32_ps(v, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+}
+
+// Forward transform of plan.size real samples for about half the cost of the complex one.
+// The input is treated as size/2 complex samples, transformed, then split into the spectrum of the real signal.
+// Writes bins 0 through size/2 (inclusive) to outX and outY, so they need size/2 + 1 elements. The rest of the spectrum is the conjugate mirror of these
+void fft_real(const Plan& plan, F32* outX, F32* outY, const F32* in) {
+	ASSERT(plan.log2Size >= MIN_REAL_LOG2_SIZE, "Real FFT size too small");
+	const Plan& halfPlan = *plan.halfPlan;
+	U32 halfSize = halfPlan.size;
+	fft_first_stages<false, INPUT_LAYOUT_PACKED_REAL>(halfPlan, outX, outY, in, nullptr);
+	fft_remaining_stages<false>(halfPlan, outX, outY);
+	// Z[halfSize] wraps around to Z[0], which makes the generic formula produce both the DC and nyquist bins
+	outX[halfSize] = outX[0];
+	outY[halfSize] = outY[0];
+
+	// With p = Z[k] and q = Z[halfSize - k]:
+	// E = (p + conj(q)) / 2, D = (p - conj(q)) / 2
+	// T = rotate(-i * D, k/size turns)
+	// X[k] = E + T, X[halfSize - k] = conj(E - T)
+	// Both bins depend on the same pair, so they're done together in place
+	__m256 half = _mm256_set1_ps(0.5F);
+	for (U32 k = 0; k < halfSize / 2; k += 8) {
+		U32 mirror = halfSize - k - 7;
+		__m256 px = _mm256_loadu_ps(outX + k);
+		__m256 py = _mm256_loadu_ps(outY + k);
+		__m256 qx = reverse_f32x8(_mm256_loadu_ps(outX + mirror));
+		__m256 qy = reverse_f32x8(_mm256_loadu_ps(outY + mirror));
+		__m256 cosine = _mm256_loadu_ps(plan.realTwiddlesCos + k);
+		__m256 sine = _mm256_loadu_ps(plan.realTwiddlesSin + k);
+		__m256 ex = _mm256_mul_ps(_mm256_add_ps(px, qx), half);
+		__m256 ey = _mm256_mul_ps(_mm256_sub_ps(py, qy), half);
+		__m256 dx = _mm256_mul_ps(_mm256_sub_ps(px, qx), half);
+		__m256 dy = _mm256_mul_ps(_mm256_add_ps(py, qy), half);
+		__m256 tx = _mm256_fmadd_ps(cosine, dy, _mm256_mul_ps(sine, dx));
+		__m256 ty = _mm256_fmsub_ps(sine, dy, _mm256_mul_ps(cosine, dx));
+		_mm256_storeu_ps(outX + k, _mm256_add_ps(ex, tx));
+		_mm256_storeu_ps(outY + k, _mm256_add_ps(ey, ty));
+		_mm256_storeu_ps(outX + mirror, reverse_f32x8(_mm256_sub_ps(ex, tx)));
+		_mm256_storeu_ps(outY + mirror, reverse_f32x8(_mm256_sub_ps(ty, ey)));
+	}
+	// The quarter bin pairs with itself, and the formula above reduces to leaving it alone
+}
+
+// Inverse of fft_real. Takes bins 0 through size/2 (inclusive) and writes plan.size real samples, scaled by size like the complex inverse.
+// workspace needs space for plan.size floats and must not alias anything else. The inputs are left untouched
+void ifft_real(const Plan& plan, F32* out, const F32* inX, const F32* inY, F32* workspace) {
+	ASSERT(plan.log2Size >= MIN_REAL_LOG2_SIZE, "Real FFT size too small");
+	const Plan& halfPlan = *plan.halfPlan;
+	U32 halfSize = halfPlan.size;
+	// Merge the spectrum back into the half size complex spectrum, using out as temporary storage.
+	// With p = X[k] and q = X[halfSize - k]:
+	// A = p + conj(q), B = p - conj(q)
+	// Z[k] = A + i * rotate(B, -k/size turns)
+	F32* zX = out;
+	F32* zY = out + halfSize;
+	for (U32 k = 0; k < halfSize; k += 8) {
+		U32 mirror = halfSize - k - 7;
+		__m256 px = _mm256_loadu_ps(inX + k);
+		__m256 py = _mm256_loadu_ps(inY + k);
+		__m256 qx = reverse_f32x8(_mm256_loadu_ps(inX + mirror));
+		__m256 qy = reverse_f32x8(_mm256_loadu_ps(inY + mirror));
+		__m256 cosine = _mm256_loadu_ps(plan.realTwiddlesCos + k);
+		__m256 sine = _mm256_loadu_ps(plan.realTwiddlesSin + k);
+		__m256 ax = _mm256_add_ps(px, qx);
+		__m256 ay = _mm256_sub_ps(py, qy);
+		__m256 bx = _mm256_sub_ps(px, qx);
+		__m256 by = _mm256_add_ps(py, qy);
+		_mm256_storeu_ps(zX + k, _mm256_fmadd_ps(bx, sine, _mm256_fnmadd_ps(by, cosine, ax)));
+		_mm256_storeu_ps(zY + k, _mm256_fmadd_ps(bx, cosine, _mm256_fmadd_ps(by, sine, ay)));
+	}
+	F32* workX = workspace;
+	F32* workY = workspace + halfSize;
+	fft_first_stages<true, INPUT_LAYOUT_COMPLEX>(halfPlan, workX, workY, zX, zY);
+	fft_remaining_stages<true>(halfPlan, workX, workY);
+	// Even samples came out in x, odd samples in y
+	for (U32 i = 0; i < halfSize; i += 8) {
+		__m256 evens = _mm256_loadu_ps(workX + i);
+		__m256 odds = _mm256_loadu_ps(workY + i);
+		__m256 low = _mm256_unpacklo_ps(evens, odds);
+		__m256 high = _mm256_unpackhi_ps(evens, odds);
+		_mm256_storeu_ps(out + 2 * i, _mm256_permute2f128_ps(low, high, 0x20));
+		_mm256_storeu_ps(out + 2 * i + 8, _mm256_permute2f128_ps(low, high, 0x31));
+	}
+}
+
+// Twiddle j of the radix 2 stage with half size halfStride, broadcast to every lane.
+// Stages below 8 don't have their own table, but their twiddles are every (8/halfStride)th entry of the half size 8 one
+FINLINE void batched_stage_twiddle(const Plan& plan, U32 halfStride, U32 j, __m256* cosine, __m256* sine) {
+	if (halfStride >= 8) {
+		const F32* table = plan.stageTwiddles + 2 * (halfStride - 8);
+		*cosine = _mm256_broadcast_ss(table + j);
+		*sine = _mm256_broadcast_ss(table + halfStride + j);
+	} else {
+		U32 idx = j * (8 / halfStride);
+		*cosine = _mm256_broadcast_ss(plan.stageTwiddles + idx);
+		*sine = _mm256_broadcast_ss(plan.stageTwiddles + 8 + idx);
+	}
+}
+
+// One radix 2^2 butterfly of the batched transform, on rows gx[0], gx[h], gx[2h] and gx[3h]. Without twiddles, it's the j = 0 one, where they'd all be 1
+template<B32 inverse, B32 twiddled>
+FINLINE void batched_radix4_butterfly(__m256* gx, __m256* gy, U32 h, __m256 cosine1, __m256 sine1, __m256 cosine2, __m256 sine2) {
+	__m256 rotX = gx[h];
+	__m256 rotY = gy[h];
+	if constexpr (twiddled) {
+		complex_rotate<inverse>(&rotX, &rotY, rotX, rotY, cosine1, sine1);
+	}
+	__m256 a0X = _mm256_add_ps(gx[0], rotX);
+	__m256 a0Y = _mm256_add_ps(gy[0], rotY);
+	__m256 a1X = _mm256_sub_ps(gx[0], rotX);
+	__m256 a1Y = _mm256_sub_ps(gy[0], rotY);
+	rotX = gx[3 * h];
+	rotY = gy[3 * h];
+	if constexpr (twiddled) {
+		complex_rotate<inverse>(&rotX, &rotY, rotX, rotY, cosine1, sine1);
+	}
+	__m256 a2X = _mm256_add_ps(gx[2 * h], rotX);
+	__m256 a2Y = _mm256_add_ps(gy[2 * h], rotY);
+	__m256 a3X = _mm256_sub_ps(gx[2 * h], rotX);
+	__m256 a3Y = _mm256_sub_ps(gy[2 * h], rotY);
+
+	rotX = a2X;
+	rotY = a2Y;
+	if constexpr (twiddled) {
+		complex_rotate<inverse>(&rotX, &rotY, rotX, rotY, cosine2, sine2);
+	}
+	gx[0] = _mm256_add_ps(a0X, rotX);
+	gy[0] = _mm256_add_ps(a0Y, rotY);
+	gx[2 * h] = _mm256_sub_ps(a0X, rotX);
+	gy[2 * h] = _mm256_sub_ps(a0Y, rotY);
+	rotX = a3X;
+	rotY = a3Y;
+	if constexpr (twiddled) {
+		complex_rotate<inverse>(&rotX, &rotY, rotX, rotY, cosine2, sine2);
+	}
+	__m256 quarterX, quarterY;
+	if constexpr (inverse) {
+		quarterX = rotY;
+		quarterY = _mm256_sub_ps(_mm256_setzero_ps(), rotX);
+	} else {
+		quarterX = _mm256_sub_ps(_mm256_setzero_ps(), rotY);
+		quarterY = rotX;
+	}
+	gx[h] = _mm256_add_ps(a1X, quarterX);
+	gy[h] = _mm256_add_ps(a1Y, quarterY);
+	gx[3 * h] = _mm256_sub_ps(a1X, quarterX);
+	gy[3 * h] = _mm256_sub_ps(a1Y, quarterY);
+}
+
+// One radix 2^2 pass (half sizes h and 2h) of the batched transform over rows [begin, end), which has to be a whole number of 4h row groups
+template<B32 inverse>
+FINLINE void batched_radix4_stage(const Plan& plan, __m256* vx, __m256* vy, U32 h, U32 begin, U32 end) {
+	__m256 one = _mm256_set1_ps(1.0F);
+	__m256 zero = _mm256_setzero_ps();
+	for (U32 group = begin; group < end; group += 4 * h) {
+		batched_radix4_butterfly<inverse, false>(vx + group, vy + group, h, one, zero, one, zero);
+	}
+	for (U32 j = 1; j < h; j++) {
+		__m256 cosine1, sine1, cosine2, sine2;
+		batched_stage_twiddle(plan, h, j, &cosine1, &sine1);
+		batched_stage_twiddle(plan, 2 * h, j, &cosine2, &sine2);
+		for (U32 group = begin; group < end; group += 4 * h) {
+			batched_radix4_butterfly<inverse, true>(vx + group + j, vy + group + j, h, cosine1, sine1, cosine2, sine2);
+		}
+	}
+}
+
+// Rows of the batched transform worked on together while they stay in L1, 8KB each of x and y
+static constexpr U32 BATCHED_BLOCK_ROWS = 256;
+
+// Complex transform of 8 independent signals at once, one per lane. Element i of the signal in lane v is at x[i * 8 + v],
+// so every butterfly is a full register with no shuffles or gathers, and the twiddles are shared across lanes. In place.
+// The rows have to come in already in bit reversed order (row plan.bitReverseIndices[i] holds element i), which callers get for free by writing them there as they fill the batch.
+// Same sign convention and scaling as fft
+template<B32 inverse>
+void fft_batched8_bit_reversed(const Plan& plan, F32* x, F32* y) {
+	ASSERT(plan.log2Size >= 4, "Batched FFT size too small");
+	U32 size = plan.size;
+	__m256* vx = reinterpret_cast<__m256*>(x);
+	__m256* vy = reinterpret_cast<__m256*>(y);
+	// A whole batch is 8 times the size of a single transform and falls out of L1 past 256 points. Stages that stay inside a block of rows
+	// run on one block at a time, so only the last pass or two go over the whole batch
+	U32 blockRows = min(size, BATCHED_BLOCK_ROWS);
+	U32 firstHalfStride = plan.log2Size & 1 ? 2 : 1;
+	U32 halfStride = firstHalfStride;
+	for (U32 block = 0; block < size; block += blockRows) {
+		if (plan.log2Size & 1) {
+			// The first stage's only twiddle is 1
+			for (U32 i = block; i < block + blockRows; i += 2) {
+				__m256 evenX = vx[i];
+				__m256 evenY = vy[i];
+				vx[i] = _mm256_add_ps(evenX, vx[i + 1]);
+				vy[i] = _mm256_add_ps(evenY, vy[i + 1]);
+				vx[i + 1] = _mm256_sub_ps(evenX, vx[i + 1]);
+				vy[i + 1] = _mm256_sub_ps(evenY, vy[i + 1]);
+			}
+		}
+		// Radix 2^2, same structure as fft_remaining_stages
+		for (halfStride = firstHalfStride; 4 * halfStride <= blockRows; halfStride <<= 2) {
+			batched_radix4_stage<inverse>(plan, vx, vy, halfStride, block, block + blockRows);
+		}
+	}
+	for (; halfStride < size; halfStride <<= 2) {
+		batched_radix4_stage<inverse>(plan, vx, vy, halfStride, 0, size);
+	}
+}
+
+// Bins k and halfSize - k of 8 real signals at once, from bins p = Z[k] and q = Z[halfSize - k] of their half size transforms with even samples in x and odd samples in y.
+// The same split fft_real does, with the twiddle for k broadcast across lanes instead of running along k
+FINLINE void split_packed_real_x8(__m256* kX, __m256* kY, __m256* mirrorX, __m256* mirrorY, __m256 px, __m256 py, __m256 qx, __m256 qy, __m256 cosine, __m256 sine) {
+	__m256 half = _mm256_set1_ps(0.5F);
+	__m256 ex = _mm256_mul_ps(_mm256_add_ps(px, qx), half);
+	__m256 ey = _mm256_mul_ps(_mm256_sub_ps(py, qy), half);
+	__m256 dx = _mm256_mul_ps(_mm256_sub_ps(px, qx), half);
+	__m256 dy = _mm256_mul_ps(_mm256_add_ps(py, qy), half);
+	__m256 tx = _mm256_fmadd_ps(cosine, dy, _mm256_mul_ps(sine, dx));
+	__m256 ty = _mm256_fmsub_ps(sine, dy, _mm256_mul_ps(cosine, dx));
+	*kX = _mm256_add_ps(ex, tx);
+	*kY = _mm256_add_ps(ey, ty);
+	*mirrorX = _mm256_sub_ps(ex, tx);
+	*mirrorY = _mm256_sub_ps(ty, ey);
+}
+
+}
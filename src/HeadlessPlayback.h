@@ -0,0 +1,90 @@
+#pragma once
+#include "DrillLib.h"
+#include "AudioDevice.h"
+#include "Nodes.h"
+#include "Serialization.h"
+
+// Plays a project through the audio device for a set time without opening a window, for machines that can't (render nodes, CI).
+// The device paces it exactly like the windowed build, so the timing it prints at the end is what the engine would manage live
+// DAWdle --play <project.dawdle> <seconds> [--audio-backend null|wasapi|alsa] [--audio-wav <path>]
+namespace HeadlessPlayback {
+
+Nodes::NodeGraph graph;
+U64 audioFrameClock;
+U32 audioBufferCount;
+alignas(32) F32 audioBuffer[Nodes::MAX_OUTPUT_CHANNELS][Nodes::PROCESS_BUFFER_SIZE];
+alignas(32) F32 silentLane[Nodes::PROCESS_BUFFER_SIZE];
+
+void print_usage() {
+	println("Usage: DAWdle --play <project.dawdle> <seconds> [--audio-backend null|wasapi|alsa] [--audio-wav <path>]");
+}
+
+// The same block streaming DAWdle::fill_audio_buffer does, without pausing or the UI lock. Nothing else touches the graph here
+B32 fill_audio_buffer(F32* buffer, U32 numSamples, U32 numChannels) {
+	U32 currentSample = 0;
+	U32 graphChannels = min(numChannels, Nodes::MAX_OUTPUT_CHANNELS);
+	MemoryArena& stackArena = get_scratch_arena();
+	MEMORY_ARENA_FRAME(stackArena) {
+		const F32** lanes = stackArena.alloc<const F32*>(numChannels);
+		while (currentSample < numSamples) {
+			if (audioBufferCount == 0) {
+				graph.generate_output(audioBuffer, graphChannels, audioFrameClock);
+				audioFrameClock += Nodes::PROCESS_BUFFER_SIZE;
+				audioBufferCount = Nodes::PROCESS_BUFFER_SIZE;
+			}
+			U32 samplesToGenerate = min(audioBufferCount, numSamples - currentSample);
+			U32 laneOffset = Nodes::PROCESS_BUFFER_SIZE - audioBufferCount;
+			for (U32 i = 0; i < numChannels; i++) {
+				lanes[i] = (i < graphChannels ? audioBuffer[i] : silentLane) + laneOffset;
+			}
+			AudioDevice::interleave_channels(buffer, lanes, samplesToGenerate, numChannels);
+			buffer += samplesToGenerate * numChannels;
+			audioBufferCount -= samplesToGenerate;
+			currentSample += samplesToGenerate;
+		}
+	}
+	return true;
+}
+
+// args are everything after --play
+U32 run_headless_playback(int argc, char** argv) {
+	if (argc < 2) {
+		print_usage();
+		return EXIT_FAILURE;
+	}
+	const char* projectPath = argv[0];
+	F64 durationSeconds;
+	StrA durationStr{ argv[1], strlen(argv[1]) };
+	if (!SerializeTools::parse_f64(&durationSeconds, &durationStr) || durationStr.length != 0 || !(durationSeconds > 0.0)) {
+		println("Duration must be a positive number of seconds");
+		return EXIT_FAILURE;
+	}
+
+	AudioDevice::init(AudioDevice::requestedBackend, fill_audio_buffer, AudioDevice::requestedWavOutputPath);
+	graph.init();
+	if (!Serialization::LoadNodeGraph(graph, projectPath)) {
+		AudioDevice::shutdown();
+		return EXIT_FAILURE;
+	}
+	audioFrameClock = 0;
+	audioBufferCount = 0;
+	U64 totalFrames = U64(durationSeconds * F64(AudioDevice::sample_rate()));
+	while (AudioDevice::stats.framesRendered < totalFrames) {
+		AudioDevice::do_audio();
+	}
+	AudioDevice::shutdown();
+	graph.delete_all_nodes();
+
+	print("Played ");
+	print_integer(AudioDevice::stats.framesRendered);
+	print(" frames in ");
+	print_integer(AudioDevice::stats.callbackCount);
+	print(" callbacks, ");
+	print_integer(AudioDevice::stats.xrunCount);
+	println(" xruns");
+	char json[1024];
+	println(DeadlineMonitor::dump_json(json, sizeof(json)));
+	return EXIT_SUCCESS;
+}
+
+}
@@ -3,14 +3,937 @@
 #include "Nodes.h"
 #include "UI.h"
 #include "Serialization.h"
+#include "DeadlineMonitor.h"
 
 namespace DAWdle {
 extern B32 isPaused;
+extern volatile B32 audioClockResetRequested;
 extern F64 audioPlaybackTime;
 }
 
 namespace NodeUI {
 
+// Random numbers
+const U64 UI_TYPE_ID_NODE_WIDGET_INPUT = 0x1126F1C02281B4EEull;
+const U64 UI_TYPE_ID_NODE_WIDGET_OUTPUT = 0xCE6949D284D6D8EDull;
+
+constexpr V4F32 SLIDER_COLOR{ 0.1F, 0.2F, 0.1F, 1.0F };
+constexpr V4F32 SLIDER_ERROR_COLOR{ 0.3F, 0.08F, 0.08F, 1.0F };
+
+// The model never holds a box, so this is how the view gets from a graph, node or widget back to whatever is showing it.
+// Open addressing on the object's address. View has to start with a const void* key, null for an empty slot, and be fine zeroed
+template<typename View>
+struct ViewTable {
+	View* slots;
+	U32 capacity;
+	U32 count;
+
+	FINLINE U32 home_slot(const void* key) {
+		return U32((UPtr(key) * 0x9E3779B97F4A7C15ull) >> 32) & (capacity - 1);
+	}
+
+	View* find(const void* key) {
+		if (count == 0) {
+			return nullptr;
+		}
+		for (U32 i = home_slot(key); slots[i].key; i = (i + 1) & (capacity - 1)) {
+			if (slots[i].key == key) {
+				return &slots[i];
+			}
+		}
+		return nullptr;
+	}
+
+	// Anything new is zeroed apart from the key. Adding can move every entry, so don't hold on to the result past the next add
+	View* get_or_add(const void* key) {
+		if (View* view = find(key)) {
+			return view;
+		}
+		if ((count + 1) * 4 > capacity * 3) {
+			View* oldSlots = slots;
+			U32 oldCapacity = capacity;
+			capacity = max(oldCapacity * 2, 64u);
+			slots = reinterpret_cast<View*>(heap_zalloc(capacity * sizeof(View)));
+			if (!slots) {
+				abort("Out of memory");
+			}
+			for (U32 i = 0; i < oldCapacity; i++) {
+				if (oldSlots[i].key) {
+					U32 slot = home_slot(oldSlots[i].key);
+					while (slots[slot].key) {
+						slot = (slot + 1) & (capacity - 1);
+					}
+					slots[slot] = oldSlots[i];
+				}
+			}
+			heap_free(oldSlots);
+		}
+		U32 slot = home_slot(key);
+		while (slots[slot].key) {
+			slot = (slot + 1) & (capacity - 1);
+		}
+		slots[slot] = View{};
+		slots[slot].key = key;
+		count++;
+		return &slots[slot];
+	}
+
+	void remove(const void* key) {
+		View* view = find(key);
+		if (!view) {
+			return;
+		}
+		// Shifts later entries of the run back into the hole instead of leaving a tombstone, so find can always stop at the first empty slot.
+		// An entry can move back as long as that doesn't put it before its home slot
+		U32 mask = capacity - 1;
+		U32 hole = U32(view - slots);
+		for (U32 i = (hole + 1) & mask; slots[i].key; i = (i + 1) & mask) {
+			if (((i - home_slot(slots[i].key)) & mask) >= ((i - hole) & mask)) {
+				slots[hole] = slots[i];
+				hole = i;
+			}
+		}
+		slots[hole] = View{};
+		count--;
+	}
+};
+
+struct GraphView {
+	const void* key;
+	// Shared by every panel showing the graph
+	UI::BoxHandle box;
+};
+struct NodeView {
+	const void* key;
+	UI::BoxHandle box;
+	UI::BoxHandle titleBox;
+	// Buttons showing settings that can change from outside the view (loading a file, say), like the STFT size, hop and window
+	UI::BoxHandle settingButtons[3];
+};
+struct WidgetView {
+	const void* key;
+	// The slider for inputs, the connector for outputs, the scroll bar for piano rolls
+	UI::BoxHandle box;
+	// Where connections to an input or output are drawn to. Picked up every frame as the connector draws
+	V2F32 connectionRenderPos;
+};
+
+ViewTable<GraphView> graphViews;
+ViewTable<NodeView> nodeViews;
+ViewTable<WidgetView> widgetViews;
+
+// One vertical span per column, min to max, filling the box left to right. Full scale is the box's height
+void draw_peak_columns(UI::UserCommunication& comm, PeakPyramid::Peak* columns, U32 columnCount, V2F32 origin, F32 width, F32 height, V4F32 color) {
+	F32 columnWidth = width / F32(columnCount);
+	F32 halfHeight = height * 0.5F;
+	for (U32 i = 0; i < columnCount; i++) {
+		PeakPyramid::Peak peak = columns[i];
+		// Reaching over to the neighbor's range keeps steep edges from breaking up into separate dots
+		if (i > 0) {
+			peak.min = min(peak.min, columns[i - 1].max);
+			peak.max = max(peak.max, columns[i - 1].min);
+		}
+		F32 top = origin.y + halfHeight - clamp(peak.max, -1.0F, 1.0F) * halfHeight;
+		F32 bottom = origin.y + halfHeight - clamp(peak.min, -1.0F, 1.0F) * halfHeight;
+		// Flat stretches still need to be visible
+		F32 center = (top + bottom) * 0.5F;
+		top = min(top, center - 1.0F);
+		bottom = max(bottom, center + 1.0F);
+		F32 x = origin.x + F32(i) * columnWidth;
+		comm.tessellator->ui_rect2d(x, top, x + columnWidth, bottom, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, color, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
+	}
+}
+
+void build_widget(Nodes::NodeWidgetInput& input) {
+	using namespace UI;
+	using namespace Nodes;
+	UI_RBOX() {
+		workingBox.unsafeBox->backgroundColor = V4F32{ 0.05F, 0.05F, 0.05F, 1.0F }.to_rgba8();
+		workingBox.unsafeBox->flags &= ~BOX_FLAG_INVISIBLE;
+		spacer(6.0F);
+
+		BoxHandle sliderHandle;
+		UI_BACKGROUND_COLOR((V4F32{ SLIDER_COLOR }))
+		sliderHandle = slider_number(-F64_INF, F64_INF, 0.1, [](Box* box) {
+			// Setting the expression comes back around through node_changed, which turns the slider red while the text doesn't parse
+			reinterpret_cast<NodeWidgetInput*>(box->userData[3])->set_expression(StrA{ box->typedTextBuffer, box->numTypedCharacters });
+		});
+		sliderHandle.unsafeBox->userData[3] = UPtr(&input);
+		widgetViews.get_or_add(&input)->box = sliderHandle;
+		// The slider starts out showing its own placeholder, which only gets replaced if there's an expression to show
+		if (input.expressionLength) {
+			Box* slider = sliderHandle.unsafeBox;
+			slider->numTypedCharacters = min(input.expressionLength, MAX_TEXT_INPUT);
+			memcpy(slider->typedTextBuffer, input.expression, slider->numTypedCharacters);
+			slider->backgroundColor = V4F32{ input.program.valid ? SLIDER_COLOR : SLIDER_ERROR_COLOR }.to_rgba8();
+		}
+		UI_SIZE((V2F32{ 8.0F, 8.0F })) {
+			Box* connector = generic_box().unsafeBox;
+			connector->flags = BOX_FLAG_FLOATING_X | BOX_FLAG_CUSTOM_DRAW | BOX_FLAG_CENTER_ON_ORTHOGONAL_AXIS;
+			connector->contentOffset.x = -4.0F;
+			connector->backgroundTexture = &Textures::nodeConnect;
+			connector->userTypeId = UI_TYPE_ID_NODE_WIDGET_INPUT;
+			connector->userData[0] = UPtr(&input);
+			connector->actionCallback = [](Box* box, UserCommunication& comm) {
+				NodeWidgetInput& inputWidget = *reinterpret_cast<NodeWidgetInput*>(box->userData[0]);
+				ActionResult result = ACTION_PASS;
+				if (box == UI::activeBox.get() && comm.tessellator) {
+					F32 handleScale = distance(comm.renderArea.midpoint(), comm.mousePos) * 0.5F;
+					comm.tessellator->ui_bezier_curve(comm.renderArea.midpoint(), comm.renderArea.midpoint() - V2F32{ handleScale, 0.0F }, comm.mousePos + V2F32{ handleScale, 0.0F }, comm.mousePos, comm.renderZ + 0.05F, 32, 2.0F, V4F32{ 1.0F, 1.0F, 1.0F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
+					result = ACTION_HANDLED;
+				}
+				if (comm.tessellator) {
+					widgetViews.find(&inputWidget)->connectionRenderPos = comm.renderArea.midpoint();
+				}
+				if (comm.draggedTo && comm.draggedTo->userTypeId == UI_TYPE_ID_NODE_WIDGET_OUTPUT) {
+					inputWidget.connect(reinterpret_cast<NodeWidgetOutput*>(comm.draggedTo->userData[0]));
+					result = ACTION_HANDLED;
+				}
+				if (comm.leftClickStart && inputWidget.inputHandle.get()) {
+					WidgetView* otherView = widgetViews.find(inputWidget.inputHandle.get());
+					inputWidget.inputHandle = {};
+					if (otherView && otherView->box.get()) {
+						UI::activeBox = otherView->box;
+						result = ACTION_HANDLED;
+					}
+				}
+				return ACTION_PASS;
+			};
+		}
+	}
+}
+
+void build_widget(Nodes::NodeWidgetOutput& output) {
+	using namespace UI;
+	using namespace Nodes;
+	UI_RBOX() {
+		workingBox.unsafeBox->backgroundColor = V4F32{ 0.05F, 0.05F, 0.05F, 1.0F }.to_rgba8();
+		workingBox.unsafeBox->flags &= ~BOX_FLAG_INVISIBLE;
+		spacer();
+		str_a(output.displayStr);
+		spacer();
+		UI_SIZE((V2F32{ 8.0F, 8.0F })) {
+			Box* connector = generic_box().unsafeBox;
+			connector->flags = BOX_FLAG_FLOATING_X | BOX_FLAG_CUSTOM_DRAW | BOX_FLAG_CENTER_ON_ORTHOGONAL_AXIS;
+			connector->contentOffset.x = nodeViews.find(output.header.parent)->box.unsafeBox->minSize.x - 4.0F;
+			connector->backgroundTexture = &Textures::nodeConnect;
+			connector->userTypeId = UI_TYPE_ID_NODE_WIDGET_OUTPUT;
+			connector->userData[0] = UPtr(&output);
+			connector->actionCallback = [](Box* box, UserCommunication& comm) {
+				NodeWidgetOutput& outputWidget = *reinterpret_cast<NodeWidgetOutput*>(box->userData[0]);
+				ActionResult result = ACTION_PASS;
+				if (box == UI::activeBox.get() && comm.tessellator) {
+					F32 handleScale = distance(comm.renderArea.midpoint(), comm.mousePos) * 0.5F;
+					comm.tessellator->ui_bezier_curve(comm.renderArea.midpoint(), comm.renderArea.midpoint() + V2F32{ handleScale, 0.0F }, comm.mousePos - V2F32{ handleScale, 0.0F }, comm.mousePos, comm.renderZ + 0.05F, 32, 2.0F, V4F32{ 1.0F, 1.0F, 1.0F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
+					result = ACTION_HANDLED;
+				}
+				if (comm.tessellator) {
+					widgetViews.find(&outputWidget)->connectionRenderPos = comm.renderArea.midpoint();
+				}
+				if (comm.draggedTo && comm.draggedTo->userTypeId == UI_TYPE_ID_NODE_WIDGET_INPUT) {
+					reinterpret_cast<NodeWidgetInput*>(comm.draggedTo->userData[0])->connect(&outputWidget);
+					result = ACTION_HANDLED;
+				}
+				return result;
+			};
+			widgetViews.get_or_add(&output)->box = BoxHandle{ connector, connector->generation };
+		}
+	}
+}
+
+void build_widget(Nodes::NodeWidgetOscilloscope& osc) {
+	using namespace UI;
+	using namespace Nodes;
+	workingBox.unsafeBox->minSize.x = 200.0F;
+	UI_RBOX() {
+		workingBox.unsafeBox->backgroundColor = V4F32{ 0.1F, 0.1F, 0.1F, 0.9F }.to_rgba8();
+		workingBox.unsafeBox->flags |= BOX_FLAG_CLIP_CHILDREN;
+		BoxHandle contentBox = generic_box();
+		contentBox.unsafeBox->backgroundColor = V4F32{ 0.0F, 0.0F, 0.0F, 1.0F }.to_rgba8();
+		contentBox.unsafeBox->flags |= BOX_FLAG_CUSTOM_DRAW;
+		contentBox.unsafeBox->minSize = V2F32{ 200.0F, 100.0F };
+		contentBox.unsafeBox->actionCallback = [](Box* box, UserCommunication& comm) {
+			NodeWidgetOscilloscope& osc = *reinterpret_cast<NodeWidgetOscilloscope*>(box->userData[1]);
+			if (comm.tessellator) {
+				osc.drain();
+				U64 windowStart = osc.find_trigger();
+				V2F32 origin = box->computedOffset + box->parent->computedOffset;
+				F32 width = comm.renderArea.maxX - comm.renderArea.minX;
+				F32 height = comm.renderArea.maxY - comm.renderArea.minY;
+				// One min to max span per pixel column. Anything finer than that wouldn't show up anyway
+				U32 columnCount = clamp(U32(width), 1u, NodeWidgetOscilloscope::DISPLAY_SAMPLES);
+				MemoryArena& arena = get_scratch_arena();
+				MEMORY_ARENA_FRAME(arena) {
+					PeakPyramid::Peak* columns = arena.alloc<PeakPyramid::Peak>(columnCount);
+					osc.peaks.column_peaks(windowStart, windowStart + NodeWidgetOscilloscope::DISPLAY_SAMPLES, columnCount, osc.history, columns);
+					draw_peak_columns(comm, columns, columnCount, origin, width, height, V4F32{ 1.0F, 1.0F, 1.0F, 1.0F });
+				}
+			}
+			return UI::ACTION_HANDLED;
+			};
+		contentBox.unsafeBox->userData[1] = UPtr(&osc);
+		spacer(20.0F);
+	}
+}
+
+void build_widget(Nodes::NodeWidgetSamplerButton& button) {
+	using namespace UI;
+	using namespace Nodes;
+	UI_RBOX() {
+		workingBox.unsafeBox->backgroundColor = V4F32{ 0.05F, 0.05F, 0.05F, 1.0F }.to_rgba8();
+		workingBox.unsafeBox->flags &= ~BOX_FLAG_INVISIBLE;
+		spacer(20.0F);
+		UI_BACKGROUND_COLOR((V4F32{ 0.1F, 0.1F, 0.1F, 0.0F }))
+			text_button("Load Sample"sa, [](Box* box) {
+				NodeWidgetSamplerButton& button = *reinterpret_cast<NodeWidgetSamplerButton*>(box->userData[1]);
+
+				inDialog = true;
+				open_file_dialog(button.path, sizeof(button.path), "Sound Files (*.flac; *.ogg; *.opus; *.wav)\0*.flac;*.ogg;*.opus;*.wav\0\0");
+				inDialog = false;
+
+				button.loadFromFile();
+			}).unsafeBox->userData[1] = UPtr(&button);
+		spacer(20.0F);
+	}
+	UI_RBOX() {
+		workingBox.unsafeBox->backgroundColor = V4F32{ 0.05F, 0.05F, 0.05F, 1.0F }.to_rgba8();
+		workingBox.unsafeBox->flags &= ~BOX_FLAG_INVISIBLE;
+		workingBox.unsafeBox->flags |= BOX_FLAG_CLIP_CHILDREN;
+		spacer(20.0F);
+		BoxHandle thumbnailBox = generic_box();
+		thumbnailBox.unsafeBox->backgroundColor = V4F32{ 0.0F, 0.0F, 0.0F, 1.0F }.to_rgba8();
+		thumbnailBox.unsafeBox->flags |= BOX_FLAG_CUSTOM_DRAW;
+		thumbnailBox.unsafeBox->minSize = V2F32{ 160.0F, 48.0F };
+		thumbnailBox.unsafeBox->actionCallback = [](Box* box, UserCommunication& comm) {
+			NodeWidgetSamplerButton& button = *reinterpret_cast<NodeWidgetSamplerButton*>(box->userData[1]);
+			if (comm.tessellator && button.numSamples) {
+				if (!button.peaks.storage) {
+					button.peaks.init(button.numSamples);
+					button.peaks.append(button.audioData, button.numSamples);
+				}
+				V2F32 origin = box->computedOffset + box->parent->computedOffset;
+				F32 width = comm.renderArea.maxX - comm.renderArea.minX;
+				F32 height = comm.renderArea.maxY - comm.renderArea.minY;
+				U32 columnCount = max(U32(width), 1u);
+				MemoryArena& arena = get_scratch_arena();
+				MEMORY_ARENA_FRAME(arena) {
+					PeakPyramid::Peak* columns = arena.alloc<PeakPyramid::Peak>(columnCount);
+					button.peaks.column_peaks(0, button.numSamples, columnCount, button.audioData, columns);
+					draw_peak_columns(comm, columns, columnCount, origin, width, height, V4F32{ 0.6F, 0.8F, 1.0F, 1.0F });
+				}
+			}
+			return UI::ACTION_HANDLED;
+		};
+		thumbnailBox.unsafeBox->userData[1] = UPtr(&button);
+		spacer(20.0F);
+	}
+}
+
+void build_widget(Nodes::NodeWidgetPianoRoll& pianoRoll) {
+	using namespace UI;
+	using namespace Nodes;
+	workingBox.unsafeBox->minSize = V2F32{ 500.0F, 300.0F };
+	UI_BACKGROUND_COLOR((V4F32{ 0.07F, 0.07F, 0.07F, 1.0F }))
+	UI_RBOX() {
+		workingBox.unsafeBox->minSize = V2F32{ 500.0F, 200.0F };
+		BoxHandle rollUI = generic_box();
+		rollUI.unsafeBox->flags |= BOX_FLAG_DONT_LAYOUT_TO_FIT_CHILDREN | BOX_FLAG_CLIP_CHILDREN;
+		rollUI.unsafeBox->sizeParentPercent = V2F32{ 1.0F, 1.0F };
+		rollUI.unsafeBox->layoutDirection = LAYOUT_DIRECTION_RIGHT;
+		UI_WORKING_BOX(rollUI) {
+			BoxHandle piano = generic_box();
+			piano.unsafeBox->flags |= BOX_FLAG_CLIP_CHILDREN | BOX_FLAG_CUSTOM_DRAW;
+			piano.unsafeBox->backgroundColor = V4F32{ 0.04F, 0.04F, 0.04F, 1.0F }.to_rgba8();
+			piano.unsafeBox->minSize = V2F32{ 60.0F, 1200.0F };
+			piano.unsafeBox->actionCallback = [](Box* box, UserCommunication& comm) {
+				NodeWidgetPianoRoll& pianoRoll = *reinterpret_cast<NodeWidgetPianoRoll*>(box->userData[0]);
+				if (comm.tessellator) {
+					for (U32 i = 0; i < 10; i++) {
+						U32 baseOffset = (10 - i) * 120;
+						comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 14.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 1.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.9F, 0.9F, 0.9F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
+						comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 34.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 16.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.9F, 0.9F, 0.9F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
+						comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 49.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 36.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.9F, 0.9F, 0.9F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
+						comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 64.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 51.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.9F, 0.9F, 0.9F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
+						comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 84.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 66.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.9F, 0.9F, 0.9F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
+						comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 104.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 86.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.9F, 0.9F, 0.9F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
+						comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 119.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 106.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.9F, 0.9F, 0.9F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
+
+						F32 halfMaxX = (comm.renderArea.minX + comm.renderArea.maxX) * 0.5F;
+						comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 20.0F) * comm.scale, halfMaxX, comm.renderArea.minY + (baseOffset - 10.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.04F, 0.04F, 0.04F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
+						comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 40.0F) * comm.scale, halfMaxX, comm.renderArea.minY + (baseOffset - 30.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.04F, 0.04F, 0.04F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
+						comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 70.0F) * comm.scale, halfMaxX, comm.renderArea.minY + (baseOffset - 60.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.04F, 0.04F, 0.04F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
+						comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 90.0F) * comm.scale, halfMaxX, comm.renderArea.minY + (baseOffset - 80.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.04F, 0.04F, 0.04F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
+						comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 110.0F) * comm.scale, halfMaxX, comm.renderArea.minY + (baseOffset - 100.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.04F, 0.04F, 0.04F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
+
+						TextRenderer::draw_string_batched(*comm.tessellator, NOTE_DISPLAY_NAMES[i * 12], mix(comm.renderArea.minX, comm.renderArea.maxX, 0.75F), comm.renderArea.minY + (baseOffset - 12.0F) * comm.scale, comm.renderZ, 12.0F * comm.scale, V4F32{ 0.0F, 0.0F, 0.0F, 1.0F }, comm.clipBoxIndex << 16);
+					}
+					return ACTION_HANDLED;
+				}
+				if (comm.leftClickStart) {
+					Note noteBase = NOTE_C0;
+					for (U32 i = 0; i < 10; i++) {
+						U32 baseOffset = (10 - i) * 120;
+						F32 halfMaxX = (comm.renderArea.minX + comm.renderArea.maxX) * 0.5F;
+						pianoRoll.manuallyPlayedNoteStart = DAWdle::audioPlaybackTime;
+						if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 20.0F) * comm.scale, halfMaxX, comm.renderArea.minY + (baseOffset - 10.0F) * comm.scale }, comm.mousePos)) {
+							pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_C0S);
+						} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 40.0F) * comm.scale, halfMaxX, comm.renderArea.minY + (baseOffset - 30.0F) * comm.scale }, comm.mousePos)) {
+							pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_D0S);
+						} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 70.0F) * comm.scale, halfMaxX, comm.renderArea.minY + (baseOffset - 60.0F) * comm.scale }, comm.mousePos)) {
+							pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_F0S);
+						} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 90.0F) * comm.scale, halfMaxX, comm.renderArea.minY + (baseOffset - 80.0F) * comm.scale }, comm.mousePos)) {
+							pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_G0S);
+						} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 110.0F) * comm.scale, halfMaxX, comm.renderArea.minY + (baseOffset - 100.0F) * comm.scale }, comm.mousePos)) {
+							pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_A0S);
+						} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 14.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 1.0F) * comm.scale }, comm.mousePos)) {
+							pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_C0);
+						} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 34.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 16.0F) * comm.scale }, comm.mousePos)) {
+							pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_D0);
+						} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 49.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 36.0F) * comm.scale }, comm.mousePos)) {
+							pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_E0);
+						} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 64.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 51.0F) * comm.scale }, comm.mousePos)) {
+							pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_F0);
+						} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 84.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 66.0F) * comm.scale }, comm.mousePos)) {
+							pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_G0);
+						} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 104.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 86.0F) * comm.scale }, comm.mousePos)) {
+							pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_A0);
+						} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 119.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 106.0F) * comm.scale }, comm.mousePos)) {
+							pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_B0);
+						}
+						noteBase = Note(U32(noteBase) + 12);
+					}
+					return ACTION_HANDLED;
+				}
+				if (comm.leftClicked) {
+					pianoRoll.manuallyPlayedNote = NOTE_Count;
+					return ACTION_HANDLED;
+				}
+				if (comm.scrollInput) {
+					scroll_bar_manual_input(widgetViews.find(&pianoRoll)->box, -comm.scrollInput * 0.1F / comm.scale);
+					return ACTION_HANDLED;
+				}
+				return ACTION_PASS;
+			};
+			piano.unsafeBox->userData[0] = UPtr(&pianoRoll);
+			
+
+			BoxHandle roll = generic_box();
+			roll.unsafeBox->flags |= BOX_FLAG_CUSTOM_DRAW | BOX_FLAG_CLIP_CHILDREN;
+			roll.unsafeBox->backgroundColor = V4F32{ 0.02F, 0.02F, 0.02F, 1.0F }.to_rgba8();
+			roll.unsafeBox->minSize = V2F32{ 0.0F, 1200.0F };
+			roll.unsafeBox->sizeParentPercent.x = 1.0F;
+			roll.unsafeBox->actionCallback = [](Box* box, UserCommunication& comm) {
+				NodeWidgetPianoRoll& pianoRoll = *reinterpret_cast<NodeWidgetPianoRoll*>(box->userData[0]);
+				if (comm.tessellator) {
+					for (U32 i = 1; i <= 120; i++) {
+						U32 baseOffset = i * 10;
+						F32 width = 0.5F;
+						V4F32 color = V4F32{ 0.2F, 0.2F, 0.2F, 1.0F };
+						if (i % 12 == 0) {
+							color = V4F32{ 0.5F, 0.5F, 0.5F, 1.0F };
+						}
+						comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - width) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset + width) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, color, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
+					}
+					U32 drawStart = 1 + U32(box->contentOffset.x) / 10;
+					for (U32 i = drawStart; i < drawStart + 120; i++) {
+						U32 baseOffset = -box->contentOffset.x + i * 10;
+						F32 width = 0.5F;
+						V4F32 color = V4F32{ 0.2F, 0.2F, 0.2F, 1.0F };
+						if (i % 4 == 0) {
+							color = V4F32{ 0.5F, 0.5F, 0.5F, 1.0F };
+						}
+						comm.tessellator->ui_rect2d(comm.renderArea.minX + (baseOffset - width) * comm.scale, comm.renderArea.minY, comm.renderArea.minX + (baseOffset + width) * comm.scale, comm.renderArea.maxY, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, color, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
+					}
+					for (U32 i = 0; i < pianoRoll.noteCount; i++) {
+						PianoRollNote note = pianoRoll.notes[i];
+						comm.tessellator->ui_rect2d(comm.renderArea.minX + (note.startTime * 40.0F - box->contentOffset.x) * comm.scale, comm.renderArea.maxY - (F32(note.assignedNote) * 10.0F + 10.0F) * comm.scale, comm.renderArea.minX + (note.endTime * 40.0F - box->contentOffset.x) * comm.scale, comm.renderArea.maxY - F32(note.assignedNote) * 10.0F * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{0.8F, 0.8F, 0.8F, 1.0F}, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
+					}
+					return ACTION_HANDLED;
+				}
+				V2F32 mouseRelative = (comm.mousePos - V2F32{ comm.renderArea.minX, comm.renderArea.minY }) / comm.scale + box->contentOffset;
+				if (comm.scrollInput) {
+					for (U32 i = 0; i < pianoRoll.noteCount; i++) {
+						PianoRollNote& note = pianoRoll.notes[i];
+						Rng2F32 noteBB{ note.startTime * 40.0F, 1200.0F - F32(note.assignedNote) * 10.0F - 10.0F, note.endTime * 40.0F, 1200.0F - F32(note.assignedNote) * 10.0F };
+						if (rng_contains_point(noteBB, mouseRelative)) {
+							note.endTime = max(note.startTime + 0.25F, note.endTime + F32(signumf32(comm.scrollInput)) * 0.25F);
+							return ACTION_HANDLED;
+						}
+					}
+					box->contentOffset.x = max(box->contentOffset.x - comm.scrollInput * comm.scale * 0.5F, 0.0F);
+					return ACTION_HANDLED;
+				}
+
+				if (comm.leftClickStart) {
+					F32 startTime = 0.25F * floorf32(mouseRelative.x * 0.1F);
+					Note assignedNote = Note(U32(floorf32((1200.0F - mouseRelative.y) * 0.1F)));
+					pianoRoll.add_note(PianoRollNote{ startTime, startTime + 1.0F, assignedNote, NOTE_FREQUENCIES[assignedNote] });
+					pianoRoll.manuallyPlayedNote = assignedNote;
+					return ACTION_HANDLED;
+				}
+				if (comm.leftClicked) {
+					pianoRoll.manuallyPlayedNote = NOTE_Count;
+					return ACTION_HANDLED;
+				}
+				if (comm.rightClickStart) {
+					for (U32 i = 0; i < pianoRoll.noteCount; i++) {
+						PianoRollNote& note = pianoRoll.notes[i];
+						Rng2F32 noteBB{ note.startTime * 40.0F, 1200.0F - F32(note.assignedNote) * 10.0F - 10.0F, note.endTime * 40.0F, 1200.0F - F32(note.assignedNote) * 10.0F };
+						if (rng_contains_point(noteBB, mouseRelative)) {
+							pianoRoll.delete_note(i);
+						}
+					}
+					return ACTION_HANDLED;
+				}
+				return ACTION_PASS;
+			};
+			roll.unsafeBox->userData[0] = UPtr(&pianoRoll);
+		}
+		widgetViews.get_or_add(&pianoRoll)->box = scroll_bar(rollUI, 8.0F);
+	}
+}
+
+void build_channel_out_controls(Nodes::NodeHeader* node) {
+	using namespace UI;
+	using namespace Nodes;
+	BoxHandle dropdownBox = generic_box();
+	dropdownBox.unsafeBox->flags |= BOX_FLAG_INVISIBLE;
+	dropdownBox.unsafeBox->layoutDirection = LAYOUT_DIRECTION_RIGHT;
+	dropdownBox.unsafeBox->sizeParentPercent.x = 1.0F;
+	UI_WORKING_BOX(dropdownBox) {
+		spacer();
+		BoxHandle channelSelector = text_button("Channel"sa, nullptr);
+		channelSelector.unsafeBox->userData[1] = UPtr(node);
+		channelSelector.unsafeBox->actionCallback = [](Box* box, UserCommunication& comm) {
+			if (comm.leftClicked) {
+				UI_BACKGROUND_COLOR((V4F32{ 0.15F, 0.15F, 0.15F, 1.0F }))
+				UI_ADD_CONTEXT_MENU(BoxHandle{}, (V2F32{ comm.renderArea.minX, comm.renderArea.maxY })) {
+					contextMenuBox.unsafeBox->contentScale = comm.scale;
+					workingBox.unsafeBox->userData[1] = box->userData[1];
+					BoxConsumer callback = [](Box* box) {
+						reinterpret_cast<NodeChannelOut*>(box->parent->userData[1])->set_channel(U32(box->userData[1]));
+					};
+
+					text_button("All Channels"sa, callback).unsafeBox->userData[1] = CHANNEL_OUT_ALL;
+					for (U32 i = 0; i < MAX_OUTPUT_CHANNELS; i++) {
+						text_button(channel_out_name(i), callback).unsafeBox->userData[1] = i;
+					}
+				}
+			}
+			return ACTION_PASS;
+		};
+		spacer();
+	}
+}
+
+void build_wave_controls(Nodes::NodeHeader* node) {
+	using namespace UI;
+	using namespace Nodes;
+	BoxHandle dropdownBox = generic_box();
+	dropdownBox.unsafeBox->flags |= BOX_FLAG_INVISIBLE;
+	dropdownBox.unsafeBox->layoutDirection = LAYOUT_DIRECTION_RIGHT;
+	dropdownBox.unsafeBox->sizeParentPercent.x = 1.0F;
+	UI_WORKING_BOX(dropdownBox) {
+		spacer();
+		BoxHandle waveformSelector = text_button("Waveform"sa, nullptr);
+		waveformSelector.unsafeBox->userData[1] = UPtr(node);
+		waveformSelector.unsafeBox->actionCallback = [](Box* box, UserCommunication& comm) {
+			if (comm.leftClicked) {
+				UI_BACKGROUND_COLOR((V4F32{ 0.15F, 0.15F, 0.15F, 1.0F }))
+					UI_ADD_CONTEXT_MENU(BoxHandle{}, (V2F32{ comm.renderArea.minX, comm.renderArea.maxY })) {
+					contextMenuBox.unsafeBox->contentScale = comm.scale;
+					workingBox.unsafeBox->userData[1] = box->userData[1];
+					BoxConsumer callback = [](Box* box) {
+						reinterpret_cast<NodeWave*>(box->parent->userData[1])->set_waveform(Waveform(box->userData[1]));
+					};
+
+					for (Waveform op = WAVE_SINE; op <= WAVE_NOISE; op = Waveform(op + 1)) {
+						text_button(waveform_name(op), callback).unsafeBox->userData[1] = UPtr(op);
+					}
+				}
+			}
+			return ACTION_PASS;
+		};
+		spacer();
+	}
+}
+
+void build_filter_controls(Nodes::NodeHeader* node) {
+	using namespace UI;
+	using namespace Nodes;
+	BoxHandle dropdownBox = generic_box();
+	dropdownBox.unsafeBox->flags |= BOX_FLAG_INVISIBLE;
+	dropdownBox.unsafeBox->layoutDirection = LAYOUT_DIRECTION_RIGHT;
+	dropdownBox.unsafeBox->sizeParentPercent.x = 1.0F;
+
+	UI_WORKING_BOX(dropdownBox) {
+		spacer();
+		BoxHandle filterSelector = text_button("Filter Type"sa, nullptr);
+		filterSelector.unsafeBox->userData[1] = UPtr(node);
+		filterSelector.unsafeBox->actionCallback = [](Box* box, UserCommunication& comm) {
+			if (comm.leftClicked) {
+				UI_BACKGROUND_COLOR((V4F32{ 0.15F, 0.15F, 0.15F, 1.0F }))
+					UI_ADD_CONTEXT_MENU(BoxHandle{}, (V2F32{ comm.renderArea.minX, comm.renderArea.maxY })) {
+					contextMenuBox.unsafeBox->contentScale = comm.scale;
+					workingBox.unsafeBox->userData[1] = box->userData[1];
+					BoxConsumer callback = [](Box* box) {
+						NodeFilter* filter = reinterpret_cast<NodeFilter*>(box->parent->userData[1]);
+						filter->filterType = static_cast<FilterType>(box->userData[1]);
+						filter->setFilter(filter->cutoffFrequency, filter->resonance, filter->filterType);
+					};
+
+					for (int op = FILTER_LOWPASS; op <= FILTER_BANDPASS; ++op) {
+						text_button(filterTypeName(static_cast<FilterType>(op)), callback).unsafeBox->userData[1] = UPtr(op);
+					}
+				}
+			}
+			return ACTION_PASS;
+		};
+		spacer();
+	}
+}
+
+void build_math_op_controls(Nodes::NodeHeader* node) {
+	using namespace UI;
+	using namespace Nodes;
+	BoxHandle dropdownBox = generic_box();
+	dropdownBox.unsafeBox->flags |= BOX_FLAG_INVISIBLE;
+	dropdownBox.unsafeBox->layoutDirection = LAYOUT_DIRECTION_RIGHT;
+	dropdownBox.unsafeBox->sizeParentPercent.x = 1.0F;
+	UI_WORKING_BOX(dropdownBox) {
+		spacer();
+		BoxHandle operationSelector = text_button("Operation"sa, nullptr);
+		operationSelector.unsafeBox->userData[1] = UPtr(node);
+		operationSelector.unsafeBox->actionCallback = [](Box* box, UserCommunication& comm) {
+			if (comm.leftClicked) {
+				UI_BACKGROUND_COLOR((V4F32{ 0.15F, 0.15F, 0.15F, 1.0F }))
+				UI_ADD_CONTEXT_MENU(BoxHandle{}, (V2F32{ comm.renderArea.minX, comm.renderArea.maxY })) {
+					contextMenuBox.unsafeBox->contentScale = comm.scale;
+					workingBox.unsafeBox->userData[1] = box->userData[1];
+					BoxConsumer callback = [](Box* box) {
+						reinterpret_cast<NodeMathOp*>(box->parent->userData[1])->set_op(MathOp(box->userData[1]));
+					};
+
+					for (MathOp op = MATH_OP_NEG; op <= MATH_OP_RSQRT; op = MathOp(U32(op) + 1)) {
+						text_button(math_op_name(op), callback).unsafeBox->userData[1] = op;
+					}
+
+					UI_SIZE((V2F32{ 64.0F, 2.0F }))
+					UI_BACKGROUND_COLOR((V4F32{ 0.1F, 0.1F, 0.1F, 1.0F }))
+					generic_box();
+
+					for (MathOp op = MATH_OP_ADD; op <= MATH_OP_REM; op = MathOp(U32(op) + 1)) {
+						text_button(math_op_name(op), callback).unsafeBox->userData[1] = op;
+					}
+
+					UI_SIZE((V2F32{ 64.0F, 2.0F }))
+					UI_BACKGROUND_COLOR((V4F32{ 0.1F, 0.1F, 0.1F, 1.0F }))
+					generic_box();
+
+					for (MathOp op = MATH_OP_EQ; op <= MATH_OP_LE; op = MathOp(U32(op) + 1)) {
+						text_button(math_op_name(op), callback).unsafeBox->userData[1] = op;
+					}
+
+					UI_SIZE((V2F32{ 64.0F, 2.0F }))
+					UI_BACKGROUND_COLOR((V4F32{ 0.1F, 0.1F, 0.1F, 1.0F }))
+					generic_box();
+
+					for (MathOp op = MATH_OP_AND; op <= MATH_OP_MAX; op = MathOp(U32(op) + 1)) {
+						text_button(math_op_name(op), callback).unsafeBox->userData[1] = op;
+					}
+				}
+			}
+			return ACTION_PASS;
+		};
+		spacer();
+	}
+}
+
+void build_oversample_out_controls(Nodes::NodeHeader* node) {
+	using namespace UI;
+	using namespace Nodes;
+	BoxHandle dropdownBox = generic_box();
+	dropdownBox.unsafeBox->flags |= BOX_FLAG_INVISIBLE;
+	dropdownBox.unsafeBox->layoutDirection = LAYOUT_DIRECTION_RIGHT;
+	dropdownBox.unsafeBox->sizeParentPercent.x = 1.0F;
+	UI_WORKING_BOX(dropdownBox) {
+		spacer();
+		BoxHandle factorSelector = text_button("Factor"sa, nullptr);
+		factorSelector.unsafeBox->userData[1] = UPtr(node);
+		factorSelector.unsafeBox->actionCallback = [](Box* box, UserCommunication& comm) {
+			if (comm.leftClicked) {
+				UI_BACKGROUND_COLOR((V4F32{ 0.15F, 0.15F, 0.15F, 1.0F }))
+				UI_ADD_CONTEXT_MENU(BoxHandle{}, (V2F32{ comm.renderArea.minX, comm.renderArea.maxY })) {
+					contextMenuBox.unsafeBox->contentScale = comm.scale;
+					workingBox.unsafeBox->userData[1] = box->userData[1];
+					BoxConsumer callback = [](Box* box) {
+						reinterpret_cast<NodeOversampleOut*>(box->parent->userData[1])->set_log2_factor(U32(box->userData[1]));
+					};
+
+					for (U32 i = 0; i <= Oversampling::MAX_LOG2_FACTOR; i++) {
+						text_button(OVERSAMPLE_FACTOR_NAMES[i], callback).unsafeBox->userData[1] = i;
+					}
+				}
+			}
+			return ACTION_PASS;
+		};
+		spacer();
+	}
+}
+
+// Builds the size/hop/window dropdowns for either STFT node. StftNode has to have a settings member and an apply_settings function
+template<typename StftNode>
+void build_stft_settings_controls(Nodes::NodeHeader* header) {
+	using namespace UI;
+	using namespace Nodes;
+	StftNode* node = reinterpret_cast<StftNode*>(header);
+	// Kept so node_changed can relabel them when the settings change from somewhere else
+	BoxHandle* settingButtons = nodeViews.find(header)->settingButtons;
+	BoxHandle dropdownBox = generic_box();
+	dropdownBox.unsafeBox->flags |= BOX_FLAG_INVISIBLE;
+	dropdownBox.unsafeBox->layoutDirection = LAYOUT_DIRECTION_RIGHT;
+	dropdownBox.unsafeBox->sizeParentPercent.x = 1.0F;
+	UI_WORKING_BOX(dropdownBox) {
+		spacer();
+		settingButtons[0] = text_button(STFT_FFT_SIZE_NAMES[node->settings.log2FftSize - STFT_MIN_LOG2_FFT_SIZE], nullptr);
+		settingButtons[0].unsafeBox->userData[1] = UPtr(node);
+		settingButtons[0].unsafeBox->actionCallback = [](Box* box, UserCommunication& comm) {
+			if (comm.leftClicked) {
+				UI_BACKGROUND_COLOR((V4F32{ 0.15F, 0.15F, 0.15F, 1.0F }))
+					UI_ADD_CONTEXT_MENU(BoxHandle{}, (V2F32{ comm.renderArea.minX, comm.renderArea.maxY })) {
+					contextMenuBox.unsafeBox->contentScale = comm.scale;
+					workingBox.unsafeBox->userData[1] = box->userData[1];
+					BoxConsumer callback = [](Box* box) {
+						StftNode* stftNode = reinterpret_cast<StftNode*>(box->parent->userData[1]);
+						StftSettings newSettings = stftNode->settings;
+						newSettings.log2FftSize = U32(box->userData[1]);
+						stftNode->apply_settings(newSettings);
+					};
+					for (U32 log2Size = STFT_MIN_LOG2_FFT_SIZE; log2Size <= STFT_MAX_LOG2_FFT_SIZE; log2Size++) {
+						text_button(STFT_FFT_SIZE_NAMES[log2Size - STFT_MIN_LOG2_FFT_SIZE], callback).unsafeBox->userData[1] = log2Size;
+					}
+				}
+			}
+			return ACTION_PASS;
+		};
+		spacer();
+		settingButtons[1] = text_button(STFT_HOP_NAMES[node->settings.log2HopDivisor], nullptr);
+		settingButtons[1].unsafeBox->userData[1] = UPtr(node);
+		settingButtons[1].unsafeBox->actionCallback = [](Box* box, UserCommunication& comm) {
+			if (comm.leftClicked) {
+				UI_BACKGROUND_COLOR((V4F32{ 0.15F, 0.15F, 0.15F, 1.0F }))
+					UI_ADD_CONTEXT_MENU(BoxHandle{}, (V2F32{ comm.renderArea.minX, comm.renderArea.maxY })) {
+					contextMenuBox.unsafeBox->contentScale = comm.scale;
+					workingBox.unsafeBox->userData[1] = box->userData[1];
+					BoxConsumer callback = [](Box* box) {
+						StftNode* stftNode = reinterpret_cast<StftNode*>(box->parent->userData[1]);
+						StftSettings newSettings = stftNode->settings;
+						newSettings.log2HopDivisor = U32(box->userData[1]);
+						stftNode->apply_settings(newSettings);
+					};
+					for (U32 log2Divisor = 1; log2Divisor <= STFT_MAX_LOG2_HOP_DIVISOR; log2Divisor++) {
+						text_button(STFT_HOP_NAMES[log2Divisor], callback).unsafeBox->userData[1] = log2Divisor;
+					}
+				}
+			}
+			return ACTION_PASS;
+		};
+		spacer();
+		settingButtons[2] = text_button(stft_window_name(node->settings.window), nullptr);
+		settingButtons[2].unsafeBox->userData[1] = UPtr(node);
+		settingButtons[2].unsafeBox->actionCallback = [](Box* box, UserCommunication& comm) {
+			if (comm.leftClicked) {
+				UI_BACKGROUND_COLOR((V4F32{ 0.15F, 0.15F, 0.15F, 1.0F }))
+					UI_ADD_CONTEXT_MENU(BoxHandle{}, (V2F32{ comm.renderArea.minX, comm.renderArea.maxY })) {
+					contextMenuBox.unsafeBox->contentScale = comm.scale;
+					workingBox.unsafeBox->userData[1] = box->userData[1];
+					BoxConsumer callback = [](Box* box) {
+						StftNode* stftNode = reinterpret_cast<StftNode*>(box->parent->userData[1]);
+						StftSettings newSettings = stftNode->settings;
+						newSettings.window = StftWindow(box->userData[1]);
+						stftNode->apply_settings(newSettings);
+					};
+					for (StftWindow window = STFT_WINDOW_HANN; window < STFT_WINDOW_COUNT; window = StftWindow(window + 1)) {
+						text_button(stft_window_name(window), callback).unsafeBox->userData[1] = UPtr(window);
+					}
+				}
+			}
+			return ACTION_PASS;
+		};
+		spacer();
+	}
+}
+
+void update_stft_settings_controls(const Nodes::StftSettings& settings, UI::BoxHandle* settingButtons) {
+	using namespace Nodes;
+	if (UI::Box* box = settingButtons[0].get()) {
+		box->text = STFT_FFT_SIZE_NAMES[settings.log2FftSize - STFT_MIN_LOG2_FFT_SIZE];
+	}
+	if (UI::Box* box = settingButtons[1].get()) {
+		box->text = STFT_HOP_NAMES[settings.log2HopDivisor];
+	}
+	if (UI::Box* box = settingButtons[2].get()) {
+		box->text = stft_window_name(settings.window);
+	}
+}
+
+// A node's own controls, wherever its custom element sits among its widgets
+void build_widget(Nodes::NodeWidgetCustomUIElement& element) {
+	using namespace Nodes;
+	NodeHeader* node = element.header.parent;
+	switch (node->type) {
+	case NODE_CHANNEL_OUT: build_channel_out_controls(node); break;
+	case NODE_WAVE: build_wave_controls(node); break;
+	case NODE_FILTER: build_filter_controls(node); break;
+	case NODE_MATH: build_math_op_controls(node); break;
+	case NODE_OVERSAMPLE_OUT: build_oversample_out_controls(node); break;
+	case NODE_STFT_ANALYSIS: build_stft_settings_controls<NodeSTFTAnalysis>(node); break;
+	case NODE_STFT_SYNTHESIS: build_stft_settings_controls<NodeSTFTSynthesis>(node); break;
+	default: break;
+	}
+}
+
+void build_node(UI::BoxHandle graphBox, Nodes::NodeHeader* node) {
+	using namespace UI;
+	using namespace Nodes;
+	BoxHandle oldWorkingBox = workingBox;
+	workingBox = graphBox;
+	BoxHandle nodeBox = generic_box();
+	nodeViews.get_or_add(node)->box = nodeBox;
+	Box* box = nodeBox.unsafeBox;
+	box->layoutDirection = LAYOUT_DIRECTION_DOWN;
+	box->backgroundColor = V4F32{ 0.0F, 1.0F, 0.0F, 1.0F }.to_rgba8();
+	box->minSize = V2F32{ 120.0F, 200.0F };
+	box->flags = BOX_FLAG_FLOATING_X | BOX_FLAG_FLOATING_Y | BOX_FLAG_DONT_LAYOUT_TO_FIT_CHILDREN;
+	box->contentOffset = node->offset;
+	box->zOffset = -0.1F;
+	box->userData[0] = UPtr(node);
+	box->actionCallback = [](Box* box, UserCommunication& comm) {
+		if (comm.drag.x != 0.0F || comm.drag.y != 0.0F) {
+			box->contentOffset += comm.drag;
+			reinterpret_cast<NodeHeader*>(box->userData[0])->offset = box->contentOffset;
+			return ACTION_HANDLED;
+		}
+		if (comm.leftClickStart) {
+			UI::move_box_to_front(box);
+		}
+		return ACTION_PASS;
+	};
+	workingBox = nodeBox;
+
+	UI_RBOX() {
+		spacer();
+		UI_TEXT_SIZE(12.0F)
+		UI_TEXT_COLOR((V4F32{ 0.2F, 0.0F, 0.0F, 1.0F }))
+		nodeViews.find(node)->titleBox = str_a(StrA{ node->title, node->titleLength });
+		spacer();
+		UI_SIZE((V2F32{ 8.0F, 8.0F }));
+		button(Textures::uiX, [](Box* box) {
+			reinterpret_cast<NodeHeader*>(box->userData[1])->parent->delete_node(reinterpret_cast<NodeHeader*>(box->userData[1]));
+		}).unsafeBox->userData[1] = UPtr(node);
+	}
+	for (NodeWidgetHeader* widget = node->widgetBegin; widget; widget = widget->next) {
+#define X(enumName, typeName) case NODE_WIDGET_##enumName: build_widget(*reinterpret_cast<typeName*>(widget)); break;
+		switch (widget->type) {
+		NODE_WIDGETS
+		default: break;
+		}
+#undef X
+		spacer(2.0F);
+	}
+	workingBox = oldWorkingBox;
+}
+
+void node_created(Nodes::NodeHeader* node) {
+	// Graphs nobody has shown yet get all their nodes built at once when a panel first attaches them
+	if (GraphView* graphView = graphViews.find(node->parent)) {
+		build_node(graphView->box, node);
+	}
+}
+
+void node_deleted(Nodes::NodeHeader* node) {
+	NodeView* nodeView = nodeViews.find(node);
+	if (!nodeView) {
+		return;
+	}
+	UI::free_box(nodeView->box);
+	nodeViews.remove(node);
+	for (Nodes::NodeWidgetHeader* widget = node->widgetBegin; widget; widget = widget->next) {
+		widgetViews.remove(widget);
+	}
+}
+
+void node_changed(Nodes::NodeHeader* node) {
+	using namespace Nodes;
+	NodeView* nodeView = nodeViews.find(node);
+	if (!nodeView) {
+		return;
+	}
+	if (UI::Box* box = nodeView->titleBox.get()) {
+		box->text = StrA{ node->title, node->titleLength };
+	}
+	if (node->type == NODE_STFT_ANALYSIS) {
+		update_stft_settings_controls(reinterpret_cast<NodeSTFTAnalysis*>(node)->settings, nodeView->settingButtons);
+	} else if (node->type == NODE_STFT_SYNTHESIS) {
+		update_stft_settings_controls(reinterpret_cast<NodeSTFTSynthesis*>(node)->settings, nodeView->settingButtons);
+	}
+	for (NodeWidgetHeader* widget = node->widgetBegin; widget; widget = widget->next) {
+		if (widget->type != NODE_WIDGET_INPUT) {
+			continue;
+		}
+		NodeWidgetInput& input = *reinterpret_cast<NodeWidgetInput*>(widget);
+		WidgetView* widgetView = widgetViews.find(&input);
+		UI::Box* slider = widgetView ? widgetView->box.get() : nullptr;
+		if (!slider) {
+			continue;
+		}
+		// Typing into the slider already left it showing the expression, only changes from elsewhere (loading, say) need copying over
+		U32 length = min(input.expressionLength, UI::MAX_TEXT_INPUT);
+		if (slider->numTypedCharacters != length || memcmp(slider->typedTextBuffer, input.expression, length) != 0) {
+			slider->numTypedCharacters = length;
+			memcpy(slider->typedTextBuffer, input.expression, length);
+		}
+		slider->backgroundColor = V4F32{ input.program.valid ? SLIDER_COLOR : SLIDER_ERROR_COLOR }.to_rgba8();
+	}
+}
+
+// Builds the boxes for every node already in the graph the first time it's shown, later nodes get theirs through node_created
+UI::BoxHandle attach_graph(Nodes::NodeGraph* graph) {
+	GraphView* graphView = graphViews.find(graph);
+	if (graphView && graphView->box.get()) {
+		return graphView->box;
+	}
+	UI::BoxHandle graphBox = UI::alloc_box();
+	graphBox.unsafeBox->flags = UI::BOX_FLAG_INVISIBLE;
+	graphViews.get_or_add(graph)->box = graphBox;
+	for (Nodes::NodeHeader* node = graph->nodesFirst; node; node = node->next) {
+		build_node(graphBox, node);
+	}
+	return graphBox;
+}
+
+void draw_connections(Nodes::NodeGraph& graph, DynamicVertexBuffer::Tessellator& tes, F32 z, U32 clipBoxIndex) {
+	using namespace Nodes;
+	for (NodeHeader* node = graph.nodesFirst; node; node = node->next) {
+		for (NodeWidgetHeader* widget = node->widgetBegin; widget; widget = widget->next) {
+			if (widget->type == NODE_WIDGET_INPUT) {
+				NodeWidgetInput& input = *reinterpret_cast<NodeWidgetInput*>(widget);
+				if (NodeWidgetOutput* output = input.inputHandle.get()) {
+					WidgetView* inputView = widgetViews.find(&input);
+					WidgetView* outputView = widgetViews.find(output);
+					if (!inputView || !outputView) {
+						continue;
+					}
+					V2F32 inputPos = inputView->connectionRenderPos;
+					V2F32 outputPos = outputView->connectionRenderPos;
+					V2F32 handleOffset = V2F32{ distance(inputPos, outputPos) * 0.5F, 0.0F };
+					tes.ui_bezier_curve(outputPos, outputPos + handleOffset, inputPos - handleOffset, inputPos, z - 0.05F, 32, 2.0F, V4F32{ 0.8F, 0.8F, 0.8F, 1.0F }, Textures::simpleWhite.index, clipBoxIndex << 16);
+				}
+			}
+		}
+	}
+}
+
 struct Panel;
 Panel* alloc_panel();
 void free_panel(Panel* panel);
@@ -73,7 +996,9 @@ struct Panel {
 					fileDialogOptions.Flags = OFN_FILEMUSTEXIST;
 					inDialog = true;
 					if (GetOpenFileNameA(&fileDialogOptions)) {
-						Serialization::LoadNodeGraph(*graph, loadPath);
+						if (!Serialization::LoadNodeGraph(*graph, loadPath) && Serialization::loadError) {
+							Win32::error_box(Serialization::loadError);
+						}
 					}
 					inDialog = false;
 				}
@@ -95,7 +1020,25 @@ struct Panel {
 			UI_BACKGROUND_COLOR((V4F32{ 0.05F, 0.05F, 0.05F, 1.0F }))
 			text_button("Stop"sa, [](Box* box) {
 				DAWdle::isPaused = true;
-				DAWdle::audioPlaybackTime = 0.0;
+				DAWdle::audioClockResetRequested = true;
+			});
+			spacer(500);
+			// Picks up the monitor's text every frame, it shows up on the next layout
+			BoxHandle timingOverlay = str_a("DSP"sa, [](Box* box, UserCommunication& comm) {
+				if (comm.tessellator && !DeadlineMonitor::overlayText.is_empty()) {
+					box->text = DeadlineMonitor::overlayText;
+				}
+				return ACTION_PASS;
+			});
+			timingOverlay.unsafeBox->flags |= BOX_FLAG_CUSTOM_DRAW;
+			spacer(500);
+			UI_BACKGROUND_COLOR((V4F32{ 0.05F, 0.05F, 0.05F, 1.0F }))
+			text_button("Dump Timing"sa, [](Box* box) {
+				char json[1024];
+				StrA dump = DeadlineMonitor::dump_json(json, sizeof(json));
+				if (write_data_to_file("audio_timing.json"sa, const_cast<char*>(dump.str), U32(dump.length))) {
+					println("Wrote audio timing to audio_timing.json");
+				}
 			});
 			spacer();
 			UI_BACKGROUND_COLOR((V4F32{ 0.02F, 0.02F, 0.02F, 1.0F }))
@@ -111,7 +1054,7 @@ struct Panel {
 			Panel& panel = *reinterpret_cast<Panel*>(box->userData[0]);
 			UI::ActionResult result = UI::ACTION_PASS;
 			if (comm.tessellator) {
-				panel.nodeGraph->draw_connections(*comm.tessellator, comm.renderZ, comm.clipBoxIndex);
+				draw_connections(*panel.nodeGraph, *comm.tessellator, comm.renderZ, comm.clipBoxIndex);
 				result = UI::ACTION_HANDLED;
 			}
 			if (comm.scrollInput != 0.0F) {
@@ -210,6 +1153,27 @@ struct Panel {
 					text_button("From Polar"sa, [](Box* box) {
 						reinterpret_cast<Nodes::NodeGraph*>(box->parent->userData[0])->create_node<Nodes::NodeFromPolar>(bitcast<V2F32>(box->parent->userData[1]));
 					});
+					text_button("STFT Analysis"sa, [](Box* box) {
+						reinterpret_cast<Nodes::NodeGraph*>(box->parent->userData[0])->create_node<Nodes::NodeSTFTAnalysis>(bitcast<V2F32>(box->parent->userData[1]));
+					});
+					text_button("STFT Synthesis"sa, [](Box* box) {
+						reinterpret_cast<Nodes::NodeGraph*>(box->parent->userData[0])->create_node<Nodes::NodeSTFTSynthesis>(bitcast<V2F32>(box->parent->userData[1]));
+					});
+					text_button("Convolution Reverb"sa, [](Box* box) {
+						reinterpret_cast<Nodes::NodeGraph*>(box->parent->userData[0])->create_node<Nodes::NodeConvolution>(bitcast<V2F32>(box->parent->userData[1]));
+					});
+					text_button("Pan"sa, [](Box* box) {
+						reinterpret_cast<Nodes::NodeGraph*>(box->parent->userData[0])->create_node<Nodes::NodePan>(bitcast<V2F32>(box->parent->userData[1]));
+					});
+					text_button("Spread"sa, [](Box* box) {
+						reinterpret_cast<Nodes::NodeGraph*>(box->parent->userData[0])->create_node<Nodes::NodeSpread>(bitcast<V2F32>(box->parent->userData[1]));
+					});
+					text_button("Oversample In"sa, [](Box* box) {
+						reinterpret_cast<Nodes::NodeGraph*>(box->parent->userData[0])->create_node<Nodes::NodeOversampleIn>(bitcast<V2F32>(box->parent->userData[1]));
+					});
+					text_button("Oversample"sa, [](Box* box) {
+						reinterpret_cast<Nodes::NodeGraph*>(box->parent->userData[0])->create_node<Nodes::NodeOversampleOut>(bitcast<V2F32>(box->parent->userData[1]));
+					});
 					BoxHandle test = generic_box();
 					test.unsafeBox->flags |= BOX_FLAG_DONT_CLOSE_CONTEXT_MENU_ON_INTERACTION | BOX_FLAG_HIGHLIGHT_ON_USER_INTERACTION;
 					test.unsafeBox->text = "Another context menu"sa;
@@ -235,7 +1199,7 @@ struct Panel {
 		content.unsafeBox->userData[0] = UPtr(this);
 
 		if (nodeGraph) {
-			if (UI::Box* graphBox = nodeGraph->uiBox.get()) {
+			if (UI::Box* graphBox = attach_graph(nodeGraph).get()) {
 				// It's important to not set graphBox's pointers here; unlike most boxes, it's expected to be children of multiple panels
 				contentBox->childFirst = contentBox->childLast = graphBox;
 			}
@@ -363,6 +1327,9 @@ void free_panel(Panel* panel) {
 }
 
 void init(Nodes::NodeGraph* defaultGraph) {
+	Nodes::viewCallbacks.nodeCreated = node_created;
+	Nodes::viewCallbacks.nodeDeleted = node_deleted;
+	Nodes::viewCallbacks.nodeChanged = node_changed;
 	Panel* panel = alloc_panel();
 	panel->nodeGraph = defaultGraph;
 	panel->uiBox = UI::alloc_box();
@@ -1,24 +1,29 @@
 #pragma once
-#include <commdlg.h>
 #include <libsoundwave/AudioDecoder.h>
 #include <filesystem>
 #include "DrillLib.h"
-#include "UI.h"
-#include "ExpressionParser.h"
+#include "AudioFormat.h"
+#include "ExpressionJIT.h"
 #include "FFT.h"
+#include "Oversampling.h"
+#include "PeakPyramid.h"
 
-namespace DAWdle {
-extern F64 audioPlaybackTime;
-}
 namespace Nodes {
 
 const U32 PROCESS_BUFFER_SIZE = 1024;
 
-const U32 INVALID_NODE_IDX = 0xFFFFFFFF;
+// base, base + step, base + 2 * step... for length samples, a multiple of 4. One FMA per 4 samples from an index vector, so there's no divide per sample and no error accumulating from repeated adds
+void fill_linear_ramp(F64* buffer, U32 length, F64 base, F64 step) {
+	__m256d baseX4 = _mm256_set1_pd(base);
+	__m256d stepX4 = _mm256_set1_pd(step);
+	__m256d index = _mm256_setr_pd(0.0, 1.0, 2.0, 3.0);
+	for (U32 i = 0; i < length; i += 4) {
+		_mm256_store_pd(buffer + i, _mm256_fmadd_pd(index, stepX4, baseX4));
+		index = _mm256_add_pd(index, _mm256_set1_pd(4.0));
+	}
+}
 
-// Random numbers
-const U64 UI_TYPE_ID_NODE_WIDGET_INPUT = 0x1126F1C02281B4EEull;
-const U64 UI_TYPE_ID_NODE_WIDGET_OUTPUT = 0xCE6949D284D6D8EDull;
+const U32 INVALID_NODE_IDX = 0xFFFFFFFF;
 
 struct NodeHeader;
 void process_node(NodeHeader* node);
@@ -43,7 +48,14 @@ void process_node(NodeHeader* node);
 	X(TO_FREQUENCY_DOMAIN, NodeFFT)\
 	X(TO_TIME_DOMAIN, NodeIFFT)\
 	X(TO_POLAR, NodeToPolar)\
-	X(FROM_POLAR, NodeFromPolar)
+	X(FROM_POLAR, NodeFromPolar)\
+	X(STFT_ANALYSIS, NodeSTFTAnalysis)\
+	X(STFT_SYNTHESIS, NodeSTFTSynthesis)\
+	X(CONVOLUTION, NodeConvolution)\
+	X(PAN, NodePan)\
+	X(SPREAD, NodeSpread)\
+	X(OVERSAMPLE_IN, NodeOversampleIn)\
+	X(OVERSAMPLE_OUT, NodeOversampleOut)
 
 #define X(enumName, typeName) NODE_##enumName,
 enum NodeType : U32 {
@@ -64,6 +76,17 @@ enum NodeIOType : U32 {
 	NODE_IO_LIST_BUFFER, // List of buffers (typically small buffers, used for things like multiple notes playing at a time). Comes with a buffer of values plus a buffer of list offsets for each sample
 	NODE_IO_COUNT
 };
+// What's known about a value's samples for the current block, so nodes downstream can skip work that wouldn't change anything.
+// No flags means nothing is known, which is always safe, so a node that doesn't set them costs some speed but never correctness
+enum NodeIOFlag : U32 {
+	// Every sample is the same
+	NODE_IO_FLAG_CONSTANT = 1 << 0,
+	// Every sample is zero. An empty list counts, there's nothing in it to hear
+	NODE_IO_FLAG_SILENT = 1 << 1,
+	// No sample is denormal, so arithmetic on it stays on the fast path
+	NODE_IO_FLAG_DENORMAL_FREE = 1 << 2
+};
+const U32 NODE_IO_SILENCE_FLAGS = NODE_IO_FLAG_CONSTANT | NODE_IO_FLAG_SILENT | NODE_IO_FLAG_DENORMAL_FREE;
 struct NodeIOValue {
 	F64 scalarBuffer[8];
 	F64* buffer;
@@ -71,7 +94,24 @@ struct NodeIOValue {
 	U32 bufferLength;
 	U32 listEndsLength;
 	U32 bufferMask;
+	U32 flags;
 
+	// Looks at all of scalarBuffer rather than just the first sample, since anything reading a scalar reads whichever lane it lands on
+	void set_scalar_flags() {
+		flags = NODE_IO_SILENCE_FLAGS;
+		for (U32 i = 0; i < ARRAY_COUNT(scalarBuffer); i++) {
+			U64 bits = bitcast<U64>(scalarBuffer[i]);
+			if (scalarBuffer[i] != scalarBuffer[0]) {
+				flags &= ~NODE_IO_FLAG_CONSTANT;
+			}
+			if (scalarBuffer[i] != 0.0) {
+				flags &= ~NODE_IO_FLAG_SILENT;
+			}
+			if ((bits & 0x7FF0000000000000ull) == 0 && (bits << 1) != 0) {
+				flags &= ~NODE_IO_FLAG_DENORMAL_FREE;
+			}
+		}
+	}
 	void set_scalar(F64 val) {
 		for (U32 i = 0; i < ARRAY_COUNT(scalarBuffer); i++) {
 			scalarBuffer[i] = val;
@@ -81,8 +121,49 @@ struct NodeIOValue {
 		bufferLength = 1;
 		listEndsLength = 0;
 		bufferMask = ARRAY_COUNT(scalarBuffer) - 1;
+		set_scalar_flags();
+	}
+	// Zero for the whole block. Lists keep their list ends, so they still line up with everything else reading the same voices
+	void set_silent() {
+		if (!listEnds) {
+			set_scalar(0.0);
+			return;
+		}
+		memset(buffer, 0, (bufferMask == U32_MAX ? bufferLength : ARRAY_COUNT(scalarBuffer)) * sizeof(F64));
+		flags = NODE_IO_SILENCE_FLAGS;
+	}
+	FINLINE B32 is_silent() const {
+		return flags & NODE_IO_FLAG_SILENT;
 	}
 };
+// Full size buffers for a single block, handed back once nothing left in the block will read them so the next node to need one reuses it while it's still in cache.
+// Buffers come in power of two sizes and the most recently freed one goes out first, so however big the graph is, a block only touches about as many buffers as are live at once
+const U32 BLOCK_BUFFER_MIN_LOG2_CAPACITY = 3;
+struct BlockBufferPool {
+	// By log2 of the capacity. A free buffer's first 8 bytes point at the next one
+	F64* freeLists[32];
+
+	// The buffers came from audioArena, which is about to be reset
+	void reset() {
+		memset(freeLists, 0, sizeof(freeLists));
+	}
+	static U32 log2_capacity_for(U32 length) {
+		return max(BLOCK_BUFFER_MIN_LOG2_CAPACITY, 32u - U32(__lzcnt(max(length, 1u) - 1u)));
+	}
+	F64* acquire(U32 log2Capacity) {
+		if (F64* buffer = freeLists[log2Capacity]) {
+			freeLists[log2Capacity] = *reinterpret_cast<F64**>(buffer);
+			return buffer;
+		}
+		return audioArena.alloc_aligned_with_slack<F64>(1ull << log2Capacity, alignof(__m256), 2 * sizeof(__m256));
+	}
+	void release(F64* buffer, U32 log2Capacity) {
+		*reinterpret_cast<F64**>(buffer) = freeLists[log2Capacity];
+		freeLists[log2Capacity] = buffer;
+	}
+};
+
+// Outputs that need a full buffer are left with a null buffer, process_node gives them one from the block pool
 void make_node_io_consistent(NodeIOValue** inputs, U32 inputCount, NodeIOValue** outputs, U32 outputCount) {
 	if (inputCount == 0) {
 		for (U32 i = 0; i < outputCount; i++) {
@@ -187,21 +268,39 @@ void make_node_io_consistent(NodeIOValue** inputs, U32 inputCount, NodeIOValue**
 		output.bufferLength = bufferLength;
 		output.listEndsLength = listEnds ? listEndsLength : 0;
 		output.listEnds = listEnds;
+		output.flags = 0;
 		if (bufferLength <= ARRAY_COUNT(output.scalarBuffer)) {
 			output.bufferMask = ARRAY_COUNT(output.scalarBuffer) - 1;
 			output.buffer = output.scalarBuffer;
 		} else {
 			output.bufferMask = U32_MAX;
-			output.buffer = audioArena.alloc_aligned_with_slack<F64>(bufferLength, alignof(__m256), 2 * sizeof(__m256));
+			output.buffer = nullptr;
 		}
 	}
 }
 
 struct NodeHeader;
 
+// How the model lets whatever is showing it know something changed. All null until a view sets them, which never happens headless.
+// The model never holds a box itself, the view keeps its own boxes keyed by node and widget
+struct ViewCallbacks {
+	// After the node is in its graph, with all its widgets
+	void (*nodeCreated)(NodeHeader* node);
+	// Before anything about the node is destroyed
+	void (*nodeDeleted)(NodeHeader* node);
+	// Title, settings or an input expression changed
+	void (*nodeChanged)(NodeHeader* node);
+};
+ViewCallbacks viewCallbacks;
+
+FINLINE void notify_view_node_changed(NodeHeader* node) {
+	if (viewCallbacks.nodeChanged) {
+		viewCallbacks.nodeChanged(node);
+	}
+}
+
 struct NodeWidgetHeader {
 	NodeWidgetType type;
-	U64 generation;
 	NodeHeader* parent;
 	NodeWidgetHeader* next;
 	NodeWidgetHeader* prev;
@@ -211,35 +310,36 @@ struct NodeWidgetHeader {
 		next = prev = nullptr;
 	}
 };
+// Widgets come out of a slab allocator, so the slot's generation tells whether the widget is still the one the handle was made for
 template<typename Widget>
 struct NodeWidgetHandle {
 	Widget* unsafeWidget;
 	U64 generation;
 
 	FINLINE Widget* get() {
-		return !unsafeWidget || unsafeWidget->header.generation == 0 || unsafeWidget->header.generation > generation ? nullptr : unsafeWidget;
+		return unsafeWidget && slab_generation(unsafeWidget) == generation ? unsafeWidget : nullptr;
 	}
 };
 struct NodeWidgetOutput {
 	NodeWidgetHeader header;
 	NodeIOValue value;
 	StrA displayStr;
-
-	UI::BoxHandle uiBoxConnector;
-
-	V2F32 connectionRenderPos;
+	// Per block. Inputs that haven't finished with this output yet, and the pool buffer it holds, if any. The buffer goes back to the pool when the count hits zero
+	U32 readsRemaining;
+	U32 pooledLog2Capacity;
+	F64* pooledBuffer;
 
 	void init(StrA display) {
 		header.init(NODE_WIDGET_OUTPUT);
 		value = NodeIOValue{};
 		displayStr = display;
+		readsRemaining = 0;
+		pooledBuffer = nullptr;
 	}
 	void init() {
 		init("Output"sa);
 	}
 
-	void add_to_ui();
-
 	void destroy() {
 
 	}
@@ -250,134 +350,115 @@ struct NodeWidgetInput {
 	NodeWidgetHandle<NodeWidgetOutput> inputHandle;
 	NodeIOValue value;
 	F64 defaultValue;
-	UI::BoxHandle sliderHandle;
-
-	V2F32 connectionRenderPos;
 
+	// Same as the most a slider can hold. Empty until something sets it, so the input runs on defaultValue
+	static constexpr U32 EXPRESSION_CAPACITY = 512;
+	char expression[EXPRESSION_CAPACITY];
+	U32 expressionLength;
 	tbrs::ByteProgram program;
+	tbrs::JitProgram jit;
 
 	void init(F64 defaultVal) {
 		header.init(NODE_WIDGET_INPUT);
 		defaultValue = defaultVal;
 		inputHandle = NodeWidgetHandle<NodeWidgetOutput>{};
+		expressionLength = 0;
 		program.init();
+		jit.init();
+	}
+
+	// Caller has to hold the modification lock, the audio thread might be running the old program
+	void set_expression(StrA newExpression) {
+		expressionLength = U32(min<U64>(newExpression.length, EXPRESSION_CAPACITY));
+		memcpy(expression, newExpression.str, expressionLength);
+		tbrs::parse_program(&program, StrA{ expression, expressionLength });
+		tbrs::compile_jit(&jit, program);
+		notify_view_node_changed(header.parent);
 	}
 
 	void connect(NodeWidgetOutput* outputWidget) {
-		inputHandle = NodeWidgetHandle<NodeWidgetOutput>{ outputWidget, outputWidget->header.generation };
-	}
-
-	void add_to_ui() {
-		using namespace UI;
-		UI_RBOX() {
-			workingBox.unsafeBox->backgroundColor = V4F32{ 0.05F, 0.05F, 0.05F, 1.0F }.to_rgba8();
-			workingBox.unsafeBox->flags &= ~BOX_FLAG_INVISIBLE;
-			spacer(6.0F);
-
-			UI_BACKGROUND_COLOR((V4F32{ 0.1F, 0.2F, 0.1F, 1.0F }))
-			sliderHandle = slider_number(-F64_INF, F64_INF, 0.1, [](Box* box) {
-				NodeWidgetInput& input = *reinterpret_cast<NodeWidgetInput*>(box->userData[3]);
-					StrA parseStr{ box->typedTextBuffer, box->numTypedCharacters };
-					tbrs::parse_program(&input.program, parseStr);
-			});
-			sliderHandle .unsafeBox->userData[3] = UPtr(this);
-			UI_SIZE((V2F32{ 8.0F, 8.0F })) {
-				Box* connector = generic_box().unsafeBox;
-				connector->flags = BOX_FLAG_FLOATING_X | BOX_FLAG_CUSTOM_DRAW | BOX_FLAG_CENTER_ON_ORTHOGONAL_AXIS;
-				connector->contentOffset.x = -4.0F;
-				connector->backgroundTexture = &Textures::nodeConnect;
-				connector->userTypeId = UI_TYPE_ID_NODE_WIDGET_INPUT;
-				connector->userData[0] = UPtr(this);
-				connector->actionCallback = [](Box* box, UserCommunication& comm) {
-					NodeWidgetInput& inputWidget = *reinterpret_cast<NodeWidgetInput*>(box->userData[0]);
-					ActionResult result = ACTION_PASS;
-					if (box == UI::activeBox.get() && comm.tessellator) {
-						F32 handleScale = distance(comm.renderArea.midpoint(), comm.mousePos) * 0.5F;
-						comm.tessellator->ui_bezier_curve(comm.renderArea.midpoint(), comm.renderArea.midpoint() - V2F32{ handleScale, 0.0F }, comm.mousePos + V2F32{ handleScale, 0.0F }, comm.mousePos, comm.renderZ + 0.05F, 32, 2.0F, V4F32{ 1.0F, 1.0F, 1.0F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
-						result = ACTION_HANDLED;
-					}
-					if (comm.tessellator) {
-						inputWidget.connectionRenderPos = comm.renderArea.midpoint();
-					}
-					if (comm.draggedTo && comm.draggedTo->userTypeId == UI_TYPE_ID_NODE_WIDGET_OUTPUT) {
-						inputWidget.connect(reinterpret_cast<NodeWidgetOutput*>(comm.draggedTo->userData[0]));
-						result = ACTION_HANDLED;
-					}
-					if (comm.leftClickStart && inputWidget.inputHandle.get()) {
-						BoxHandle otherConnector = inputWidget.inputHandle.get()->uiBoxConnector;
-						inputWidget.inputHandle = {};
-						if (otherConnector.get()) {
-							UI::activeBox = otherConnector;
-							result = ACTION_HANDLED;
-						}
-					}
-					return ACTION_PASS;
-				};
-			}
-		}
+		inputHandle = NodeWidgetHandle<NodeWidgetOutput>{ outputWidget, slab_generation(outputWidget) };
 	}
 
 	void destroy() {
+		jit.destroy();
 		program.destroy();
 	}
 };
 struct NodeWidgetOscilloscope {
 	NodeWidgetHeader header;
-	F32* waveformBuffer;
+	// About a third of a second at 48kHz. A frame only drains a few hundred samples, so the UI can hitch for a while before anything gets dropped
+	static constexpr U32 RING_CAPACITY = 16384;
+	// What the UI keeps around to look for a trigger in
+	static constexpr U32 HISTORY_SIZE = 4096;
+	static constexpr U32 DISPLAY_SAMPLES = 1024;
+	// Filled by the audio thread, drained by the draw callback. Neither ever waits on the other
+	SPSCRing<F32> ring;
+	F32* ringStorage;
+	// UI thread only. The newest HISTORY_SIZE samples drained from the ring, wrapping around at position & (HISTORY_SIZE - 1), with peaks kept up to date as they come in
+	F32* history;
+	PeakPyramid::Pyramid peaks;
+	F32 triggerLevel;
 	U32 sampleRate;
-	size_t waveformBufferSize;
 
 	void init() {
 		header.init(NODE_WIDGET_OSCILLOSCOPE);
-		waveformBufferSize = PROCESS_BUFFER_SIZE;
-		waveformBuffer = new F32[waveformBufferSize];
-		std::fill_n(waveformBuffer, waveformBufferSize, 0.0f);
+		ringStorage = new F32[RING_CAPACITY];
+		ring.init(ringStorage, RING_CAPACITY);
+		history = new F32[HISTORY_SIZE];
+		std::fill_n(history, HISTORY_SIZE, 0.0f);
+		peaks.init(HISTORY_SIZE);
+		// Starts out a full history of silence, so there's always a whole window to draw
+		peaks.append(history, HISTORY_SIZE);
+		triggerLevel = 0.0F;
 		sampleRate = 44100;
 	}
 
-	void add_to_ui() {
-		using namespace UI;
-		workingBox.unsafeBox->minSize.x = 200.0F;
-		UI_RBOX() {
-			workingBox.unsafeBox->backgroundColor = V4F32{ 0.1F, 0.1F, 0.1F, 0.9F }.to_rgba8();
-			workingBox.unsafeBox->flags |= BOX_FLAG_CLIP_CHILDREN;
-			BoxHandle contentBox = generic_box();
-			contentBox.unsafeBox->backgroundColor = V4F32{ 0.0F, 0.0F, 0.0F, 1.0F }.to_rgba8();
-			contentBox.unsafeBox->flags |= BOX_FLAG_CUSTOM_DRAW;
-			contentBox.unsafeBox->minSize = V2F32{ 200.0F, 100.0F };
-			contentBox.unsafeBox->actionCallback = [](Box* box, UserCommunication& comm) {
-				NodeWidgetOscilloscope& osc = *reinterpret_cast<NodeWidgetOscilloscope*>(box->userData[1]);
-				if (comm.tessellator) {
-					V2F32 origin = box->computedOffset + box->parent->computedOffset;
-					F32 width = comm.renderArea.maxX - comm.renderArea.minX;
-					F32 height = comm.renderArea.maxY - comm.renderArea.minY;
-					MemoryArena& arena = get_scratch_arena();
-					MEMORY_ARENA_FRAME(arena) {
-						V2F32* points = arena.alloc<V2F32>(osc.waveformBufferSize);
-						//TODO the number of points can be reduced depending on the render size (no point in rendering a 1024 segment line if it's only 100 pixels wide)
-						for (size_t i = 0; i < osc.waveformBufferSize; ++i) {
-							points[i].x = origin.x + (i / (F32)osc.waveformBufferSize) * width;
-							points[i].y = origin.y + height / 2 - osc.waveformBuffer[i] * height / 2;
-						}
-						comm.tessellator->ui_line_strip(points, osc.waveformBufferSize, comm.renderZ, 2.0F, V4F32{ 1.0F, 1.0F, 1.0F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
-					}
-				}
-				return UI::ACTION_HANDLED;
-				};
-			contentBox.unsafeBox->userData[1] = UPtr(this);
-			spacer(20.0F);
+	// Audio thread only. Every sample of the block goes in, anything the UI hasn't made room for is dropped
+	void push_samples(const NodeIOValue& value) {
+		// A scalar is a flat line for the whole block
+		U32 count = value.bufferMask == U32_MAX ? value.bufferLength : PROCESS_BUFFER_SIZE;
+		alignas(32) F32 converted[256];
+		for (U32 i = 0; i < count; i += ARRAY_COUNT(converted)) {
+			U32 chunk = min<U32>(ARRAY_COUNT(converted), count - i);
+			// Buffers have slack past the end, so rounding the last chunk up to 4 is fine
+			for (U32 j = 0; j < chunk; j += 4) {
+				_mm_store_ps(converted + j, _mm256_cvtpd_ps(_mm256_load_pd(value.buffer + ((i + j) & value.bufferMask))));
+			}
+			ring.write(converted, chunk);
 		}
 	}
 
-	void updateWaveform(const double* data, U32 size) {
-		size_t copySize = std::min(static_cast<size_t>(size), waveformBufferSize);
-		for (size_t i = 0; i < copySize; ++i) {
-			waveformBuffer[i] = static_cast<float>(data[i]);
+	// UI thread only. Anything older than the history would just be thrown away, so it's skipped without copying
+	void drain() {
+		U64 available = ring.available();
+		U32 count = U32(min<U64>(available, HISTORY_SIZE));
+		ring.skip(available - count);
+		while (count) {
+			U32 start = U32(peaks.sampleCount & (HISTORY_SIZE - 1));
+			U32 chunk = min(count, HISTORY_SIZE - start);
+			ring.read(history + start, chunk);
+			peaks.append(history + start, chunk);
+			count -= chunk;
 		}
 	}
 
+	// Start of the window to draw. Looks back from the newest full window for a rising crossing of the trigger level, so a periodic signal holds still.
+	// Free runs on the newest window if there isn't one
+	U64 find_trigger() {
+		U64 newestStart = peaks.sampleCount - DISPLAY_SAMPLES;
+		for (U64 i = newestStart; i > peaks.first_position(); i--) {
+			if (history[(i - 1) & (HISTORY_SIZE - 1)] < triggerLevel && history[i & (HISTORY_SIZE - 1)] >= triggerLevel) {
+				return i;
+			}
+		}
+		return newestStart;
+	}
+
 	void destroy() {
-		delete[] waveformBuffer;
+		delete[] ringStorage;
+		delete[] history;
+		peaks.destroy();
 	}
 };
 struct NodeWidgetSamplerButton {
@@ -387,37 +468,19 @@ struct NodeWidgetSamplerButton {
 	U64 numSamples = 0;
 	I32 sampleRate = 0;
 	F32* phaseAccumulation;
+	// Built the first time the thumbnail is drawn after a file comes in, so it doesn't get any slower to draw the longer the sample is.
+	// Nothing headless ever draws it, so nothing headless pays for it
+	PeakPyramid::Pyramid peaks;
+	// Lets the owning node do its own preprocessing whenever a new file comes in. Runs on the UI thread
+	void (*loadCallback)(NodeWidgetSamplerButton* button);
 
 	void init() {
 		header.init(NODE_WIDGET_SAMPLER_BUTTON);
-		phaseAccumulation = reinterpret_cast<F32*>(HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, 1024 * sizeof(F32)));
-	}
-
-	void add_to_ui() {
-		using namespace UI;
-		UI_RBOX() {
-			workingBox.unsafeBox->backgroundColor = V4F32{ 0.05F, 0.05F, 0.05F, 1.0F }.to_rgba8();
-			workingBox.unsafeBox->flags &= ~BOX_FLAG_INVISIBLE;
-			spacer(20.0F);
-			UI_BACKGROUND_COLOR((V4F32{ 0.1F, 0.1F, 0.1F, 0.0F }))
-				text_button("Load Sample"sa, [](Box* box) {
-					NodeWidgetSamplerButton& button = *reinterpret_cast<NodeWidgetSamplerButton*>(box->userData[1]);
-
-					OPENFILENAMEA fileDialogOptions{};
-					fileDialogOptions.lStructSize = sizeof(fileDialogOptions);
-					fileDialogOptions.hwndOwner = Win32::window;
-					fileDialogOptions.hInstance = Win32::instance;
-					fileDialogOptions.lpstrFilter = "Sound Files (*.flac; *.ogg; *.opus; *.wav)\0*.flac;*.ogg;*.opus;*.wav\0\0";
-					fileDialogOptions.lpstrFile = button.path;
-					fileDialogOptions.nMaxFile = sizeof(button.path);
-					inDialog = true;
-					GetOpenFileNameA(&fileDialogOptions);
-					inDialog = false;
-
-					button.loadFromFile();
-				}).unsafeBox->userData[1] = UPtr(this);
-			spacer(20.0F);
-		}
+		audioData = nullptr;
+		numSamples = 0;
+		loadCallback = nullptr;
+		peaks.storage = nullptr;
+		phaseAccumulation = reinterpret_cast<F32*>(heap_zalloc(1024 * sizeof(F32)));
 	}
 
 	void loadFromFile() {
@@ -427,6 +490,8 @@ struct NodeWidgetSamplerButton {
 		auto data = std::make_unique<soundwave::AudioData>();
 		loader.Load(data.get(), path);
 
+		delete[] audioData;
+
 		if (data->channelCount == 2) {
 			numSamples = data->samples.size() / 2;
 			audioData = new F32[numSamples];
@@ -438,25 +503,23 @@ struct NodeWidgetSamplerButton {
 			memcpy(audioData, data->samples.data(), data->samples.size() * sizeof(F32));
 		}
 		sampleRate = data->sampleRate;
+		peaks.destroy();
+		if (loadCallback) {
+			loadCallback(this);
+		}
 	}
 
 	void destroy() {
-		delete audioData;
-		HeapFree(GetProcessHeap(), 0, phaseAccumulation);
+		delete[] audioData;
+		peaks.destroy();
+		heap_free(phaseAccumulation);
 	}
 };
+// Where a node's own controls (dropdowns and the like) go among its widgets. What goes there is up to the view, going by the node's type
 struct NodeWidgetCustomUIElement {
 	NodeWidgetHeader header;
-	UI::BoxHandle uiBox;
-	void init(UI::BoxHandle box) {
+	void init() {
 		header.init(NODE_WIDGET_CUSTOM_UI_ELEMENT);
-		uiBox = box;
-	}
-	void add_to_ui() {
-		if (UI::Box* box = uiBox.get()) {
-			box->parent = UI::workingBox.unsafeBox;
-			DLL_INSERT_TAIL(box, UI::workingBox.unsafeBox->childFirst, UI::workingBox.unsafeBox->childLast, prev, next);
-		}
 	}
 	void destroy() {};
 };
@@ -617,7 +680,6 @@ struct NodeWidgetPianoRoll {
 	PianoRollNote* notes;
 	U32 noteCount;
 	U32 noteCapacity;
-	UI::BoxHandle scrollBarHandle;
 	F64 manuallyPlayedNoteStart;
 	Note manuallyPlayedNote;
 
@@ -633,7 +695,7 @@ struct NodeWidgetPianoRoll {
 	}
 	void add_note(PianoRollNote note) {
 		if (noteCount == noteCapacity) {
-			PianoRollNote* newNotes = reinterpret_cast<PianoRollNote*>(HeapReAlloc(GetProcessHeap(), 0, notes, noteCapacity * 2 * sizeof(PianoRollNote)));
+			PianoRollNote* newNotes = reinterpret_cast<PianoRollNote*>(heap_realloc(notes, noteCapacity * 2 * sizeof(PianoRollNote)));
 			if (!newNotes) {
 				return;
 			}
@@ -697,212 +759,20 @@ struct NodeWidgetPianoRoll {
 	void init() {
 		header.init(NODE_WIDGET_PIANO_ROLL);
 		noteCapacity = 64;
-		notes = reinterpret_cast<PianoRollNote*>(HeapAlloc(GetProcessHeap(), 0, noteCapacity * sizeof(PianoRollNote)));
+		notes = reinterpret_cast<PianoRollNote*>(heap_alloc(noteCapacity * sizeof(PianoRollNote)));
 		noteCount = 0;
 		manuallyPlayedNote = NOTE_Count;
 	}
-	void add_to_ui() {
-		using namespace UI;
-		workingBox.unsafeBox->minSize = V2F32{ 500.0F, 300.0F };
-		UI_BACKGROUND_COLOR((V4F32{ 0.07F, 0.07F, 0.07F, 1.0F }))
-		UI_RBOX() {
-			workingBox.unsafeBox->minSize = V2F32{ 500.0F, 200.0F };
-			BoxHandle rollUI = generic_box();
-			rollUI.unsafeBox->flags |= BOX_FLAG_DONT_LAYOUT_TO_FIT_CHILDREN | BOX_FLAG_CLIP_CHILDREN;
-			rollUI.unsafeBox->sizeParentPercent = V2F32{ 1.0F, 1.0F };
-			rollUI.unsafeBox->layoutDirection = LAYOUT_DIRECTION_RIGHT;
-			UI_WORKING_BOX(rollUI) {
-				BoxHandle piano = generic_box();
-				piano.unsafeBox->flags |= BOX_FLAG_CLIP_CHILDREN | BOX_FLAG_CUSTOM_DRAW;
-				piano.unsafeBox->backgroundColor = V4F32{ 0.04F, 0.04F, 0.04F, 1.0F }.to_rgba8();
-				piano.unsafeBox->minSize = V2F32{ 60.0F, 1200.0F };
-				piano.unsafeBox->actionCallback = [](Box* box, UserCommunication& comm) {
-					NodeWidgetPianoRoll& pianoRoll = *reinterpret_cast<NodeWidgetPianoRoll*>(box->userData[0]);
-					if (comm.tessellator) {
-						for (U32 i = 0; i < 10; i++) {
-							U32 baseOffset = (10 - i) * 120;
-							comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 14.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 1.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.9F, 0.9F, 0.9F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
-							comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 34.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 16.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.9F, 0.9F, 0.9F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
-							comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 49.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 36.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.9F, 0.9F, 0.9F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
-							comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 64.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 51.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.9F, 0.9F, 0.9F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
-							comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 84.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 66.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.9F, 0.9F, 0.9F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
-							comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 104.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 86.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.9F, 0.9F, 0.9F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
-							comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 119.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 106.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.9F, 0.9F, 0.9F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
-
-							F32 halfMaxX = (comm.renderArea.minX + comm.renderArea.maxX) * 0.5F;
-							comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 20.0F) * comm.scale, halfMaxX, comm.renderArea.minY + (baseOffset - 10.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.04F, 0.04F, 0.04F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
-							comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 40.0F) * comm.scale, halfMaxX, comm.renderArea.minY + (baseOffset - 30.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.04F, 0.04F, 0.04F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
-							comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 70.0F) * comm.scale, halfMaxX, comm.renderArea.minY + (baseOffset - 60.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.04F, 0.04F, 0.04F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
-							comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 90.0F) * comm.scale, halfMaxX, comm.renderArea.minY + (baseOffset - 80.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.04F, 0.04F, 0.04F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
-							comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 110.0F) * comm.scale, halfMaxX, comm.renderArea.minY + (baseOffset - 100.0F) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{ 0.04F, 0.04F, 0.04F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
-
-							TextRenderer::draw_string_batched(*comm.tessellator, NOTE_DISPLAY_NAMES[i * 12], mix(comm.renderArea.minX, comm.renderArea.maxX, 0.75F), comm.renderArea.minY + (baseOffset - 12.0F) * comm.scale, comm.renderZ, 12.0F * comm.scale, V4F32{ 0.0F, 0.0F, 0.0F, 1.0F }, comm.clipBoxIndex << 16);
-						}
-						return ACTION_HANDLED;
-					}
-					if (comm.leftClickStart) {
-						Note noteBase = NOTE_C0;
-						for (U32 i = 0; i < 10; i++) {
-							U32 baseOffset = (10 - i) * 120;
-							F32 halfMaxX = (comm.renderArea.minX + comm.renderArea.maxX) * 0.5F;
-							pianoRoll.manuallyPlayedNoteStart = DAWdle::audioPlaybackTime;
-							if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 20.0F) * comm.scale, halfMaxX, comm.renderArea.minY + (baseOffset - 10.0F) * comm.scale }, comm.mousePos)) {
-								pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_C0S);
-							} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 40.0F) * comm.scale, halfMaxX, comm.renderArea.minY + (baseOffset - 30.0F) * comm.scale }, comm.mousePos)) {
-								pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_D0S);
-							} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 70.0F) * comm.scale, halfMaxX, comm.renderArea.minY + (baseOffset - 60.0F) * comm.scale }, comm.mousePos)) {
-								pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_F0S);
-							} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 90.0F) * comm.scale, halfMaxX, comm.renderArea.minY + (baseOffset - 80.0F) * comm.scale }, comm.mousePos)) {
-								pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_G0S);
-							} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 110.0F) * comm.scale, halfMaxX, comm.renderArea.minY + (baseOffset - 100.0F) * comm.scale }, comm.mousePos)) {
-								pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_A0S);
-							} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 14.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 1.0F) * comm.scale }, comm.mousePos)) {
-								pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_C0);
-							} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 34.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 16.0F) * comm.scale }, comm.mousePos)) {
-								pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_D0);
-							} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 49.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 36.0F) * comm.scale }, comm.mousePos)) {
-								pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_E0);
-							} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 64.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 51.0F) * comm.scale }, comm.mousePos)) {
-								pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_F0);
-							} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 84.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 66.0F) * comm.scale }, comm.mousePos)) {
-								pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_G0);
-							} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 104.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 86.0F) * comm.scale }, comm.mousePos)) {
-								pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_A0);
-							} else if (rng_contains_point(Rng2F32{ comm.renderArea.minX, comm.renderArea.minY + (baseOffset - 119.0F) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset - 106.0F) * comm.scale }, comm.mousePos)) {
-								pianoRoll.manuallyPlayedNote = Note(noteBase + NOTE_B0);
-							}
-							noteBase = Note(U32(noteBase) + 12);
-						}
-						return ACTION_HANDLED;
-					}
-					if (comm.leftClicked) {
-						pianoRoll.manuallyPlayedNote = NOTE_Count;
-						return ACTION_HANDLED;
-					}
-					if (comm.scrollInput) {
-						scroll_bar_manual_input(pianoRoll.scrollBarHandle, -comm.scrollInput * 0.1F / comm.scale);
-						return ACTION_HANDLED;
-					}
-					return ACTION_PASS;
-				};
-				piano.unsafeBox->userData[0] = UPtr(this);
-				
-
-				BoxHandle roll = generic_box();
-				roll.unsafeBox->flags |= BOX_FLAG_CUSTOM_DRAW | BOX_FLAG_CLIP_CHILDREN;
-				roll.unsafeBox->backgroundColor = V4F32{ 0.02F, 0.02F, 0.02F, 1.0F }.to_rgba8();
-				roll.unsafeBox->minSize = V2F32{ 0.0F, 1200.0F };
-				roll.unsafeBox->sizeParentPercent.x = 1.0F;
-				roll.unsafeBox->actionCallback = [](Box* box, UserCommunication& comm) {
-					NodeWidgetPianoRoll& pianoRoll = *reinterpret_cast<NodeWidgetPianoRoll*>(box->userData[0]);
-					if (comm.tessellator) {
-						for (U32 i = 1; i <= 120; i++) {
-							U32 baseOffset = i * 10;
-							F32 width = 0.5F;
-							V4F32 color = V4F32{ 0.2F, 0.2F, 0.2F, 1.0F };
-							if (i % 12 == 0) {
-								color = V4F32{ 0.5F, 0.5F, 0.5F, 1.0F };
-							}
-							comm.tessellator->ui_rect2d(comm.renderArea.minX, comm.renderArea.minY + (baseOffset - width) * comm.scale, comm.renderArea.maxX, comm.renderArea.minY + (baseOffset + width) * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, color, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
-						}
-						U32 drawStart = 1 + U32(box->contentOffset.x) / 10;
-						for (U32 i = drawStart; i < drawStart + 120; i++) {
-							U32 baseOffset = -box->contentOffset.x + i * 10;
-							F32 width = 0.5F;
-							V4F32 color = V4F32{ 0.2F, 0.2F, 0.2F, 1.0F };
-							if (i % 4 == 0) {
-								color = V4F32{ 0.5F, 0.5F, 0.5F, 1.0F };
-							}
-							comm.tessellator->ui_rect2d(comm.renderArea.minX + (baseOffset - width) * comm.scale, comm.renderArea.minY, comm.renderArea.minX + (baseOffset + width) * comm.scale, comm.renderArea.maxY, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, color, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
-						}
-						for (U32 i = 0; i < pianoRoll.noteCount; i++) {
-							PianoRollNote note = pianoRoll.notes[i];
-							comm.tessellator->ui_rect2d(comm.renderArea.minX + (note.startTime * 40.0F - box->contentOffset.x) * comm.scale, comm.renderArea.maxY - (F32(note.assignedNote) * 10.0F + 10.0F) * comm.scale, comm.renderArea.minX + (note.endTime * 40.0F - box->contentOffset.x) * comm.scale, comm.renderArea.maxY - F32(note.assignedNote) * 10.0F * comm.scale, comm.renderZ, 0.0F, 0.0F, 1.0F, 1.0F, V4F32{0.8F, 0.8F, 0.8F, 1.0F}, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
-						}
-						return ACTION_HANDLED;
-					}
-					V2F32 mouseRelative = (comm.mousePos - V2F32{ comm.renderArea.minX, comm.renderArea.minY }) / comm.scale + box->contentOffset;
-					if (comm.scrollInput) {
-						for (U32 i = 0; i < pianoRoll.noteCount; i++) {
-							PianoRollNote& note = pianoRoll.notes[i];
-							Rng2F32 noteBB{ note.startTime * 40.0F, 1200.0F - F32(note.assignedNote) * 10.0F - 10.0F, note.endTime * 40.0F, 1200.0F - F32(note.assignedNote) * 10.0F };
-							if (rng_contains_point(noteBB, mouseRelative)) {
-								note.endTime = max(note.startTime + 0.25F, note.endTime + F32(signumf32(comm.scrollInput)) * 0.25F);
-								return ACTION_HANDLED;
-							}
-						}
-						box->contentOffset.x = max(box->contentOffset.x - comm.scrollInput * comm.scale * 0.5F, 0.0F);
-						return ACTION_HANDLED;
-					}
-
-					if (comm.leftClickStart) {
-						F32 startTime = 0.25F * floorf32(mouseRelative.x * 0.1F);
-						Note assignedNote = Note(U32(floorf32((1200.0F - mouseRelative.y) * 0.1F)));
-						pianoRoll.add_note(PianoRollNote{ startTime, startTime + 1.0F, assignedNote, NOTE_FREQUENCIES[assignedNote] });
-						pianoRoll.manuallyPlayedNote = assignedNote;
-						return ACTION_HANDLED;
-					}
-					if (comm.leftClicked) {
-						pianoRoll.manuallyPlayedNote = NOTE_Count;
-						return ACTION_HANDLED;
-					}
-					if (comm.rightClickStart) {
-						for (U32 i = 0; i < pianoRoll.noteCount; i++) {
-							PianoRollNote& note = pianoRoll.notes[i];
-							Rng2F32 noteBB{ note.startTime * 40.0F, 1200.0F - F32(note.assignedNote) * 10.0F - 10.0F, note.endTime * 40.0F, 1200.0F - F32(note.assignedNote) * 10.0F };
-							if (rng_contains_point(noteBB, mouseRelative)) {
-								pianoRoll.delete_note(i);
-							}
-						}
-						return ACTION_HANDLED;
-					}
-					return ACTION_PASS;
-				};
-				roll.unsafeBox->userData[0] = UPtr(this);
-			}
-			scrollBarHandle = scroll_bar(rollUI, 8.0F);
-		}
-	}
 	void destroy() {
-		HeapFree(GetProcessHeap(), 0, notes);
+		heap_free(notes);
 	};
 };
-union NodeWidget {
-	NodeWidgetHeader header;
-	NodeWidgetInput input;
-	NodeWidgetOutput output;
-	NodeWidgetOscilloscope oscilloscope;
-	NodeWidgetSamplerButton file_dialog_button;
-	NodeWidgetCustomUIElement customUIElement;
-	NodeWidgetPianoRoll pianoRoll;
-};
 
 struct NodeGraph;
-union Node;
-Node* alloc_node();
-void free_node(Node* toFree);
-
-NodeWidgetHeader* freeWidgetListHead = nullptr;
-U64 currentWidgetGeneration = 1;
-NodeWidget* alloc_widget() {
-	if (!freeWidgetListHead) {
-		const U32 amountToAlloc = 256;
-		NodeWidget* block = globalArena.alloc<NodeWidget>(amountToAlloc);
-		for (U32 i = 0; i < amountToAlloc; i++) {
-			block[i].header.next = &block[i + 1].header;
-		}
-		block[amountToAlloc - 1].header.next = nullptr;
-		freeWidgetListHead = &block->header;
-	}
-	NodeWidgetHeader* allocated = freeWidgetListHead;
-	freeWidgetListHead = allocated->next;
-	return reinterpret_cast<NodeWidget*>(allocated);
-}
-void free_widget(NodeWidget* toFree) {
-	toFree->header.next = freeWidgetListHead;
-	toFree->header.generation = 0;
-	freeWidgetListHead = &toFree->header;
-}
+struct NodeOversampleOut;
+
+// Shared by every graph. Widgets are only ever created while a node is being set up, which already has to be on one thread at a time
+SlabAllocator nodeWidgetAllocator;
 
 struct NodeHeader {
 	NodeType type;
@@ -911,6 +781,11 @@ struct NodeHeader {
 	char title[TITLE_CAPACITY];
 	V2F32 offset;
 	B32 hasProcessed;
+	// Which Oversample node's region this runs in, null for the device rate. Worked out again every block
+	NodeOversampleOut* oversampleRegion;
+	// Only used while the regions are being worked out
+	B32 oversampleRegionAssigned;
+	B32 hasConsumer;
 	NodeWidgetHeader* widgetBegin;
 	NodeWidgetHeader* widgetEnd;
 	U32 serializeIndex;
@@ -920,46 +795,67 @@ struct NodeHeader {
 	NodeHeader* next;
 	NodeHeader* selectedPrev;
 	NodeHeader* selectedNext;
-	UI::BoxHandle uiBox;
-	UI::BoxHandle uiNodeTitleBox;
+	// Heap memory for state a node carries between blocks that's too big to live in the node itself
+	void* stateMemory;
+
+	void set_title(StrA newTitle) {
+		titleLength = U32(newTitle.length);
+		ASSERT(titleLength < TITLE_CAPACITY, "title length too long");
+		memcpy(title, newTitle.str, newTitle.length);
+		notify_view_node_changed(this);
+	}
 
 	void init(NodeType nodeType, StrA straTitle) {
 		type = nodeType;
-		titleLength = U32(straTitle.length);
-		ASSERT(titleLength < TITLE_CAPACITY, "title length too long");
-		memcpy(title, straTitle.str, straTitle.length);
+		set_title(straTitle);
 		offset = V2F32{};
 		hasProcessed = false;
+		oversampleRegion = nullptr;
+		oversampleRegionAssigned = false;
+		hasConsumer = false;
 		widgetEnd = widgetBegin = nullptr;
 		prev = next = nullptr;
 		selectedPrev = selectedNext = nullptr;
-		uiBox = UI::BoxHandle{};
 		serializeIndex = 0;
+		stateMemory = nullptr;
+	}
+
+	// Zeroed and aligned for AVX. Any previous state is freed, so only call this when the audio thread can't be looking at it
+	void* alloc_state(U64 size) {
+		free_state();
+		stateMemory = heap_zalloc(size + alignof(__m256));
+		if (!stateMemory) {
+			abort("Out of memory");
+		}
+		return reinterpret_cast<void*>(ALIGN_HIGH(UPtr(stateMemory), alignof(__m256)));
+	}
+	void free_state() {
+		if (stateMemory) {
+			heap_free(stateMemory);
+			stateMemory = nullptr;
+		}
 	}
 
 	void destroy() {
-		UI::free_box(uiBox);
+		free_state();
 		for (NodeWidgetHeader* widget = widgetBegin; widget != nullptr;) {
 			NodeWidgetHeader* nextWidget = widget->next;
-#define X(enumName, typeName) case NODE_WIDGET_##enumName: reinterpret_cast<typeName*>(widget)->destroy(); break;
+#define X(enumName, typeName) case NODE_WIDGET_##enumName: reinterpret_cast<typeName*>(widget)->destroy(); nodeWidgetAllocator.free(reinterpret_cast<typeName*>(widget)); break;
 			switch (widget->type) {
 				NODE_WIDGETS
 			default: break;
 			}
 #undef X
-			free_widget(reinterpret_cast<NodeWidget*>(widget));
 			widget = nextWidget;
 		}
-		free_node(reinterpret_cast<Node*>(this));
 	}
 
-	NodeWidget* add_widget() {
-		NodeWidget* widget = alloc_widget();
+	template<typename Widget>
+	Widget* add_widget() {
+		Widget* widget = nodeWidgetAllocator.alloc<Widget>();
 		widget->header = NodeWidgetHeader{};
-		widget->header.generation = currentWidgetGeneration++;
 		widget->header.parent = this;
 		if (widgetBegin == nullptr) {
-			// Accessing the header through a union like this and then accessing it through a widget member is UB, but MSVC is so unlikely to break it that I don't care
 			widgetBegin = widgetEnd = &widget->header;
 		} else {
 			widget->header.prev = widgetEnd;
@@ -990,36 +886,53 @@ struct NodeHeader {
 	NodeWidgetSamplerButton* get_samplerbutton(U32 idx) {
 		return reinterpret_cast<NodeWidgetSamplerButton*>(get_nth_of_type(NODE_WIDGET_SAMPLER_BUTTON, idx));
 	}
-
-	UI::Box* add_to_ui();
 };
 struct NodeTimeIn {
 	NodeHeader header;
 	void init() {
 		header.init(NODE_TIME_IN, "Time"sa);
-		header.add_widget()->output.init();
+		header.add_widget<NodeWidgetOutput>()->init();
+		header.add_widget<NodeWidgetOutput>()->init("Sample"sa);
 	}
 	void process();
-	void add_to_ui() {
-		using namespace UI;
-		Box* box = header.add_to_ui();
-	}
 };
+// The graph itself carries one signal per connection. Channels only exist at the output, where each channel out picks which lane of the output bus it adds into
+const U32 MAX_OUTPUT_CHANNELS = 8;
+// Goes to every lane, which is how a mono graph ends up in both speakers
+const U32 CHANNEL_OUT_ALL = U32_MAX;
+const StrA CHANNEL_OUT_NAMES[MAX_OUTPUT_CHANNELS]{ "Left Out"sa, "Right Out"sa, "Channel 3 Out"sa, "Channel 4 Out"sa, "Channel 5 Out"sa, "Channel 6 Out"sa, "Channel 7 Out"sa, "Channel 8 Out"sa };
+StrA channel_out_name(U32 channel) {
+	return channel < MAX_OUTPUT_CHANNELS ? CHANNEL_OUT_NAMES[channel] : "Channel Out"sa;
+}
+
 struct NodeChannelOut {
 	NodeHeader header;
 	NodeChannelOut* outputPrev;
 	NodeChannelOut* outputNext;
-	
+	U32 channel;
+
+	void set_channel(U32 newChannel) {
+		channel = newChannel < MAX_OUTPUT_CHANNELS ? newChannel : CHANNEL_OUT_ALL;
+		header.set_title(channel_out_name(channel));
+	}
 
 	void init() {
 		header.init(NODE_CHANNEL_OUT, "Channel Out"sa);
-		header.add_widget()->input.init(0.0);
+		header.add_widget<NodeWidgetCustomUIElement>()->init();
+		header.add_widget<NodeWidgetInput>()->init(0.0);
+		set_channel(CHANNEL_OUT_ALL);
 	}
 	void process() {
 		
 	}
 	F64* get_output_buffer(U32* lengthOut, U32* maskOut) {
 		NodeIOValue& val = header.get_input(0)->value;
+		if (val.is_silent()) {
+			// Wouldn't add anything to the mix
+			*lengthOut = 0;
+			*maskOut = 0;
+			return nullptr;
+		}
 		if (val.listEndsLength) {
 			*lengthOut = val.listEndsLength;
 			*maskOut = U32_MAX;
@@ -1040,10 +953,6 @@ struct NodeChannelOut {
 			return val.buffer;
 		}
 	}
-	void add_to_ui() {
-		using namespace UI;
-		Box* box = header.add_to_ui();
-	}
 };
 
 __m256i lcg_a = _mm256_set1_epi32(1664525);
@@ -1083,45 +992,15 @@ struct NodeWave {
 
 	void set_waveform(Waveform newWaveform) {
 		waveform = newWaveform;
-		if (UI::Box* box = header.uiNodeTitleBox.get()) {
-			box->text = waveform_name(newWaveform);
-		}
+		header.set_title(waveform_name(newWaveform));
 	}
 
 	void init() {
 		header.init(NODE_WAVE, "Basic Wave"sa);
-		header.add_widget()->output.init();
-		header.add_widget()->input.init(0.0);
-		header.add_widget()->input.init(0.0);
-		using namespace UI;
-		BoxHandle dropdownBox = alloc_box();
-		dropdownBox.unsafeBox->flags |= BOX_FLAG_INVISIBLE;
-		dropdownBox.unsafeBox->layoutDirection = LAYOUT_DIRECTION_RIGHT;
-		dropdownBox.unsafeBox->sizeParentPercent.x = 1.0F;
-		UI_WORKING_BOX(dropdownBox) {
-			spacer();
-			BoxHandle waveformSelector = text_button("Waveform"sa, nullptr);
-			waveformSelector.unsafeBox->userData[1] = UPtr(this);
-			waveformSelector.unsafeBox->actionCallback = [](Box* box, UserCommunication& comm) {
-				if (comm.leftClicked) {
-					UI_BACKGROUND_COLOR((V4F32{ 0.15F, 0.15F, 0.15F, 1.0F }))
-						UI_ADD_CONTEXT_MENU(BoxHandle{}, (V2F32{ comm.renderArea.minX, comm.renderArea.maxY })) {
-						contextMenuBox.unsafeBox->contentScale = comm.scale;
-						workingBox.unsafeBox->userData[1] = box->userData[1];
-						BoxConsumer callback = [](Box* box) {
-							reinterpret_cast<NodeWave*>(box->parent->userData[1])->set_waveform(Waveform(box->userData[1]));
-						};
-
-						for (Waveform op = WAVE_SINE; op <= WAVE_NOISE; op = Waveform(op + 1)) {
-							text_button(waveform_name(op), callback).unsafeBox->userData[1] = UPtr(op);
-						}
-					}
-				}
-				return ACTION_PASS;
-			};
-			spacer();
-		}
-		header.add_widget()->customUIElement.init(dropdownBox);
+		header.add_widget<NodeWidgetOutput>()->init();
+		header.add_widget<NodeWidgetInput>()->init(0.0);
+		header.add_widget<NodeWidgetInput>()->init(0.0);
+		header.add_widget<NodeWidgetCustomUIElement>()->init();
 	}
 
 	void process() {
@@ -1165,7 +1044,7 @@ struct NodeWave {
 				_mm256_store_pd(output.buffer + i + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(squareResult, 1)));
 			}
 			break;
-		case WAVE_TRIANGLE:
+		case WAVE_TRIANGLE: {
 			__m256 sign_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
 			for (U32 i = 0; i < output.bufferLength; i += 8) {
 				__m256d d1 = _mm256_mul_pd(_mm256_load_pd(time.buffer + (i & time.bufferMask)), _mm256_load_pd(frequency.buffer + (i & frequency.bufferMask)));
@@ -1178,7 +1057,7 @@ struct NodeWave {
 				_mm256_store_pd(output.buffer + i, _mm256_cvtps_pd(_mm256_castps256_ps128(triangleResult)));
 				_mm256_store_pd(output.buffer + i + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(triangleResult, 1)));
 			}
-			break;
+		} break;
 		case WAVE_NOISE:
 			for (U32 i = 0; i < output.bufferLength; i += 8) {
 				__m256 noiseResult = random_f32();
@@ -1188,10 +1067,6 @@ struct NodeWave {
 			break;
 		}
 	}
-	void add_to_ui() {
-		using namespace UI;
-		Box* box = header.add_to_ui();
-	}
 };
 
 enum FilterType {
@@ -1209,6 +1084,8 @@ const StrA filterTypeName(FilterType type) {
 	}
 }
 
+// About -180 dB
+const F32 FILTER_TAIL_THRESHOLD = 1e-9F;
 struct NodeFilter {
 	NodeHeader header;
 	float cutoffFrequency;
@@ -1221,55 +1098,22 @@ struct NodeFilter {
 	float x_1, x_2, y_1, y_2;
 
 	void init() {
-		using namespace UI;
 		header.init(NODE_FILTER, "Filter"sa);
-		header.add_widget()->input.init(0.0f);
-		header.add_widget()->input.init(1000.0f);
-		header.add_widget()->input.init(0.7f);
-		header.add_widget()->output.init();
+		header.add_widget<NodeWidgetInput>()->init(0.0f);
+		header.add_widget<NodeWidgetInput>()->init(1000.0f);
+		header.add_widget<NodeWidgetInput>()->init(0.7f);
+		header.add_widget<NodeWidgetOutput>()->init();
 		sampleRate = 44100;
 		cutoffFrequency = 1000.0f;
 		resonance = 0.7f;
 		filterType = FILTER_LOWPASS;
-		using namespace UI;
-		BoxHandle dropdownBox = alloc_box();
-		dropdownBox.unsafeBox->flags |= BOX_FLAG_INVISIBLE;
-		dropdownBox.unsafeBox->layoutDirection = LAYOUT_DIRECTION_RIGHT;
-		dropdownBox.unsafeBox->sizeParentPercent.x = 1.0F;
-
-		UI_WORKING_BOX(dropdownBox) {
-			spacer();
-			BoxHandle filterSelector = text_button("Filter Type"sa, nullptr);
-			filterSelector.unsafeBox->userData[1] = UPtr(this);
-			filterSelector.unsafeBox->actionCallback = [](Box* box, UserCommunication& comm) {
-				if (comm.leftClicked) {
-					UI_BACKGROUND_COLOR((V4F32{ 0.15F, 0.15F, 0.15F, 1.0F }))
-						UI_ADD_CONTEXT_MENU(BoxHandle{}, (V2F32{ comm.renderArea.minX, comm.renderArea.maxY })) {
-						contextMenuBox.unsafeBox->contentScale = comm.scale;
-						workingBox.unsafeBox->userData[1] = box->userData[1];
-						BoxConsumer callback = [](Box* box) {
-							NodeFilter* filter = reinterpret_cast<NodeFilter*>(box->parent->userData[1]);
-							filter->filterType = static_cast<FilterType>(box->userData[1]);
-							filter->setFilter(filter->cutoffFrequency, filter->resonance, filter->filterType);
-						};
-
-						for (int op = FILTER_LOWPASS; op <= FILTER_BANDPASS; ++op) {
-							text_button(filterTypeName(static_cast<FilterType>(op)), callback).unsafeBox->userData[1] = UPtr(op);
-						}
-					}
-				}
-				return ACTION_PASS;
-			};
-			spacer();
-		}
-		header.add_widget()->customUIElement.init(dropdownBox);
+		x_1 = x_2 = y_1 = y_2 = 0.0F;
+		header.add_widget<NodeWidgetCustomUIElement>()->init();
 	}
 
 	void setFilterType(FilterType type) {
 		filterType = type;
-		if (UI::Box* box = header.uiNodeTitleBox.get()) {
-			box->text = filterTypeName(type);
-		}
+		header.set_title(filterTypeName(type));
 	}
 
 	void setFilter(float cutoff, float Q, FilterType type) {
@@ -1368,15 +1212,19 @@ struct NodeFilter {
 			setFilter(cutoffFrequency, resonance, filterType);
 		}
 
+		if (inputSignal.is_silent() && x_1 == 0.0F && x_2 == 0.0F && y_1 == 0.0F && y_2 == 0.0F) {
+			output.set_silent();
+			return;
+		}
 		for (U32 i = 0; i < output.bufferLength; i++) {
-			output.buffer[i] = processSample(inputSignal.buffer[i]);
+			output.buffer[i] = processSample(inputSignal.buffer[i & inputSignal.bufferMask]);
+		}
+		// A decaying tail never quite reaches zero on its own, it just sinks into denormals. Once it's far below anything audible it's cut off, and the filter goes quiet until something comes in again
+		if (abs(y_1) < FILTER_TAIL_THRESHOLD && abs(y_2) < FILTER_TAIL_THRESHOLD && abs(x_1) < FILTER_TAIL_THRESHOLD && abs(x_2) < FILTER_TAIL_THRESHOLD) {
+			x_1 = x_2 = y_1 = y_2 = 0.0F;
 		}
 	}
 
-	void add_to_ui() {
-		using namespace UI;
-		Box* box = header.add_to_ui();
-	}
 };
 
 enum MathOp {
@@ -1440,78 +1288,46 @@ struct NodeMathOp {
 
 	void set_op(MathOp newOp) {
 		op = newOp;
-		if (UI::Box* box = header.uiNodeTitleBox.get()) {
-			box->text = math_op_name(newOp);
-		}
+		header.set_title(math_op_name(newOp));
 		//TODO disable second input if it's a unary operation
 	}
 
 	void init() {
 		header.init(NODE_MATH, "Math"sa);
-		{
-			using namespace UI;
-			BoxHandle dropdownBox = alloc_box();
-			dropdownBox.unsafeBox->flags |= BOX_FLAG_INVISIBLE;
-			dropdownBox.unsafeBox->layoutDirection = LAYOUT_DIRECTION_RIGHT;
-			dropdownBox.unsafeBox->sizeParentPercent.x = 1.0F;
-			UI_WORKING_BOX(dropdownBox) {
-				spacer();
-				BoxHandle operationSelector = text_button("Operation"sa, nullptr);
-				operationSelector.unsafeBox->userData[1] = UPtr(this);
-				operationSelector.unsafeBox->actionCallback = [](Box* box, UserCommunication& comm) {
-					if (comm.leftClicked) {
-						UI_BACKGROUND_COLOR((V4F32{ 0.15F, 0.15F, 0.15F, 1.0F }))
-						UI_ADD_CONTEXT_MENU(BoxHandle{}, (V2F32{ comm.renderArea.minX, comm.renderArea.maxY })) {
-							contextMenuBox.unsafeBox->contentScale = comm.scale;
-							workingBox.unsafeBox->userData[1] = box->userData[1];
-							BoxConsumer callback = [](Box* box) {
-								reinterpret_cast<NodeMathOp*>(box->parent->userData[1])->set_op(MathOp(box->userData[1]));
-							};
-
-							for (MathOp op = MATH_OP_NEG; op <= MATH_OP_RSQRT; op = MathOp(U32(op) + 1)) {
-								text_button(math_op_name(op), callback).unsafeBox->userData[1] = op;
-							}
-
-							UI_SIZE((V2F32{ 64.0F, 2.0F }))
-							UI_BACKGROUND_COLOR((V4F32{ 0.1F, 0.1F, 0.1F, 1.0F }))
-							generic_box();
-
-							for (MathOp op = MATH_OP_ADD; op <= MATH_OP_REM; op = MathOp(U32(op) + 1)) {
-								text_button(math_op_name(op), callback).unsafeBox->userData[1] = op;
-							}
-
-							UI_SIZE((V2F32{ 64.0F, 2.0F }))
-							UI_BACKGROUND_COLOR((V4F32{ 0.1F, 0.1F, 0.1F, 1.0F }))
-							generic_box();
-
-							for (MathOp op = MATH_OP_EQ; op <= MATH_OP_LE; op = MathOp(U32(op) + 1)) {
-								text_button(math_op_name(op), callback).unsafeBox->userData[1] = op;
-							}
-
-							UI_SIZE((V2F32{ 64.0F, 2.0F }))
-							UI_BACKGROUND_COLOR((V4F32{ 0.1F, 0.1F, 0.1F, 1.0F }))
-							generic_box();
-
-							for (MathOp op = MATH_OP_AND; op <= MATH_OP_MAX; op = MathOp(U32(op) + 1)) {
-								text_button(math_op_name(op), callback).unsafeBox->userData[1] = op;
-							}
-						}
-					}
-					return ACTION_PASS;
-				};
-				spacer();
-			}
-			header.add_widget()->customUIElement.init(dropdownBox);
-		}
-		header.add_widget()->output.init();
-		header.add_widget()->input.init(0.0);
-		header.add_widget()->input.init(0.0);
+		header.add_widget<NodeWidgetCustomUIElement>()->init();
+		header.add_widget<NodeWidgetOutput>()->init();
+		header.add_widget<NodeWidgetInput>()->init(0.0);
+		header.add_widget<NodeWidgetInput>()->init(0.0);
 		set_op(MATH_OP_ADD);
 	}
+	// Whether the result is all zeros from which operands are silent alone
+	B32 result_is_silent(B32 aSilent, B32 bSilent) {
+		switch (op) {
+		case MATH_OP_NEG: case MATH_OP_ABS: case MATH_OP_SQRT:
+			return aSilent;
+		case MATH_OP_MUL: case MATH_OP_AND:
+			return aSilent || bSilent;
+		case MATH_OP_ADD: case MATH_OP_SUB: case MATH_OP_OR: case MATH_OP_XOR: case MATH_OP_MIN: case MATH_OP_MAX:
+			return aSilent && bSilent;
+		default:
+			return false;
+		}
+	}
 	void process() {
 		NodeIOValue& operandA = header.get_input(0)->value;
 		NodeIOValue& operandB = header.get_input(1)->value;
 		NodeIOValue& output = header.get_output(0)->value;
+		if (result_is_silent(operandA.is_silent(), operandB.is_silent())) {
+			output.set_silent();
+			return;
+		}
+		// Constant operands give a constant result, so it's worked out for one vector and broadcast instead of run over the whole block
+		B32 constantResult = !output.listEnds && (operandA.flags & NODE_IO_FLAG_CONSTANT) && (op <= MATH_OP_RSQRT || (operandB.flags & NODE_IO_FLAG_CONSTANT));
+		if (constantResult) {
+			output.buffer = output.scalarBuffer;
+			output.bufferLength = 1;
+			output.bufferMask = ARRAY_COUNT(output.scalarBuffer) - 1;
+		}
 		switch (op) {
 		case MATH_OP_NEG: {
 			__m256d signBit = _mm256_castsi256_pd(_mm256_set1_epi64x(0x8000000000000000ull));
@@ -1661,10 +1477,10 @@ struct NodeMathOp {
 			}
 		} break;
 		}
-	}
-	void add_to_ui() {
-		using namespace UI;
-		Box* box = header.add_to_ui();
+		if (constantResult) {
+			// Some ops only fill the first 4 lanes
+			output.set_scalar(output.scalarBuffer[0]);
+		}
 	}
 };
 struct NodeOscilloscope {
@@ -1673,25 +1489,19 @@ struct NodeOscilloscope {
 
 	void init() {
 		header.init(NODE_OSCILLOSCOPE, "Oscilloscope"sa);
-		header.add_widget()->oscilloscope.init();
-		header.add_widget()->input.init(0.0);
+		header.add_widget<NodeWidgetOscilloscope>()->init();
+		header.add_widget<NodeWidgetInput>()->init(0.0);
 	}
 	void process() {
 		NodeIOValue& input = header.get_input(TIME_INPUT_IDX)->value;
-		double* audioDataDouble = input.buffer;
-		U32 bufferSize = input.bufferLength;
 		NodeWidgetOscilloscope* oscWidget = reinterpret_cast<NodeWidgetOscilloscope*>(header.get_nth_of_type(NODE_WIDGET_OSCILLOSCOPE, 0));
 		if (oscWidget) {
-			oscWidget->updateWaveform(input.buffer, bufferSize);
+			oscWidget->push_samples(input);
 		}
 		else {
 			print("Oscilloscope widget not found or not initialized.\n");
 		}
 	}
-	void add_to_ui() {
-		using namespace UI;
-		Box* box = header.add_to_ui();
-	}
 };
 struct NodeSampler {
 	NodeHeader header;
@@ -1699,17 +1509,20 @@ struct NodeSampler {
 
 	void init() {
 		header.init(NODE_SAMPLER, "Sampler"sa);
-		header.add_widget()->output.init();
-		header.add_widget()->input.init(0.0);
-		header.add_widget()->input.init(1.0);
-		header.add_widget()->file_dialog_button.init();
+		header.add_widget<NodeWidgetOutput>()->init();
+		header.add_widget<NodeWidgetInput>()->init(0.0);
+		header.add_widget<NodeWidgetInput>()->init(1.0);
+		header.add_widget<NodeWidgetSamplerButton>()->init();
 	}
 	void process() {
 		NodeWidgetSamplerButton& button = *header.get_samplerbutton(0);
-		if (!button.audioData) return;
 		NodeIOValue& time = header.get_input(TIME_INPUT_IDX)->value;
 		NodeIOValue& pitch = header.get_input(1)->value;
 		NodeIOValue& output = header.get_output(0)->value;
+		if (!button.audioData) {
+			output.set_silent();
+			return;
+		}
 
 		__m256d sampleCount = _mm256_set1_pd(F64(button.numSamples));
 		__m256i sampleCountMinus1 = _mm256_set1_epi32(button.numSamples - 1);
@@ -1724,7 +1537,7 @@ struct NodeSampler {
 		_MM_SET_ROUNDING_MODE(_MM_ROUND_TOWARD_ZERO);
 		for (U32 i = 0; i < output.bufferLength; i += 8) {
 			__m256d timeInput0 = _mm256_load_pd(time.buffer + (i & time.bufferMask));
-			__m256d timeInput1 = _mm256_load_pd(time.buffer + (i + 4 & time.bufferMask));
+			__m256d timeInput1 = _mm256_load_pd(time.buffer + ((i + 4) & time.bufferMask));
 			__m256d normalizedTime0 = _mm256_mul_pd(rcpSampleLengthSeconds, timeInput0);
 			__m256d normalizedTime1 = _mm256_mul_pd(rcpSampleLengthSeconds, timeInput1);
 			normalizedTime0 = _mm256_sub_pd(normalizedTime0, _mm256_round_pd(normalizedTime0, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC));
@@ -1756,10 +1569,6 @@ struct NodeSampler {
 		}
 		_MM_SET_ROUNDING_MODE(oldRoundingMode);
 	}
-	void add_to_ui() {
-		using namespace UI;
-		Box* box = header.add_to_ui();
-	}
 };
 struct NodePianoRoll {
 	NodeHeader header;
@@ -1767,11 +1576,11 @@ struct NodePianoRoll {
 
 	void init() {
 		header.init(NODE_PIANO_ROLL, "Piano Roll"sa);
-		header.add_widget()->pianoRoll.init();
+		header.add_widget<NodeWidgetPianoRoll>()->init();
 		pianoRoll = reinterpret_cast<NodeWidgetPianoRoll*>(header.get_nth_of_type(NODE_WIDGET_PIANO_ROLL, 0));
-		header.add_widget()->output.init("Note time"sa);
-		header.add_widget()->output.init("Note frequency"sa);
-		header.add_widget()->input.init(0.0);
+		header.add_widget<NodeWidgetOutput>()->init("Note time"sa);
+		header.add_widget<NodeWidgetOutput>()->init("Note frequency"sa);
+		header.add_widget<NodeWidgetInput>()->init(0.0);
 	}
 	void process() {
 		NodeIOValue& timeInput = header.get_input(0)->value;
@@ -1794,22 +1603,21 @@ struct NodePianoRoll {
 		noteFreqOutput.listEndsLength = timeInput.bufferLength;
 		noteFreqOutput.bufferMask = U32_MAX;
 	}
-	void add_to_ui() {
-		header.add_to_ui();
-	}
 };
 struct NodeListCollapse {
 	NodeHeader header;
 
 	void init() {
 		header.init(NODE_LIST_COLLAPSE, "List Collapse"sa);
-		header.add_widget()->output.init();
-		header.add_widget()->input.init(0.0);
+		header.add_widget<NodeWidgetOutput>()->init();
+		header.add_widget<NodeWidgetInput>()->init(0.0);
 	}
 	void process() {
 		NodeIOValue& inputVal = header.get_input(0)->value;
 		NodeIOValue& outputVal = header.get_output(0)->value;
-		if (outputVal.listEnds) {
+		if (outputVal.listEnds && inputVal.is_silent()) {
+			outputVal.set_scalar(0.0);
+		} else if (outputVal.listEnds) {
 			outputVal.buffer = audioArena.alloc_aligned_with_slack<F64>(inputVal.listEndsLength, alignof(__m256), 2 * sizeof(__m256));
 			outputVal.bufferLength = inputVal.listEndsLength;
 			outputVal.listEnds = nullptr;
@@ -1828,23 +1636,163 @@ struct NodeListCollapse {
 			outputVal = inputVal;
 		}
 	}
-	void add_to_ui() {
-		header.add_to_ui();
+};
+// Constant power, so a sound doesn't get quieter in the middle. -1 is hard left, 1 is hard right. Angle is in turns, a quarter turn sweeps from all left to all right
+FINLINE __m256 pan_angle_f32x8(__m256 pan) {
+	pan = _mm256_min_ps(_mm256_max_ps(pan, _mm256_set1_ps(-1.0F)), _mm256_set1_ps(1.0F));
+	return _mm256_mul_ps(_mm256_add_ps(pan, _mm256_set1_ps(1.0F)), _mm256_set1_ps(0.125F));
+}
+FINLINE void pan_gains(F32 pan, F32* leftOut, F32* rightOut) {
+	F32 angle = (clamp(pan, -1.0F, 1.0F) + 1.0F) * 0.125F;
+	*leftOut = cosf32(angle);
+	*rightOut = sinf32(angle);
+}
+
+struct NodePan {
+	NodeHeader header;
+
+	void init() {
+		header.init(NODE_PAN, "Pan"sa);
+		header.add_widget<NodeWidgetOutput>()->init("Left"sa);
+		header.add_widget<NodeWidgetOutput>()->init("Right"sa);
+		header.add_widget<NodeWidgetInput>()->init(0.0);
+		header.add_widget<NodeWidgetInput>()->init(0.0);
+	}
+	void process() {
+		NodeIOValue& signal = header.get_input(0)->value;
+		NodeIOValue& pan = header.get_input(1)->value;
+		NodeIOValue& left = header.get_output(0)->value;
+		NodeIOValue& right = header.get_output(1)->value;
+		if (signal.is_silent()) {
+			left.set_silent();
+			right.set_silent();
+			return;
+		}
+		// Both gains come out of one 8 wide cos/sin pair, the rest is two multiplies per sample. Lists pan each voice on its own, since the outputs keep the input's list ends
+		for (U32 i = 0; i < left.bufferLength; i += 8) {
+			__m128 panLow = _mm256_cvtpd_ps(_mm256_load_pd(pan.buffer + (i & pan.bufferMask)));
+			__m128 panHigh = _mm256_cvtpd_ps(_mm256_load_pd(pan.buffer + ((i + 4) & pan.bufferMask)));
+			__m256 angle = pan_angle_f32x8(_mm256_insertf128_ps(_mm256_castps128_ps256(panLow), panHigh, 1));
+			__m256 leftGain = cosf32x8(angle);
+			__m256 rightGain = sinf32x8(angle);
+			__m256d signalLow = _mm256_load_pd(signal.buffer + (i & signal.bufferMask));
+			__m256d signalHigh = _mm256_load_pd(signal.buffer + ((i + 4) & signal.bufferMask));
+			_mm256_store_pd(left.buffer + i, _mm256_mul_pd(signalLow, _mm256_cvtps_pd(_mm256_castps256_ps128(leftGain))));
+			_mm256_store_pd(left.buffer + i + 4, _mm256_mul_pd(signalHigh, _mm256_cvtps_pd(_mm256_extractf128_ps(leftGain, 1))));
+			_mm256_store_pd(right.buffer + i, _mm256_mul_pd(signalLow, _mm256_cvtps_pd(_mm256_castps256_ps128(rightGain))));
+			_mm256_store_pd(right.buffer + i + 4, _mm256_mul_pd(signalHigh, _mm256_cvtps_pd(_mm256_extractf128_ps(rightGain, 1))));
+		}
+	}
+};
+
+// Takes a list of voices (chords from the piano roll, for example) and fans them out across the stereo field, lowest voice on the left.
+// Width 0 puts them all in the middle, 1 spreads them from hard left to hard right
+struct NodeSpread {
+	NodeHeader header;
+
+	// Gains are worked out once per block for each voice count, past this they're computed per voice
+	static constexpr U32 MAX_CACHED_VOICES = 16;
+
+	void init() {
+		header.init(NODE_SPREAD, "Spread"sa);
+		header.add_widget<NodeWidgetOutput>()->init("Left"sa);
+		header.add_widget<NodeWidgetOutput>()->init("Right"sa);
+		header.add_widget<NodeWidgetInput>()->init(0.0);
+		header.add_widget<NodeWidgetInput>()->init(1.0);
+	}
+	void process() {
+		NodeIOValue& voices = header.get_input(0)->value;
+		NodeIOValue& width = header.get_input(1)->value;
+		NodeIOValue& left = header.get_output(0)->value;
+		NodeIOValue& right = header.get_output(1)->value;
+		if (voices.is_silent()) {
+			// Voices get summed into each side, so silence comes out as a plain zero rather than a list
+			left.set_scalar(0.0);
+			right.set_scalar(0.0);
+			return;
+		}
+		// Width changing over a block isn't going to be audible, and reading it once is what lets the gains be cached
+		F32 spreadWidth = F32(width.buffer[0]);
+		if (!voices.listEndsLength) {
+			// A single voice sits in the middle
+			F32 leftGain, rightGain;
+			pan_gains(0.0F, &leftGain, &rightGain);
+			__m256d leftGainX4 = _mm256_set1_pd(leftGain);
+			__m256d rightGainX4 = _mm256_set1_pd(rightGain);
+			for (U32 i = 0; i < left.bufferLength; i += 4) {
+				__m256d signal = _mm256_load_pd(voices.buffer + (i & voices.bufferMask));
+				_mm256_store_pd(left.buffer + i, _mm256_mul_pd(signal, leftGainX4));
+				_mm256_store_pd(right.buffer + i, _mm256_mul_pd(signal, rightGainX4));
+			}
+			return;
+		}
+
+		// Gains for voice k of n live at offset n * (n - 1) / 2 + k
+		F32 leftGains[MAX_CACHED_VOICES * (MAX_CACHED_VOICES + 1) / 2];
+		F32 rightGains[MAX_CACHED_VOICES * (MAX_CACHED_VOICES + 1) / 2];
+		B8 voiceCountCached[MAX_CACHED_VOICES + 1]{};
+		auto voice_gains = [&](U32 voice, U32 voiceCount, F32* leftGainOut, F32* rightGainOut) {
+			F32 pan = voiceCount > 1 ? spreadWidth * (2.0F * F32(voice) / F32(voiceCount - 1) - 1.0F) : 0.0F;
+			pan_gains(pan, leftGainOut, rightGainOut);
+		};
+
+		U32 outputLength = voices.listEndsLength;
+		F64* leftBuffer = audioArena.alloc_aligned_with_slack<F64>(outputLength, alignof(__m256), 2 * sizeof(__m256));
+		F64* rightBuffer = audioArena.alloc_aligned_with_slack<F64>(outputLength, alignof(__m256), 2 * sizeof(__m256));
+		U32 prevEnd = 0;
+		for (U32 i = 0; i < outputLength; i++) {
+			U32 voiceCount = voices.listEnds[i] - prevEnd;
+			F64 leftAccumulator = 0.0;
+			F64 rightAccumulator = 0.0;
+			if (voiceCount <= MAX_CACHED_VOICES) {
+				U32 gainOffset = voiceCount * (voiceCount - 1) / 2;
+				if (voiceCount && !voiceCountCached[voiceCount]) {
+					for (U32 k = 0; k < voiceCount; k++) {
+						voice_gains(k, voiceCount, &leftGains[gainOffset + k], &rightGains[gainOffset + k]);
+					}
+					voiceCountCached[voiceCount] = true;
+				}
+				for (U32 k = 0; k < voiceCount; k++) {
+					F64 sample = voices.buffer[prevEnd + k];
+					leftAccumulator += sample * leftGains[gainOffset + k];
+					rightAccumulator += sample * rightGains[gainOffset + k];
+				}
+			} else {
+				for (U32 k = 0; k < voiceCount; k++) {
+					F32 leftGain, rightGain;
+					voice_gains(k, voiceCount, &leftGain, &rightGain);
+					F64 sample = voices.buffer[prevEnd + k];
+					leftAccumulator += sample * leftGain;
+					rightAccumulator += sample * rightGain;
+				}
+			}
+			leftBuffer[i] = leftAccumulator;
+			rightBuffer[i] = rightAccumulator;
+			prevEnd = voices.listEnds[i];
+		}
+		left.buffer = leftBuffer;
+		right.buffer = rightBuffer;
+		left.bufferLength = right.bufferLength = outputLength;
+		left.listEnds = right.listEnds = nullptr;
+		left.listEndsLength = right.listEndsLength = 0;
+		left.bufferMask = right.bufferMask = U32_MAX;
 	}
 };
 template<B32 inverse>
 struct NodeFourierTransform {
 	NodeHeader header;
+	FFT::Plan* plan;
 
 	void init() {
 		header.init(inverse ? NODE_TO_TIME_DOMAIN : NODE_TO_FREQUENCY_DOMAIN, inverse ? "Time Domain"sa : "Freq Domain"sa);
-		header.add_widget()->output.init("x"sa);
-		header.add_widget()->output.init("y"sa);
+		header.add_widget<NodeWidgetOutput>()->init("x"sa);
+		header.add_widget<NodeWidgetOutput>()->init("y"sa);
 		if (!inverse) {
-			header.add_widget()->output.init("frequency"sa);
+			header.add_widget<NodeWidgetOutput>()->init("frequency"sa);
 		}
-		header.add_widget()->input.init(0.0);
-		header.add_widget()->input.init(0.0);
+		header.add_widget<NodeWidgetInput>()->init(0.0);
+		header.add_widget<NodeWidgetInput>()->init(0.0);
+		plan = FFT::get_plan_for_size(PROCESS_BUFFER_SIZE);
 	}
 	void process() {
 		NodeIOValue& inputX = header.get_input(0)->value;
@@ -1852,12 +1800,18 @@ struct NodeFourierTransform {
 		NodeIOValue& outputX = header.get_output(0)->value;
 		NodeIOValue& outputY = header.get_output(1)->value;
 		NodeIOValue& outputFreq = header.get_output(2)->value;
-
-		F32* inX = frameArena.alloc_aligned_with_slack<F32>(1024, alignof(__m256), 0);
-		F32* inY = inputY.buffer == inputY.scalarBuffer && inputY.scalarBuffer[0] == 0.0 ? nullptr : frameArena.alloc_aligned_with_slack<F32>(1024, alignof(__m256), 0);
-		F32* outX = frameArena.alloc_aligned_with_slack<F32>(1024, alignof(__m256), 0);
-		F32* outY = frameArena.alloc_aligned_with_slack<F32>(1024, alignof(__m256), 0);
-		for (U32 i = 0; i < 1024; i += 4) {
+		if (inputX.listEnds || inputY.listEnds) {
+			process_voices(inputX, inputY, outputX, outputY, outputFreq);
+			return;
+		}
+
+		const U32 size = plan->size;
+		const U32 sizeMask = size - 1;
+		F32* inX = audioArena.alloc_aligned_with_slack<F32>(size, alignof(__m256), 0);
+		F32* inY = inputY.buffer == inputY.scalarBuffer && inputY.scalarBuffer[0] == 0.0 ? nullptr : audioArena.alloc_aligned_with_slack<F32>(size, alignof(__m256), 0);
+		F32* outX = audioArena.alloc_aligned_with_slack<F32>(size, alignof(__m256), 0);
+		F32* outY = audioArena.alloc_aligned_with_slack<F32>(size, alignof(__m256), 0);
+		for (U32 i = 0; i < size; i += 4) {
 			__m256d x = _mm256_load_pd(inputX.buffer + (i & inputX.bufferMask));
 			_mm_store_ps(inX + i, _mm256_cvtpd_ps(x));
 			if (inY) {
@@ -1865,23 +1819,198 @@ struct NodeFourierTransform {
 				_mm_store_ps(inY + i, _mm256_cvtpd_ps(y));
 			}
 		}
-		B32 inv = inverse;
 		if (inY) {
-			FFT::fft_1024<inverse, true>(outX, outY, inX, inY);
+			FFT::fft<inverse, true>(*plan, outX, outY, inX, inY);
 		} else {
-			FFT::fft_1024<inverse, false>(outX, outY, inX, inY);
+			// Real input only needs a half size transform. The upper half of the spectrum is the conjugate mirror of the lower half,
+			// and the inverse of a real signal is the conjugate of the forward transform
+			FFT::fft_real(*plan, outX, outY, inX);
+			if (inverse) {
+				for (U32 i = 0; i <= size / 2; i++) {
+					outY[i] = -outY[i];
+				}
+			}
+			for (U32 i = size / 2 + 1; i < size; i++) {
+				outX[i] = outX[size - i];
+				outY[i] = -outY[size - i];
+			}
 		}
-		__m256d freqScale = _mm256_set1_pd(F64(WASAPIInterface::AUDIO_FORMAT_SAMPLE_RATE_HZ[WASAPIInterface::outputAudioFormat]) / 1024.0);
+		__m256d freqScale = _mm256_set1_pd(F64(AudioDevice::sample_rate()) / F64(size));
 		for (U32 i = 0; i < outputX.bufferLength; i += 4) {
-			_mm256_store_pd(outputX.buffer + i, _mm256_cvtps_pd(_mm_load_ps(outX + (i & 1023))));
-			_mm256_store_pd(outputY.buffer + i, _mm256_cvtps_pd(_mm_load_ps(outY + (i & 1023))));
+			_mm256_store_pd(outputX.buffer + i, _mm256_cvtps_pd(_mm_load_ps(outX + (i & sizeMask))));
+			_mm256_store_pd(outputY.buffer + i, _mm256_cvtps_pd(_mm_load_ps(outY + (i & sizeMask))));
 			if (!inverse) {
 				_mm256_store_pd(outputFreq.buffer + i, _mm256_mul_pd(_mm256_setr_pd(F64(i), F64(i + 1), F64(i + 2), F64(i + 3)), freqScale));
 			}
 		}
 	}
-	void add_to_ui() {
-		header.add_to_ui();
+	// How many voices a list has at a sample, 0 past its end. Anything that isn't a list doesn't add any voices of its own
+	static FINLINE U32 list_voice_count(const NodeIOValue& input, U32 sample) {
+		if (!input.listEnds || sample >= input.listEndsLength) {
+			return 0;
+		}
+		return input.listEnds[sample] - (sample == 0 ? 0 : input.listEnds[sample - 1]);
+	}
+	// Fills one row of the batch from voices [firstVoice, firstVoice + 8) of an input sample. A list reads its own voices, with lanes for voices it doesn't have,
+	// or samples past the end of the list, set to 0. Anything else is one value per sample, which goes to every voice the sample has (sampleVoices), same as make_io_compatible would broadcast it
+	static FINLINE void gather_voices(F32* dst, const NodeIOValue& input, U32 sample, U32 firstVoice, U32 sampleVoices) {
+		if (!input.listEnds) {
+			F64 value = input.bufferMask != U32_MAX || sample < input.bufferLength ? input.buffer[sample & input.bufferMask] : 0.0;
+			__m256i voicesLeft = _mm256_set1_epi32(I32(sampleVoices) - I32(firstVoice));
+			__m256 mask = _mm256_castsi256_ps(_mm256_cmpgt_epi32(voicesLeft, _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+			_mm256_store_ps(dst, _mm256_and_ps(_mm256_set1_ps(F32(value)), mask));
+			return;
+		}
+		if (sample >= input.listEndsLength) {
+			_mm256_store_ps(dst, _mm256_setzero_ps());
+			return;
+		}
+		U32 start = sample == 0 ? 0 : input.listEnds[sample - 1];
+		U32 count = input.listEnds[sample] - start;
+		if (input.bufferMask == U32_MAX) {
+			const F64* src = input.buffer + start + firstVoice;
+			__m256d lo, hi;
+			if (firstVoice + 8 <= count) {
+				lo = _mm256_loadu_pd(src);
+				hi = _mm256_loadu_pd(src + 4);
+			} else {
+				// Masked off lanes read as 0 and don't touch memory, so this can't run past the list
+				__m256i voicesLeft = _mm256_set1_epi64x(I64(count) - I64(firstVoice));
+				lo = _mm256_maskload_pd(src, _mm256_cmpgt_epi64(voicesLeft, _mm256_setr_epi64x(0, 1, 2, 3)));
+				hi = _mm256_maskload_pd(src + 4, _mm256_cmpgt_epi64(voicesLeft, _mm256_setr_epi64x(4, 5, 6, 7)));
+			}
+			_mm256_store_ps(dst, _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)), _mm256_cvtpd_ps(hi), 1));
+		} else {
+			for (U32 voice = firstVoice; voice < firstVoice + 8; voice++) {
+				dst[voice - firstVoice] = voice < count ? F32(input.buffer[(start + voice) & input.bufferMask]) : 0.0F;
+			}
+		}
+	}
+	// Writes one bin for voices [firstVoice, firstVoice + 8) of the output list layout, which has voiceCount entries per bin
+	static FINLINE void scatter_voices(F64* dstX, F64* dstY, __m256 x, __m256 y, U32 voiceCount, U32 firstVoice) {
+		if (firstVoice + 8 <= voiceCount) {
+			_mm256_storeu_pd(dstX + firstVoice, _mm256_cvtps_pd(_mm256_castps256_ps128(x)));
+			_mm256_storeu_pd(dstX + firstVoice + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)));
+			_mm256_storeu_pd(dstY + firstVoice, _mm256_cvtps_pd(_mm256_castps256_ps128(y)));
+			_mm256_storeu_pd(dstY + firstVoice + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(y, 1)));
+		} else if (firstVoice < voiceCount) {
+			__m256i voicesLeft = _mm256_set1_epi64x(voiceCount - firstVoice);
+			__m256i maskLo = _mm256_cmpgt_epi64(voicesLeft, _mm256_setr_epi64x(0, 1, 2, 3));
+			__m256i maskHi = _mm256_cmpgt_epi64(voicesLeft, _mm256_setr_epi64x(4, 5, 6, 7));
+			_mm256_maskstore_pd(dstX + firstVoice, maskLo, _mm256_cvtps_pd(_mm256_castps256_ps128(x)));
+			_mm256_maskstore_pd(dstX + firstVoice + 4, maskHi, _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)));
+			_mm256_maskstore_pd(dstY + firstVoice, maskLo, _mm256_cvtps_pd(_mm256_castps256_ps128(y)));
+			_mm256_maskstore_pd(dstY + firstVoice + 4, maskHi, _mm256_cvtps_pd(_mm256_extractf128_ps(y, 1)));
+		}
+	}
+	// Transforms every voice of a list buffer on its own, voice n being the nth element of each sample's list (voices missing from a sample count as 0).
+	// Voices go 8 to a register so the butterflies are full width, and without a y input each voice only needs a half size transform.
+	// If x and y are both lists, a sample has as many voices as the longer of the two. If only one is, the other is broadcast to every voice.
+	// The output has the same voices in the same order, with every bin holding the highest voice count
+	void process_voices(NodeIOValue& inputX, NodeIOValue& inputY, NodeIOValue& outputX, NodeIOValue& outputY, NodeIOValue& outputFreq) {
+		const U32 size = plan->size;
+		U32* sampleVoices = audioArena.alloc_aligned_with_slack<U32>(size, alignof(__m256), 0);
+		U32 voiceCount = 0;
+		for (U32 i = 0; i < size; i++) {
+			sampleVoices[i] = max(list_voice_count(inputX, i), list_voice_count(inputY, i));
+			voiceCount = max(voiceCount, sampleVoices[i]);
+		}
+
+		// A list that has the highest voice count at every sample already has the output's layout. Every sample of it has at most voiceCount voices,
+		// so that's the case exactly when they add up to size * voiceCount
+		U32* outputListEnds = nullptr;
+		NodeIOValue* inputs[]{ &inputX, &inputY };
+		for (NodeIOValue* input : inputs) {
+			if (input->listEnds && input->listEndsLength >= size && input->listEnds[size - 1] == size * voiceCount) {
+				outputListEnds = input->listEnds;
+			}
+		}
+		if (!outputListEnds) {
+			outputListEnds = audioArena.alloc_aligned_with_slack<U32>(size, alignof(__m256), 2 * sizeof(__m256));
+			for (U32 i = 0; i < size; i++) {
+				outputListEnds[i] = (i + 1) * voiceCount;
+			}
+		}
+		NodeIOValue* outputs[]{ &outputX, &outputY, inverse ? nullptr : &outputFreq };
+		for (NodeIOValue* output : outputs) {
+			if (output) {
+				output->buffer = audioArena.alloc_aligned_with_slack<F64>(size * voiceCount, alignof(__m256), 2 * sizeof(__m256));
+				output->bufferLength = size * voiceCount;
+				output->bufferMask = U32_MAX;
+				output->listEnds = outputListEnds;
+				output->listEndsLength = size;
+			}
+		}
+		if (voiceCount == 0) {
+			return;
+		}
+
+		B32 hasY = !(inputY.buffer == inputY.scalarBuffer && inputY.scalarBuffer[0] == 0.0);
+		if (hasY) {
+			F32* batchX = audioArena.alloc_aligned_with_slack<F32>(size * 8, alignof(__m256), 0);
+			F32* batchY = audioArena.alloc_aligned_with_slack<F32>(size * 8, alignof(__m256), 0);
+			for (U32 firstVoice = 0; firstVoice < voiceCount; firstVoice += 8) {
+				// Rows go straight to their bit reversed position, which saves the transform a pass over the batch
+				for (U32 i = 0; i < size; i++) {
+					U32 row = plan->bitReverseIndices[i] * 8;
+					gather_voices(batchX + row, inputX, i, firstVoice, sampleVoices[i]);
+					gather_voices(batchY + row, inputY, i, firstVoice, sampleVoices[i]);
+				}
+				FFT::fft_batched8_bit_reversed<inverse>(*plan, batchX, batchY);
+				for (U32 k = 0; k < size; k++) {
+					scatter_voices(outputX.buffer + k * voiceCount, outputY.buffer + k * voiceCount, _mm256_load_ps(batchX + k * 8), _mm256_load_ps(batchY + k * 8), voiceCount, firstVoice);
+				}
+			}
+		} else {
+			// Same approach as fft_real, 8 voices at a time: each voice is packed into a half size complex signal (even samples in x, odd samples in y) and split afterwards.
+			// Only bins up to size / 2 are worked out, the rest being the conjugate mirror, and the inverse of a real signal is the conjugate of the forward transform
+			const FFT::Plan& halfPlan = *plan->halfPlan;
+			const U32 halfSize = halfPlan.size;
+			F32* batchX = audioArena.alloc_aligned_with_slack<F32>(halfSize * 8, alignof(__m256), 0);
+			F32* batchY = audioArena.alloc_aligned_with_slack<F32>(halfSize * 8, alignof(__m256), 0);
+			__m256 signBit = _mm256_set1_ps(-0.0F);
+			for (U32 firstVoice = 0; firstVoice < voiceCount; firstVoice += 8) {
+				for (U32 i = 0; i < halfSize; i++) {
+					U32 row = halfPlan.bitReverseIndices[i] * 8;
+					gather_voices(batchX + row, inputX, i * 2, firstVoice, sampleVoices[i * 2]);
+					gather_voices(batchY + row, inputX, i * 2 + 1, firstVoice, sampleVoices[i * 2 + 1]);
+				}
+				FFT::fft_batched8_bit_reversed<false>(halfPlan, batchX, batchY);
+				for (U32 k = 0; k <= halfSize / 2; k++) {
+					// Z[halfSize] wraps around to Z[0], so k = 0 gives both the DC and nyquist bins
+					U32 mirror = halfSize - k;
+					U32 q = mirror & (halfSize - 1);
+					__m256 kX, kY, mirrorX, mirrorY;
+					FFT::split_packed_real_x8(&kX, &kY, &mirrorX, &mirrorY,
+						_mm256_load_ps(batchX + k * 8), _mm256_load_ps(batchY + k * 8), _mm256_load_ps(batchX + q * 8), _mm256_load_ps(batchY + q * 8),
+						_mm256_broadcast_ss(plan->realTwiddlesCos + k), _mm256_broadcast_ss(plan->realTwiddlesSin + k));
+					if (inverse) {
+						kY = _mm256_xor_ps(kY, signBit);
+						mirrorY = _mm256_xor_ps(mirrorY, signBit);
+					}
+					scatter_voices(outputX.buffer + k * voiceCount, outputY.buffer + k * voiceCount, kX, kY, voiceCount, firstVoice);
+					scatter_voices(outputX.buffer + mirror * voiceCount, outputY.buffer + mirror * voiceCount, mirrorX, mirrorY, voiceCount, firstVoice);
+					if (k != 0) {
+						scatter_voices(outputX.buffer + (size - k) * voiceCount, outputY.buffer + (size - k) * voiceCount, kX, _mm256_xor_ps(kY, signBit), voiceCount, firstVoice);
+						scatter_voices(outputX.buffer + (size - mirror) * voiceCount, outputY.buffer + (size - mirror) * voiceCount, mirrorX, _mm256_xor_ps(mirrorY, signBit), voiceCount, firstVoice);
+					}
+				}
+			}
+		}
+		if (!inverse) {
+			F64 freqScale = F64(AudioDevice::sample_rate()) / F64(size);
+			for (U32 k = 0; k < size; k++) {
+				__m256d freq = _mm256_set1_pd(F64(k) * freqScale);
+				F64* dst = outputFreq.buffer + k * voiceCount;
+				U32 voice = 0;
+				for (; voice + 4 <= voiceCount; voice += 4) {
+					_mm256_storeu_pd(dst + voice, freq);
+				}
+				for (; voice < voiceCount; voice++) {
+					dst[voice] = F64(k) * freqScale;
+				}
+			}
+		}
 	}
 };
 using NodeFFT = NodeFourierTransform<false>;
@@ -1891,10 +2020,10 @@ struct NodeToPolar {
 	NodeHeader header;
 	void init() {
 		header.init(NODE_TO_POLAR, "To Polar"sa);
-		header.add_widget()->output.init("Angle"sa);
-		header.add_widget()->output.init("Magnitude"sa);
-		header.add_widget()->input.init(0.0);
-		header.add_widget()->input.init(0.0);
+		header.add_widget<NodeWidgetOutput>()->init("Angle"sa);
+		header.add_widget<NodeWidgetOutput>()->init("Magnitude"sa);
+		header.add_widget<NodeWidgetInput>()->init(0.0);
+		header.add_widget<NodeWidgetInput>()->init(0.0);
 	}
 	void process() {
 		NodeIOValue& x = header.get_input(0)->value;
@@ -1908,18 +2037,15 @@ struct NodeToPolar {
 			_mm256_store_pd(magnitude.buffer + i, _mm256_sqrt_pd(_mm256_fmadd_pd(xVal, xVal, _mm256_mul_pd(yVal, yVal))));
 		}
 	}
-	void add_to_ui() {
-		header.add_to_ui();
-	}
 };
 struct NodeFromPolar {
 	NodeHeader header;
 	void init() {
 		header.init(NODE_FROM_POLAR, "From Polar"sa);
-		header.add_widget()->output.init("x"sa);
-		header.add_widget()->output.init("y"sa);
-		header.add_widget()->input.init(0.0);
-		header.add_widget()->input.init(0.0);
+		header.add_widget<NodeWidgetOutput>()->init("x"sa);
+		header.add_widget<NodeWidgetOutput>()->init("y"sa);
+		header.add_widget<NodeWidgetInput>()->init(0.0);
+		header.add_widget<NodeWidgetInput>()->init(0.0);
 	}
 	void process() {
 		NodeIOValue& angle = header.get_input(0)->value;
@@ -1935,111 +2061,525 @@ struct NodeFromPolar {
 			_mm256_store_pd(y.buffer + i, _mm256_mul_pd(sine, magnitudeVal));
 		}
 	}
-	void add_to_ui() {
-		header.add_to_ui();
+};
+
+enum StftWindow : U32 {
+	STFT_WINDOW_HANN,
+	STFT_WINDOW_BLACKMAN_HARRIS,
+	STFT_WINDOW_COUNT
+};
+StrA stft_window_name(StftWindow window) {
+	switch (window) {
+	case STFT_WINDOW_HANN:            return "Hann"sa;
+	case STFT_WINDOW_BLACKMAN_HARRIS: return "Blackman-Harris"sa;
+	default:                          return ""sa;
+	}
+}
+
+const U32 STFT_MIN_LOG2_FFT_SIZE = 8;
+const U32 STFT_MAX_LOG2_FFT_SIZE = 13;
+const StrA STFT_FFT_SIZE_NAMES[STFT_MAX_LOG2_FFT_SIZE - STFT_MIN_LOG2_FFT_SIZE + 1]{ "FFT 256"sa, "FFT 512"sa, "FFT 1024"sa, "FFT 2048"sa, "FFT 4096"sa, "FFT 8192"sa };
+const U32 STFT_MAX_LOG2_HOP_DIVISOR = 3;
+const StrA STFT_HOP_NAMES[STFT_MAX_LOG2_HOP_DIVISOR + 1]{ "Hop 1"sa, "Hop 1/2"sa, "Hop 1/4"sa, "Hop 1/8"sa };
+
+// Analysis and synthesis have to agree on these for the frames to line up, so it's all in one struct that gets saved as a unit
+struct StftSettings {
+	U32 log2FftSize;
+	U32 log2HopDivisor;
+	StftWindow window;
+
+	U32 fft_size() const {
+		return 1u << log2FftSize;
+	}
+	U32 hop_size() const {
+		return fft_size() >> log2HopDivisor;
+	}
+	// Frames are packed as fftSize/2 complex bins. DC and nyquist are both purely real for real input, so nyquist rides along in the imaginary part of DC
+	U32 bin_count() const {
+		return fft_size() / 2;
+	}
+	void sanitize() {
+		log2FftSize = clamp(log2FftSize, STFT_MIN_LOG2_FFT_SIZE, STFT_MAX_LOG2_FFT_SIZE);
+		log2HopDivisor = clamp(log2HopDivisor, 1u, STFT_MAX_LOG2_HOP_DIVISOR);
+		window = window < STFT_WINDOW_COUNT ? window : STFT_WINDOW_HANN;
 	}
 };
+const StftSettings STFT_DEFAULT_SETTINGS{ 10, 2, STFT_WINDOW_HANN };
+
+// Periodic window, so overlapping copies at the hop sum up evenly. size must be a multiple of 8
+void compute_stft_window(F32* out, U32 size, StftWindow window) {
+	__m256 laneOffsets = _mm256_setr_ps(0.0F, 1.0F, 2.0F, 3.0F, 4.0F, 5.0F, 6.0F, 7.0F);
+	__m256 rcpSize = _mm256_set1_ps(1.0F / F32(size));
+	for (U32 i = 0; i < size; i += 8) {
+		// Turns, since that's what the DrillMath trig takes
+		__m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(F32(i)), laneOffsets), rcpSize);
+		__m256 result;
+		if (window == STFT_WINDOW_BLACKMAN_HARRIS) {
+			// 4 term, -92dB sidelobes
+			result = _mm256_fnmadd_ps(_mm256_set1_ps(0.48829F), cosf32x8(t), _mm256_set1_ps(0.35875F));
+			result = _mm256_fmadd_ps(_mm256_set1_ps(0.14128F), cosf32x8(_mm256_add_ps(t, t)), result);
+			result = _mm256_fnmadd_ps(_mm256_set1_ps(0.01168F), cosf32x8(_mm256_mul_ps(t, _mm256_set1_ps(3.0F))), result);
+		} else {
+			result = _mm256_fnmadd_ps(_mm256_set1_ps(0.5F), cosf32x8(t), _mm256_set1_ps(0.5F));
+		}
+		_mm256_store_ps(out + i, result);
+	}
+}
 
-union Node {
-	Node* freeListNextPtr;
+// Streaming analysis. Emits a frame every hop samples, so a block's output is however many frames finished during it, back to back, each bin_count() long.
+// Blocks where no frame finishes output a scalar 0, which synthesis reads as no frames
+struct NodeSTFTAnalysis {
 	NodeHeader header;
-#define X(enumName, typeName) typeName typeName##_val;
-	NODES
-#undef X
+	StftSettings settings;
+	FFT::Plan* plan;
+	F32* window;
+	// Last fftSize input samples, so frames can straddle blocks
+	F32* history;
+	// Frame end offset into the next block, in [1, hop]. Hop and block size are both powers of two and this starts at hop,
+	// so frames always end on a multiple of hop into the block and the last one in a block ends right at the block's end
+	U32 samplesUntilFrame;
+
+	void apply_settings(StftSettings newSettings) {
+		settings = newSettings;
+		settings.sanitize();
+		U32 fftSize = settings.fft_size();
+		plan = FFT::get_plan(settings.log2FftSize);
+		F32* state = reinterpret_cast<F32*>(header.alloc_state(2 * fftSize * sizeof(F32)));
+		window = state;
+		history = state + fftSize;
+		compute_stft_window(window, fftSize, settings.window);
+		samplesUntilFrame = settings.hop_size();
+		notify_view_node_changed(&header);
+	}
+
+	void init() {
+		header.init(NODE_STFT_ANALYSIS, "STFT Analysis"sa);
+		header.add_widget<NodeWidgetOutput>()->init("x"sa);
+		header.add_widget<NodeWidgetOutput>()->init("y"sa);
+		header.add_widget<NodeWidgetOutput>()->init("frequency"sa);
+		header.add_widget<NodeWidgetInput>()->init(0.0);
+		settings = STFT_DEFAULT_SETTINGS;
+		header.add_widget<NodeWidgetCustomUIElement>()->init();
+		apply_settings(settings);
+	}
+	void process() {
+		NodeIOValue& input = header.get_input(0)->value;
+		NodeIOValue& outputX = header.get_output(0)->value;
+		NodeIOValue& outputY = header.get_output(1)->value;
+		NodeIOValue& outputFreq = header.get_output(2)->value;
+		const U32 fftSize = settings.fft_size();
+		const U32 hop = settings.hop_size();
+		const U32 binCount = settings.bin_count();
+
+		// History followed by this block, so every frame is one contiguous run of samples
+		F32* samples = audioArena.alloc_aligned_with_slack<F32>(fftSize + PROCESS_BUFFER_SIZE, alignof(__m256), 0);
+		memcpy(samples, history, fftSize * sizeof(F32));
+		for (U32 i = 0; i < PROCESS_BUFFER_SIZE; i += 4) {
+			_mm_store_ps(samples + fftSize + i, _mm256_cvtpd_ps(_mm256_load_pd(input.buffer + (i & input.bufferMask))));
+		}
+		memcpy(history, samples + PROCESS_BUFFER_SIZE, fftSize * sizeof(F32));
+
+		U32 frameCount = samplesUntilFrame <= PROCESS_BUFFER_SIZE ? (PROCESS_BUFFER_SIZE - samplesUntilFrame) / hop + 1 : 0;
+		if (frameCount == 0) {
+			outputX.set_scalar(0.0);
+			outputY.set_scalar(0.0);
+			outputFreq.set_scalar(0.0);
+			samplesUntilFrame -= PROCESS_BUFFER_SIZE;
+			return;
+		}
+		U32 outputLength = frameCount * binCount;
+		NodeIOValue* outputs[]{ &outputX, &outputY, &outputFreq };
+		for (NodeIOValue* output : outputs) {
+			output->buffer = audioArena.alloc_aligned_with_slack<F64>(outputLength, alignof(__m256), 2 * sizeof(__m256));
+			output->bufferLength = outputLength;
+			output->bufferMask = U32_MAX;
+			output->listEnds = nullptr;
+			output->listEndsLength = 0;
+		}
+		F32* windowed = audioArena.alloc_aligned_with_slack<F32>(fftSize, alignof(__m256), 0);
+		F32* spectrumX = audioArena.alloc_aligned_with_slack<F32>(binCount + 8, alignof(__m256), 0);
+		F32* spectrumY = audioArena.alloc_aligned_with_slack<F32>(binCount + 8, alignof(__m256), 0);
+		__m256d freqScale = _mm256_set1_pd(F64(AudioDevice::sample_rate()) / F64(fftSize));
+		for (U32 frame = 0; frame < frameCount; frame++) {
+			// A frame ending at block offset e covers block samples [e - fftSize, e), which is [e, e + fftSize) in samples
+			F32* frameSamples = samples + samplesUntilFrame + frame * hop;
+			for (U32 i = 0; i < fftSize; i += 8) {
+				_mm256_store_ps(windowed + i, _mm256_mul_ps(_mm256_loadu_ps(frameSamples + i), _mm256_load_ps(window + i)));
+			}
+			FFT::fft_real(*plan, spectrumX, spectrumY, windowed);
+			spectrumY[0] = spectrumX[binCount];
+			U32 frameOffset = frame * binCount;
+			for (U32 i = 0; i < binCount; i += 4) {
+				_mm256_store_pd(outputX.buffer + frameOffset + i, _mm256_cvtps_pd(_mm_load_ps(spectrumX + i)));
+				_mm256_store_pd(outputY.buffer + frameOffset + i, _mm256_cvtps_pd(_mm_load_ps(spectrumY + i)));
+				_mm256_store_pd(outputFreq.buffer + frameOffset + i, _mm256_mul_pd(_mm256_setr_pd(F64(i), F64(i + 1), F64(i + 2), F64(i + 3)), freqScale));
+			}
+		}
+		samplesUntilFrame = samplesUntilFrame + frameCount * hop - PROCESS_BUFFER_SIZE;
+	}
 };
 
-// This code is basically the same as alloc_widget. Perhaps I ought to have some sort of generic block allocator
-Node* freeNodeListHead = nullptr;
-Node* alloc_node() {
-	if (!freeNodeListHead) {
-		const U32 amountToAlloc = 256;
-		Node* block = globalArena.alloc<Node>(amountToAlloc);
-		for (U32 i = 0; i < amountToAlloc; i++) {
-			block[i].freeListNextPtr = &block[i + 1];
-		}
-		block[amountToAlloc - 1].freeListNextPtr = nullptr;
-		freeNodeListHead = block;
-	}
-	Node* allocated = freeNodeListHead;
-	freeNodeListHead = allocated->freeListNextPtr;
-	return allocated;
-}
-void free_node(Node* toFree) {
-	toFree->freeListNextPtr = freeNodeListHead;
-	freeNodeListHead = toFree;
-}
+// Streaming resynthesis. Takes the frame stream from analysis (after whatever spectral processing) and overlap-adds it back into a signal.
+// Total latency through the pair is fftSize samples
+struct NodeSTFTSynthesis {
+	NodeHeader header;
+	StftSettings settings;
+	FFT::Plan* plan;
+	// Synthesis window with the overlap normalization and the 1/fftSize from the inverse transform folded in
+	F32* window;
+	// Starts at the current block. A frame that ended e samples into the block is added at e, which makes the latency exactly fftSize
+	F32* overlapAdd;
+	U32 overlapAddCapacity;
+
+	void apply_settings(StftSettings newSettings) {
+		settings = newSettings;
+		settings.sanitize();
+		U32 fftSize = settings.fft_size();
+		U32 hop = settings.hop_size();
+		plan = FFT::get_plan(settings.log2FftSize);
+		// Frames end at most a block into the accumulator
+		overlapAddCapacity = fftSize + PROCESS_BUFFER_SIZE;
+		F32* state = reinterpret_cast<F32*>(header.alloc_state((fftSize + overlapAddCapacity) * sizeof(F32)));
+		window = state;
+		overlapAdd = state + fftSize;
+		compute_stft_window(window, fftSize, settings.window);
+		// Normalize by the sum of squared windows overlapping each position rather than assuming the window is COLA.
+		// Reconstruction stays exact for any window/hop pair, even with the approximate cosine
+		for (U32 i = 0; i < hop; i++) {
+			F32 sumSquares = 0.0F;
+			for (U32 j = i; j < fftSize; j += hop) {
+				sumSquares += window[j] * window[j];
+			}
+			F32 normalization = 1.0F / (sumSquares * F32(fftSize));
+			for (U32 j = i; j < fftSize; j += hop) {
+				window[j] *= normalization;
+			}
+		}
+		notify_view_node_changed(&header);
+	}
 
-void process_node(NodeHeader* node) {
-	if (node->hasProcessed) {
-		return;
+	void init() {
+		header.init(NODE_STFT_SYNTHESIS, "STFT Synthesis"sa);
+		header.add_widget<NodeWidgetOutput>()->init();
+		header.add_widget<NodeWidgetInput>()->init(0.0);
+		header.add_widget<NodeWidgetInput>()->init(0.0);
+		settings = STFT_DEFAULT_SETTINGS;
+		header.add_widget<NodeWidgetCustomUIElement>()->init();
+		apply_settings(settings);
 	}
-	node->hasProcessed = true;
-	ArenaArrayList<NodeIOValue*> inputs{ &audioArena };
-	ArenaArrayList<NodeIOValue*> outputs{ &audioArena };
-	for (NodeWidgetHeader* widget = node->widgetBegin; widget != nullptr; widget = widget->next) {
-		if (widget->type == NODE_WIDGET_INPUT) {
-			NodeWidgetInput* inWidget = reinterpret_cast<NodeWidgetInput*>(widget);
-			if (NodeWidgetOutput* input = inWidget->inputHandle.get()) {
-				process_node(input->header.parent);
-				inWidget->value = input->value;
-				if (inWidget->program.valid && (!inWidget->inputHandle.get() || inWidget->program.operatesOnBuffer)) {
-					F64* oldBuffer = inWidget->value.buffer;
-					if (inWidget->value.buffer != inWidget->value.scalarBuffer) {
-						inWidget->value.buffer = audioArena.alloc_aligned_with_slack<F64>(inWidget->value.bufferLength, alignof(__m256), 2 * sizeof(__m256));
-					}
-					if (inWidget->value.bufferMask == U32_MAX) {
-						for (U32 i = 0; i < inWidget->value.bufferLength; i += 4) {
-							_mm256_store_pd(inWidget->value.buffer + i, interpret(inWidget->program, _mm256_load_pd(oldBuffer + i)));
-						}
-					}
-					else {
-						tbrs::AVX2D result = interpret(inWidget->program, _mm256_load_pd(oldBuffer));
-						_mm256_store_pd(inWidget->value.buffer, result);
-						_mm256_store_pd(inWidget->value.buffer + 4, result);
-					}
+	void process() {
+		NodeIOValue& inputX = header.get_input(0)->value;
+		NodeIOValue& inputY = header.get_input(1)->value;
+		NodeIOValue& output = header.get_output(0)->value;
+		const U32 fftSize = settings.fft_size();
+		const U32 hop = settings.hop_size();
+		const U32 binCount = settings.bin_count();
+
+		U32 frameCount = inputX.buffer == inputX.scalarBuffer ? 0 : inputX.bufferLength / binCount;
+		F32* spectrumX = audioArena.alloc_aligned_with_slack<F32>(binCount + 8, alignof(__m256), 0);
+		F32* spectrumY = audioArena.alloc_aligned_with_slack<F32>(binCount + 8, alignof(__m256), 0);
+		F32* frameSamples = audioArena.alloc_aligned_with_slack<F32>(fftSize, alignof(__m256), 0);
+		F32* workspace = audioArena.alloc_aligned_with_slack<F32>(fftSize, alignof(__m256), 0);
+		for (U32 frame = 0; frame < frameCount; frame++) {
+			// Analysis ends a block's last frame at the block's end and the rest hop apart before it, so the frames land where analysis took them from
+			// without any state that could drift from the analysis node's, no matter when either one's settings were applied
+			U32 framesAfter = frameCount - 1 - frame;
+			if (framesAfter * hop > PROCESS_BUFFER_SIZE) {
+				// More frames than analysis with these settings would make, probably mismatched settings. Dropping them beats writing into samples already sent out
+				continue;
+			}
+			U32 writePos = PROCESS_BUFFER_SIZE - framesAfter * hop;
+			U32 frameOffset = frame * binCount;
+			for (U32 i = 0; i < binCount; i += 4) {
+				_mm_store_ps(spectrumX + i, _mm256_cvtpd_ps(_mm256_load_pd(inputX.buffer + ((frameOffset + i) & inputX.bufferMask))));
+				_mm_store_ps(spectrumY + i, _mm256_cvtpd_ps(_mm256_load_pd(inputY.buffer + ((frameOffset + i) & inputY.bufferMask))));
+			}
+			spectrumX[binCount] = spectrumY[0];
+			spectrumY[binCount] = 0.0F;
+			spectrumY[0] = 0.0F;
+			FFT::ifft_real(*plan, frameSamples, spectrumX, spectrumY, workspace);
+			F32* dst = overlapAdd + writePos;
+			for (U32 i = 0; i < fftSize; i += 8) {
+				_mm256_storeu_ps(dst + i, _mm256_fmadd_ps(_mm256_load_ps(frameSamples + i), _mm256_load_ps(window + i), _mm256_loadu_ps(dst + i)));
+			}
+		}
+
+		output.buffer = audioArena.alloc_aligned_with_slack<F64>(PROCESS_BUFFER_SIZE, alignof(__m256), 2 * sizeof(__m256));
+		output.bufferLength = PROCESS_BUFFER_SIZE;
+		output.bufferMask = U32_MAX;
+		output.listEnds = nullptr;
+		output.listEndsLength = 0;
+		for (U32 i = 0; i < PROCESS_BUFFER_SIZE; i += 4) {
+			_mm256_store_pd(output.buffer + i, _mm256_cvtps_pd(_mm_loadu_ps(overlapAdd + i)));
+		}
+		memmove(overlapAdd, overlapAdd + PROCESS_BUFFER_SIZE, (overlapAddCapacity - PROCESS_BUFFER_SIZE) * sizeof(F32));
+		memset(overlapAdd + overlapAddCapacity - PROCESS_BUFFER_SIZE, 0, PROCESS_BUFFER_SIZE * sizeof(F32));
+	}
+};
+
+// Uniformly partitioned overlap-save convolution. The partition size is the block size, so the head partition comes out in the same block it went in
+// and there's no added latency. Every block does one forward FFT of the new input, a complex multiply accumulate of the input spectrum history
+// against every IR partition, and one inverse FFT. The MAC is the only part that scales with IR length, and it's a straight streaming AVX loop,
+// so a 5 second IR at 48khz is ~235 partitions of 1032 bins, about half a million flops per block.
+struct NodeConvolution {
+	NodeHeader header;
+	static constexpr U32 PARTITION_SIZE = PROCESS_BUFFER_SIZE;
+	static constexpr U32 FFT_SIZE = PARTITION_SIZE * 2;
+	// FFT_SIZE / 2 + 1 bins, rounded up so every spectrum is a whole number of AVX registers
+	static constexpr U32 BIN_STRIDE = ALIGN_HIGH(FFT_SIZE / 2 + 1, 8u);
+	FFT::Plan* plan;
+	NodeWidgetSamplerButton* irButton;
+	U32 partitionCount;
+	// Partition p of the IR spectrum is at p * BIN_STRIDE. Has the 1/FFT_SIZE of the inverse transform folded in
+	F32* irSpectraX;
+	F32* irSpectraY;
+	// Ring of input spectra, one per past block. The newest is at historyHead, partition p multiplies the spectrum p blocks back
+	F32* historyX;
+	F32* historyY;
+	U32 historyHead;
+	F32* previousInput;
+
+	void load_impulse_response(const F32* impulseResponse, U64 length, I32 irSampleRate) {
+		MemoryArena& stackArena = get_scratch_arena();
+		MEMORY_ARENA_FRAME(stackArena) {
+			// Linear resample to the output rate. An IR is mostly noise decay, so this is plenty good enough
+			F64 outputSampleRate = F64(AudioDevice::sample_rate());
+			if (irSampleRate > 0 && F64(irSampleRate) != outputSampleRate && length > 1) {
+				F64 step = F64(irSampleRate) / outputSampleRate;
+				U64 resampledLength = U64(F64(length - 1) / step) + 1;
+				F32* resampled = stackArena.alloc<F32>(resampledLength);
+				for (U64 i = 0; i < resampledLength; i++) {
+					F64 pos = F64(i) * step;
+					U64 idx = min(U64(pos), length - 2);
+					F32 t = F32(pos - F64(idx));
+					resampled[i] = impulseResponse[idx] + (impulseResponse[idx + 1] - impulseResponse[idx]) * t;
 				}
+				impulseResponse = resampled;
+				length = resampledLength;
 			}
-			else {
-				inWidget->value.set_scalar(inWidget->defaultValue);
-				if (inWidget->program.valid) {
-					tbrs::AVX2D result = interpret(inWidget->program, _mm256_load_pd(inWidget->value.buffer));
-					_mm256_store_pd(inWidget->value.buffer, result);
-					_mm256_store_pd(inWidget->value.buffer + 4, result);
+
+			partitionCount = max(U32((length + PARTITION_SIZE - 1) / PARTITION_SIZE), 1u);
+			U64 spectraSize = U64(partitionCount) * BIN_STRIDE;
+			F32* state = reinterpret_cast<F32*>(header.alloc_state((spectraSize * 4 + PARTITION_SIZE) * sizeof(F32)));
+			irSpectraX = state;
+			irSpectraY = irSpectraX + spectraSize;
+			historyX = irSpectraY + spectraSize;
+			historyY = historyX + spectraSize;
+			previousInput = historyY + spectraSize;
+			historyHead = 0;
+
+			// Zero padded to twice the partition size, so the circular convolution of overlap-save only wraps into the half we throw away
+			F32* segment = stackArena.alloc_aligned_with_slack<F32>(FFT_SIZE, alignof(__m256), 0);
+			for (U32 partition = 0; partition < partitionCount; partition++) {
+				memset(segment, 0, FFT_SIZE * sizeof(F32));
+				U64 segmentStart = U64(partition) * PARTITION_SIZE;
+				if (segmentStart < length) {
+					memcpy(segment, impulseResponse + segmentStart, min<U64>(PARTITION_SIZE, length - segmentStart) * sizeof(F32));
+				}
+				F32* dstX = irSpectraX + partition * BIN_STRIDE;
+				F32* dstY = irSpectraY + partition * BIN_STRIDE;
+				FFT::fft_real(*plan, dstX, dstY, segment);
+				__m256 scale = _mm256_set1_ps(1.0F / F32(FFT_SIZE));
+				for (U32 i = 0; i < BIN_STRIDE; i += 8) {
+					_mm256_store_ps(dstX + i, _mm256_mul_ps(_mm256_load_ps(dstX + i), scale));
+					_mm256_store_ps(dstY + i, _mm256_mul_ps(_mm256_load_ps(dstY + i), scale));
 				}
 			}
-			inputs.push_back(&inWidget->value);
-		} else if (widget->type == NODE_WIDGET_OUTPUT) {
-			outputs.push_back(&reinterpret_cast<NodeWidgetOutput*>(widget)->value);
 		}
 	}
-	make_node_io_consistent(inputs.data, inputs.size, outputs.data, outputs.size);
-#define X(enumName, typeName) case NODE_##enumName: reinterpret_cast<typeName*>(node)->process(); break;
-	switch (node->type) {
-	NODES
-	default: break;
+
+	void init() {
+		header.init(NODE_CONVOLUTION, "Convolution Reverb"sa);
+		header.add_widget<NodeWidgetOutput>()->init();
+		header.add_widget<NodeWidgetInput>()->init(0.0);
+		header.add_widget<NodeWidgetSamplerButton>()->init();
+		irButton = header.get_samplerbutton(0);
+		irButton->loadCallback = [](NodeWidgetSamplerButton* button) {
+			NodeConvolution* node = reinterpret_cast<NodeConvolution*>(button->header.parent);
+			node->load_impulse_response(button->audioData, button->numSamples, button->sampleRate);
+		};
+		plan = FFT::get_plan_for_size(FFT_SIZE);
+		partitionCount = 0;
 	}
-#undef X
-}
+	void process() {
+		NodeIOValue& input = header.get_input(0)->value;
+		NodeIOValue& output = header.get_output(0)->value;
+		if (partitionCount == 0) {
+			output.set_scalar(0.0);
+			return;
+		}
+
+		// Overlap-save: the previous block followed by this one
+		F32* frame = audioArena.alloc_aligned_with_slack<F32>(FFT_SIZE, alignof(__m256), 0);
+		memcpy(frame, previousInput, PARTITION_SIZE * sizeof(F32));
+		for (U32 i = 0; i < PARTITION_SIZE; i += 4) {
+			_mm_store_ps(frame + PARTITION_SIZE + i, _mm256_cvtpd_ps(_mm256_load_pd(input.buffer + (i & input.bufferMask))));
+		}
+		memcpy(previousInput, frame + PARTITION_SIZE, PARTITION_SIZE * sizeof(F32));
+
+		historyHead = historyHead == 0 ? partitionCount - 1 : historyHead - 1;
+		FFT::fft_real(*plan, historyX + historyHead * BIN_STRIDE, historyY + historyHead * BIN_STRIDE, frame);
+
+		F32* accumulatorX = audioArena.alloc_aligned_with_slack<F32>(BIN_STRIDE, alignof(__m256), 0);
+		F32* accumulatorY = audioArena.alloc_aligned_with_slack<F32>(BIN_STRIDE, alignof(__m256), 0);
+		memset(accumulatorX, 0, BIN_STRIDE * sizeof(F32));
+		memset(accumulatorY, 0, BIN_STRIDE * sizeof(F32));
+		// Walking forward from the head goes newest to oldest, which lines up with the partitions going earliest to latest
+		U32 historyIdx = historyHead;
+		for (U32 partition = 0; partition < partitionCount; partition++) {
+			const F32* inX = historyX + historyIdx * BIN_STRIDE;
+			const F32* inY = historyY + historyIdx * BIN_STRIDE;
+			const F32* irX = irSpectraX + partition * BIN_STRIDE;
+			const F32* irY = irSpectraY + partition * BIN_STRIDE;
+			for (U32 i = 0; i < BIN_STRIDE; i += 8) {
+				__m256 aX = _mm256_load_ps(inX + i);
+				__m256 aY = _mm256_load_ps(inY + i);
+				__m256 bX = _mm256_load_ps(irX + i);
+				__m256 bY = _mm256_load_ps(irY + i);
+				__m256 accX = _mm256_fmadd_ps(aX, bX, _mm256_load_ps(accumulatorX + i));
+				__m256 accY = _mm256_fmadd_ps(aX, bY, _mm256_load_ps(accumulatorY + i));
+				_mm256_store_ps(accumulatorX + i, _mm256_fnmadd_ps(aY, bY, accX));
+				_mm256_store_ps(accumulatorY + i, _mm256_fmadd_ps(aY, bX, accY));
+			}
+			historyIdx = historyIdx + 1 == partitionCount ? 0 : historyIdx + 1;
+		}
 
-void add_node_to_ui(UI::BoxHandle parent, NodeHeader* node) {
-	UI::BoxHandle oldWorkingBox = UI::workingBox;
-	UI::workingBox = parent;
-#define X(enumName, typeName) case NODE_##enumName: reinterpret_cast<typeName*>(node)->add_to_ui(); break;
-	switch (node->type) {
-	NODES
-	default: break;
+		F32* result = audioArena.alloc_aligned_with_slack<F32>(FFT_SIZE, alignof(__m256), 0);
+		F32* workspace = audioArena.alloc_aligned_with_slack<F32>(FFT_SIZE, alignof(__m256), 0);
+		FFT::ifft_real(*plan, result, accumulatorX, accumulatorY, workspace);
+		// The first half is wrapped around garbage from the circular convolution, the second half is this block's output
+		output.buffer = audioArena.alloc_aligned_with_slack<F64>(PARTITION_SIZE, alignof(__m256), 2 * sizeof(__m256));
+		output.bufferLength = PARTITION_SIZE;
+		output.bufferMask = U32_MAX;
+		output.listEnds = nullptr;
+		output.listEndsLength = 0;
+		for (U32 i = 0; i < PARTITION_SIZE; i += 4) {
+			_mm256_store_pd(output.buffer + i, _mm256_cvtps_pd(_mm_load_ps(result + PARTITION_SIZE + i)));
+		}
 	}
-#undef X
-	UI::workingBox = oldWorkingBox;
+};
+
+// Everything that depends on the rate a part of the graph runs at. The graph has one for the device rate, every Oversample node has one for its region
+struct ProcessRate {
+	F64* timeBuffer;
+	// Sample index at this rate, so inside a 4x region it counts 4 times as fast as the device's frames
+	F64* frameIndexBuffer;
+	U32 blockLength;
+	// Relative to the device rate
+	U32 log2Factor;
+	F64 sampleRate;
+};
+
+// Exactly length samples of value, which is what the resamplers need. Lists get their voices summed, scalars get repeated, short buffers are padded with silence
+F64* oversample_flatten(NodeIOValue& value, U32 length) {
+	F64* block = audioArena.alloc_aligned_with_slack<F64>(length, alignof(__m256), 2 * sizeof(__m256));
+	if (value.listEndsLength) {
+		U32 prevEnd = 0;
+		for (U32 i = 0; i < length; i++) {
+			F64 accumulator = 0.0;
+			if (i < value.listEndsLength) {
+				for (U32 j = prevEnd; j < value.listEnds[i]; j++) {
+					accumulator += value.buffer[j];
+				}
+				prevEnd = value.listEnds[i];
+			}
+			block[i] = accumulator;
+		}
+	} else if (value.bufferMask != U32_MAX) {
+		for (U32 i = 0; i < length; i += 4) {
+			_mm256_store_pd(block + i, _mm256_load_pd(value.buffer + (i & value.bufferMask)));
+		}
+	} else {
+		U32 copyLength = min(value.bufferLength, length);
+		memcpy(block, value.buffer, copyLength * sizeof(F64));
+		memset(block + copyLength, 0, (length - copyLength) * sizeof(F64));
+	}
+	return block;
 }
 
-void add_widget_to_ui(NodeWidgetHeader* widget) {
-#define X(enumName, typeName) case NODE_WIDGET_##enumName: reinterpret_cast<typeName*>(widget)->add_to_ui(); break;
-	switch (widget->type) {
-		NODE_WIDGETS
-	default: break;
+// Where a signal from the rest of the graph comes into an oversampled region. It gets upsampled by whatever factor the Oversample node it ends up feeding is set to
+struct NodeOversampleIn {
+	NodeHeader header;
+	Oversampling::UpStage* stages;
+	// Factor the stage histories were built up at, so switching factors starts from silence rather than from another chain's history
+	U32 log2Factor;
+
+	void init() {
+		header.init(NODE_OVERSAMPLE_IN, "Oversample In"sa);
+		header.add_widget<NodeWidgetOutput>()->init();
+		header.add_widget<NodeWidgetInput>()->init(0.0);
+		stages = reinterpret_cast<Oversampling::UpStage*>(header.alloc_state(Oversampling::MAX_LOG2_FACTOR * sizeof(Oversampling::UpStage)));
+		log2Factor = 0;
+	}
+	B32 up_stages_silent() {
+		for (U32 i = 0; i < log2Factor; i++) {
+			if (!Oversampling::history_is_silent(stages[i].history)) {
+				return false;
+			}
+		}
+		return true;
 	}
-#undef X
+	void process();
+};
+
+const StrA OVERSAMPLE_FACTOR_NAMES[Oversampling::MAX_LOG2_FACTOR + 1]{ "1x"sa, "2x"sa, "4x"sa, "8x"sa };
+const StrA OVERSAMPLE_TITLES[Oversampling::MAX_LOG2_FACTOR + 1]{ "Oversample 1x"sa, "Oversample 2x"sa, "Oversample 4x"sa, "Oversample 8x"sa };
+
+// Runs part of the graph at a multiple of the device rate, so nonlinear things in it (clipping, waveshaping, hard edged waves) alias a lot less.
+// The region is everything upstream of this node's input, back to Oversample In nodes, which is where signals from the rest of the graph come in.
+// Only the nodes in the region pay for the higher rate. Time and the sample index are regenerated at the higher rate inside it rather than resampled, so oscillators stay exact.
+// A connection crossing the edge of a region anywhere other than through these nodes reads as unconnected, since the block lengths on either side don't match
+struct NodeOversampleOut {
+	NodeHeader header;
+	U32 log2Factor;
+	Oversampling::DownStage* stages;
+	// Set up by the graph at the start of every block
+	ProcessRate rate;
+	// log2Factor once nesting is taken into account. Regions inside regions multiply, but never past MAX_LOG2_FACTOR total so a block can't balloon
+	U32 activeLog2Factor;
+
+	void set_log2_factor(U32 newLog2Factor) {
+		log2Factor = min(newLog2Factor, Oversampling::MAX_LOG2_FACTOR);
+		// History from a different chain of stages would just be a click
+		memset(stages, 0, Oversampling::MAX_LOG2_FACTOR * sizeof(Oversampling::DownStage));
+		header.set_title(OVERSAMPLE_TITLES[log2Factor]);
+	}
+
+	void init() {
+		header.init(NODE_OVERSAMPLE_OUT, "Oversample 4x"sa);
+		header.add_widget<NodeWidgetOutput>()->init();
+		header.add_widget<NodeWidgetInput>()->init(0.0);
+		stages = reinterpret_cast<Oversampling::DownStage*>(header.alloc_state(Oversampling::MAX_LOG2_FACTOR * sizeof(Oversampling::DownStage)));
+		rate = ProcessRate{};
+		activeLog2Factor = 0;
+		header.add_widget<NodeWidgetCustomUIElement>()->init();
+		set_log2_factor(2);
+	}
+	B32 down_stages_silent() {
+		for (U32 i = 0; i < activeLog2Factor; i++) {
+			if (!Oversampling::history_is_silent(stages[i].evenHistory) || !Oversampling::history_is_silent(stages[i].oddHistory)) {
+				return false;
+			}
+		}
+		return true;
+	}
+	void process();
+};
+
+// The region a node's inputs come from. An Oversample node's inputs are inside its own region, an Oversample In's come from around the region it feeds
+NodeOversampleOut* node_input_region(NodeHeader* node) {
+	if (node->type == NODE_OVERSAMPLE_OUT) {
+		return reinterpret_cast<NodeOversampleOut*>(node);
+	}
+	if (node->type == NODE_OVERSAMPLE_IN) {
+		return node->oversampleRegion ? node->oversampleRegion->header.oversampleRegion : nullptr;
+	}
+	return node->oversampleRegion;
+}
+// The output an input actually reads this block. One that crosses the edge of an oversampled region without going through an Oversample node isn't read, the block lengths wouldn't match
+NodeWidgetOutput* bound_input(NodeWidgetInput* inWidget, NodeOversampleOut* inputRegion) {
+	NodeWidgetOutput* input = inWidget->inputHandle.get();
+	return input && input->header.parent->oversampleRegion == inputRegion ? input : nullptr;
 }
 
 struct NodeGraph {
@@ -2053,21 +2593,30 @@ struct NodeGraph {
 	NodeChannelOut* outputsFirst;
 	NodeChannelOut* outputsLast;
 
-	F64* currentTimeBuffer;
+	// The clock is an exact sample count. Time is derived from it each block rather than accumulated, so it never drifts and a block starting at a given frame always sees the same times
+	U64 currentFrame;
+	// Time buffer is currentFrame + i over the sample rate, the frame index buffer is currentFrame + i, for anything that wants the integer index rather than seconds. Exact in F64 for far longer than anything will run
+	ProcessRate baseRate;
+	// Whatever the node being processed runs at. The base rate, unless it's in an oversampled region
+	ProcessRate rate;
 
-	UI::BoxHandle uiBox;
+	// Each node takes a slot its own size rather than the size of the biggest node type, and a graph's nodes stay together in memory
+	SlabAllocator nodeAllocator;
+	BlockBufferPool bufferPool;
 
 	template<typename NodeT, typename... Args>
 	NodeT& create_node(V2F32 pos, Args... args) {
-		NodeT* node = reinterpret_cast<NodeT*>(alloc_node());
+		NodeT* node = nodeAllocator.alloc<NodeT>();
 		node->init(args...);
 		node->header.parent = this;
 		node->header.offset = pos;
-		add_node_to_ui(uiBox, &node->header);
 		DLL_INSERT_TAIL(&node->header, nodesFirst, nodesLast, prev, next);
 		if (node->header.type == NODE_CHANNEL_OUT) {
 			DLL_INSERT_TAIL(reinterpret_cast<NodeChannelOut*>(node), outputsFirst, outputsLast, outputPrev, outputNext);
 		}
+		if (viewCallbacks.nodeCreated) {
+			viewCallbacks.nodeCreated(&node->header);
+		}
 		return *node;
 	}
 
@@ -2095,6 +2644,9 @@ struct NodeGraph {
 		}
 	}
 	void delete_node(NodeHeader* node) {
+		if (viewCallbacks.nodeDeleted) {
+			viewCallbacks.nodeDeleted(node);
+		}
 		DLL_REMOVE(node, nodesFirst, nodesLast, prev, next);
 		if (node->selectedNext) {
 			DLL_REMOVE(node, selectedFirst, selectedLast, selectedPrev, selectedNext);
@@ -2103,6 +2655,12 @@ struct NodeGraph {
 			DLL_REMOVE(reinterpret_cast<NodeChannelOut*>(node), outputsFirst, outputsLast, outputPrev, outputNext);
 		}
 		node->destroy();
+#define X(enumName, typeName) case NODE_##enumName: nodeAllocator.free(reinterpret_cast<typeName*>(node)); break;
+		switch (node->type) {
+		NODES
+		default: break;
+		}
+#undef X
 	}
 	void delete_all_nodes() {
 		while (nodesFirst != nullptr) {
@@ -2121,8 +2679,6 @@ struct NodeGraph {
 	}
 	void init() {
 		*this = NodeGraph{};
-		uiBox = UI::alloc_box();
-		uiBox.unsafeBox->flags = UI::BOX_FLAG_INVISIBLE;
 	}
 	void destroy() {
 		for (NodeHeader* node = selectedFirst; node; node = node->selectedNext) {
@@ -2130,141 +2686,457 @@ struct NodeGraph {
 		}
 	}
 
-	void generate_output(F32 outputBuf[PROCESS_BUFFER_SIZE], F64 time[PROCESS_BUFFER_SIZE]) {
-		currentTimeBuffer = time;
-		audioArena.reset();
+	// Same start time as the rate around it, finer steps
+	void prepare_oversample_rate(NodeOversampleOut* region) {
+		const ProcessRate& outer = region->header.oversampleRegion ? region->header.oversampleRegion->rate : baseRate;
+		region->activeLog2Factor = min(region->log2Factor, Oversampling::MAX_LOG2_FACTOR - outer.log2Factor);
+		ProcessRate& inner = region->rate;
+		inner.log2Factor = outer.log2Factor + region->activeLog2Factor;
+		inner.blockLength = PROCESS_BUFFER_SIZE << inner.log2Factor;
+		inner.sampleRate = baseRate.sampleRate * F64(1u << inner.log2Factor);
+		inner.timeBuffer = audioArena.alloc_aligned_with_slack<F64>(inner.blockLength, alignof(__m256), 2 * sizeof(__m256));
+		inner.frameIndexBuffer = audioArena.alloc_aligned_with_slack<F64>(inner.blockLength, alignof(__m256), 2 * sizeof(__m256));
+		fill_linear_ramp(inner.timeBuffer, inner.blockLength, F64(currentFrame) / baseRate.sampleRate, 1.0 / inner.sampleRate);
+		fill_linear_ramp(inner.frameIndexBuffer, inner.blockLength, F64(currentFrame << inner.log2Factor), 1.0);
+	}
+	void assign_oversample_region(NodeHeader* node, NodeOversampleOut* region) {
+		if (node->oversampleRegionAssigned) {
+			return;
+		}
+		node->oversampleRegionAssigned = true;
+		node->oversampleRegion = region;
+		if (node->type == NODE_OVERSAMPLE_OUT) {
+			// Whatever region this one sits in got assigned before the walk could reach it, so its rate is already set up
+			prepare_oversample_rate(reinterpret_cast<NodeOversampleOut*>(node));
+		}
+		NodeOversampleOut* inputRegion = node_input_region(node);
+		for (NodeWidgetHeader* widget = node->widgetBegin; widget; widget = widget->next) {
+			if (widget->type == NODE_WIDGET_INPUT) {
+				if (NodeWidgetOutput* input = reinterpret_cast<NodeWidgetInput*>(widget)->inputHandle.get()) {
+					assign_oversample_region(input->header.parent, inputRegion);
+				}
+			}
+		}
+	}
+	// Walks back from everything nothing else reads, so every node lands in the region of whatever reads it.
+	// A node read from both sides of a region's edge ends up on whichever side the walk finds first, and the other side sees it as unconnected
+	void assign_oversample_regions() {
 		for (NodeHeader* node = nodesFirst; node; node = node->next) {
-			node->hasProcessed = false;
+			for (NodeWidgetHeader* widget = node->widgetBegin; widget; widget = widget->next) {
+				if (widget->type == NODE_WIDGET_INPUT) {
+					if (NodeWidgetOutput* input = reinterpret_cast<NodeWidgetInput*>(widget)->inputHandle.get()) {
+						input->header.parent->hasConsumer = true;
+					}
+				}
+			}
+		}
+		for (NodeHeader* node = nodesFirst; node; node = node->next) {
+			if (!node->hasConsumer) {
+				assign_oversample_region(node, nullptr);
+			}
 		}
-		memset(outputBuf, 0, PROCESS_BUFFER_SIZE * sizeof(F32));
+		// Anything left is only reachable around a cycle
 		for (NodeHeader* node = nodesFirst; node; node = node->next) {
+			assign_oversample_region(node, nullptr);
+		}
+	}
+
+	// outputs is planar, one lane of PROCESS_BUFFER_SIZE samples per channel. Channel outs set to a channel the device doesn't have are dropped
+	void generate_output(F32 outputs[][PROCESS_BUFFER_SIZE], U32 channelCount, U64 startFrame) {
+		audioArena.reset();
+		bufferPool.reset();
+		currentFrame = startFrame;
+		baseRate.blockLength = PROCESS_BUFFER_SIZE;
+		baseRate.log2Factor = 0;
+		baseRate.sampleRate = F64(AudioDevice::sample_rate());
+		baseRate.timeBuffer = audioArena.alloc_aligned_with_slack<F64>(PROCESS_BUFFER_SIZE, alignof(__m256), 2 * sizeof(__m256));
+		baseRate.frameIndexBuffer = audioArena.alloc_aligned_with_slack<F64>(PROCESS_BUFFER_SIZE, alignof(__m256), 2 * sizeof(__m256));
+		// One divide per block for the base keeps it exact, the step's rounding error only gets multiplied by at most the block size
+		fill_linear_ramp(baseRate.timeBuffer, PROCESS_BUFFER_SIZE, F64(startFrame) / baseRate.sampleRate, 1.0 / baseRate.sampleRate);
+		fill_linear_ramp(baseRate.frameIndexBuffer, PROCESS_BUFFER_SIZE, F64(startFrame), 1.0);
+		rate = baseRate;
+		B32 hasOversampling = false;
+		// Straight through the slabs, the order doesn't matter here
+		nodeAllocator.for_each_live([&](void* object) {
+			NodeHeader* node = reinterpret_cast<NodeHeader*>(object);
 			node->hasProcessed = false;
+			node->oversampleRegion = nullptr;
+			node->oversampleRegionAssigned = false;
+			node->hasConsumer = false;
+			hasOversampling |= node->type == NODE_OVERSAMPLE_OUT;
+			for (NodeWidgetHeader* widget = node->widgetBegin; widget; widget = widget->next) {
+				if (widget->type == NODE_WIDGET_OUTPUT) {
+					reinterpret_cast<NodeWidgetOutput*>(widget)->readsRemaining = 0;
+					reinterpret_cast<NodeWidgetOutput*>(widget)->pooledBuffer = nullptr;
+				}
+			}
+		});
+		if (hasOversampling) {
+			assign_oversample_regions();
+		}
+		// How long each output's buffer has to live, counting only the reads process_node will really do. Channel outs are read once more after everything has run, and never finish with theirs
+		nodeAllocator.for_each_live([](void* object) {
+			NodeHeader* node = reinterpret_cast<NodeHeader*>(object);
+			NodeOversampleOut* inputRegion = node_input_region(node);
+			for (NodeWidgetHeader* widget = node->widgetBegin; widget; widget = widget->next) {
+				if (widget->type == NODE_WIDGET_INPUT) {
+					if (NodeWidgetOutput* input = bound_input(reinterpret_cast<NodeWidgetInput*>(widget), inputRegion)) {
+						input->readsRemaining++;
+					}
+				}
+			}
+		});
+		memset(outputs, 0, channelCount * PROCESS_BUFFER_SIZE * sizeof(F32));
+		// Anything already pulled in as another node's input is skipped here. Stateful nodes (filters, the resamplers) would advance twice in a block otherwise
+		for (NodeHeader* node = nodesFirst; node; node = node->next) {
 			process_node(node);
 		}
+		alignas(32) F32 converted[PROCESS_BUFFER_SIZE];
 		for (NodeChannelOut* output = outputsFirst; output; output = output->outputNext) {
 			process_node(&output->header);
 			U32 bufSize;
 			U32 bufMask;
 			F64* buf = output->get_output_buffer(&bufSize, &bufMask);
-			if (buf && bufSize == PROCESS_BUFFER_SIZE) {
-				__m256d scale = _mm256_set1_pd(0.5);
+			B32 toAllChannels = output->channel == CHANNEL_OUT_ALL;
+			if (!buf || bufSize != PROCESS_BUFFER_SIZE || (!toAllChannels && output->channel >= channelCount)) {
+				continue;
+			}
+			// Convert once, then it's just an add per lane, so sending a signal to every channel doesn't redo the double to float work for each one
+			__m256d scale = _mm256_set1_pd(0.5);
+			for (U32 i = 0; i < PROCESS_BUFFER_SIZE; i += 8) {
+				__m128 d1 = _mm256_cvtpd_ps(_mm256_mul_pd(scale, _mm256_load_pd(buf + (i & bufMask))));
+				__m128 d2 = _mm256_cvtpd_ps(_mm256_mul_pd(scale, _mm256_load_pd(buf + ((i + 4) & bufMask))));
+				_mm256_store_ps(converted + i, _mm256_insertf128_ps(_mm256_castps128_ps256(d1), d2, 1));
+			}
+			U32 firstChannel = toAllChannels ? 0 : output->channel;
+			U32 endChannel = toAllChannels ? channelCount : output->channel + 1;
+			for (U32 channel = firstChannel; channel < endChannel; channel++) {
+				F32* lane = outputs[channel];
 				for (U32 i = 0; i < PROCESS_BUFFER_SIZE; i += 8) {
-					__m128 d1 = _mm256_cvtpd_ps(_mm256_mul_pd(scale, _mm256_load_pd(buf + (i & bufMask))));
-					__m128 d2 = _mm256_cvtpd_ps(_mm256_mul_pd(scale, _mm256_load_pd(buf + ((i + 4) & bufMask))));
-					__m256 result = _mm256_load_ps(outputBuf + i);
-					result = _mm256_add_ps(result, _mm256_insertf128_ps(_mm256_castps128_ps256(d1), d2, 1));
-					_mm256_store_ps(outputBuf + i, result);
+					_mm256_store_ps(lane + i, _mm256_add_ps(_mm256_load_ps(lane + i), _mm256_load_ps(converted + i)));
 				}
 			}
 		}
 	}
+};
 
-	void draw_connections(DynamicVertexBuffer::Tessellator& tes, F32 z, U32 clipBoxIndex) {
-		for (NodeHeader* node = nodesFirst; node; node = node->next) {
-			for (NodeWidgetHeader* widget = node->widgetBegin; widget; widget = widget->next) {
-				if (widget->type == NODE_WIDGET_INPUT) {
-					NodeWidgetInput& input = *reinterpret_cast<NodeWidgetInput*>(widget);
-					if (NodeWidgetOutput* output = input.inputHandle.get()) {
-						V2F32 handleOffset = V2F32{ distance(input.connectionRenderPos, output->connectionRenderPos) * 0.5F, 0.0F };
-						tes.ui_bezier_curve(output->connectionRenderPos, output->connectionRenderPos + handleOffset, input.connectionRenderPos - handleOffset, input.connectionRenderPos, z - 0.05F, 32, 2.0F, V4F32{ 0.8F, 0.8F, 0.8F, 1.0F }, Textures::simpleWhite.index, clipBoxIndex << 16);
-					}
-				}
+// Runs an input's expression into result, which has room for at least a block at the node's rate or the whole scalar buffer.
+// Variables read the other inputs as they are before any expression is applied, so nothing here writes to the widgets.
+// Returns the unaligned buffer length, or 0 if nothing the program reads is a buffer and the result is a scalar
+U32 evaluate_input_expression(NodeHeader* node, NodeWidgetInput* inWidget, F64* result, U32 resultCapacity) {
+	const tbrs::ByteProgram& program = inWidget->program;
+	const ProcessRate& rate = node->parent->rate;
+	alignas(__m256d) F64 zeros[4]{};
+	alignas(__m256d) F64 sampleRate[4];
+	for (U32 i = 0; i < ARRAY_COUNT(sampleRate); i++) {
+		sampleRate[i] = rate.sampleRate;
+	}
+	// Anything unbound, like an input index past the end of the node, just reads as 0
+	tbrs::OperandData variables[tbrs::MAX_VARIABLES];
+	for (U32 i = 0; i < tbrs::MAX_VARIABLES; i++) {
+		variables[i] = tbrs::OperandData{ zeros, 0 };
+	}
+	U32 bufferLength = U32_MAX;
+	auto bind = [&](U32 variable, const F64* data, U32 mask, U32 length) {
+		variables[variable] = tbrs::OperandData{ data, mask };
+		if (mask == U32_MAX && program.uses_variable(variable)) {
+			bufferLength = min(bufferLength, length);
+		}
+	};
+	bind(tbrs::VARIABLE_SELF, inWidget->value.buffer, inWidget->value.bufferMask, inWidget->value.bufferLength);
+	if (rate.timeBuffer) {
+		bind(tbrs::VARIABLE_TIME, rate.timeBuffer, U32_MAX, rate.blockLength);
+		bind(tbrs::VARIABLE_SAMPLE_INDEX, rate.frameIndexBuffer, U32_MAX, rate.blockLength);
+	}
+	variables[tbrs::VARIABLE_SAMPLE_RATE] = tbrs::OperandData{ sampleRate, 0 };
+	U32 variable = tbrs::VARIABLE_NODE_INPUT0;
+	for (NodeWidgetHeader* widget = node->widgetBegin; widget != nullptr && variable < tbrs::MAX_VARIABLES; widget = widget->next) {
+		if (widget->type == NODE_WIDGET_INPUT) {
+			NodeIOValue& value = reinterpret_cast<NodeWidgetInput*>(widget)->value;
+			bind(variable++, value.buffer, value.bufferMask, value.bufferLength);
+		}
+	}
+
+	if (bufferLength == U32_MAX) {
+		tbrs::execute(program, inWidget->jit, result, variables, ARRAY_COUNT(inWidget->value.scalarBuffer));
+		return 0;
+	}
+	bufferLength = min(bufferLength, resultCapacity);
+	tbrs::execute(program, inWidget->jit, result, variables, ALIGN_HIGH(bufferLength, 4u));
+	return bufferLength;
+}
+
+// Only nodes with a single output whose process reads each input sample before writing the output sample at the same index can write over an input
+B32 node_processes_in_place(NodeType type) {
+	return type == NODE_MATH || type == NODE_FILTER || type == NODE_WAVE;
+}
+
+// Every output make_node_io_consistent left without a buffer gets one from the pool.
+// A node that can work in place takes over an input's buffer instead when nothing after it will read that buffer, or its own expression result, which nothing else ever reads
+void place_output_buffers(NodeHeader* node, ArenaArrayList<NodeWidgetInput*>& inputWidgets, ArenaArrayList<F64*>& expressionResults, ArenaArrayList<U32>& expressionLog2Capacities) {
+	B32 inPlace = node_processes_in_place(node->type);
+	for (NodeWidgetHeader* widget = node->widgetBegin; widget; widget = widget->next) {
+		if (widget->type != NODE_WIDGET_OUTPUT) {
+			continue;
+		}
+		NodeWidgetOutput* output = reinterpret_cast<NodeWidgetOutput*>(widget);
+		NodeIOValue& value = output->value;
+		if (value.buffer || value.bufferMask != U32_MAX) {
+			continue;
+		}
+		U32 log2Capacity = BlockBufferPool::log2_capacity_for(value.bufferLength);
+		F64* buffer = nullptr;
+		for (U32 i = 0; inPlace && !buffer && i < inputWidgets.size; i++) {
+			NodeWidgetInput* inWidget = inputWidgets.data[i];
+			NodeWidgetOutput* source = bound_input(inWidget, node_input_region(node));
+			if (expressionResults.data[i] && inWidget->value.buffer == expressionResults.data[i] && expressionLog2Capacities.data[i] >= log2Capacity) {
+				buffer = expressionResults.data[i];
+				log2Capacity = expressionLog2Capacities.data[i];
+				expressionResults.data[i] = nullptr;
+			} else if (source && source->pooledBuffer && inWidget->value.buffer == source->pooledBuffer && source->readsRemaining == 1 && source->pooledLog2Capacity >= log2Capacity) {
+				buffer = source->pooledBuffer;
+				log2Capacity = source->pooledLog2Capacity;
+				source->pooledBuffer = nullptr;
+				source->readsRemaining = 0;
 			}
 		}
+		value.buffer = buffer ? buffer : node->parent->bufferPool.acquire(log2Capacity);
+		output->pooledBuffer = value.buffer;
+		output->pooledLog2Capacity = log2Capacity;
 	}
-};
+}
 
-UI::Box* NodeHeader::add_to_ui() {
-	using namespace UI;
-	uiBox = generic_box();
-	Box* box = uiBox.unsafeBox;
-	box->layoutDirection = LAYOUT_DIRECTION_DOWN;
-	box->backgroundColor = V4F32{ 0.0F, 1.0F, 0.0F, 1.0F }.to_rgba8();
-	box->minSize = V2F32{ 120.0F, 200.0F };
-	box->flags = BOX_FLAG_FLOATING_X | BOX_FLAG_FLOATING_Y | BOX_FLAG_DONT_LAYOUT_TO_FIT_CHILDREN;
-	box->contentOffset = offset;
-	box->zOffset = -0.1F;
-	box->userData[0] = UPtr(this);
-	box->actionCallback = [](Box* box, UserCommunication& comm) {
-		if (comm.drag.x != 0.0F || comm.drag.y != 0.0F) {
-			box->contentOffset += comm.drag;
-			reinterpret_cast<NodeHeader*>(box->userData[0])->offset = box->contentOffset;
-			return ACTION_HANDLED;
-		}
-		if (comm.leftClickStart) {
-			UI::move_box_to_front(box);
-		}
-		return ACTION_PASS;
-	};
-	workingBox = uiBox;
-
-	UI_RBOX() {
-		spacer();
-		UI_TEXT_SIZE(12.0F)
-		UI_TEXT_COLOR((V4F32{ 0.2F, 0.0F, 0.0F, 1.0F }))
-		uiNodeTitleBox = str_a(StrA{ title, titleLength });
-		spacer();
-		UI_SIZE((V2F32{ 8.0F, 8.0F }));
-		button(Textures::uiX, [](Box* box) {
-			reinterpret_cast<NodeHeader*>(box->userData[1])->parent->delete_node(reinterpret_cast<NodeHeader*>(box->userData[1]));
-		}).unsafeBox->userData[1] = UPtr(this);
-	}
-	for (NodeWidgetHeader* widget = widgetBegin; widget; widget = widget->next) {
-		add_widget_to_ui(widget);
-		spacer(2.0F);
-	}
-	
-	return box;
+FINLINE B32 block_buffer_contains(const F64* buffer, U32 log2Capacity, const F64* data) {
+	return data >= buffer && data < buffer + (1ull << log2Capacity);
+}
+// Whether any of node's outputs other than except still points somewhere in buffer
+B32 outputs_point_into(NodeHeader* node, F64* buffer, U32 log2Capacity, NodeWidgetOutput* except) {
+	for (NodeWidgetHeader* widget = node->widgetBegin; widget; widget = widget->next) {
+		NodeWidgetOutput* output = reinterpret_cast<NodeWidgetOutput*>(widget);
+		if (widget->type == NODE_WIDGET_OUTPUT && output != except && block_buffer_contains(buffer, log2Capacity, output->value.buffer)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// After the node has run, everything it was the last to read goes back to the pool. A buffer one of its outputs still points into without owning it (an input passed straight through)
+// stays out of the pool for the rest of the block instead, since whatever reads that output isn't counted against the buffer
+void release_block_buffers(NodeHeader* node, ArenaArrayList<NodeWidgetInput*>& inputWidgets, ArenaArrayList<F64*>& expressionResults, ArenaArrayList<U32>& expressionLog2Capacities) {
+	BlockBufferPool& pool = node->parent->bufferPool;
+	for (NodeWidgetHeader* widget = node->widgetBegin; widget; widget = widget->next) {
+		if (widget->type != NODE_WIDGET_OUTPUT) {
+			continue;
+		}
+		NodeWidgetOutput* output = reinterpret_cast<NodeWidgetOutput*>(widget);
+		F64* buffer = output->pooledBuffer;
+		if (!buffer) {
+			continue;
+		}
+		if (outputs_point_into(node, buffer, output->pooledLog2Capacity, output)) {
+			output->pooledBuffer = nullptr;
+		} else if (!block_buffer_contains(buffer, output->pooledLog2Capacity, output->value.buffer) || output->readsRemaining == 0) {
+			// Nodes that made their own output buffer don't need the one they were given, and nothing needs an output nobody reads
+			output->pooledBuffer = nullptr;
+			pool.release(buffer, output->pooledLog2Capacity);
+		}
+	}
+	// Channel outs get read again after everything has run
+	if (node->type == NODE_CHANNEL_OUT) {
+		return;
+	}
+	for (U32 i = 0; i < inputWidgets.size; i++) {
+		if (F64* result = expressionResults.data[i]) {
+			if (!outputs_point_into(node, result, expressionLog2Capacities.data[i], nullptr)) {
+				pool.release(result, expressionLog2Capacities.data[i]);
+			}
+		}
+		NodeWidgetOutput* source = bound_input(inputWidgets.data[i], node_input_region(node));
+		if (!source || source->readsRemaining == 0) {
+			continue;
+		}
+		if (source->pooledBuffer && outputs_point_into(node, source->pooledBuffer, source->pooledLog2Capacity, nullptr)) {
+			source->pooledBuffer = nullptr;
+		}
+		source->readsRemaining--;
+		if (source->readsRemaining == 0 && source->pooledBuffer) {
+			pool.release(source->pooledBuffer, source->pooledLog2Capacity);
+			source->pooledBuffer = nullptr;
+		}
+	}
+}
+
+void process_node(NodeHeader* node) {
+	if (node->hasProcessed) {
+		return;
+	}
+	node->hasProcessed = true;
+	// The node runs at the rate its inputs come in at, expressions included. The node that pulled this one in might be at another rate, so it gets put back after
+	NodeGraph* graph = node->parent;
+	ProcessRate callerRate = graph->rate;
+	NodeOversampleOut* inputRegion = node_input_region(node);
+	graph->rate = inputRegion ? inputRegion->rate : graph->baseRate;
+	ArenaArrayList<NodeWidgetInput*> inputWidgets{ &audioArena };
+	ArenaArrayList<NodeIOValue*> inputs{ &audioArena };
+	ArenaArrayList<NodeIOValue*> outputs{ &audioArena };
+	for (NodeWidgetHeader* widget = node->widgetBegin; widget != nullptr; widget = widget->next) {
+		if (widget->type == NODE_WIDGET_INPUT) {
+			NodeWidgetInput* inWidget = reinterpret_cast<NodeWidgetInput*>(widget);
+			NodeWidgetOutput* input = bound_input(inWidget, inputRegion);
+			if (input) {
+				process_node(input->header.parent);
+				inWidget->value = input->value;
+			} else {
+				inWidget->value.set_scalar(inWidget->defaultValue);
+			}
+			inputWidgets.push_back(inWidget);
+			inputs.push_back(&inWidget->value);
+		} else if (widget->type == NODE_WIDGET_OUTPUT) {
+			outputs.push_back(&reinterpret_cast<NodeWidgetOutput*>(widget)->value);
+		}
+	}
+	// Expressions can read the node's other inputs, so every result is held back until all of them have run
+	ArenaArrayList<F64*> expressionResults{ &audioArena };
+	ArenaArrayList<U32> expressionLengths{ &audioArena };
+	ArenaArrayList<U32> expressionLog2Capacities{ &audioArena };
+	for (NodeWidgetInput* inWidget : inputWidgets) {
+		NodeIOValue& value = inWidget->value;
+		F64* result = nullptr;
+		U32 length = 0;
+		U32 log2Capacity = 0;
+		if (inWidget->program.valid && (!inWidget->inputHandle.get() || inWidget->program.uses_variable(tbrs::VARIABLE_SELF))) {
+			U32 capacity = max(value.bufferMask == U32_MAX ? value.bufferLength : 0u, graph->rate.blockLength);
+			log2Capacity = BlockBufferPool::log2_capacity_for(capacity);
+			result = graph->bufferPool.acquire(log2Capacity);
+			length = evaluate_input_expression(node, inWidget, result, capacity);
+		}
+		expressionResults.push_back(result);
+		expressionLengths.push_back(length);
+		expressionLog2Capacities.push_back(log2Capacity);
+	}
+	for (U32 i = 0; i < inputs.size; i++) {
+		NodeIOValue& value = *inputs.data[i];
+		F64* result = expressionResults.data[i];
+		U32 length = expressionLengths.data[i];
+		if (!result) {
+			continue;
+		}
+		if (length == 0) {
+			memcpy(value.scalarBuffer, result, sizeof(value.scalarBuffer));
+			value.buffer = value.scalarBuffer;
+			value.bufferLength = 1;
+			value.bufferMask = ARRAY_COUNT(value.scalarBuffer) - 1;
+			value.listEnds = nullptr;
+			value.listEndsLength = 0;
+			value.set_scalar_flags();
+		} else {
+			// A list input keeps its voices as long as the expression didn't change how many samples there are
+			if (value.bufferMask != U32_MAX || value.bufferLength != length) {
+				value.listEnds = nullptr;
+				value.listEndsLength = 0;
+			}
+			value.buffer = result;
+			value.bufferLength = length;
+			value.bufferMask = U32_MAX;
+			value.flags = 0;
+		}
+	}
+	make_node_io_consistent(inputs.data, inputs.size, outputs.data, outputs.size);
+	place_output_buffers(node, inputWidgets, expressionResults, expressionLog2Capacities);
+#define X(enumName, typeName) case NODE_##enumName: reinterpret_cast<typeName*>(node)->process(); break;
+	switch (node->type) {
+	NODES
+	default: break;
+	}
+#undef X
+	// Flags the node didn't set itself that are cheap to work out here, so even nodes that know nothing about them pass silence along
+	for (NodeIOValue* output : outputs) {
+		if (output->flags) {
+			continue;
+		}
+		if (output->listEnds && output->bufferLength == 0) {
+			output->flags = NODE_IO_SILENCE_FLAGS;
+		} else if (output->buffer == output->scalarBuffer) {
+			output->set_scalar_flags();
+		}
+	}
+	release_block_buffers(node, inputWidgets, expressionResults, expressionLog2Capacities);
+	graph->rate = callerRate;
 }
 
 void NodeTimeIn::process() {
 	NodeWidgetOutput& output = *header.get_output(0);
-	if (header.parent->currentTimeBuffer) {
+	NodeWidgetOutput& sampleOutput = *header.get_output(1);
+	const ProcessRate& rate = header.parent->rate;
+	if (rate.timeBuffer) {
 		output.value = NodeIOValue{};
-		output.value.buffer = header.parent->currentTimeBuffer;
-		output.value.bufferLength = PROCESS_BUFFER_SIZE;
+		output.value.buffer = rate.timeBuffer;
+		output.value.bufferLength = rate.blockLength;
 		output.value.bufferMask = U32_MAX;
+		sampleOutput.value = output.value;
+		sampleOutput.value.buffer = rate.frameIndexBuffer;
 	} else {
 		output.value.set_scalar(0.0);
+		sampleOutput.value.set_scalar(0.0);
 	}
 }
 
-void NodeWidgetOutput::add_to_ui() {
-	using namespace UI;
-	UI_RBOX() {
-		workingBox.unsafeBox->backgroundColor = V4F32{ 0.05F, 0.05F, 0.05F, 1.0F }.to_rgba8();
-		workingBox.unsafeBox->flags &= ~BOX_FLAG_INVISIBLE;
-		spacer();
-		str_a(displayStr);
-		spacer();
-		UI_SIZE((V2F32{ 8.0F, 8.0F })) {
-			Box* connector = generic_box().unsafeBox;
-			connector->flags = BOX_FLAG_FLOATING_X | BOX_FLAG_CUSTOM_DRAW | BOX_FLAG_CENTER_ON_ORTHOGONAL_AXIS;
-			//connector->contentOffset.x = 120.0F - 4.0F;
-			connector->contentOffset.x = header.parent->uiBox.unsafeBox->minSize.x - 4.0F;
-			connector->backgroundTexture = &Textures::nodeConnect;
-			connector->userTypeId = UI_TYPE_ID_NODE_WIDGET_OUTPUT;
-			connector->userData[0] = UPtr(this);
-			connector->actionCallback = [](Box* box, UserCommunication& comm) {
-				NodeWidgetOutput& outputWidget = *reinterpret_cast<NodeWidgetOutput*>(box->userData[0]);
-				ActionResult result = ACTION_PASS;
-				if (box == UI::activeBox.get() && comm.tessellator) {
-					F32 handleScale = distance(comm.renderArea.midpoint(), comm.mousePos) * 0.5F;
-					comm.tessellator->ui_bezier_curve(comm.renderArea.midpoint(), comm.renderArea.midpoint() + V2F32{ handleScale, 0.0F }, comm.mousePos - V2F32{ handleScale, 0.0F }, comm.mousePos, comm.renderZ + 0.05F, 32, 2.0F, V4F32{ 1.0F, 1.0F, 1.0F, 1.0F }, Textures::simpleWhite.index, comm.clipBoxIndex << 16);
-					result = ACTION_HANDLED;
-				}
-				if (comm.tessellator) {
-					outputWidget.connectionRenderPos = comm.renderArea.midpoint();
-				}
-				if (comm.draggedTo && comm.draggedTo->userTypeId == UI_TYPE_ID_NODE_WIDGET_INPUT) {
-					reinterpret_cast<NodeWidgetInput*>(comm.draggedTo->userData[0])->connect(&outputWidget);
-					result = ACTION_HANDLED;
-				}
-				return result;
-			};
-			uiBoxConnector = BoxHandle{ connector, connector->generation };
-		}
+void NodeOversampleIn::process() {
+	NodeIOValue& input = header.get_input(0)->value;
+	NodeIOValue& output = header.get_output(0)->value;
+	NodeOversampleOut* region = header.oversampleRegion;
+	U32 regionLog2Factor = region ? region->activeLog2Factor : 0;
+	if (regionLog2Factor != log2Factor) {
+		memset(stages, 0, Oversampling::MAX_LOG2_FACTOR * sizeof(Oversampling::UpStage));
+		log2Factor = regionLog2Factor;
+	}
+	if (!log2Factor) {
+		// Not feeding an Oversample node (or it's set to 1x), so this is just a wire
+		output = input;
+		return;
 	}
+	if (input.is_silent() && up_stages_silent()) {
+		output.set_scalar(0.0);
+		return;
+	}
+	// The graph is still at the rate around the region here, only the output is at the region's rate
+	U32 length = header.parent->rate.blockLength;
+	F64* block = oversample_flatten(input, length);
+	F64* scratch = audioArena.alloc_aligned_with_slack<F64>(Oversampling::HISTORY_LENGTH + (length << (log2Factor - 1)), alignof(__m256), 0);
+	for (U32 i = 0; i < log2Factor; i++) {
+		F64* upsampled = audioArena.alloc_aligned_with_slack<F64>(length * 2, alignof(__m256), 2 * sizeof(__m256));
+		Oversampling::upsample_2x(stages[i], upsampled, block, length, scratch);
+		block = upsampled;
+		length *= 2;
+	}
+	output = NodeIOValue{};
+	output.buffer = block;
+	output.bufferLength = length;
+	output.bufferMask = U32_MAX;
+}
+
+void NodeOversampleOut::process() {
+	NodeIOValue& input = header.get_input(0)->value;
+	NodeIOValue& output = header.get_output(0)->value;
+	if (input.is_silent() && down_stages_silent()) {
+		output.set_scalar(0.0);
+		return;
+	}
+	// The graph is at this region's rate while this node runs, the output goes back out at the rate around it
+	U32 length = header.parent->rate.blockLength;
+	F64* block = oversample_flatten(input, length);
+	F64* scratch = audioArena.alloc_aligned_with_slack<F64>(2 * Oversampling::HISTORY_LENGTH + length, alignof(__m256), 0);
+	for (U32 i = 0; i < activeLog2Factor; i++) {
+		length /= 2;
+		F64* downsampled = audioArena.alloc_aligned_with_slack<F64>(length, alignof(__m256), 2 * sizeof(__m256));
+		Oversampling::downsample_2x(stages[i], downsampled, block, length, scratch);
+		block = downsampled;
+	}
+	output = NodeIOValue{};
+	output.buffer = block;
+	output.bufferLength = length;
+	output.bufferMask = U32_MAX;
 }
 
+
 }
\ No newline at end of file
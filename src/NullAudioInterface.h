@@ -0,0 +1,115 @@
+#pragma once
+#include "AudioFormat.h"
+
+// A device that isn't there. It plays samples at the sample rate according to the monotonic clock, the same as real hardware would,
+// so the engine runs with realistic callback timing and xruns can be measured on a machine without a sound card. Optionally writes everything it plays to a WAV file
+namespace NullAudioInterface {
+
+using namespace AudioDevice;
+
+const AudioFormat DEFAULT_FORMAT = AUDIO_FORMAT_32BIT_IEEE_FLOAT_48_KHZ;
+const U32 DEFAULT_CHANNEL_COUNT = 2;
+// Same 20ms WASAPI asks for, split into two periods like a typical double buffered device
+const U32 PERIODS_PER_BUFFER = 2;
+const F64 BUFFER_DURATION_SECONDS = 0.02;
+
+U32 periodFrames;
+U32 bufferFrames;
+F32* audioBuffer;
+U8* encodedBuffer;
+// Frame 0 of the stream plays at startTime. The device position is always derived from the clock, so timing error never accumulates
+U64 startTimeNanoseconds;
+U64 framesWritten;
+B32 writingWav;
+WavWriter wavWriter;
+
+FillCallback audioBufferFillCallback;
+
+U64 frames_to_nanoseconds(U64 frames) {
+	U64 sampleRate = AUDIO_FORMAT_SAMPLE_RATE_HZ[outputAudioFormat];
+	return frames / sampleRate * 1000000000ull + frames % sampleRate * 1000000000ull / sampleRate;
+}
+
+U64 nanoseconds_to_frames(U64 nanoseconds) {
+	U64 sampleRate = AUDIO_FORMAT_SAMPLE_RATE_HZ[outputAudioFormat];
+	return nanoseconds / 1000000000ull * sampleRate + nanoseconds % 1000000000ull * sampleRate / 1000000000ull;
+}
+
+// wavOutputPath can be null to not write anything
+B32 init_null(FillCallback bufferFillCallback, AudioFormat format, U32 channelCount, const char* wavOutputPath) {
+	audioBufferFillCallback = bufferFillCallback;
+	outputAudioFormat = format;
+	outputChannelCount = channelCount;
+	bufferFrames = U32(F64(AUDIO_FORMAT_SAMPLE_RATE_HZ[format]) * BUFFER_DURATION_SECONDS);
+	periodFrames = bufferFrames / PERIODS_PER_BUFFER;
+	audioBuffer = globalArena.alloc<F32>(bufferFrames * channelCount);
+	encodedBuffer = globalArena.alloc<U8>(bufferFrames * channelCount * audio_format_container_bytes(format));
+
+	writingWav = false;
+	if (wavOutputPath) {
+		if (!wavWriter.open(wavOutputPath, format, channelCount, outputSettings.packed24Bit)) {
+			print("Failed to open WAV output ");
+			println(wavOutputPath);
+			return false;
+		}
+		writingWav = true;
+	}
+	print("Using null audio device with format ");
+	println(AUDIO_FORMAT_NAMES[outputAudioFormat]);
+	framesWritten = 0;
+	startTimeNanoseconds = 0;
+	return true;
+}
+
+void shutdown_null() {
+	if (writingWav) {
+		wavWriter.close();
+		writingWav = false;
+	}
+}
+
+void do_audio() {
+	U64 playedFrames = 0;
+	// Playback starts once the first buffer is filled, so there's nothing to wait for on the first call
+	if (stats.callbackCount != 0) {
+		// Wake up when a period's worth of the buffer has been played, like a device interrupt would
+		U64 wakeFrame = framesWritten + periodFrames > bufferFrames ? framesWritten + periodFrames - bufferFrames : 0;
+		U64 wakeTime = startTimeNanoseconds + frames_to_nanoseconds(wakeFrame);
+		sleep_until_nanoseconds(wakeTime);
+		U64 now = monotonic_nanoseconds();
+		if (now > wakeTime) {
+			stats.maxWakeLatenessSeconds = max(stats.maxWakeLatenessSeconds, F64(now - wakeTime) * 1.0e-9);
+		}
+		playedFrames = nanoseconds_to_frames(now - startTimeNanoseconds);
+	}
+	if (playedFrames > framesWritten) {
+		// The device ran dry. Real hardware would have played silence in the meantime, so the stream picks up from where the device is now
+		stats.xrunCount++;
+		if (writingWav) {
+			wavWriter.write_silence(playedFrames - framesWritten);
+		}
+		framesWritten = playedFrames;
+	}
+	U32 framesToFill = bufferFrames - U32(framesWritten - playedFrames);
+	if (framesToFill == 0) {
+		return;
+	}
+
+	B32 hasAudio = audioBufferFillCallback(audioBuffer, framesToFill, outputChannelCount);
+	if (writingWav) {
+		if (hasAudio) {
+			encode_audio_to_final_buffer(encodedBuffer, audioBuffer, framesToFill, outputChannelCount, outputAudioFormat, outputSettings);
+			wavWriter.write(encodedBuffer, framesToFill);
+		} else {
+			wavWriter.write_silence(framesToFill);
+		}
+	}
+	if (stats.callbackCount == 0) {
+		startTimeNanoseconds = monotonic_nanoseconds();
+	}
+	framesWritten += framesToFill;
+	stats.callbackCount++;
+	stats.framesRendered += framesToFill;
+}
+
+}
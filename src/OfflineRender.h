@@ -0,0 +1,332 @@
+#pragma once
+#include "DrillLib.h"
+#include "SerializeTools.h"
+#include "AudioFormat.h"
+#include "Nodes.h"
+#include "Serialization.h"
+
+// Renders a project straight to a WAV file as fast as the graph can be processed. No window, no audio device, nothing waits on a clock.
+// DAWdle --render <project.dawdle> <output.wav> <seconds> [--rate 44100|48000|96000] [--bits 8|16|24|32|float] [--channels count] [--threads count] [--preroll seconds] [--gain dB] [--dither none|tpdf]
+namespace OfflineRender {
+
+using namespace AudioDevice;
+
+const U32 DEFAULT_SAMPLE_RATE = 48000;
+const U32 DEFAULT_CHANNEL_COUNT = 2;
+const U32 MAX_CHANNEL_COUNT = Nodes::MAX_OUTPUT_CHANNELS;
+const U32 MAX_THREAD_COUNT = 256;
+// An IIR filter's state never fully washes out, but a fraction of a second gets it well below audible
+const F64 FILTER_PREROLL_SECONDS = 0.5;
+// Chunks shorter than this spend too much of their time in pre-roll
+const F64 MIN_CHUNK_SECONDS = 1.0;
+// Enough chunks per thread that one slow section of the timeline doesn't leave the other threads idle at the end
+const U32 CHUNKS_PER_THREAD = 4;
+
+void print_usage() {
+	println("Usage: DAWdle --render <project.dawdle> <output.wav> <seconds> [--rate 44100|48000|96000] [--bits 8|16|24|32|float] [--channels count] [--threads count] [--preroll seconds] [--gain dB] [--dither none|tpdf]");
+}
+
+StrA arg_str(const char* arg) {
+	return StrA{ arg, strlen(arg) };
+}
+
+B32 parse_f64_arg(F64* out, const char* arg) {
+	StrA str = arg_str(arg);
+	return SerializeTools::parse_f64(out, &str) && str.length == 0;
+}
+
+B32 parse_u32_arg(U32* out, const char* arg) {
+	F64 value;
+	if (!parse_f64_arg(&value, arg) || value < 1.0 || value > F64(U32_MAX) || F64(U32(value)) != value) {
+		return false;
+	}
+	*out = U32(value);
+	return true;
+}
+
+B32 find_format(AudioFormat* formatOut, U32 sampleRate, U32 bitDepth, B32 isFloat) {
+	for (U32 i = 0; i < AUDIO_FORMAT_Count; i++) {
+		if (AUDIO_FORMAT_SAMPLE_RATE_HZ[i] == sampleRate && AUDIO_FORMAT_BIT_DEPTH[i] == bitDepth && AUDIO_FORMAT_IS_FLOAT[i] == isFloat) {
+			*formatOut = AudioFormat(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+// Most of the graph is a pure function of the time buffer, but a few nodes carry state from one block to the next.
+// A chunk rendered on its own has to run those for a while before its start so they're in the same state they would have been in a straight through render.
+// The pre-roll start also has to line up with anything that works in frames bigger than a block (STFT hops), or the frames would land in different places
+U64 required_preroll_frames(Nodes::NodeGraph& graph, U32 sampleRate, U64* alignmentOut) {
+	using namespace Nodes;
+	U64 prerollFrames = 0;
+	U64 alignment = PROCESS_BUFFER_SIZE;
+	// Stateful nodes feeding each other add up, so this just sums them rather than working out the longest path
+	for (NodeHeader* node = graph.nodesFirst; node; node = node->next) {
+		switch (node->type) {
+		case NODE_FILTER: {
+			prerollFrames += U64(FILTER_PREROLL_SECONDS * F64(sampleRate));
+		} break;
+		case NODE_STFT_ANALYSIS: {
+			U32 fftSize = reinterpret_cast<NodeSTFTAnalysis*>(node)->settings.fft_size();
+			prerollFrames += fftSize;
+			alignment = max<U64>(alignment, fftSize);
+		} break;
+		case NODE_STFT_SYNTHESIS: {
+			U32 fftSize = reinterpret_cast<NodeSTFTSynthesis*>(node)->settings.fft_size();
+			prerollFrames += fftSize;
+			alignment = max<U64>(alignment, fftSize);
+		} break;
+		case NODE_CONVOLUTION: {
+			prerollFrames += U64(reinterpret_cast<NodeConvolution*>(node)->partitionCount) * NodeConvolution::PARTITION_SIZE;
+		} break;
+		case NODE_OVERSAMPLE_IN:
+		case NODE_OVERSAMPLE_OUT: {
+			prerollFrames += Oversampling::PREROLL_FRAMES;
+		} break;
+		default: break;
+		}
+	}
+	*alignmentOut = alignment;
+	return prerollFrames;
+}
+
+// Shared between the render threads. Everything except nextChunk is set before they start and only read after
+struct ParallelRender {
+	Nodes::NodeGraph* graphs;
+	// Planar, channelCount lanes of totalFrames each
+	F32* output;
+	U32 channelCount;
+	U64 totalFrames;
+	U64 chunkFrames;
+	U64 prerollFrames;
+	volatile I64 nextChunk;
+	volatile I32 failedThreads;
+};
+ParallelRender parallelRender;
+
+// Each thread has its own copy of the graph, so node state never gets shared, and its own audio arena (thread local)
+U32 render_thread_func(void* param) {
+	ParallelRender& job = parallelRender;
+	Nodes::NodeGraph& graph = job.graphs[UPtr(param)];
+	if (!drill_lib_init_thread()) {
+		atomic_increment32(&job.failedThreads);
+		return EXIT_FAILURE;
+	}
+	alignas(32) F32 processBuffer[MAX_CHANNEL_COUNT][Nodes::PROCESS_BUFFER_SIZE];
+	// If this thread happens to pick up the chunk right after its last one, the graph state is already correct and the pre-roll can be skipped
+	U64 renderedUpTo = U64_MAX;
+	while (true) {
+		U64 chunkStart = U64(atomic_fetch_add64(&job.nextChunk, 1)) * job.chunkFrames;
+		if (chunkStart >= job.totalFrames) {
+			break;
+		}
+		U64 chunkEnd = min(chunkStart + job.chunkFrames, job.totalFrames);
+		U64 frame = chunkStart;
+		if (renderedUpTo != chunkStart) {
+			frame = chunkStart > job.prerollFrames ? chunkStart - job.prerollFrames : 0;
+		}
+		for (; frame < chunkEnd; frame += Nodes::PROCESS_BUFFER_SIZE) {
+			// The graph's time comes from the frame index, so every chunk agrees on what time it is
+			graph.generate_output(processBuffer, job.channelCount, frame);
+			if (frame >= chunkStart) {
+				for (U32 channel = 0; channel < job.channelCount; channel++) {
+					memcpy(job.output + channel * job.totalFrames + frame, processBuffer[channel], min<U64>(Nodes::PROCESS_BUFFER_SIZE, job.totalFrames - frame) * sizeof(F32));
+				}
+			}
+		}
+		renderedUpTo = chunkEnd;
+	}
+	drill_lib_destroy_thread();
+	return 0;
+}
+
+// Renders the whole timeline into output (channelCount planar lanes, each totalFrames long) on threadCount threads. Returns false if any thread couldn't start
+B32 render_parallel(const char* projectPath, F32* output, U64 totalFrames, U32 sampleRate, U32 channelCount, U32 threadCount, F64 prerollSecondsOverride) {
+	using namespace Nodes;
+	// Loading touches the node allocators, which aren't thread safe, so all the copies get loaded up front on this thread
+	parallelRender.graphs = globalArena.alloc<NodeGraph>(threadCount);
+	for (U32 i = 0; i < threadCount; i++) {
+		parallelRender.graphs[i].init();
+		if (!Serialization::LoadNodeGraph(parallelRender.graphs[i], projectPath)) {
+			return false;
+		}
+	}
+	U64 alignment;
+	U64 prerollFrames = required_preroll_frames(parallelRender.graphs[0], sampleRate, &alignment);
+	if (prerollSecondsOverride >= 0.0) {
+		prerollFrames = U64(prerollSecondsOverride * F64(sampleRate));
+	}
+	prerollFrames = ALIGN_HIGH(prerollFrames, alignment);
+	U64 minChunkFrames = max<U64>(U64(MIN_CHUNK_SECONDS * F64(sampleRate)), prerollFrames * 4);
+	U64 chunkFrames = ALIGN_HIGH(max<U64>(totalFrames / (U64(threadCount) * CHUNKS_PER_THREAD), minChunkFrames), alignment);
+
+	parallelRender.output = output;
+	parallelRender.channelCount = channelCount;
+	parallelRender.totalFrames = totalFrames;
+	parallelRender.chunkFrames = chunkFrames;
+	parallelRender.prerollFrames = prerollFrames;
+	parallelRender.nextChunk = 0;
+	parallelRender.failedThreads = 0;
+
+	ThreadHandle* threads = globalArena.alloc<ThreadHandle>(threadCount);
+	U32 threadsStarted = 0;
+	for (; threadsStarted < threadCount; threadsStarted++) {
+		if (!create_thread(&threads[threadsStarted], render_thread_func, reinterpret_cast<void*>(UPtr(threadsStarted)), 0)) {
+			U32 err = last_platform_error();
+			print("Failed to create render thread, code: ");
+			println_integer(err);
+			break;
+		}
+	}
+	// Chunks are pulled from a shared counter, so if only some threads started they still render everything
+	for (U32 i = 0; i < threadsStarted; i++) {
+		join_thread(threads[i]);
+	}
+	for (U32 i = 0; i < threadCount; i++) {
+		parallelRender.graphs[i].delete_all_nodes();
+	}
+	return threadsStarted > 0 && parallelRender.failedThreads < I32(threadsStarted);
+}
+
+// args are everything after --render
+U32 run_offline_render(int argc, char** argv) {
+	if (argc < 3) {
+		print_usage();
+		return EXIT_FAILURE;
+	}
+	const char* projectPath = argv[0];
+	const char* outputPath = argv[1];
+	F64 durationSeconds;
+	if (!parse_f64_arg(&durationSeconds, argv[2]) || !(durationSeconds > 0.0)) {
+		println("Duration must be a positive number of seconds");
+		return EXIT_FAILURE;
+	}
+	U32 sampleRate = DEFAULT_SAMPLE_RATE;
+	U32 bitDepth = 32;
+	B32 isFloat = true;
+	U32 channelCount = DEFAULT_CHANNEL_COUNT;
+	U32 threadCount = min(processor_count(), MAX_THREAD_COUNT);
+	// Negative means work it out from the graph
+	F64 prerollSeconds = -1.0;
+	OutputSettings settings = DEFAULT_OUTPUT_SETTINGS;
+	settings.packed24Bit = true;
+	F64 gainDecibels;
+	for (int i = 3; i < argc; i += 2) {
+		StrA option = arg_str(argv[i]);
+		if (i + 1 >= argc) {
+			print_usage();
+			return EXIT_FAILURE;
+		}
+		const char* value = argv[i + 1];
+		B32 valid = false;
+		if (option == "--rate"sa) {
+			valid = parse_u32_arg(&sampleRate, value);
+		} else if (option == "--bits"sa) {
+			isFloat = arg_str(value) == "float"sa;
+			valid = isFloat || parse_u32_arg(&bitDepth, value);
+			bitDepth = isFloat ? 32 : bitDepth;
+		} else if (option == "--channels"sa) {
+			valid = parse_u32_arg(&channelCount, value) && channelCount <= MAX_CHANNEL_COUNT;
+		} else if (option == "--threads"sa) {
+			valid = parse_u32_arg(&threadCount, value) && threadCount <= MAX_THREAD_COUNT;
+		} else if (option == "--preroll"sa) {
+			valid = parse_f64_arg(&prerollSeconds, value) && prerollSeconds >= 0.0;
+		} else if (option == "--gain"sa) {
+			valid = parse_f64_arg(&gainDecibels, value);
+			settings.gain = _mm_cvtss_f32(powf32x4(_mm_set_ps1(10.0F), _mm_set_ps1(F32(gainDecibels / 20.0))));
+		} else if (option == "--dither"sa) {
+			settings.dither = arg_str(value) == "tpdf"sa;
+			valid = settings.dither || arg_str(value) == "none"sa;
+		}
+		if (!valid) {
+			print_usage();
+			return EXIT_FAILURE;
+		}
+	}
+	AudioFormat format;
+	if (!find_format(&format, sampleRate, bitDepth, isFloat)) {
+		println("Unsupported sample rate or bit depth");
+		return EXIT_FAILURE;
+	}
+	// Nodes read the sample rate from here, so it has to be set before anything gets loaded or processed
+	outputAudioFormat = format;
+	outputChannelCount = channelCount;
+
+	WavWriter wavWriter;
+	if (!wavWriter.open(outputPath, format, channelCount, settings.packed24Bit)) {
+		print("Failed to open WAV output ");
+		println(outputPath);
+		return EXIT_FAILURE;
+	}
+
+	alignas(32) F32 processBuffer[MAX_CHANNEL_COUNT][Nodes::PROCESS_BUFFER_SIZE];
+	F32 interleavedBuffer[Nodes::PROCESS_BUFFER_SIZE * MAX_CHANNEL_COUNT];
+	U8 encodedBuffer[Nodes::PROCESS_BUFFER_SIZE * MAX_CHANNEL_COUNT * sizeof(F32)];
+	const F32* lanes[MAX_CHANNEL_COUNT];
+	auto write_block = [&](U32 numFrames) {
+		interleave_channels(interleavedBuffer, lanes, numFrames, channelCount);
+		encode_audio_to_final_buffer(encodedBuffer, interleavedBuffer, numFrames, channelCount, format, settings);
+		wavWriter.write(encodedBuffer, numFrames);
+	};
+
+	U64 totalFrames = U64(durationSeconds * F64(sampleRate) + 0.5);
+	threadCount = U32(min<U64>(threadCount, (totalFrames + Nodes::PROCESS_BUFFER_SIZE - 1) / Nodes::PROCESS_BUFFER_SIZE));
+	// The parallel render needs the whole timeline in memory to stitch the chunks back together in order
+	F32* parallelOutput = threadCount > 1 ? reinterpret_cast<F32*>(heap_alloc(totalFrames * channelCount * sizeof(F32))) : nullptr;
+	if (threadCount > 1 && !parallelOutput) {
+		println("Not enough memory to render in parallel, rendering on one thread");
+		threadCount = 1;
+	}
+
+	F64 startTime = current_time_seconds();
+	if (threadCount > 1) {
+		if (!render_parallel(projectPath, parallelOutput, totalFrames, sampleRate, channelCount, threadCount, prerollSeconds)) {
+			heap_free(parallelOutput);
+			wavWriter.close();
+			return EXIT_FAILURE;
+		}
+		for (U64 frame = 0; frame < totalFrames; frame += Nodes::PROCESS_BUFFER_SIZE) {
+			for (U32 channel = 0; channel < channelCount; channel++) {
+				lanes[channel] = parallelOutput + channel * totalFrames + frame;
+			}
+			write_block(U32(min<U64>(Nodes::PROCESS_BUFFER_SIZE, totalFrames - frame)));
+		}
+		heap_free(parallelOutput);
+	} else {
+		Nodes::NodeGraph graph;
+		graph.init();
+		if (!Serialization::LoadNodeGraph(graph, projectPath)) {
+			wavWriter.close();
+			return EXIT_FAILURE;
+		}
+		for (U32 channel = 0; channel < channelCount; channel++) {
+			lanes[channel] = processBuffer[channel];
+		}
+		for (U64 frame = 0; frame < totalFrames; frame += Nodes::PROCESS_BUFFER_SIZE) {
+			graph.generate_output(processBuffer, channelCount, frame);
+			write_block(U32(min<U64>(Nodes::PROCESS_BUFFER_SIZE, totalFrames - frame)));
+		}
+		graph.delete_all_nodes();
+	}
+	F64 renderSeconds = current_time_seconds() - startTime;
+	if (!wavWriter.close()) {
+		print("Failed to write WAV output ");
+		println(outputPath);
+		return EXIT_FAILURE;
+	}
+
+	F64 audioSeconds = F64(totalFrames) / F64(sampleRate);
+	print("Rendered ");
+	print_float(audioSeconds);
+	print(" seconds of audio in ");
+	print_float(renderSeconds);
+	print(" seconds on ");
+	print_integer(threadCount);
+	print(threadCount == 1 ? " thread (" : " threads (");
+	print_float(renderSeconds > 0.0 ? audioSeconds / renderSeconds : 0.0);
+	println("x real time)");
+	return EXIT_SUCCESS;
+}
+
+}
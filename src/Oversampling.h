@@ -0,0 +1,142 @@
+#pragma once
+#include "DrillLib.h"
+
+// Half band FIR resamplers for running part of the graph at 2x, 4x or 8x the device rate. Every 2x step is one half band stage, so 8x is three of them back to back.
+// A half band filter has every other tap zero apart from the middle one, so split into its two polyphase branches, one branch is a plain delay and the other is a short symmetric FIR.
+// That FIR is the whole cost of a stage. Mirrored taps share a multiply, so it's 16 adds and 16 FMAs per 4 samples
+namespace Oversampling {
+
+const U32 MAX_LOG2_FACTOR = 3;
+// Nonzero taps in the FIR branch, 63 taps total. Transition band is centered on a quarter of the higher rate, the passband goes up to about 0.41 of the lower rate
+const U32 BRANCH_TAPS = 32;
+const U32 HALF_BRANCH_TAPS = BRANCH_TAPS / 2;
+// The delay branch is the center tap, which sits halfway between the middle two taps of the FIR branch
+const U32 BRANCH_DELAY = HALF_BRANCH_TAPS - 1;
+// Samples of history each branch carries into the next block. BRANCH_TAPS - 1 rounded up so the block after it stays aligned
+const U32 HISTORY_LENGTH = BRANCH_TAPS;
+// Every stage forgets its input after HISTORY_LENGTH samples of its own rate. Each stage further in runs twice as fast, so together they remember less than twice the first one
+const U32 PREROLL_FRAMES = 2 * HISTORY_LENGTH;
+const F64 KAISER_BETA = 9.0;
+
+struct Coefficients {
+	// First half of the FIR branch, the second half is the same backwards.
+	// Upsampling has a gain of 2 to make up for the zeros stuffed in between samples, so its taps are twice the downsampling ones
+	alignas(32) F64 up[HALF_BRANCH_TAPS];
+	alignas(32) F64 down[HALF_BRANCH_TAPS];
+};
+
+struct UpStage {
+	alignas(32) F64 history[HISTORY_LENGTH];
+};
+
+struct DownStage {
+	alignas(32) F64 evenHistory[HISTORY_LENGTH];
+	alignas(32) F64 oddHistory[HISTORY_LENGTH];
+};
+
+// Once a stage's history is all zeros, silence going in comes out as exact silence, so the FIR can be skipped until something else comes in
+FINLINE B32 history_is_silent(const F64* history) {
+	for (U32 i = 0; i < HISTORY_LENGTH; i++) {
+		if (history[i] != 0.0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Zeroth order modified Bessel function of the first kind, for the Kaiser window. The series converges quickly for the betas anyone would use
+F64 bessel_i0(F64 x) {
+	F64 halfX = x * 0.5;
+	F64 term = 1.0;
+	F64 sum = 1.0;
+	for (U32 k = 1; k < 32; k++) {
+		term *= halfX / F64(k);
+		sum += term * term;
+	}
+	return sum;
+}
+
+// Kaiser windowed sinc cut off at a quarter of the higher rate. The nonzero taps are all an odd distance from the center, where the sine in the sinc is just +-1
+Coefficients design_half_band(F64 kaiserBeta) {
+	Coefficients coefficients;
+	F64 taps[HALF_BRANCH_TAPS];
+	F64 branchSum = 0.0;
+	F64 windowScale = 1.0 / bessel_i0(kaiserBeta);
+	for (U32 i = 0; i < HALF_BRANCH_TAPS; i++) {
+		// Distance from the center tap at the higher rate, 31, 29, ..., 1
+		U32 distance = BRANCH_TAPS - 1 - 2 * i;
+		F64 ratio = F64(distance) / F64(BRANCH_TAPS);
+		F64 window = bessel_i0(kaiserBeta * _mm_cvtsd_f64(_mm_sqrt_pd(_mm_set_sd(1.0 - ratio * ratio)))) * windowScale;
+		// MATH_PI is only F32 precision
+		F64 sinc = ((distance >> 1) & 1 ? -1.0 : 1.0) / (3.141592653589793238462643383279 * F64(distance));
+		taps[i] = sinc * window;
+		branchSum += 2.0 * taps[i];
+	}
+	// Scaled so the FIR branch passes DC at exactly the same level as the delay branch. Any mismatch would show up as a tone at the lower rate's Nyquist
+	for (U32 i = 0; i < HALF_BRANCH_TAPS; i++) {
+		coefficients.up[i] = taps[i] / branchSum;
+		coefficients.down[i] = 0.5 * taps[i] / branchSum;
+	}
+	return coefficients;
+}
+
+const Coefficients HALF_BAND = design_half_band(KAISER_BETA);
+
+// Output for x[0..3], reads back BRANCH_TAPS - 1 samples before x. Two accumulators so the FMAs aren't all waiting on each other
+FINLINE __m256d branch_fir_x4(const F64* x, const F64* halfTaps) {
+	__m256d accumulator0 = _mm256_setzero_pd();
+	__m256d accumulator1 = _mm256_setzero_pd();
+	for (U32 i = 0; i < HALF_BRANCH_TAPS; i += 2) {
+		__m256d pair0 = _mm256_add_pd(_mm256_loadu_pd(x - i), _mm256_loadu_pd(x - (BRANCH_TAPS - 1) + i));
+		__m256d pair1 = _mm256_add_pd(_mm256_loadu_pd(x - (i + 1)), _mm256_loadu_pd(x - (BRANCH_TAPS - 1) + (i + 1)));
+		accumulator0 = _mm256_fmadd_pd(pair0, _mm256_set1_pd(halfTaps[i]), accumulator0);
+		accumulator1 = _mm256_fmadd_pd(pair1, _mm256_set1_pd(halfTaps[i + 1]), accumulator1);
+	}
+	return _mm256_add_pd(accumulator0, accumulator1);
+}
+
+// numSamples in, 2 * numSamples out. numSamples has to be a multiple of 4, out 32 byte aligned.
+// scratch needs room for HISTORY_LENGTH + numSamples and 32 byte alignment
+void upsample_2x(UpStage& stage, F64* out, const F64* in, U32 numSamples, F64* scratch) {
+	memcpy(scratch, stage.history, HISTORY_LENGTH * sizeof(F64));
+	memcpy(scratch + HISTORY_LENGTH, in, numSamples * sizeof(F64));
+	const F64* x = scratch + HISTORY_LENGTH;
+	for (U32 i = 0; i < numSamples; i += 4) {
+		__m256d filtered = branch_fir_x4(x + i, HALF_BAND.up);
+		__m256d delayed = _mm256_loadu_pd(x + i - BRANCH_DELAY);
+		// f0 d0 f2 d2 and f1 d1 f3 d3, then the 128 bit halves get put back in order
+		__m256d low = _mm256_unpacklo_pd(filtered, delayed);
+		__m256d high = _mm256_unpackhi_pd(filtered, delayed);
+		_mm256_store_pd(out + i * 2, _mm256_permute2f128_pd(low, high, 0x20));
+		_mm256_store_pd(out + i * 2 + 4, _mm256_permute2f128_pd(low, high, 0x31));
+	}
+	memcpy(stage.history, scratch + numSamples, HISTORY_LENGTH * sizeof(F64));
+}
+
+// 2 * numSamples in, numSamples out. numSamples has to be a multiple of 4, in and out 32 byte aligned.
+// scratch needs room for 2 * (HISTORY_LENGTH + numSamples) and 32 byte alignment
+void downsample_2x(DownStage& stage, F64* out, const F64* in, U32 numSamples, F64* scratch) {
+	F64* even = scratch;
+	F64* odd = scratch + HISTORY_LENGTH + numSamples;
+	memcpy(even, stage.evenHistory, HISTORY_LENGTH * sizeof(F64));
+	memcpy(odd, stage.oddHistory, HISTORY_LENGTH * sizeof(F64));
+	for (U32 i = 0; i < numSamples; i += 4) {
+		__m256d a = _mm256_load_pd(in + i * 2);
+		__m256d b = _mm256_load_pd(in + i * 2 + 4);
+		// u0 u4 u2 u6 and u1 u5 u3 u7, then the middle two swap
+		_mm256_store_pd(even + HISTORY_LENGTH + i, _mm256_permute4x64_pd(_mm256_unpacklo_pd(a, b), _MM_SHUFFLE(3, 1, 2, 0)));
+		_mm256_store_pd(odd + HISTORY_LENGTH + i, _mm256_permute4x64_pd(_mm256_unpackhi_pd(a, b), _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+	const F64* evenX = even + HISTORY_LENGTH;
+	const F64* oddX = odd + HISTORY_LENGTH;
+	// Keeping the even samples lines the FIR branch up with them and puts the center tap on the odd ones, half a sample further back.
+	// That extra half sample makes a round trip through both directions exactly 2 * HALF_BRANCH_TAPS - 1 samples late at the lower rate, a whole number
+	for (U32 i = 0; i < numSamples; i += 4) {
+		__m256d filtered = branch_fir_x4(evenX + i, HALF_BAND.down);
+		_mm256_store_pd(out + i, _mm256_fmadd_pd(_mm256_loadu_pd(oddX + i - (BRANCH_DELAY + 1)), _mm256_set1_pd(0.5), filtered));
+	}
+	memcpy(stage.evenHistory, even + numSamples, HISTORY_LENGTH * sizeof(F64));
+	memcpy(stage.oddHistory, odd + numSamples, HISTORY_LENGTH * sizeof(F64));
+}
+
+}
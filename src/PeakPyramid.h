@@ -0,0 +1,168 @@
+#pragma once
+#include "DrillLib.h"
+
+// Min/max summaries of a waveform at every power of two zoom level, so drawing it costs the same however much audio is behind it.
+// Level 0 keeps one peak per BASE_BUCKET_SIZE samples, each level above that covers twice as much with half as many peaks.
+// Closer in than a base bucket, the samples themselves are cheaper to read than anything that could be stored for them
+namespace PeakPyramid {
+
+const U32 BASE_LOG2 = 5;
+const U64 BASE_BUCKET_SIZE = 1ull << BASE_LOG2;
+const U32 MAX_LEVELS = 64 - BASE_LOG2;
+
+struct Peak {
+	F32 min;
+	F32 max;
+
+	FINLINE void add(F32 sample) {
+		min = ::min(min, sample);
+		max = ::max(max, sample);
+	}
+	FINLINE void add(Peak other) {
+		min = ::min(min, other.min);
+		max = ::max(max, other.max);
+	}
+};
+
+// Nothing has gone into it yet, anything added replaces both ends
+const Peak EMPTY_PEAK{ F32_INF, -F32_INF };
+
+FINLINE Peak peak_of(const F32* samples, U64 count) {
+	Peak peak = EMPTY_PEAK;
+	for (U64 i = 0; i < count; i++) {
+		peak.add(samples[i]);
+	}
+	return peak;
+}
+
+// Covers the newest capacity samples appended. Positions are absolute sample counts from the first append, storage wraps around underneath,
+// so the same thing works for a scrolling scope and for a whole file. The caller keeps the samples themselves in a buffer of the same capacity, indexed by position & (capacity - 1)
+struct Pyramid {
+	Peak* levels[MAX_LEVELS];
+	U32 levelCount;
+	U64 capacity;
+	U64 sampleCount;
+	Peak* storage;
+
+	// capacity is rounded up to a power of two, no smaller than a base bucket
+	void init(U64 minCapacity) {
+		capacity = BASE_BUCKET_SIZE;
+		while (capacity < minCapacity) {
+			capacity <<= 1;
+		}
+		levelCount = U32(63 - lzcnt64(capacity)) - BASE_LOG2 + 1;
+		// Every level is half the one before it, so all of them together are just under twice the bottom one
+		U64 totalPeaks = 2 * (capacity >> BASE_LOG2) - 1;
+		storage = reinterpret_cast<Peak*>(heap_zalloc(totalPeaks * sizeof(Peak)));
+		Peak* level = storage;
+		for (U32 i = 0; i < levelCount; i++) {
+			levels[i] = level;
+			level += capacity >> (BASE_LOG2 + i);
+		}
+		sampleCount = 0;
+	}
+
+	void destroy() {
+		heap_free(storage);
+		storage = nullptr;
+		sampleCount = 0;
+	}
+
+	FINLINE Peak& bucket(U32 level, U64 index) {
+		return levels[level][index & ((capacity >> (BASE_LOG2 + level)) - 1)];
+	}
+
+	// Only touches the buckets the new samples land in and the ones above them, so it's cheap enough to do every time audio shows up.
+	// A bucket that's still filling can hold peaks from the last time around the storage, but queries only ever use buckets that are entirely inside their range
+	void append(const F32* samples, U64 count) {
+		if (count > capacity) {
+			samples += count - capacity;
+			sampleCount += count - capacity;
+			count = capacity;
+		}
+		if (count == 0) {
+			return;
+		}
+		U64 firstPosition = sampleCount;
+		for (U64 i = 0; i < count;) {
+			U64 position = firstPosition + i;
+			U64 inBucket = min(count - i, BASE_BUCKET_SIZE - (position & (BASE_BUCKET_SIZE - 1)));
+			Peak peak = peak_of(samples + i, inBucket);
+			Peak& base = bucket(0, position >> BASE_LOG2);
+			if ((position & (BASE_BUCKET_SIZE - 1)) == 0) {
+				base = peak;
+			} else {
+				base.add(peak);
+			}
+			i += inBucket;
+		}
+		sampleCount += count;
+		U64 first = firstPosition >> BASE_LOG2;
+		U64 last = (sampleCount - 1) >> BASE_LOG2;
+		for (U32 level = 1; level < levelCount; level++) {
+			first >>= 1;
+			last >>= 1;
+			for (U64 index = first; index <= last; index++) {
+				Peak peak = bucket(level - 1, index * 2);
+				peak.add(bucket(level - 1, index * 2 + 1));
+				bucket(level, index) = peak;
+			}
+		}
+	}
+
+	// Oldest position still covered
+	FINLINE U64 first_position() {
+		return sampleCount > capacity ? sampleCount - capacity : 0;
+	}
+
+	// Peak of positions [start, end), which has to be within what's still covered. The ragged ends under a base bucket come from the samples,
+	// then it climbs the levels like a segment tree, taking at most one bucket from each side per level
+	Peak range_peak(U64 start, U64 end, const F32* samples) {
+		Peak peak = EMPTY_PEAK;
+		U64 mask = capacity - 1;
+		U64 alignedStart = min(end, (start + BASE_BUCKET_SIZE - 1) & ~(BASE_BUCKET_SIZE - 1));
+		for (U64 i = start; i < alignedStart; i++) {
+			peak.add(samples[i & mask]);
+		}
+		U64 alignedEnd = max(alignedStart, end & ~(BASE_BUCKET_SIZE - 1));
+		for (U64 i = alignedEnd; i < end; i++) {
+			peak.add(samples[i & mask]);
+		}
+		U64 low = alignedStart >> BASE_LOG2;
+		U64 high = alignedEnd >> BASE_LOG2;
+		for (U32 level = 0; low < high; level++) {
+			if (low & 1) {
+				peak.add(bucket(level, low++));
+			}
+			if (high & 1) {
+				peak.add(bucket(level, --high));
+			}
+			low >>= 1;
+			high >>= 1;
+		}
+		return peak;
+	}
+
+	// One peak per column over positions [start, end), for drawing a vertical span per pixel.
+	// Column edges snap to the level whose buckets are no wider than a column, so a column is a bucket or two whether it covers a hundred samples or a million.
+	// Only the first and last columns can have ragged ends
+	void column_peaks(U64 start, U64 end, U32 columnCount, const F32* samples, Peak* out) {
+		if (end <= start || columnCount == 0) {
+			memset(out, 0, columnCount * sizeof(Peak));
+			return;
+		}
+		U64 length = end - start;
+		U64 samplesPerColumn = length / columnCount;
+		U64 snapMask = samplesPerColumn >= BASE_BUCKET_SIZE ? (1ull << (63 - lzcnt64(samplesPerColumn))) - 1 : 0;
+		U64 columnStart = start;
+		for (U32 i = 0; i < columnCount; i++) {
+			U64 columnEnd = i + 1 == columnCount ? end : max(start, (start + length * (i + 1) / columnCount) & ~snapMask);
+			// Zoomed in past one sample per column, columns share samples
+			U64 first = min(columnStart, end - 1);
+			out[i] = range_peak(first, max(columnEnd, first + 1), samples);
+			columnStart = max(columnStart, columnEnd);
+		}
+	}
+};
+
+}
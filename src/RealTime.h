@@ -0,0 +1,90 @@
+#pragma once
+#include "DrillLib.h"
+
+// Real-time mode, DAWdle --realtime. Normally the arenas only commit memory when something first touches it, which is a page fault
+// (and a trip into the kernel) in the middle of rendering a block the first time a graph needs more memory than before.
+// In real-time mode the audio thread's memory is committed and locked into physical memory up front instead, so once it's set up the render path never faults.
+// If it happens anyway (the graph grew past what was locked) it gets reported and the lock grows to cover it
+namespace RealTime {
+
+// Extra locked past the measured high-water mark, so adding a few nodes doesn't immediately fault
+const U64 ARENA_HEADROOM_BYTES = 8 * MEGABYTE;
+// Well under the 4MB the linker reserves per thread stack, and far more than a block of processing actually uses
+const U32 AUDIO_STACK_PREFAULT_BYTES = 256 * KILOBYTE;
+
+B32 enabled;
+// Only touched by the audio thread
+B32 audioThreadPrepared;
+B32 arenasLocked;
+// Locking isn't retried every block once the OS has said no
+B32 lockFailed;
+U64 lockedBytes;
+// Faults seen on the render path after the arenas were locked. Should stay 0
+U32 renderPageFaults;
+
+// Locks each of the audio thread's arenas up to what it's used so far plus headroom
+B32 lock_audio_arenas() {
+	MemoryArena* arenas[]{ &audioArena, &scratchArena0, &scratchArena1 };
+	U64 bytesToLock = 0;
+	for (MemoryArena* arena : arenas) {
+		bytesToLock += ALIGN_HIGH(arena->committedBytes + ARENA_HEADROOM_BYTES, MEMORY_ARENA_BYTES_TO_COMMIT_AT_A_TIME);
+	}
+	if (bytesToLock > lockedBytes && !grow_lockable_memory(bytesToLock - lockedBytes)) {
+		return false;
+	}
+	for (MemoryArena* arena : arenas) {
+		if (!arena->commit_and_lock(arena->committedBytes + ARENA_HEADROOM_BYTES)) {
+			return false;
+		}
+	}
+	lockedBytes = max(lockedBytes, bytesToLock);
+	return true;
+}
+
+// Called on the audio thread before it renders anything
+void prepare_audio_thread() {
+	if (!enabled) {
+		return;
+	}
+	if (!grow_lockable_memory(AUDIO_STACK_PREFAULT_BYTES) || !prefault_and_lock_stack(AUDIO_STACK_PREFAULT_BYTES)) {
+		print("Real-time mode: failed to lock audio thread stack, code: ");
+		println_integer(last_platform_error());
+	}
+	audioThreadPrepared = true;
+	arenasLocked = false;
+}
+
+// Called on the audio thread after each block with arenaFaultCount from before the block.
+// The first block is the measurement: whatever it faulted in is the high-water mark for this graph, and that gets locked with headroom
+void end_block(U32 faultCountBeforeBlock) {
+	if (!enabled || !audioThreadPrepared || lockFailed) {
+		return;
+	}
+	if (arenasLocked) {
+		if (arenaFaultCount == faultCountBeforeBlock) {
+			return;
+		}
+		renderPageFaults += arenaFaultCount - faultCountBeforeBlock;
+		print("Real-time mode: page fault on the audio thread, graph outgrew the locked arenas. Total: ");
+		println_integer(renderPageFaults);
+	}
+	arenasLocked = lock_audio_arenas();
+	if (!arenasLocked) {
+		lockFailed = true;
+		print("Real-time mode: failed to lock audio arenas, code: ");
+		println_integer(last_platform_error());
+	}
+}
+
+void report() {
+	if (!enabled) {
+		return;
+	}
+	print("Real-time mode: ");
+	print_integer(lockedBytes / KILOBYTE);
+	print(" KB of audio arenas locked, ");
+	print_integer(renderPageFaults);
+	println(" page faults on the render path");
+}
+
+}
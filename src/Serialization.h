@@ -1,8 +1,14 @@
+#pragma once
 #include <fstream>
+#include <iostream>
+#include <vector>
 #include "Nodes.h"
 
 const U32 SERIALIZE_FILE_MAGIC = 0x44574144;
-const U32 CURRENT_SERIALIZE_VERSION = DRILL_LIB_MAKE_VERSION(1, 2, 0);
+const U32 CURRENT_SERIALIZE_VERSION = DRILL_LIB_MAKE_VERSION(1, 4, 0);
+// 1.3.0 added the channel out channel, older files load with everything going to all channels like they used to.
+// 1.4.0 added the oversample nodes, which older files can't have
+const U32 OLDEST_LOADABLE_SERIALIZE_VERSION = DRILL_LIB_MAKE_VERSION(1, 2, 0);
 
 namespace Nodes {
     NodeHeader* createNodeByType(NodeGraph& graph, NodeType type, V2F32 pos) {
@@ -33,16 +39,18 @@ namespace Serialization {
         std::vector<MathOp> mathOps;
         std::vector<Waveform> waveforms;
         std::vector<FilterType> filterTypes;
-        std::vector<std::pair<char*, U32>> inputStrs;
+        std::vector<U32> outputChannels;
+        std::vector<U32> oversampleFactors;
+        std::vector<std::pair<const char*, U32>> inputStrs;
         std::vector<NodePianoRoll*> pianoRolls;
+        std::vector<StftSettings> stftSettings;
 
         U32 currentSerializeIndex = 0;
         for (NodeHeader* node = graph.nodesFirst; node; node = node->next) {
             node->serializeIndex = currentSerializeIndex++;
             nodeBasicData.emplace_back(node->type, node->offset);
-            if (node->type == NODE_SAMPLER) {
-                NodeSampler& samplerNode = *reinterpret_cast<NodeSampler*>(node);
-                NodeWidgetSamplerButton& button = *samplerNode.header.get_samplerbutton(0);
+            if (node->type == NODE_SAMPLER || node->type == NODE_CONVOLUTION) {
+                NodeWidgetSamplerButton& button = *node->get_samplerbutton(0);
                 U32 pathLength = strlen(button.path);
                 samplerData.emplace_back(pathLength, button.path);
             }
@@ -58,9 +66,21 @@ namespace Serialization {
                 NodeFilter& filterNode = *reinterpret_cast<NodeFilter*>(node);
                 filterTypes.push_back(filterNode.filterType);
             }
+            if (node->type == NODE_CHANNEL_OUT) {
+                outputChannels.push_back(reinterpret_cast<NodeChannelOut*>(node)->channel);
+            }
+            if (node->type == NODE_OVERSAMPLE_OUT) {
+                oversampleFactors.push_back(reinterpret_cast<NodeOversampleOut*>(node)->log2Factor);
+            }
             if (node->type == NODE_PIANO_ROLL) {
                 pianoRolls.push_back(reinterpret_cast<NodePianoRoll*>(node));
             }
+            if (node->type == NODE_STFT_ANALYSIS) {
+                stftSettings.push_back(reinterpret_cast<NodeSTFTAnalysis*>(node)->settings);
+            }
+            if (node->type == NODE_STFT_SYNTHESIS) {
+                stftSettings.push_back(reinterpret_cast<NodeSTFTSynthesis*>(node)->settings);
+            }
         }
         for (NodeHeader* node = graph.nodesFirst; node; node = node->next) {
             U32 inputWidgetCount = 0;
@@ -71,8 +91,7 @@ namespace Serialization {
             for (NodeWidgetHeader* widget = node->widgetBegin; widget; widget = widget->next) {
                 if (widget->type == NODE_WIDGET_INPUT) {
                     NodeWidgetInput* input = reinterpret_cast<NodeWidgetInput*>(widget);
-                    UI::Box* inputBox = input->sliderHandle.unsafeBox;
-                    inputStrs.emplace_back(inputBox->typedTextBuffer, inputBox->numTypedCharacters);
+                    inputStrs.emplace_back(input->expression, input->expressionLength);
                     U32 outputNodeIndex = INVALID_NODE_IDX;
                     U32 outputWidgetIndex = 0;
                     if (input->inputHandle.get() && input->inputHandle.get()->header.parent) {
@@ -101,7 +120,10 @@ namespace Serialization {
         size_t mathNodeIndex = 0;
         size_t waveNodeIndex = 0;
         size_t filterNodeIndex = 0;
+        size_t channelOutIndex = 0;
+        size_t oversampleIndex = 0;
         size_t pianoRollIndex = 0;
+        size_t stftIndex = 0;
         for (size_t i = 0; i < nodeBasicData.size(); ++i) {
             const auto& [type, offset] = nodeBasicData[i];
             outFile.write(reinterpret_cast<const char*>(&type), sizeof(type));
@@ -117,7 +139,7 @@ namespace Serialization {
                 outFile.write(reinterpret_cast<const char*>(&inputStrLen), sizeof(inputStrLen));
                 outFile.write(inputStr, inputStrLen);
             }
-            if (type == NODE_SAMPLER) {
+            if (type == NODE_SAMPLER || type == NODE_CONVOLUTION) {
                 const auto& [pathLength, pathData] = samplerData[samplerIndex++];
                 outFile.write(reinterpret_cast<const char*>(&pathLength), sizeof(pathLength));
                 outFile.write(reinterpret_cast<const char*>(pathData), pathLength);
@@ -134,32 +156,51 @@ namespace Serialization {
                 outFile.write(reinterpret_cast<const char*>(&filterTypes[filterNodeIndex]), sizeof(filterTypes[filterNodeIndex]));
                 filterNodeIndex++;
             }
+            if (type == NODE_CHANNEL_OUT) {
+                outFile.write(reinterpret_cast<const char*>(&outputChannels[channelOutIndex]), sizeof(outputChannels[channelOutIndex]));
+                channelOutIndex++;
+            }
+            if (type == NODE_OVERSAMPLE_OUT) {
+                outFile.write(reinterpret_cast<const char*>(&oversampleFactors[oversampleIndex]), sizeof(oversampleFactors[oversampleIndex]));
+                oversampleIndex++;
+            }
             if (type == NODE_PIANO_ROLL) {
                 outFile.write(reinterpret_cast<const char*>(&pianoRolls[pianoRollIndex]->pianoRoll->noteCount), sizeof(pianoRolls[pianoRollIndex]->pianoRoll->noteCount));
                 outFile.write(reinterpret_cast<const char*>(pianoRolls[pianoRollIndex]->pianoRoll->notes), pianoRolls[pianoRollIndex]->pianoRoll->noteCount * sizeof(PianoRollNote));
                 pianoRollIndex++;
             }
+            if (type == NODE_STFT_ANALYSIS || type == NODE_STFT_SYNTHESIS) {
+                outFile.write(reinterpret_cast<const char*>(&stftSettings[stftIndex]), sizeof(stftSettings[stftIndex]));
+                stftIndex++;
+            }
         }
 
         outFile.close();
     }
-    void LoadNodeGraph(Nodes::NodeGraph& graph, const std::string& filePath) {
+    // Returns false if the file couldn't be loaded, in which case the graph is left as it was
+    // Why the last LoadNodeGraph call turned the file down, for the UI to show. Null if it wasn't the file's fault (or the load worked)
+    const char* loadError;
+
+    bool LoadNodeGraph(Nodes::NodeGraph& graph, const std::string& filePath) {
         using namespace Nodes;
+        loadError = nullptr;
         std::ifstream inFile(filePath, std::ios::binary);
         if (!inFile.is_open()) {
             std::cerr << "Failed to open file for reading: " << filePath << std::endl;
-            return;
+            return false;
         }
         U32 fileMagic, fileVersion;
         inFile.read(reinterpret_cast<char*>(&fileMagic), sizeof(fileMagic));
         inFile.read(reinterpret_cast<char*>(&fileVersion), sizeof(fileVersion));
         if (fileMagic != SERIALIZE_FILE_MAGIC) {
-            MessageBox(nullptr, "Not a valid DAWdle file.", "File Error", MB_OK | MB_ICONERROR);
-            return;
+            std::cerr << "Not a valid DAWdle file: " << filePath << std::endl;
+            loadError = "Not a valid DAWdle file.";
+            return false;
         }
-        if (fileVersion != CURRENT_SERIALIZE_VERSION) {
-            MessageBox(nullptr, "Incompatible file version.", "Version Error", MB_OK | MB_ICONERROR);
-            return;
+        if (fileVersion > CURRENT_SERIALIZE_VERSION || fileVersion < OLDEST_LOADABLE_SERIALIZE_VERSION) {
+            std::cerr << "Incompatible file version: " << filePath << std::endl;
+            loadError = "Incompatible file version.";
+            return false;
         }
 
         graph.delete_all_nodes();
@@ -182,17 +223,18 @@ namespace Serialization {
                 nodeConnections.push_back({ outputNodeIndex, outputWidgetIndex });
 
                 NodeWidgetInput* input = node->get_input(i);
-                UI::Box* slider = input->sliderHandle.unsafeBox;
-                inFile.read(reinterpret_cast<char*>(&slider->numTypedCharacters), sizeof(slider->numTypedCharacters));
-                inFile.read(slider->typedTextBuffer, slider->numTypedCharacters);
-                StrA parseStr{ slider->typedTextBuffer, slider->numTypedCharacters };
-                tbrs::parse_program(&input->program, parseStr);
+                U32 expressionLength;
+                inFile.read(reinterpret_cast<char*>(&expressionLength), sizeof(expressionLength));
+                char expression[NodeWidgetInput::EXPRESSION_CAPACITY];
+                U32 lengthToKeep = min(expressionLength, NodeWidgetInput::EXPRESSION_CAPACITY);
+                inFile.read(expression, lengthToKeep);
+                inFile.ignore(expressionLength - lengthToKeep);
+                input->set_expression(StrA{ expression, lengthToKeep });
             }
             connections.push_back(nodeConnections);
 
-            if (type == NODE_SAMPLER) {
-                NodeSampler& samplerNode = *reinterpret_cast<NodeSampler*>(node);
-                NodeWidgetSamplerButton& button = *samplerNode.header.get_samplerbutton(0);
+            if (type == NODE_SAMPLER || type == NODE_CONVOLUTION) {
+                NodeWidgetSamplerButton& button = *node->get_samplerbutton(0);
 
                 U32 pathLength;
                 inFile.read(reinterpret_cast<char*>(&pathLength), sizeof(pathLength));
@@ -218,11 +260,21 @@ namespace Serialization {
                 inFile.read(reinterpret_cast<char*>(&type), sizeof(type));
                 filterNode.setFilterType(type);
             }
+            if (type == NODE_CHANNEL_OUT && fileVersion >= DRILL_LIB_MAKE_VERSION(1, 3, 0)) {
+                U32 channel;
+                inFile.read(reinterpret_cast<char*>(&channel), sizeof(channel));
+                reinterpret_cast<NodeChannelOut*>(node)->set_channel(channel);
+            }
+            if (type == NODE_OVERSAMPLE_OUT) {
+                U32 log2Factor;
+                inFile.read(reinterpret_cast<char*>(&log2Factor), sizeof(log2Factor));
+                reinterpret_cast<NodeOversampleOut*>(node)->set_log2_factor(log2Factor);
+            }
             if (type == NODE_PIANO_ROLL) {
                 NodePianoRoll& pianoRoll = *reinterpret_cast<NodePianoRoll*>(node);
                 inFile.read(reinterpret_cast<char*>(&pianoRoll.pianoRoll->noteCount), sizeof(pianoRoll.pianoRoll->noteCount));
                 pianoRoll.pianoRoll->noteCapacity = next_power_of_two(max(64u, pianoRoll.pianoRoll->noteCount));
-                PianoRollNote* newNotes = reinterpret_cast<PianoRollNote*>(HeapReAlloc(GetProcessHeap(), 0, pianoRoll.pianoRoll->notes, pianoRoll.pianoRoll->noteCapacity * sizeof(PianoRollNote)));
+                PianoRollNote* newNotes = reinterpret_cast<PianoRollNote*>(heap_realloc(pianoRoll.pianoRoll->notes, pianoRoll.pianoRoll->noteCapacity * sizeof(PianoRollNote)));
                 if (newNotes) {
                     inFile.read(reinterpret_cast<char*>(newNotes), pianoRoll.pianoRoll->noteCount * sizeof(PianoRollNote));
                     pianoRoll.pianoRoll->notes = newNotes;
@@ -230,6 +282,16 @@ namespace Serialization {
                     abort("Out of memory");
                 }
             }
+            if (type == NODE_STFT_ANALYSIS) {
+                StftSettings settings;
+                inFile.read(reinterpret_cast<char*>(&settings), sizeof(settings));
+                reinterpret_cast<NodeSTFTAnalysis*>(node)->apply_settings(settings);
+            }
+            if (type == NODE_STFT_SYNTHESIS) {
+                StftSettings settings;
+                inFile.read(reinterpret_cast<char*>(&settings), sizeof(settings));
+                reinterpret_cast<NodeSTFTSynthesis*>(node)->apply_settings(settings);
+            }
         }
 
         for (size_t i = 0; i < nodeHeaders.size(); i++) {
@@ -248,5 +310,6 @@ namespace Serialization {
         }
 
         inFile.close();
+        return true;
     }
 }
\ No newline at end of file
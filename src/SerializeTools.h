@@ -11,10 +11,10 @@ FINLINE B32 is_digit(char c) {
 	return c >= '0' && c <= '9';
 }
 FINLINE B32 is_hex_digit(char c) {
-	return c >= '0' && c <= '9' || c >= 'A' && c <= 'F' || c >= 'a' && c <= 'f';
+	return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f');
 }
 FINLINE B32 is_alpha(char c) {
-	return c >= 'a' && c <= 'z' || c >= 'A' && c <= 'Z';
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
 }
 FINLINE B32 is_upper_alpha(char c) {
 	return c >= 'A' && c <= 'Z';
@@ -229,8 +229,8 @@ void serialize_f64(char* dstBuffer, U32* dstBufferSize, F64 startValue) {
 	U32 dstBufferCapacity = *dstBufferSize;
 	*dstBufferSize = 0;
 	B32 negative = B32(bitcast<U64>(startValue) >> 63ull);
-	U64 significand = bitcast<U64>(startValue) & (1ull << 52ull) - 1ull;
-	I32 exponent = I32(bitcast<U64>(startValue) >> 52ull & (1ull << 11ull) - 1ull) - 1023;
+	U64 significand = bitcast<U64>(startValue) & ((1ull << 52ull) - 1ull);
+	I32 exponent = I32((bitcast<U64>(startValue) >> 52ull) & ((1ull << 11ull) - 1ull)) - 1023;
 	if (negative && dstBufferCapacity) {
 		dstBufferCapacity--;
 		(*dstBufferSize)++;
@@ -337,9 +337,9 @@ void serialize_f64(char* dstBuffer, U32* dstBufferSize, F64 startValue) {
 				mulLo = _mulx_u64(multiplicand, pow5Lo, &mulHi);
 				U64 midBits = multiplicand * pow5Hi + mulHi;
 				// The parity bit is the beta-th bit, counting from the MSB
-				B32 xIsOdd = midBits >> 64 - beta & 1;
+				B32 xIsOdd = (midBits >> (64 - beta)) & 1;
 				// It's an integer if the 64 lower bits starting after the parity bit are 0
-				B32 xIsInteger = (midBits & (1 << 64 - beta) - 1) == 0 && mulLo >> 64 - beta == 0;
+				B32 xIsInteger = (midBits & ((1 << (64 - beta)) - 1)) == 0 && (mulLo >> (64 - beta)) == 0;
 				if (xIsOdd) {
 					// Odd number, zf < deltaf, so s * 10^(-k + kappa + 1) is the unique element in I intersect (TheIntegers * 10^(-k0 + 1))
 					base10Digits = s;
@@ -378,9 +378,9 @@ void serialize_f64(char* dstBuffer, U32* dstBufferSize, F64 startValue) {
 			mulLo = _mulx_u64(multiplicand, pow5Lo, &mulHi);
 			U64 midBits = multiplicand * pow5Hi + mulHi;
 			// The parity bit is the beta-th bit, counting from the MSB
-			B32 yIsOdd = midBits >> 64 - beta & 1;
-			B32 yIsInteger = (midBits & (1 << 64 - beta) - 1) == 0 && mulLo >> 64 - beta == 0;
-			if (yIsOdd != (capitalD - tenToTheKappaPower / 2 & 1)) {
+			B32 yIsOdd = (midBits >> (64 - beta)) & 1;
+			B32 yIsInteger = (midBits & ((1 << (64 - beta)) - 1)) == 0 && (mulLo >> (64 - beta)) == 0;
+			if (yIsOdd != ((capitalD - tenToTheKappaPower / 2) & 1)) {
 				// Parity is different, answer is (10 * sTilde + t - 1) * 10 ^ (-k + kappa)
 				base10Digits = 10 * sTilde + t - 1;
 				base10Exponent = -k + kappa;
@@ -408,15 +408,15 @@ void serialize_f64(char* dstBuffer, U32* dstBufferSize, F64 startValue) {
 		// = e * log_10(2) + log_10(3/4)
 		// = e * 0.30102999566 - 0.1249387366
 		// k0 = -floor(e * log_10(2) + log_10(3/4))
-		I32 k0 = -(exponent * 1262611 - 524031 >> 22);
+		I32 k0 = -((exponent * 1262611 - 524031) >> 22);
 		// beta = e + floor(k0 * log_2(10))
 		I32 beta = exponent + (k0 * 217706 >> 16);
 		// Step 2: compute xi and zi
 		const I32 p = 52;
 		U64 pow5Hi = POWER_OF_5_TABLE[(POWER_OF_5_TABLE_OFFSET + k0) * 2 + 0];
 		U64 pow5Lo = POWER_OF_5_TABLE[(POWER_OF_5_TABLE_OFFSET + k0) * 2 + 1];
-		U64 xi = (pow5Hi - (pow5Hi >> p + 2)) >> (64 - p - beta - 1);
-		U64 zi = (pow5Hi + (pow5Hi >> p + 1)) >> (64 - p - beta - 1);
+		U64 xi = (pow5Hi - (pow5Hi >> (p + 2))) >> (64 - p - beta - 1);
+		U64 zi = (pow5Hi + (pow5Hi >> (p + 1))) >> (64 - p - beta - 1);
 		// Step 3: compute xiTilde and ziTilde 
 		// I think this computation is wrong
 		U64 isInteger = exponent >= 0 && exponent <= 3;
@@ -431,7 +431,7 @@ void serialize_f64(char* dstBuffer, U32* dstBufferSize, F64 startValue) {
 			base10Exponent = -k0 + 1;
 		} else {
 			// Step 5: compute yru
-			U64 yru = (pow5Hi >> 62 - p - beta) + 1 >> 1;
+			U64 yru = ((pow5Hi >> (62 - p - beta)) + 1) >> 1;
 			// Step 6: detect tie, then choose between yru and yrd = yru - 1
 			// Tie condition check is
 			// -p - 2 - floor((p + 4) * log_5(2) - log_5(3)) <= e <= -p - 2 - floor((p + 2) * log_5(2))
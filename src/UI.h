@@ -292,7 +292,8 @@ void clear_context_menu() {
 	context_menu(BoxHandle{}, BoxHandle{}, V2F32{});
 }
 
-void init_ui() {
+// Just enough to build boxes, for when there's no window to draw them to (offline rendering still builds a node graph, and nodes live in the UI)
+void init_ui_boxes() {
 	sizeStack.reserve(16);
 	sizeStack.push_back(V2F32{ 16.0F, 16.0F });
 	textColorStack.reserve(16);
@@ -315,7 +316,10 @@ void init_ui() {
 	workingBox = root = alloc_box();
 	root.unsafeBox->flags |= BOX_FLAG_DONT_LAYOUT_TO_FIT_CHILDREN | BOX_FLAG_INVISIBLE;
 	root.unsafeBox->zOffset = 1000.0F;
+}
 
+void init_ui() {
+	init_ui_boxes();
 	for (U32 i = 0; i < VK::FRAMES_IN_FLIGHT; i++) {
 		clipBoxBuffers[i].create(MAX_CLIP_BOXES * sizeof(Rng2F32), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK::hostMemoryTypeIndex);
 	}
@@ -1,4 +1,5 @@
 #pragma once
+#include "AudioFormat.h"
 #define INITGUID
 #include <Audioclient.h>
 #include <Audiopolicy.h>
@@ -15,30 +16,7 @@
 
 namespace WASAPIInterface {
 
-#define AUDIO_FORMATS \
-	X(AUDIO_FORMAT_8BIT_INTEGER_44_1_KHZ, 8, false, 44100)\
-	X(AUDIO_FORMAT_8BIT_INTEGER_48_KHZ, 8, false, 48000)\
-	X(AUDIO_FORMAT_8BIT_INTEGER_96_KHZ, 8, false, 96000)\
-	X(AUDIO_FORMAT_16BIT_INTEGER_44_1_KHZ, 16, false, 44100)\
-	X(AUDIO_FORMAT_16BIT_INTEGER_48_KHZ, 16, false, 48000)\
-	X(AUDIO_FORMAT_16BIT_INTEGER_96_KHZ, 16, false, 96000)\
-	X(AUDIO_FORMAT_24BIT_INTEGER_44_1_KHZ, 24, false, 44100)\
-	X(AUDIO_FORMAT_24BIT_INTEGER_48_KHZ, 24, false, 48000)\
-	X(AUDIO_FORMAT_24BIT_INTEGER_96_KHZ, 24, false, 96000)\
-	X(AUDIO_FORMAT_32BIT_INTEGER_44_1_KHZ, 32, false, 44100)\
-	X(AUDIO_FORMAT_32BIT_INTEGER_48_KHZ, 32, false, 48000)\
-	X(AUDIO_FORMAT_32BIT_INTEGER_96_KHZ, 32, false, 96000)\
-	X(AUDIO_FORMAT_32BIT_IEEE_FLOAT_44_1_KHZ, 32, true, 44100)\
-	X(AUDIO_FORMAT_32BIT_IEEE_FLOAT_48_KHZ, 32, true, 48000)\
-	X(AUDIO_FORMAT_32BIT_IEEE_FLOAT_96_KHZ, 32, true, 96000)\
-
-
-enum AudioFormat {
-#define X(name, bitDepth, isFloat, frequencyHz) name,
-	AUDIO_FORMATS
-#undef X
-	AUDIO_FORMAT_Count
-};
+using namespace AudioDevice;
 
 HMODULE combaseDLL;
 HMODULE oleDLL;
@@ -55,7 +33,6 @@ IMMDeviceEnumerator* deviceEnumerator;
 IMMDevice* device;
 IAudioClient* audioClient;
 IAudioRenderClient* audioRenderClient;
-AudioFormat outputAudioFormat;
 WAVEFORMATEXTENSIBLE outputWaveFormat;
 U32 bufferFrames;
 REFERENCE_TIME requestedBufferDuration;
@@ -63,7 +40,7 @@ F32* audioBuffer;
 
 HANDLE wakeupTimer;
 
-B32 (*audioBufferFillCallback)(F32* buffer, U32 numSamples, U32 numChannels, F32 timeAmount);
+FillCallback audioBufferFillCallback;
 
 void wasapi_failure(HRESULT failureResult) {
 	print("WASAPI function failed!\n");
@@ -102,51 +79,6 @@ void load_audio_functions() {
 	load_symbol_checked(&pAvSetMmThreadCharacteristicsA, avrtDLL, "AvSetMmThreadCharacteristicsA");
 }
 
-#define X(name, bitDepth, isFloat, frequencyHz) bitDepth,
-const U32 AUDIO_FORMAT_BIT_DEPTH[]{
-	AUDIO_FORMATS
-	0
-};
-#undef X
-#define X(name, bitDepth, isFloat, frequencyHz) isFloat,
-const B32 AUDIO_FORMAT_IS_FLOAT[]{
-	AUDIO_FORMATS
-	false
-};
-#undef X
-#define X(name, bitDepth, isFloat, frequencyHz) frequencyHz,
-const U32 AUDIO_FORMAT_SAMPLE_RATE_HZ[]{
-	AUDIO_FORMATS
-	0
-};
-#undef X
-#define X(name, bitDepth, isFloat, frequencyHz) #name,
-const char* AUDIO_FORMAT_NAMES[]{
-	AUDIO_FORMATS
-	"AUDIO_FORMAT_COUNT"
-};
-#undef X
-
-#undef AUDIO_FORMATS
-
-AudioFormat audioFormatAttemptOrder[]{
-	AUDIO_FORMAT_32BIT_IEEE_FLOAT_44_1_KHZ,
-	AUDIO_FORMAT_32BIT_IEEE_FLOAT_48_KHZ,
-	AUDIO_FORMAT_32BIT_IEEE_FLOAT_96_KHZ,
-	AUDIO_FORMAT_32BIT_INTEGER_44_1_KHZ,
-	AUDIO_FORMAT_32BIT_INTEGER_48_KHZ,
-	AUDIO_FORMAT_32BIT_INTEGER_96_KHZ,
-	AUDIO_FORMAT_24BIT_INTEGER_44_1_KHZ,
-	AUDIO_FORMAT_24BIT_INTEGER_48_KHZ,
-	AUDIO_FORMAT_24BIT_INTEGER_96_KHZ,
-	AUDIO_FORMAT_16BIT_INTEGER_44_1_KHZ,
-	AUDIO_FORMAT_16BIT_INTEGER_48_KHZ,
-	AUDIO_FORMAT_16BIT_INTEGER_96_KHZ,
-	AUDIO_FORMAT_8BIT_INTEGER_44_1_KHZ,
-	AUDIO_FORMAT_8BIT_INTEGER_48_KHZ,
-	AUDIO_FORMAT_8BIT_INTEGER_96_KHZ
-};
-
 void audio_format_to_waveformatextensible(WAVEFORMATEXTENSIBLE* waveFormat, AudioFormat format, U32 channelCount, U32 channelMask) {
 	zero_memory(waveFormat, sizeof(WAVEFORMATEXTENSIBLE));
 	waveFormat->Format.wFormatTag = WAVE_FORMAT_EXTENSIBLE;
@@ -163,35 +95,7 @@ void audio_format_to_waveformatextensible(WAVEFORMATEXTENSIBLE* waveFormat, Audi
 	waveFormat->SubFormat = AUDIO_FORMAT_IS_FLOAT[format] ? KSDATAFORMAT_SUBTYPE_IEEE_FLOAT : KSDATAFORMAT_SUBTYPE_PCM;
 }
 
-void encode_audio_to_final_buffer(void* outputBuffer, F32* inputBuffer, U32 numFrames, U32 numChannels, AudioFormat format) {
-	U32 bitDepth = AUDIO_FORMAT_BIT_DEPTH[format];
-	if (AUDIO_FORMAT_IS_FLOAT[format]) {
-		F32* floatOutput = reinterpret_cast<F32*>(outputBuffer);
-		for (U32 i = 0; i < numFrames * numChannels; i++) {
-			floatOutput[i] = clamp(inputBuffer[i], -1.0F, 1.0F);
-		}
-	} else {
-		F32 amplitude = F32((1 << bitDepth - 1) - 1);
-		if (bitDepth <= 8) {
-			U8* integerOutput = reinterpret_cast<U8*>(outputBuffer);
-			for (U32 i = 0; i < numFrames * numChannels; i++) {
-				integerOutput[i] = U8(U32(clamp(inputBuffer[i], -1.0F, 1.0F) * amplitude) << (8 - bitDepth));
-			}
-		} else if (bitDepth <= 16) {
-			U16* integerOutput = reinterpret_cast<U16*>(outputBuffer);
-			for (U32 i = 0; i < numFrames * numChannels; i++) {
-				integerOutput[i] = U16(U32(clamp(inputBuffer[i], -1.0F, 1.0F) * amplitude) << (16 - bitDepth));
-			}
-		} else {
-			U32* integerOutput = reinterpret_cast<U32*>(outputBuffer);
-			for (U32 i = 0; i < numFrames * numChannels; i++) {
-				integerOutput[i] = U32(clamp(inputBuffer[i], -1.0F, 1.0F) * amplitude) << (32 - bitDepth);
-			}
-		}
-	}
-}
-
-void init_wasapi(B32 (*bufferFillCallback)(F32* buffer, U32 numSamples, U32 numChannels, F32 timeAmount)) {
+void init_wasapi(FillCallback bufferFillCallback) {
 	audioBufferFillCallback = bufferFillCallback;
 	load_audio_functions();
 
@@ -233,6 +137,7 @@ void init_wasapi(B32 (*bufferFillCallback)(F32* buffer, U32 numSamples, U32 numC
 	println("Failed to find suitable format for audio engine, exiting");
 	ExitProcess(EXIT_FAILURE);
 foundSuitableFormat:;
+	outputChannelCount = outputWaveFormat.Format.nChannels;
 	print("Using audio format ");
 	println(AUDIO_FORMAT_NAMES[outputAudioFormat]);
 
@@ -298,15 +203,21 @@ void do_audio() {
 	if (framesToFill == 0) {
 		return;
 	}
+	// Nothing left queued means the device played out everything we gave it and had to fill in on its own
+	if (paddingFrames == 0 && stats.framesRendered != 0) {
+		stats.xrunCount++;
+	}
 	if (audioRenderClient->GetBuffer(framesToFill, &finalBuffer) != S_OK) {
 		return;
 	}
 
 	// Put data in buffer
-	B32 hasAudio = audioBufferFillCallback(audioBuffer, framesToFill, outputWaveFormat.Format.nChannels, F32(framesToFill) / F32(AUDIO_FORMAT_SAMPLE_RATE_HZ[outputAudioFormat]));
-	encode_audio_to_final_buffer(finalBuffer, audioBuffer, framesToFill, outputWaveFormat.Format.nChannels, outputAudioFormat);
+	B32 hasAudio = audioBufferFillCallback(audioBuffer, framesToFill, outputWaveFormat.Format.nChannels);
+	encode_audio_to_final_buffer(finalBuffer, audioBuffer, framesToFill, outputWaveFormat.Format.nChannels, outputAudioFormat, outputSettings);
 
 	audioRenderClient->ReleaseBuffer(framesToFill, hasAudio ? 0 : AUDCLNT_BUFFERFLAGS_SILENT);
+	stats.callbackCount++;
+	stats.framesRendered += framesToFill;
 }
 
 }